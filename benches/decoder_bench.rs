@@ -0,0 +1,237 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of the parsing, decoding and YUV to RGB conversion of the files of tests/data.
+//
+//   cargo bench --bench decoder_bench [-- <filter>]
+//
+// Each measurement is printed on stdout as one line of JSON. Only the benchmarks whose
+// "<benchmark>/<file>" name contains <filter> are run.
+
+use crabby_avif::decoder::*;
+use crabby_avif::image::Image;
+use crabby_avif::reformat::rgb::AlphaMultiplyMode;
+use crabby_avif::reformat::rgb::Format;
+use crabby_avif::reformat::*;
+use crabby_avif::*;
+
+use std::time::Duration;
+use std::time::Instant;
+
+const FILES: [&str; 8] = [
+    "sofa_grid1x5_420.avif",
+    "color_grid_alpha_nogrid.avif",
+    "color_grid_alpha_grid_gainmap_nogrid.avif",
+    "colors-animated-8bpc.avif",
+    "colors-animated-12bpc-keyframes-0-2-3.avif",
+    "paris_icc_exif_xmp.avif",
+    "seine_sdr_gainmap_srgb.avif",
+    "seine_hdr_gainmap_srgb.avif",
+];
+
+// Each benchmark runs for at least MIN_DURATION and MIN_ITERATIONS iterations.
+const MIN_DURATION: Duration = Duration::from_millis(500);
+const MIN_ITERATIONS: u32 = 3;
+
+struct Measurement {
+    iterations: u32,
+    total: Duration,
+    min: Duration,
+    max: Duration,
+}
+
+// Calls |run| until enough iterations were measured. |run| returns the duration of the part of
+// the iteration that is measured, so that it can exclude its setup.
+fn measure(mut run: impl FnMut() -> AvifResult<Duration>) -> AvifResult<Measurement> {
+    let mut measurement = Measurement {
+        iterations: 0,
+        total: Duration::ZERO,
+        min: Duration::MAX,
+        max: Duration::ZERO,
+    };
+    let start = Instant::now();
+    while measurement.iterations < MIN_ITERATIONS || start.elapsed() < MIN_DURATION {
+        let duration = run()?;
+        measurement.iterations += 1;
+        measurement.total += duration;
+        measurement.min = measurement.min.min(duration);
+        measurement.max = measurement.max.max(duration);
+    }
+    Ok(measurement)
+}
+
+struct Bench {
+    filter: Option<String>,
+}
+
+impl Bench {
+    fn enabled(&self, benchmark: &str, file: &str) -> bool {
+        self.filter.as_ref().map_or(true, |filter| {
+            format!("{benchmark}/{file}").contains(filter.as_str())
+        })
+    }
+
+    // Prints the result of a benchmark. Paths that are not implemented for this file (or in this
+    // build) are reported as skipped.
+    fn report(&self, benchmark: &str, file: &str, variant: &str, result: AvifResult<Measurement>) {
+        let prefix = format!(
+            "{{\"benchmark\":\"{benchmark}\",\"file\":\"{file}\",\"variant\":\"{variant}\""
+        );
+        match result {
+            Ok(m) => println!(
+                "{prefix},\"iterations\":{},\"mean_ns\":{},\"min_ns\":{},\"max_ns\":{}}}",
+                m.iterations,
+                m.total.as_nanos() / m.iterations as u128,
+                m.min.as_nanos(),
+                m.max.as_nanos()
+            ),
+            Err(AvifError::NotImplemented) => {
+                println!("{prefix},\"skipped\":\"not implemented\"}}")
+            }
+            Err(err) => {
+                let err = format!("{err:?}")
+                    .replace('\\', "\\\\")
+                    .replace('"', "\\\"");
+                println!("{prefix},\"error\":\"{err}\"}}")
+            }
+        }
+    }
+}
+
+fn create_decoder(data: &[u8], enable_decoding_gainmap: bool) -> AvifResult<Decoder> {
+    let mut decoder = Decoder::default();
+    decoder.settings.enable_decoding_gainmap = enable_decoding_gainmap;
+    decoder.settings.enable_parsing_gainmap_metadata = enable_decoding_gainmap;
+    decoder.set_io_vec(data.to_vec());
+    decoder.parse()?;
+    Ok(decoder)
+}
+
+fn decode_all_frames(decoder: &mut Decoder) -> AvifResult<()> {
+    for _ in 0..decoder.image_count() {
+        decoder.next_image()?;
+    }
+    Ok(())
+}
+
+fn create_rgb(image: &Image, depth: u8) -> AvifResult<rgb::Image> {
+    let mut rgb = rgb::Image::create_from_yuv(image);
+    rgb.format = Format::Rgba;
+    rgb.depth = depth;
+    rgb.allocate()?;
+    Ok(rgb)
+}
+
+fn bench_conversions(bench: &Bench, file: &str, image: &Image) {
+    let depths: &[u8] = if image.depth == 8 { &[8] } else { &[8, 16] };
+    for &depth in depths {
+        let variant = format!("rgba{depth}");
+        type Conversion = fn(&Image, &mut rgb::Image) -> AvifResult<()>;
+        let conversions: [(&str, Conversion); 4] = [
+            ("convert_from_yuv", |image, rgb| rgb.convert_from_yuv(image)),
+            ("libyuv::yuv_to_rgb", |image, rgb| {
+                libyuv::yuv_to_rgb(image, rgb).map(|_| ())
+            }),
+            ("rgb_impl::yuv_to_rgb_fast", |image, rgb| {
+                rgb_impl::yuv_to_rgb_fast(image, rgb)
+            }),
+            ("rgb_impl::yuv_to_rgb_any", |image, rgb| {
+                rgb_impl::yuv_to_rgb_any(image, rgb, AlphaMultiplyMode::NoOp, 0)
+            }),
+        ];
+        for (benchmark, conversion) in conversions {
+            if !bench.enabled(benchmark, file) {
+                continue;
+            }
+            let result = create_rgb(image, depth).and_then(|mut rgb| {
+                measure(|| {
+                    let start = Instant::now();
+                    conversion(image, &mut rgb)?;
+                    Ok(start.elapsed())
+                })
+            });
+            bench.report(benchmark, file, &variant, result);
+        }
+    }
+}
+
+fn bench_gainmap(bench: &Bench, file: &str, data: &[u8]) -> AvifResult<()> {
+    let benchmark = "convert_from_yuv_with_gain_map";
+    if !bench.enabled(benchmark, file) {
+        return Ok(());
+    }
+    let mut decoder = create_decoder(data, true)?;
+    if !decoder.gainmap_present() {
+        return Ok(());
+    }
+    decoder.next_image()?;
+    let image = decoder.image().ok_or(AvifError::NoContent)?;
+    let gainmap = decoder.gainmap();
+    let headroom = gainmap.metadata.alternate_hdr_headroom;
+    let headroom = headroom.0 as f32 / headroom.1 as f32;
+    for depth in [8, 16] {
+        let result = create_rgb(image, depth).and_then(|mut rgb| {
+            measure(|| {
+                let start = Instant::now();
+                rgb.convert_from_yuv_with_gain_map(
+                    image,
+                    gainmap,
+                    headroom,
+                    TransferCharacteristics::Srgb,
+                )?;
+                Ok(start.elapsed())
+            })
+        });
+        bench.report(benchmark, file, &format!("rgba{depth}"), result);
+    }
+    Ok(())
+}
+
+fn bench_file(bench: &Bench, file: &str) -> AvifResult<()> {
+    let path = format!("{}/tests/data/{file}", env!("CARGO_MANIFEST_DIR"));
+    let data = std::fs::read(path).or(Err(AvifError::IoError))?;
+    if bench.enabled("parse", file) {
+        let result = measure(|| {
+            let start = Instant::now();
+            create_decoder(&data, false)?;
+            Ok(start.elapsed())
+        });
+        bench.report("parse", file, "", result);
+    }
+    if bench.enabled("next_image", file) {
+        let result = measure(|| {
+            let mut decoder = create_decoder(&data, false)?;
+            let start = Instant::now();
+            decode_all_frames(&mut decoder)?;
+            Ok(start.elapsed())
+        });
+        bench.report("next_image", file, "all_frames", result);
+    }
+    let mut decoder = create_decoder(&data, false)?;
+    decoder.next_image()?;
+    bench_conversions(bench, file, decoder.image().ok_or(AvifError::NoContent)?);
+    bench_gainmap(bench, file, &data)
+}
+
+fn main() {
+    // cargo bench passes --bench to the binary.
+    let filter = std::env::args().skip(1).find(|arg| !arg.starts_with("--"));
+    let bench = Bench { filter };
+    for file in FILES {
+        if let Err(err) = bench_file(&bench, file) {
+            // The remaining benchmarks of the file depend on the step that failed.
+            bench.report("setup", file, "", Err(err));
+        }
+    }
+}
@@ -0,0 +1,184 @@
+// Copyright 2024 Google LLC
+// SPDX-License-Identifier: BSD-2-Clause
+
+// Benchmarks of the parsing, decoding and YUV to RGB conversion of the C API
+// on the files of the test data folder. Each measurement is printed on stdout
+// as one line of JSON.
+//
+//   avifbenchmark <test data folder> [<filter>]
+//
+// Only the benchmarks whose "<benchmark>/<file>" name contains <filter> are
+// run.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "avif/avif.h"
+#include "avif/libavif_compat.h"
+
+using namespace crabbyavif;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr const char* kFiles[] = {
+    "sofa_grid1x5_420.avif",
+    "color_grid_alpha_nogrid.avif",
+    "color_grid_alpha_grid_gainmap_nogrid.avif",
+    "colors-animated-8bpc.avif",
+    "colors-animated-12bpc-keyframes-0-2-3.avif",
+    "paris_icc_exif_xmp.avif",
+    "seine_sdr_gainmap_srgb.avif",
+    "seine_hdr_gainmap_srgb.avif",
+};
+
+// Each benchmark runs for at least kMinDuration and kMinIterations iterations.
+constexpr std::chrono::milliseconds kMinDuration(500);
+constexpr int kMinIterations = 3;
+
+std::string filter;
+
+bool Enabled(const std::string& benchmark, const std::string& file) {
+  return (benchmark + "/" + file).find(filter) != std::string::npos;
+}
+
+// Calls run until enough iterations were measured and prints the result. run
+// returns the duration of the part of the iteration that is measured, so that
+// it can exclude its setup.
+void Measure(const std::string& benchmark, const std::string& file,
+             const std::string& variant,
+             const std::function<avifResult(Clock::duration*)>& run) {
+  int iterations = 0;
+  Clock::duration total(0);
+  Clock::duration min = Clock::duration::max();
+  Clock::duration max(0);
+  const Clock::time_point start = Clock::now();
+  avifResult result = AVIF_RESULT_OK;
+  while (iterations < kMinIterations || Clock::now() - start < kMinDuration) {
+    Clock::duration duration;
+    result = run(&duration);
+    if (result != AVIF_RESULT_OK) break;
+    ++iterations;
+    total += duration;
+    min = std::min(min, duration);
+    max = std::max(max, duration);
+  }
+  printf("{\"benchmark\":\"%s\",\"file\":\"%s\",\"variant\":\"%s\"",
+         benchmark.c_str(), file.c_str(), variant.c_str());
+  if (result != AVIF_RESULT_OK) {
+    printf(",\"error\":\"%s\"}\n", avifResultToString(result));
+    return;
+  }
+  using std::chrono::nanoseconds;
+  printf(
+      ",\"iterations\":%d,\"mean_ns\":%lld,\"min_ns\":%lld,\"max_ns\":%lld}\n",
+      iterations,
+      static_cast<long long>(
+          std::chrono::duration_cast<nanoseconds>(total).count() / iterations),
+      static_cast<long long>(
+          std::chrono::duration_cast<nanoseconds>(min).count()),
+      static_cast<long long>(
+          std::chrono::duration_cast<nanoseconds>(max).count()));
+}
+
+struct DecoderDeleter {
+  void operator()(avifDecoder* decoder) const { avifDecoderDestroy(decoder); }
+};
+using DecoderPtr = std::unique_ptr<avifDecoder, DecoderDeleter>;
+
+avifResult CreateDecoder(const std::vector<uint8_t>& data, DecoderPtr* out) {
+  DecoderPtr decoder(avifDecoderCreate());
+  if (decoder == nullptr) return AVIF_RESULT_OUT_OF_MEMORY;
+  avifResult result =
+      avifDecoderSetIOMemory(decoder.get(), data.data(), data.size());
+  if (result != AVIF_RESULT_OK) return result;
+  result = avifDecoderParse(decoder.get());
+  if (result != AVIF_RESULT_OK) return result;
+  *out = std::move(decoder);
+  return AVIF_RESULT_OK;
+}
+
+void BenchFile(const std::string& data_path, const std::string& file) {
+  std::ifstream stream(data_path + file, std::ios::binary);
+  const std::vector<uint8_t> data((std::istreambuf_iterator<char>(stream)),
+                                  std::istreambuf_iterator<char>());
+  if (Enabled("parse", file)) {
+    Measure("parse", file, "", [&](Clock::duration* duration) {
+      const Clock::time_point start = Clock::now();
+      DecoderPtr decoder;
+      const avifResult result = CreateDecoder(data, &decoder);
+      *duration = Clock::now() - start;
+      return result;
+    });
+  }
+  if (Enabled("next_image", file)) {
+    Measure("next_image", file, "all_frames", [&](Clock::duration* duration) {
+      DecoderPtr decoder;
+      avifResult result = CreateDecoder(data, &decoder);
+      if (result != AVIF_RESULT_OK) return result;
+      const Clock::time_point start = Clock::now();
+      for (int i = 0; i < decoder->imageCount; ++i) {
+        result = avifDecoderNextImage(decoder.get());
+        if (result != AVIF_RESULT_OK) return result;
+      }
+      *duration = Clock::now() - start;
+      return AVIF_RESULT_OK;
+    });
+  }
+  if (!Enabled("avifImageYUVToRGB", file)) return;
+  DecoderPtr decoder;
+  avifResult result = CreateDecoder(data, &decoder);
+  if (result == AVIF_RESULT_OK) result = avifDecoderNextImage(decoder.get());
+  if (result != AVIF_RESULT_OK) {
+    printf("{\"benchmark\":\"setup\",\"file\":\"%s\",\"error\":\"%s\"}\n",
+           file.c_str(), avifResultToString(result));
+    return;
+  }
+  std::vector<uint32_t> depths = {8};
+  if (decoder->image->depth > 8) depths.push_back(16);
+  for (uint32_t depth : depths) {
+    avifRGBImage rgb;
+    avifRGBImageSetDefaults(&rgb, decoder->image);
+    rgb.format = AVIF_RGB_FORMAT_RGBA;
+    rgb.depth = depth;
+    rgb.rowBytes = rgb.width * 4 * (depth > 8 ? 2 : 1);
+    std::vector<uint8_t> pixels(static_cast<size_t>(rgb.rowBytes) *
+                                rgb.height);
+    rgb.pixels = pixels.data();
+    Measure("avifImageYUVToRGB", file, "rgba" + std::to_string(depth),
+            [&](Clock::duration* duration) {
+              const Clock::time_point start = Clock::now();
+              const avifResult result =
+                  avifImageYUVToRGB(decoder->image, &rgb);
+              *duration = Clock::now() - start;
+              return result;
+            });
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr,
+            "Usage: %s <test data folder> [<filter>]\n"
+            "The test data folder path must end with a path separator.\n",
+            argv[0]);
+    return 1;
+  }
+  if (argc == 3) filter = argv[2];
+  for (const char* file : kFiles) {
+    BenchFile(argv[1], file);
+  }
+  return 0;
+}
@@ -1,6 +1,10 @@
 // Copyright 2023 Google LLC
 // SPDX-License-Identifier: BSD-2-Clause
 
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
 #include "avif/avif.h"
 #include "aviftest_helpers.h"
 #include "gtest/gtest.h"
@@ -30,6 +34,358 @@ TEST(AvifDecodeTest, ColorGridAlphaNoGrid) {
   EXPECT_GT(decoder->image->alphaRowBytes, 0u);
 }
 
+TEST(AvifDecodeTest, SharedThreadBudget) {
+  if (!testutil::Av1DecoderAvailable()) {
+    GTEST_SKIP() << "AV1 Codec unavailable, skip test.";
+  }
+  const char* file_name = "sofa_grid1x5_420.avif";
+  avifThreadBudget* budget = avifThreadBudgetCreate(4);
+  ASSERT_NE(budget, nullptr);
+  DecoderPtr decoder1(avifDecoderCreate());
+  DecoderPtr decoder2(avifDecoderCreate());
+  ASSERT_NE(decoder1, nullptr);
+  ASSERT_NE(decoder2, nullptr);
+  for (avifDecoder* decoder : {decoder1.get(), decoder2.get()}) {
+    decoder->maxThreads = 4;
+    ASSERT_EQ(avifDecoderSetThreadBudget(decoder, budget), AVIF_RESULT_OK);
+    ASSERT_EQ(avifDecoderSetIOFile(
+                  decoder, (std::string(data_path) + file_name).c_str()),
+              AVIF_RESULT_OK);
+    ASSERT_EQ(avifDecoderParse(decoder), AVIF_RESULT_OK);
+  }
+  // The decoders hold their own reference to the budget.
+  avifThreadBudgetDestroy(budget);
+  // The first decoder takes the whole budget and gives it back once its only
+  // image is decoded, so the second one gets it too.
+  EXPECT_EQ(avifDecoderNextImage(decoder1.get()), AVIF_RESULT_OK);
+  EXPECT_EQ(avifDecoderNextImage(decoder2.get()), AVIF_RESULT_OK);
+  EXPECT_EQ(decoder1->image->width, 1024u);
+  EXPECT_EQ(decoder2->image->width, 1024u);
+}
+
+TEST(AvifDecodeTest, ByteRanges) {
+  const char* file_name = "colors-animated-8bpc-alpha-exif-xmp.avif";
+  DecoderPtr decoder(avifDecoderCreate());
+  ASSERT_NE(decoder, nullptr);
+  ASSERT_EQ(avifDecoderSetIOFile(decoder.get(),
+                                 (std::string(data_path) + file_name).c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  size_t range_count = 0;
+  ASSERT_EQ(avifDecoderByteRanges(decoder.get(), 0, 4, AVIF_PLANES_ALL,
+                                  AVIF_FALSE, AVIF_TRUE, nullptr, &range_count),
+            AVIF_RESULT_OK);
+  ASSERT_GT(range_count, 0u);
+  std::vector<avifExtent> ranges(range_count);
+  size_t too_small_count = range_count - 1;
+  EXPECT_EQ(
+      avifDecoderByteRanges(decoder.get(), 0, 4, AVIF_PLANES_ALL, AVIF_FALSE,
+                            AVIF_TRUE, ranges.data(), &too_small_count),
+      AVIF_RESULT_INVALID_ARGUMENT);
+  EXPECT_EQ(too_small_count, range_count);
+  ASSERT_EQ(avifDecoderByteRanges(decoder.get(), 0, 4, AVIF_PLANES_ALL,
+                                  AVIF_FALSE, AVIF_TRUE, ranges.data(),
+                                  &range_count),
+            AVIF_RESULT_OK);
+  size_t total_size = 0;
+  for (size_t i = 0; i < range_count; ++i) {
+    EXPECT_GT(ranges[i].size, 0u);
+    if (i > 0) {
+      EXPECT_LT(ranges[i - 1].offset + ranges[i - 1].size, ranges[i].offset);
+    }
+    total_size += ranges[i].size;
+  }
+  EXPECT_GE(total_size, decoder->ioStats.colorOBUSize +
+                            decoder->ioStats.alphaOBUSize +
+                            decoder->image->exif.size +
+                            decoder->image->xmp.size);
+}
+
+void RecordStage(void* user_data, avifDecodeStage stage, uint64_t /*startNs*/,
+                 uint64_t /*durationNs*/) {
+  static_cast<std::vector<avifDecodeStage>*>(user_data)->push_back(stage);
+}
+
+TEST(AvifDecodeTest, DecodeStats) {
+  const char* file_name = "sofa_grid1x5_420.avif";
+  DecoderPtr decoder(avifDecoderCreate());
+  ASSERT_NE(decoder, nullptr);
+  decoder->enableDecodeStats = AVIF_TRUE;
+  std::vector<avifDecodeStage> stages;
+  ASSERT_EQ(avifDecoderSetTraceCallback(decoder.get(), RecordStage, &stages),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderSetIOFile(decoder.get(),
+                                 (std::string(data_path) + file_name).c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  EXPECT_GT(decoder->decodeStats.readCount, 0u);
+  EXPECT_GT(decoder->decodeStats.readSize, 0u);
+  EXPECT_EQ(stages, std::vector<avifDecodeStage>{AVIF_DECODE_STAGE_PARSE});
+  if (!testutil::Av1DecoderAvailable()) {
+    GTEST_SKIP() << "AV1 Codec unavailable, skip test.";
+  }
+  ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+  EXPECT_EQ(decoder->decodeStats.tileCount, 5u);
+  EXPECT_NE(decoder->decodeStats.codecChoice, AVIF_CODEC_CHOICE_AUTO);
+  EXPECT_GT(decoder->decodeStats.stageDurationsNs[AVIF_DECODE_STAGE_CODEC], 0u);
+}
+
+struct FrameAllocatorState {
+  std::atomic<int> allocations{0};
+  std::atomic<int> buffers_in_use{0};
+};
+
+avifResult AllocateFrame(void* user_data, const avifFrameBufferRequest* request,
+                         avifFrameBuffer* buffer) {
+  const int plane_count = request->yuvFormat == AVIF_PIXEL_FORMAT_YUV400 ? 1 : 3;
+  const uint32_t shift_x = request->yuvFormat == AVIF_PIXEL_FORMAT_YUV444 ? 0 : 1;
+  const uint32_t shift_y = request->yuvFormat == AVIF_PIXEL_FORMAT_YUV420 ? 1 : 0;
+  const size_t bytes_per_sample = request->depth > 8 ? 2 : 1;
+  const auto align = [&](size_t size) {
+    return (size + request->alignment - 1) / request->alignment *
+           request->alignment;
+  };
+  size_t offsets[3] = {};
+  size_t size = 0;
+  for (int plane = 0; plane < plane_count; ++plane) {
+    const uint32_t width = plane == 0 ? request->width
+                                      : (request->width + shift_x) >> shift_x;
+    const uint32_t height = plane == 0
+                                ? request->height
+                                : (request->height + shift_y) >> shift_y;
+    buffer->rowBytes[plane] =
+        static_cast<uint32_t>(align(width * bytes_per_sample));
+    offsets[plane] = size;
+    size += align(buffer->rowBytes[plane] * height + request->padding);
+  }
+  uint8_t* data =
+      static_cast<uint8_t*>(std::aligned_alloc(request->alignment, size));
+  if (data == nullptr) return AVIF_RESULT_OUT_OF_MEMORY;
+  for (int plane = 0; plane < plane_count; ++plane) {
+    buffer->planes[plane] = data + offsets[plane];
+  }
+  buffer->userData = data;
+  auto* state = static_cast<FrameAllocatorState*>(user_data);
+  ++state->allocations;
+  ++state->buffers_in_use;
+  return AVIF_RESULT_OK;
+}
+
+void ReleaseFrame(void* user_data, const avifFrameBuffer* buffer) {
+  std::free(buffer->userData);
+  --static_cast<FrameAllocatorState*>(user_data)->buffers_in_use;
+}
+
+TEST(AvifDecodeTest, FrameAllocator) {
+  const char* file_name = "paris_icc_exif_xmp.avif";
+  DecoderPtr decoder(avifDecoderCreate());
+  ASSERT_NE(decoder, nullptr);
+  FrameAllocatorState state;
+  // Both functions must be given.
+  EXPECT_EQ(avifDecoderSetFrameAllocator(decoder.get(), AllocateFrame, nullptr,
+                                         &state),
+            AVIF_RESULT_INVALID_ARGUMENT);
+  ASSERT_EQ(avifDecoderSetFrameAllocator(decoder.get(), AllocateFrame,
+                                         ReleaseFrame, &state),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderSetIOFile(decoder.get(),
+                                 (std::string(data_path) + file_name).c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  if (!testutil::Av1DecoderAvailable()) {
+    GTEST_SKIP() << "AV1 Codec unavailable, skip test.";
+  }
+  ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+  EXPECT_GT(state.allocations, 0);
+  EXPECT_GT(state.buffers_in_use, 0);
+  decoder.reset();
+  EXPECT_EQ(state.buffers_in_use, 0);
+}
+
+TEST(AvifDecodeTest, DecodeRegion) {
+  const char* file_name = "sofa_grid1x5_420.avif";
+  DecoderPtr decoder(avifDecoderCreate());
+  ASSERT_NE(decoder, nullptr);
+  ASSERT_EQ(avifDecoderSetIOFile(decoder.get(),
+                                 (std::string(data_path) + file_name).c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  const uint32_t width = decoder->image->width;
+  // Odd offsets do not match the 4:2:0 subsampling.
+  avifCropRect region = {1, 0, 2, 2};
+  EXPECT_EQ(avifDecoderDecodeRegion(decoder.get(), &region),
+            AVIF_RESULT_INVALID_ARGUMENT);
+  region = {0, 0, width + 2, 2};
+  EXPECT_EQ(avifDecoderDecodeRegion(decoder.get(), &region),
+            AVIF_RESULT_INVALID_ARGUMENT);
+  if (!testutil::Av1DecoderAvailable()) {
+    GTEST_SKIP() << "AV1 Codec unavailable, skip test.";
+  }
+  region = {2, 4, 16, 8};
+  ASSERT_EQ(avifDecoderDecodeRegion(decoder.get(), &region), AVIF_RESULT_OK);
+  EXPECT_EQ(decoder->image->width, 16u);
+  EXPECT_EQ(decoder->image->height, 8u);
+  ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+  EXPECT_EQ(decoder->image->width, width);
+}
+
+TEST(AvifDecodeTest, ReuseCodecs) {
+  DecoderPtr decoder(avifDecoderCreate());
+  ASSERT_NE(decoder, nullptr);
+  decoder->maxIdleCodecs = 2;
+  ASSERT_EQ(avifDecoderSetIOFile(
+                decoder.get(),
+                (std::string(data_path) + "sofa_grid1x5_420.avif").c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  if (!testutil::Av1DecoderAvailable()) {
+    GTEST_SKIP() << "AV1 Codec unavailable, skip test.";
+  }
+  ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+  // The codec instance of the first file is flushed and reused for the second
+  // one.
+  const std::string file_name =
+      std::string(data_path) + "paris_icc_exif_xmp.avif";
+  ASSERT_EQ(avifDecoderSetIOFile(decoder.get(), file_name.c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+  DecoderPtr expected_decoder(avifDecoderCreate());
+  ASSERT_NE(expected_decoder, nullptr);
+  ASSERT_EQ(avifDecoderSetIOFile(expected_decoder.get(), file_name.c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(expected_decoder.get()), AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderNextImage(expected_decoder.get()), AVIF_RESULT_OK);
+  const avifImage* image = decoder->image;
+  const avifImage* expected_image = expected_decoder->image;
+  ASSERT_EQ(image->width, expected_image->width);
+  ASSERT_EQ(image->height, expected_image->height);
+  for (uint32_t y = 0; y < image->height; ++y) {
+    ASSERT_EQ(memcmp(image->yuvPlanes[0] + y * image->yuvRowBytes[0],
+                     expected_image->yuvPlanes[0] +
+                         y * expected_image->yuvRowBytes[0],
+                     image->width),
+              0);
+  }
+}
+
+TEST(AvifDecodeTest, GridTileThreadsAndBufferPool) {
+  if (!testutil::Av1DecoderAvailable()) {
+    GTEST_SKIP() << "AV1 Codec unavailable, skip test.";
+  }
+  const std::string file_name =
+      std::string(data_path) + "sofa_grid1x5_420.avif";
+  DecoderPtr expected_decoder(avifDecoderCreate());
+  ASSERT_NE(expected_decoder, nullptr);
+  ASSERT_EQ(avifDecoderSetIOFile(expected_decoder.get(), file_name.c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(expected_decoder.get()), AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderNextImage(expected_decoder.get()), AVIF_RESULT_OK);
+  const avifImage* expected_image = expected_decoder->image;
+
+  DecoderPtr decoder(avifDecoderCreate());
+  ASSERT_NE(decoder, nullptr);
+  EXPECT_EQ(decoder->gridTileThreads, 1u);
+  EXPECT_EQ(decoder->bufferPoolSizeLimit, 0u);
+  decoder->gridTileThreads = 4;
+  decoder->bufferPoolSizeLimit = 64 << 20;
+  // The second parse reuses the buffers of the first decoding.
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_EQ(avifDecoderSetIOFile(decoder.get(), file_name.c_str()),
+              AVIF_RESULT_OK);
+    ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+    ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+    const avifImage* image = decoder->image;
+    ASSERT_EQ(image->width, expected_image->width);
+    ASSERT_EQ(image->height, expected_image->height);
+    for (uint32_t y = 0; y < image->height; ++y) {
+      ASSERT_EQ(memcmp(image->yuvPlanes[0] + y * image->yuvRowBytes[0],
+                       expected_image->yuvPlanes[0] +
+                           y * expected_image->yuvRowBytes[0],
+                       image->width),
+                0);
+    }
+  }
+}
+
+TEST(AvifDecodeTest, Probe) {
+  const char* file_name = "colors-animated-8bpc-alpha-exif-xmp.avif";
+  auto data =
+      testutil::read_file((std::string(data_path) + file_name).c_str());
+  avifProbeInfo info;
+  uint64_t more_bytes_needed = 0;
+  size_t prefix_size = 0;
+  avifResult result;
+  while (true) {
+    avifROData prefix = {data.data(), prefix_size};
+    result = avifProbe(&prefix, &info, &more_bytes_needed);
+    if (result != AVIF_RESULT_WAITING_ON_IO) break;
+    ASSERT_GT(more_bytes_needed, 0u);
+    prefix_size += more_bytes_needed;
+    ASSERT_LE(prefix_size, data.size());
+  }
+  ASSERT_EQ(result, AVIF_RESULT_OK);
+  EXPECT_LT(prefix_size, data.size());
+  DecoderPtr decoder(avifDecoderCreate());
+  ASSERT_NE(decoder, nullptr);
+  ASSERT_EQ(avifDecoderSetIOMemory(decoder.get(), data.data(), data.size()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  EXPECT_EQ(info.source, AVIF_DECODER_SOURCE_TRACKS);
+  EXPECT_EQ(info.width, decoder->image->width);
+  EXPECT_EQ(info.height, decoder->image->height);
+  EXPECT_EQ(info.depth, decoder->image->depth);
+  EXPECT_EQ(info.yuvFormat, decoder->image->yuvFormat);
+  EXPECT_EQ(info.alphaPresent, decoder->alphaPresent);
+  EXPECT_EQ(info.imageSequenceTrackPresent, AVIF_TRUE);
+  EXPECT_EQ(info.timescale, decoder->timescale);
+  EXPECT_EQ(info.durationInTimescales, decoder->durationInTimescales);
+}
+
+TEST(AvifDecodeTest, FrameHandle) {
+  if (!testutil::Av1DecoderAvailable()) {
+    GTEST_SKIP() << "AV1 Codec unavailable, skip test.";
+  }
+  const std::string file_name =
+      std::string(data_path) + "colors-animated-8bpc.avif";
+  DecoderPtr decoder(avifDecoderCreate());
+  ASSERT_NE(decoder, nullptr);
+  ASSERT_EQ(avifDecoderSetIOFile(decoder.get(), file_name.c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  std::vector<avifFrameHandle*> handles;
+  for (int i = 0; i < decoder->imageCount; ++i) {
+    ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+    avifFrameHandle* handle = nullptr;
+    ASSERT_EQ(avifDecoderCreateFrameHandle(decoder.get(), &handle),
+              AVIF_RESULT_OK);
+    handles.push_back(handle);
+  }
+  // The handles outlive the decoder.
+  decoder.reset();
+  DecoderPtr expected_decoder(avifDecoderCreate());
+  ASSERT_NE(expected_decoder, nullptr);
+  ASSERT_EQ(avifDecoderSetIOFile(expected_decoder.get(), file_name.c_str()),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(expected_decoder.get()), AVIF_RESULT_OK);
+  for (avifFrameHandle* handle : handles) {
+    ASSERT_EQ(avifDecoderNextImage(expected_decoder.get()), AVIF_RESULT_OK);
+    avifImage image;
+    avifFrameHandleGetImage(handle, &image);
+    const avifImage* expected_image = expected_decoder->image;
+    ASSERT_EQ(image.width, expected_image->width);
+    ASSERT_EQ(image.height, expected_image->height);
+    for (uint32_t y = 0; y < image.height; ++y) {
+      ASSERT_EQ(memcmp(image.yuvPlanes[0] + y * image.yuvRowBytes[0],
+                       expected_image->yuvPlanes[0] +
+                           y * expected_image->yuvRowBytes[0],
+                       image.width),
+                0);
+    }
+    avifFrameHandleDestroy(handle);
+  }
+}
+
 }  // namespace
 }  // namespace avif
 
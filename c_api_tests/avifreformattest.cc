@@ -75,6 +75,51 @@ TEST(AvifDecodeTest, YUVToRGBConversion) {
   }
 }
 
+TEST(AvifDecodeTest, YUVToRGBRowsConversion) {
+  for (int p = 0; p < 3; ++p) {
+    ImagePtr image(
+        avifImageCreate(kWidth, kHeight, 8, AVIF_PIXEL_FORMAT_YUV444));
+    ASSERT_NE(image, nullptr);
+    ASSERT_EQ(avifImageAllocatePlanes(image.get(), AVIF_PLANES_YUV),
+              AVIF_RESULT_OK);
+    memcpy(image->yuvPlanes[0], kYuv[p], kPlaneSize);
+    memcpy(image->yuvPlanes[1], kYuv[p] + kUOffset, kPlaneSize);
+    memcpy(image->yuvPlanes[2], kYuv[p] + kVOffset, kPlaneSize);
+    avifRGBImage rgb;
+    avifRGBImageSetDefaults(&rgb, image.get());
+    std::vector<uint8_t> expected_pixels(kWidth * kHeight * 4);
+    rgb.pixels = expected_pixels.data();
+    rgb.rowBytes = kWidth * 4;
+    ASSERT_EQ(avifImageYUVToRGB(image.get(), &rgb), AVIF_RESULT_OK);
+    std::vector<uint8_t> rgb_pixels(kWidth * kHeight * 4);
+    rgb.pixels = rgb_pixels.data();
+    EXPECT_EQ(avifRGBImageConvertibleRowCount(&rgb, image.get(), 3), 3);
+    ASSERT_EQ(avifImageYUVToRGBRows(image.get(), &rgb, 0, 1), AVIF_RESULT_OK);
+    ASSERT_EQ(avifImageYUVToRGBRows(image.get(), &rgb, 1, 3), AVIF_RESULT_OK);
+    ASSERT_EQ(avifImageYUVToRGBRows(image.get(), &rgb, 3, kHeight),
+              AVIF_RESULT_OK);
+    EXPECT_EQ(avifImageYUVToRGBRows(image.get(), &rgb, 3, kHeight + 1),
+              AVIF_RESULT_INVALID_ARGUMENT);
+    EXPECT_EQ(rgb_pixels, expected_pixels);
+    avifImageFreePlanes(image.get(), AVIF_PLANES_YUV);
+  }
+}
+
+TEST(AvifDecodeTest, ConvertibleRowCount) {
+  ImagePtr image(avifImageCreate(kWidth, kHeight, 8, AVIF_PIXEL_FORMAT_YUV420));
+  ASSERT_NE(image, nullptr);
+  avifRGBImage rgb;
+  avifRGBImageSetDefaults(&rgb, image.get());
+  // The bilinear upsampling needs the chroma row below each pair of rows.
+  rgb.chromaUpsampling = AVIF_CHROMA_UPSAMPLING_BILINEAR;
+  EXPECT_EQ(avifRGBImageConvertibleRowCount(&rgb, image.get(), 0), 0);
+  EXPECT_EQ(avifRGBImageConvertibleRowCount(&rgb, image.get(), 3), 1);
+  EXPECT_EQ(avifRGBImageConvertibleRowCount(&rgb, image.get(), kHeight),
+            kHeight);
+  rgb.chromaUpsampling = AVIF_CHROMA_UPSAMPLING_NEAREST;
+  EXPECT_EQ(avifRGBImageConvertibleRowCount(&rgb, image.get(), 3), 2);
+}
+
 }  // namespace
 }  // namespace avif
 
@@ -40,6 +40,8 @@ constexpr static const uint32_t AVIF_STRICT_ALPHA_ISPE_REQUIRED = (1 << 2);
 
 constexpr static const uint32_t AVIF_STRICT_ENABLED = ((AVIF_STRICT_PIXI_REQUIRED | AVIF_STRICT_CLAP_VALID) | AVIF_STRICT_ALPHA_ISPE_REQUIRED);
 
+constexpr static const size_t CRABBY_AVIF_DECODE_STAGE_COUNT = 5;
+
 constexpr static const size_t CRABBY_AVIF_DIAGNOSTICS_ERROR_BUFFER_SIZE = 256;
 
 constexpr static const size_t CRABBY_AVIF_PLANE_COUNT_YUV = 3;
@@ -152,10 +154,19 @@ enum avifProgressiveState {
     AVIF_PROGRESSIVE_STATE_ACTIVE = 2,
 };
 
+enum avifDecodeStage {
+    AVIF_DECODE_STAGE_IO = 0,
+    AVIF_DECODE_STAGE_PARSE = 1,
+    AVIF_DECODE_STAGE_CODEC = 2,
+    AVIF_DECODE_STAGE_SCALE = 3,
+    AVIF_DECODE_STAGE_TILE_COPY = 4,
+};
+
 enum avifDecoderSource {
     AVIF_DECODER_SOURCE_AUTO = 0,
     AVIF_DECODER_SOURCE_PRIMARY_ITEM = 1,
     AVIF_DECODER_SOURCE_TRACKS = 2,
+    AVIF_DECODER_SOURCE_THUMBNAIL = 3,
 };
 
 enum avifTransferCharacteristics : uint16_t {
@@ -255,6 +266,10 @@ enum avifResult {
 
 struct Decoder;
 
+struct avifFrameHandle;
+
+struct avifThreadBudget;
+
 using avifBool = int;
 
 using avifStrictFlags = uint32_t;
@@ -370,6 +385,44 @@ struct avifImageTiming {
 struct avifIOStats {
     size_t colorOBUSize;
     size_t alphaOBUSize;
+    size_t readAheadHits;
+    size_t readAheadMisses;
+};
+
+struct avifFrameCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint32_t frameCount;
+    size_t size;
+};
+
+struct avifDecodeStats {
+    uint64_t stageDurationsNs[CRABBY_AVIF_DECODE_STAGE_COUNT];
+    uint64_t readCount;
+    uint64_t readSize;
+    uint64_t tileCount;
+    uint64_t copiedSize;
+    avifCodecChoice codecChoice;
+};
+
+struct avifMemoryStats {
+    size_t currentSize;
+    size_t peakSize;
+};
+
+struct avifFrameBufferRequest {
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    avifPixelFormat yuvFormat;
+    size_t alignment;
+    size_t padding;
+};
+
+struct avifFrameBuffer {
+    uint8_t *planes[CRABBY_AVIF_PLANE_COUNT_YUV];
+    uint32_t rowBytes[CRABBY_AVIF_PLANE_COUNT_YUV];
+    void *userData;
 };
 
 struct avifDiagnostics {
@@ -409,6 +462,21 @@ struct avifDecoder {
     avifBool enableDecodingGainMap;
     avifBool enableParsingGainMapMetadata;
     avifBool imageSequenceTrackPresent;
+    avifBool tiledOutput;
+    avifBool metadataOnly;
+    size_t ioMinReadSize;
+    uint32_t framePipelineDepth;
+    size_t frameCacheSizeLimit;
+    uint32_t frameCacheFrameLimit;
+    avifFrameCacheStats frameCacheStats;
+    avifBool enableDecodeStats;
+    avifDecodeStats decodeStats;
+    uint32_t maxIdleCodecs;
+    size_t memoryLimit;
+    avifMemoryStats memoryStats;
+    avifBool hardwareBufferOutput;
+    uint32_t gridTileThreads;
+    size_t bufferPoolSizeLimit;
     Box<Decoder> rust_decoder;
     avifImage image_object;
     avifGainMap gainmap_object;
@@ -443,6 +511,26 @@ struct avifIO {
     void *data;
 };
 
+struct avifTileView {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    avifImage image;
+};
+
+struct avifProbeInfo {
+    avifDecoderSource source;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    avifPixelFormat yuvFormat;
+    avifBool alphaPresent;
+    avifBool imageSequenceTrackPresent;
+    uint64_t timescale;
+    uint64_t durationInTimescales;
+};
+
 struct Extent {
     uint64_t offset;
     size_t size;
@@ -484,6 +572,17 @@ struct avifPixelFormatInfo {
 
 using avifCodecFlags = uint32_t;
 
+using avifDecoderTraceFunc = void(*)(void *userData,
+                                     avifDecodeStage stage,
+                                     uint64_t startNs,
+                                     uint64_t durationNs);
+
+using avifFrameBufferAllocateFunc = avifResult(*)(void *userData,
+                                                  const avifFrameBufferRequest *request,
+                                                  avifFrameBuffer *buffer);
+
+using avifFrameBufferReleaseFunc = void(*)(void *userData, const avifFrameBuffer *buffer);
+
 
 
 
@@ -506,12 +605,38 @@ avifResult crabby_avifDecoderSetIOMemory(avifDecoder *decoder, const uint8_t *da
 
 avifResult crabby_avifDecoderSetSource(avifDecoder *decoder, avifDecoderSource source);
 
+avifThreadBudget *crabby_avifThreadBudgetCreate(uint32_t maxThreads);
+
+void crabby_avifThreadBudgetDestroy(avifThreadBudget *budget);
+
+avifResult crabby_avifDecoderSetThreadBudget(avifDecoder *decoder, const avifThreadBudget *budget);
+
+avifResult crabby_avifDecoderSetTraceCallback(avifDecoder *decoder,
+                                              avifDecoderTraceFunc callback,
+                                              void *userData);
+
+avifResult crabby_avifDecoderSetFrameAllocator(avifDecoder *decoder,
+                                               avifFrameBufferAllocateFunc allocate,
+                                               avifFrameBufferReleaseFunc release,
+                                               void *userData);
+
 avifResult crabby_avifDecoderParse(avifDecoder *decoder);
 
 avifResult crabby_avifDecoderNextImage(avifDecoder *decoder);
 
 avifResult crabby_avifDecoderNthImage(avifDecoder *decoder, uint32_t frameIndex);
 
+avifResult crabby_avifDecoderNextImageWithPlanes(avifDecoder *decoder,
+                                                 avifPlanesFlags planes,
+                                                 avifBool includeGainMap);
+
+avifResult crabby_avifDecoderNthImageWithPlanes(avifDecoder *decoder,
+                                                uint32_t frameIndex,
+                                                avifPlanesFlags planes,
+                                                avifBool includeGainMap);
+
+avifResult crabby_avifDecoderDecodeRegion(avifDecoder *decoder, const avifCropRect *region);
+
 avifResult crabby_avifDecoderNthImageTiming(const avifDecoder *decoder,
                                             uint32_t frameIndex,
                                             avifImageTiming *outTiming);
@@ -533,12 +658,40 @@ uint32_t crabby_avifDecoderNearestKeyframe(const avifDecoder *decoder, uint32_t
 
 uint32_t crabby_avifDecoderDecodedRowCount(const avifDecoder *decoder);
 
+avifResult crabby_avifDecoderCreateFrameHandle(const avifDecoder *decoder,
+                                               avifFrameHandle **outHandle);
+
+void crabby_avifFrameHandleGetImage(const avifFrameHandle *handle, avifImage *outImage);
+
+void crabby_avifFrameHandleDestroy(avifFrameHandle *handle);
+
+uint32_t crabby_avifDecoderTileCount(const avifDecoder *decoder);
+
+avifResult crabby_avifDecoderTileView(const avifDecoder *decoder,
+                                      uint32_t tileIndex,
+                                      avifTileView *outTileView);
+
+void *crabby_avifDecoderHardwareBuffer(const avifDecoder *decoder);
+
 avifResult crabby_avifDecoderNthImageMaxExtent(const avifDecoder *decoder,
                                                uint32_t frameIndex,
                                                avifExtent *outExtent);
 
+avifResult crabby_avifDecoderByteRanges(const avifDecoder *decoder,
+                                        uint32_t firstFrameIndex,
+                                        uint32_t lastFrameIndex,
+                                        avifPlanesFlags planes,
+                                        avifBool includeGainMap,
+                                        avifBool includeMetadata,
+                                        avifExtent *outRanges,
+                                        size_t *rangeCount);
+
 avifBool crabby_avifPeekCompatibleFileType(const avifROData *input);
 
+avifResult crabby_avifProbe(const avifROData *input,
+                            avifProbeInfo *outInfo,
+                            uint64_t *outMoreBytesNeeded);
+
 avifImage *crabby_avifImageCreateEmpty();
 
 avifImage *crabby_avifImageCreate(uint32_t width,
@@ -594,6 +747,21 @@ void crabby_avifRGBImageSetDefaults(avifRGBImage *rgb, const avifImage *image);
 
 avifResult crabby_avifImageYUVToRGB(const avifImage *image, avifRGBImage *rgb);
 
+avifResult crabby_avifImageYUVToRGBRows(const avifImage *image,
+                                        avifRGBImage *rgb,
+                                        uint32_t startRow,
+                                        uint32_t endRow);
+
+uint32_t crabby_avifRGBImageConvertibleRowCount(const avifRGBImage *rgb,
+                                                const avifImage *image,
+                                                uint32_t decodedRowCount);
+
+avifResult crabby_avifImageYUVToRGBWithGainMap(const avifImage *image,
+                                               const avifGainMap *gainMap,
+                                               float hdrHeadroom,
+                                               avifTransferCharacteristics outputTransferCharacteristics,
+                                               avifRGBImage *rgb);
+
 const char *crabby_avifResultToString(avifResult _res);
 
 avifBool crabby_avifCropRectConvertCleanApertureBox(avifCropRect *cropRect,
@@ -17,24 +17,37 @@
 // Functions.
 #define avifAlloc crabby_avifAlloc
 #define avifCropRectConvertCleanApertureBox crabby_avifCropRectConvertCleanApertureBox
+#define avifDecoderByteRanges crabby_avifDecoderByteRanges
 #define avifDecoderCreate crabby_avifDecoderCreate
+#define avifDecoderCreateFrameHandle crabby_avifDecoderCreateFrameHandle
 #define avifDecoderDecodedRowCount crabby_avifDecoderDecodedRowCount
+#define avifDecoderDecodeRegion crabby_avifDecoderDecodeRegion
 #define avifDecoderDestroy crabby_avifDecoderDestroy
+#define avifDecoderHardwareBuffer crabby_avifDecoderHardwareBuffer
 #define avifDecoderIsKeyframe crabby_avifDecoderIsKeyframe
 #define avifDecoderNearestKeyframe crabby_avifDecoderNearestKeyframe
 #define avifDecoderNextImage crabby_avifDecoderNextImage
+#define avifDecoderNextImageWithPlanes crabby_avifDecoderNextImageWithPlanes
 #define avifDecoderNthImage crabby_avifDecoderNthImage
 #define avifDecoderNthImageMaxExtent crabby_avifDecoderNthImageMaxExtent
 #define avifDecoderNthImageTiming crabby_avifDecoderNthImageTiming
+#define avifDecoderNthImageWithPlanes crabby_avifDecoderNthImageWithPlanes
 #define avifDecoderParse crabby_avifDecoderParse
 #define avifDecoderRead crabby_avifDecoderRead
 #define avifDecoderReadFile crabby_avifDecoderReadFile
 #define avifDecoderReadMemory crabby_avifDecoderReadMemory
+#define avifDecoderSetFrameAllocator crabby_avifDecoderSetFrameAllocator
 #define avifDecoderSetIO crabby_avifDecoderSetIO
 #define avifDecoderSetIOFile crabby_avifDecoderSetIOFile
 #define avifDecoderSetIOMemory crabby_avifDecoderSetIOMemory
 #define avifDecoderSetSource crabby_avifDecoderSetSource
+#define avifDecoderSetThreadBudget crabby_avifDecoderSetThreadBudget
+#define avifDecoderSetTraceCallback crabby_avifDecoderSetTraceCallback
+#define avifDecoderTileCount crabby_avifDecoderTileCount
+#define avifDecoderTileView crabby_avifDecoderTileView
 #define avifDiagnosticsClearError crabby_avifDiagnosticsClearError
+#define avifFrameHandleDestroy crabby_avifFrameHandleDestroy
+#define avifFrameHandleGetImage crabby_avifFrameHandleGetImage
 #define avifFree crabby_avifFree
 #define avifGetPixelFormatInfo crabby_avifGetPixelFormatInfo
 #define avifIOCreateFileReader crabby_avifIOCreateFileReader
@@ -53,13 +66,20 @@
 #define avifImageSetViewRect crabby_avifImageSetViewRect
 #define avifImageUsesU16 crabby_avifImageUsesU16
 #define avifImageYUVToRGB crabby_avifImageYUVToRGB
+#define avifImageYUVToRGBRows crabby_avifImageYUVToRGBRows
+#define avifImageYUVToRGBWithGainMap crabby_avifImageYUVToRGBWithGainMap
 #define avifPeekCompatibleFileType crabby_avifPeekCompatibleFileType
+#define avifProbe crabby_avifProbe
+#define avifRGBImageConvertibleRowCount crabby_avifRGBImageConvertibleRowCount
 #define avifRGBImageSetDefaults crabby_avifRGBImageSetDefaults
 #define avifRWDataFree crabby_avifRWDataFree
 #define avifRWDataRealloc crabby_avifRWDataRealloc
 #define avifRWDataSet crabby_avifRWDataSet
 #define avifResultToString crabby_avifResultToString
+#define avifThreadBudgetCreate crabby_avifThreadBudgetCreate
+#define avifThreadBudgetDestroy crabby_avifThreadBudgetDestroy
 // Constants.
+#define AVIF_DECODE_STAGE_COUNT CRABBY_AVIF_DECODE_STAGE_COUNT
 #define AVIF_DIAGNOSTICS_ERROR_BUFFER_SIZE CRABBY_AVIF_DIAGNOSTICS_ERROR_BUFFER_SIZE
 #define AVIF_FALSE CRABBY_AVIF_FALSE
 #define AVIF_PLANE_COUNT_YUV CRABBY_AVIF_PLANE_COUNT_YUV
@@ -19,11 +19,136 @@ use super::types::*;
 
 use std::ffi::CStr;
 use std::os::raw::c_char;
+use std::os::raw::c_void;
+use std::sync::Arc;
+use std::time::Instant;
 
+use crate::decoder::frame_allocator::*;
+use crate::decoder::frame_cache::*;
+use crate::decoder::frame_handle::*;
+use crate::decoder::instrumentation::*;
+use crate::decoder::probe::*;
+use crate::decoder::thread_budget::*;
 use crate::decoder::track::*;
 use crate::decoder::*;
 use crate::*;
 
+pub const AVIF_DECODE_STAGE_COUNT: usize = 5;
+
+#[repr(C)]
+#[derive(Clone, Copy, Debug, Default)]
+pub struct avifDecodeStats {
+    // Wall time in nanoseconds spent in each stage, indexed by avifDecodeStage.
+    pub stageDurationsNs: [u64; AVIF_DECODE_STAGE_COUNT],
+    pub readCount: u64,
+    pub readSize: u64,
+    pub tileCount: u64,
+    pub copiedSize: u64,
+    // The codec of the last codec instance that was created. AVIF_CODEC_CHOICE_AUTO if none was.
+    pub codecChoice: avifCodecChoice,
+}
+
+impl From<&DecodeStats> for avifDecodeStats {
+    fn from(stats: &DecodeStats) -> Self {
+        let mut stage_durations_ns = [0u64; AVIF_DECODE_STAGE_COUNT];
+        for (dst, src) in stage_durations_ns.iter_mut().zip(stats.stage_durations) {
+            *dst = u64::try_from(src.as_nanos()).unwrap_or(u64::MAX);
+        }
+        Self {
+            stageDurationsNs: stage_durations_ns,
+            readCount: stats.read_count,
+            readSize: stats.read_size,
+            tileCount: stats.tile_count,
+            copiedSize: stats.copied_size,
+            codecChoice: match stats.codec {
+                Some(CodecChoice::Dav1d) => avifCodecChoice::Dav1d,
+                Some(CodecChoice::Libgav1) => avifCodecChoice::Libgav1,
+                // MediaCodec has no avifCodecChoice.
+                _ => avifCodecChoice::Auto,
+            },
+        }
+    }
+}
+
+pub type avifDecoderTraceFunc =
+    unsafe extern "C" fn(userData: *mut c_void, stage: DecodeStage, startNs: u64, durationNs: u64);
+
+// See FrameBufferRequest for the meaning of the fields.
+#[repr(C)]
+#[derive(Clone, Copy, Debug)]
+pub struct avifFrameBufferRequest {
+    pub width: u32,
+    pub height: u32,
+    pub depth: u32,
+    pub yuvFormat: PixelFormat,
+    pub alignment: usize,
+    pub padding: usize,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Debug)]
+pub struct avifFrameBuffer {
+    pub planes: [*mut u8; AVIF_PLANE_COUNT_YUV],
+    pub rowBytes: [u32; AVIF_PLANE_COUNT_YUV],
+    // Not used by the decoder. Passed back to the avifFrameBufferReleaseFunc.
+    pub userData: *mut c_void,
+}
+
+pub type avifFrameBufferAllocateFunc = unsafe extern "C" fn(
+    userData: *mut c_void,
+    request: *const avifFrameBufferRequest,
+    buffer: *mut avifFrameBuffer,
+) -> avifResult;
+
+pub type avifFrameBufferReleaseFunc =
+    unsafe extern "C" fn(userData: *mut c_void, buffer: *const avifFrameBuffer);
+
+struct CFrameAllocator {
+    allocate: avifFrameBufferAllocateFunc,
+    release: avifFrameBufferReleaseFunc,
+    user_data: *mut c_void,
+}
+
+// The callbacks must be callable from any thread (see crabby_avifDecoderSetFrameAllocator()).
+unsafe impl Send for CFrameAllocator {}
+unsafe impl Sync for CFrameAllocator {}
+
+impl FrameAllocator for CFrameAllocator {
+    fn allocate(&self, request: &FrameBufferRequest) -> AvifResult<FrameBuffer> {
+        let c_request = avifFrameBufferRequest {
+            width: request.width,
+            height: request.height,
+            depth: request.depth as u32,
+            yuvFormat: request.yuv_format,
+            alignment: request.alignment,
+            padding: request.padding,
+        };
+        let mut c_buffer = avifFrameBuffer {
+            planes: [std::ptr::null_mut(); AVIF_PLANE_COUNT_YUV],
+            rowBytes: [0; AVIF_PLANE_COUNT_YUV],
+            userData: std::ptr::null_mut(),
+        };
+        let res = unsafe { (self.allocate)(self.user_data, &c_request, &mut c_buffer) };
+        if res != avifResult::Ok {
+            return Err(res.into());
+        }
+        Ok(FrameBuffer {
+            planes: c_buffer.planes,
+            row_bytes: c_buffer.rowBytes,
+            user_data: c_buffer.userData,
+        })
+    }
+
+    fn release(&self, buffer: FrameBuffer) {
+        let c_buffer = avifFrameBuffer {
+            planes: buffer.planes,
+            rowBytes: buffer.row_bytes,
+            userData: buffer.user_data,
+        };
+        unsafe { (self.release)(self.user_data, &c_buffer) };
+    }
+}
+
 #[repr(C)]
 pub struct avifDecoder {
     pub codecChoice: avifCodecChoice,
@@ -60,6 +185,49 @@ pub struct avifDecoder {
     pub enableParsingGainMapMetadata: avifBool,
     // avifBool ignoreColorAndAlpha;
     pub imageSequenceTrackPresent: avifBool,
+    // Input param. If true, grid tiles are not stitched into image. Use
+    // crabby_avifDecoderTileView() to access them. decoder->image then has the properties of the
+    // grid (dimensions, depth, format) but no planes for the categories that are grids: its
+    // yuvPlanes (or alphaPlane) are NULL.
+    pub tiledOutput: avifBool,
+    // Input param. If true, avifDecoderParse() only parses the headers and properties. The
+    // images cannot be decoded.
+    pub metadataOnly: avifBool,
+    // Input param. If not 0, the IO is read at least this number of bytes at a time and the
+    // reads that fall inside the data of a previous read are served from memory.
+    pub ioMinReadSize: usize,
+    // Input param. Maximum number of samples of an image sequence track that are kept in flight
+    // in the codec. Values larger than 1 let dav1d decode several frames in parallel.
+    pub framePipelineDepth: u32,
+    // Input params. Limits of the cache of decoded frames used by crabby_avifDecoderNthImage() and
+    // crabby_avifDecoderNextImage(). The cache is disabled if both are 0.
+    pub frameCacheSizeLimit: usize,
+    pub frameCacheFrameLimit: u32,
+    // Output param.
+    pub frameCacheStats: FrameCacheStats,
+    // Input param. If true, the stages of the decoding are measured from the next call to
+    // crabby_avifDecoderParse().
+    pub enableDecodeStats: avifBool,
+    // Output param. Measurements made since the last call to crabby_avifDecoderParse().
+    pub decodeStats: avifDecodeStats,
+    // Input param. Maximum number of initialized codec instances kept for reuse by the next call
+    // to crabby_avifDecoderParse() (for example with a new IO) instead of being destroyed.
+    pub maxIdleCodecs: u32,
+    // Input param. Maximum number of bytes of the buffers owned by the decoder. The decoding fails
+    // with AVIF_RESULT_OUT_OF_MEMORY instead of exceeding it. 0 means no limit.
+    pub memoryLimit: usize,
+    // Output param. Updated along with decodeStats.
+    pub memoryStats: MemoryStats,
+    // Input param. If true, MediaCodec renders the color planes of 8-bit images that are not
+    // grids into AHardwareBuffers (see crabby_avifDecoderHardwareBuffer()). decoder->image then
+    // has no yuvPlanes.
+    pub hardwareBufferOutput: avifBool,
+    // Input param. Number of codec instances (and threads) used to decode the tiles of a grid
+    // image in parallel. 1 decodes the tiles one after the other.
+    pub gridTileThreads: u32,
+    // Input param. Maximum number of bytes of the buffers that are kept for reuse by the next call
+    // to crabby_avifDecoderParse() (for example with a new IO). 0 disables the reuse of buffers.
+    pub bufferPoolSizeLimit: usize,
 
     // TODO: maybe wrap these fields in a private data kind of field?
     rust_decoder: Box<Decoder>,
@@ -99,6 +267,21 @@ impl Default for avifDecoder {
             enableDecodingGainMap: AVIF_FALSE,
             enableParsingGainMapMetadata: AVIF_FALSE,
             imageSequenceTrackPresent: AVIF_FALSE,
+            tiledOutput: AVIF_FALSE,
+            metadataOnly: AVIF_FALSE,
+            ioMinReadSize: 0,
+            framePipelineDepth: 1,
+            frameCacheSizeLimit: 0,
+            frameCacheFrameLimit: 0,
+            frameCacheStats: Default::default(),
+            enableDecodeStats: AVIF_FALSE,
+            decodeStats: Default::default(),
+            maxIdleCodecs: 0,
+            memoryLimit: 0,
+            memoryStats: Default::default(),
+            hardwareBufferOutput: AVIF_FALSE,
+            gridTileThreads: 1,
+            bufferPoolSizeLimit: 0,
             rust_decoder: Box::<Decoder>::default(),
             image_object: avifImage::default(),
             gainmap_image_object: avifImage::default(),
@@ -154,6 +337,87 @@ pub unsafe extern "C" fn crabby_avifDecoderSetSource(
     avifResult::Ok
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifThreadBudgetCreate(maxThreads: u32) -> *mut ThreadBudget {
+    Arc::into_raw(ThreadBudget::create(maxThreads)) as *mut _
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifThreadBudgetDestroy(budget: *mut ThreadBudget) {
+    if !budget.is_null() {
+        // The decoders that use the budget hold their own reference to it.
+        let _ = unsafe { Arc::from_raw(budget as *const ThreadBudget) };
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderSetThreadBudget(
+    decoder: *mut avifDecoder,
+    budget: *const ThreadBudget,
+) -> avifResult {
+    let rust_decoder = unsafe { &mut (*decoder).rust_decoder };
+    rust_decoder.settings.thread_budget = if budget.is_null() {
+        None
+    } else {
+        unsafe {
+            Arc::increment_strong_count(budget);
+            Some(Arc::from_raw(budget))
+        }
+    };
+    avifResult::Ok
+}
+
+// Sets a callback that is called with the start time (relative to this call) and the duration of
+// each stage of the decoding once it is done. A null callback removes the current one.
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderSetTraceCallback(
+    decoder: *mut avifDecoder,
+    callback: Option<avifDecoderTraceFunc>,
+    userData: *mut c_void,
+) -> avifResult {
+    let rust_decoder = unsafe { &mut (*decoder).rust_decoder };
+    let trace_callback: Option<TraceCallback> = callback.map(|callback| {
+        let epoch = Instant::now();
+        Box::new(move |span: &TraceSpan| {
+            let start = span.start.saturating_duration_since(epoch);
+            unsafe {
+                callback(
+                    userData,
+                    span.stage,
+                    u64::try_from(start.as_nanos()).unwrap_or(u64::MAX),
+                    u64::try_from(span.duration.as_nanos()).unwrap_or(u64::MAX),
+                );
+            }
+        }) as TraceCallback
+    });
+    rust_decoder.set_trace_callback(trace_callback);
+    avifResult::Ok
+}
+
+// Sets the functions that allocate and release the buffers into which dav1d and libgav1 decode
+// the frames. They may be called concurrently from the threads of the codecs, until the decoder is
+// destroyed or the next call to crabby_avifDecoderParse(). Only the codec instances created by the
+// next call to crabby_avifDecoderParse() use them. Null functions restore the default allocators.
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderSetFrameAllocator(
+    decoder: *mut avifDecoder,
+    allocate: Option<avifFrameBufferAllocateFunc>,
+    release: Option<avifFrameBufferReleaseFunc>,
+    userData: *mut c_void,
+) -> avifResult {
+    let rust_decoder = unsafe { &mut (*decoder).rust_decoder };
+    rust_decoder.settings.frame_allocator = match (allocate, release) {
+        (Some(allocate), Some(release)) => Some(Arc::new(CFrameAllocator {
+            allocate,
+            release,
+            user_data: userData,
+        })),
+        (None, None) => None,
+        _ => return avifResult::InvalidArgument,
+    };
+    avifResult::Ok
+}
+
 impl From<&avifDecoder> for Settings {
     fn from(decoder: &avifDecoder) -> Self {
         let strictness = if decoder.strictFlags == AVIF_STRICT_DISABLED {
@@ -192,6 +456,24 @@ impl From<&avifDecoder> for Settings {
             image_size_limit: decoder.imageSizeLimit,
             image_dimension_limit: decoder.imageDimensionLimit,
             image_count_limit: decoder.imageCountLimit,
+            max_threads: u32::try_from(decoder.maxThreads).unwrap_or(1),
+            grid_tile_threads: decoder.gridTileThreads,
+            tiled_output: decoder.tiledOutput == AVIF_TRUE,
+            metadata_only: decoder.metadataOnly == AVIF_TRUE,
+            buffer_pool_size_limit: decoder.bufferPoolSizeLimit,
+            io_min_read_size: decoder.ioMinReadSize,
+            frame_pipeline_depth: decoder.framePipelineDepth,
+            frame_cache_size_limit: decoder.frameCacheSizeLimit,
+            frame_cache_frame_limit: decoder.frameCacheFrameLimit,
+            enable_decode_stats: decoder.enableDecodeStats == AVIF_TRUE,
+            max_idle_codecs: decoder.maxIdleCodecs,
+            memory_limit: decoder.memoryLimit,
+            hardware_buffer_output: decoder.hardwareBufferOutput == AVIF_TRUE,
+            // The thread budget can only be set with crabby_avifDecoderSetThreadBudget().
+            thread_budget: decoder.rust_decoder.settings.thread_budget.clone(),
+            // The frame allocator can only be set with crabby_avifDecoderSetFrameAllocator().
+            frame_allocator: decoder.rust_decoder.settings.frame_allocator.clone(),
+            ..Default::default()
         }
     }
 }
@@ -218,6 +500,7 @@ fn rust_decoder_to_avifDecoder(src: &Decoder, dst: &mut avifDecoder) {
     dst.durationInTimescales = src.duration_in_timescales();
     dst.duration = src.duration();
     dst.ioStats = src.io_stats();
+    dst.frameCacheStats = src.frame_cache_stats();
 
     if src.gainmap_present() {
         dst.gainMapPresent = AVIF_TRUE;
@@ -237,6 +520,9 @@ pub unsafe extern "C" fn crabby_avifDecoderParse(decoder: *mut avifDecoder) -> a
 
         let res = rust_decoder.parse();
         (*decoder).diag.set_from_result(&res);
+        // Also updated on failure, to help investigate it.
+        (*decoder).decodeStats = (&rust_decoder.decode_stats()).into();
+        (*decoder).memoryStats = rust_decoder.memory_stats();
         if res.is_err() {
             return to_avifResult(&res);
         }
@@ -245,16 +531,17 @@ pub unsafe extern "C" fn crabby_avifDecoderParse(decoder: *mut avifDecoder) -> a
     }
 }
 
-#[no_mangle]
-pub unsafe extern "C" fn crabby_avifDecoderNextImage(decoder: *mut avifDecoder) -> avifResult {
+fn next_image(decoder: *mut avifDecoder, categories: &[Category]) -> avifResult {
     unsafe {
         let rust_decoder = &mut (*decoder).rust_decoder;
         rust_decoder.settings = (&(*decoder)).into();
 
         let previous_decoded_row_count = rust_decoder.decoded_row_count();
 
-        let res = rust_decoder.next_image();
+        let res = rust_decoder.next_image_with_categories(categories);
         (*decoder).diag.set_from_result(&res);
+        (*decoder).decodeStats = (&rust_decoder.decode_stats()).into();
+        (*decoder).memoryStats = rust_decoder.memory_stats();
         let mut early_return = false;
         if res.is_err() {
             early_return = true;
@@ -276,11 +563,7 @@ pub unsafe extern "C" fn crabby_avifDecoderNextImage(decoder: *mut avifDecoder)
     }
 }
 
-#[no_mangle]
-pub unsafe extern "C" fn crabby_avifDecoderNthImage(
-    decoder: *mut avifDecoder,
-    frameIndex: u32,
-) -> avifResult {
+fn nth_image(decoder: *mut avifDecoder, frameIndex: u32, categories: &[Category]) -> avifResult {
     unsafe {
         let rust_decoder = &mut (*decoder).rust_decoder;
         rust_decoder.settings = (&(*decoder)).into();
@@ -288,8 +571,10 @@ pub unsafe extern "C" fn crabby_avifDecoderNthImage(
         let previous_decoded_row_count = rust_decoder.decoded_row_count();
         let image_index = (rust_decoder.image_index() + 1) as u32;
 
-        let res = rust_decoder.nth_image(frameIndex);
+        let res = rust_decoder.nth_image_with_categories(frameIndex, categories);
         (*decoder).diag.set_from_result(&res);
+        (*decoder).decodeStats = (&rust_decoder.decode_stats()).into();
+        (*decoder).memoryStats = rust_decoder.memory_stats();
         let mut early_return = false;
         if res.is_err() {
             early_return = true;
@@ -313,6 +598,83 @@ pub unsafe extern "C" fn crabby_avifDecoderNthImage(
     }
 }
 
+fn categories_from_planes(planes: avifPlanesFlags, includeGainMap: avifBool) -> Vec<Category> {
+    let mut categories: Vec<Category> = Vec::new();
+    if (planes & avifPlanesFlag::AvifPlanesYuv as avifPlanesFlags) != 0 {
+        categories.push(Category::Color);
+    }
+    if (planes & avifPlanesFlag::AvifPlanesA as avifPlanesFlags) != 0 {
+        categories.push(Category::Alpha);
+    }
+    if includeGainMap == AVIF_TRUE {
+        categories.push(Category::Gainmap);
+    }
+    categories
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderNextImage(decoder: *mut avifDecoder) -> avifResult {
+    next_image(decoder, &Category::ALL)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderNthImage(
+    decoder: *mut avifDecoder,
+    frameIndex: u32,
+) -> avifResult {
+    nth_image(decoder, frameIndex, &Category::ALL)
+}
+
+// Same as avifDecoderNextImage() but only the color (AVIF_PLANES_YUV), alpha (AVIF_PLANES_A) and
+// gain map (includeGainMap) samples that are selected are read and decoded. The planes of the
+// other ones are freed. The gain map is decoded if includeGainMap is AVIF_TRUE even if
+// enableDecodingGainMap was AVIF_FALSE when the decoder was parsed.
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderNextImageWithPlanes(
+    decoder: *mut avifDecoder,
+    planes: avifPlanesFlags,
+    includeGainMap: avifBool,
+) -> avifResult {
+    next_image(decoder, &categories_from_planes(planes, includeGainMap))
+}
+
+// Same as avifDecoderNthImage() with the selection of avifDecoderNextImageWithPlanes().
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderNthImageWithPlanes(
+    decoder: *mut avifDecoder,
+    frameIndex: u32,
+    planes: avifPlanesFlags,
+    includeGainMap: avifBool,
+) -> avifResult {
+    nth_image(
+        decoder,
+        frameIndex,
+        &categories_from_planes(planes, includeGainMap),
+    )
+}
+
+// Decodes only the tiles that intersect |region| into decoder->image, which gets the dimensions
+// of |region| (see Decoder::decode_region()).
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderDecodeRegion(
+    decoder: *mut avifDecoder,
+    region: *const avifCropRect,
+) -> avifResult {
+    unsafe {
+        let rust_decoder = &mut (*decoder).rust_decoder;
+        rust_decoder.settings = (&(*decoder)).into();
+
+        let res = rust_decoder.decode_region(*region);
+        (*decoder).diag.set_from_result(&res);
+        (*decoder).decodeStats = (&rust_decoder.decode_stats()).into();
+        (*decoder).memoryStats = rust_decoder.memory_stats();
+        if res.is_ok() {
+            rust_decoder_to_avifDecoder(rust_decoder, &mut (*decoder));
+        }
+        to_avifResult(&res)
+    }
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn crabby_avifDecoderNthImageTiming(
     decoder: *const avifDecoder,
@@ -414,6 +776,126 @@ pub unsafe extern "C" fn crabby_avifDecoderDecodedRowCount(decoder: *const avifD
     rust_decoder.decoded_row_count()
 }
 
+// Creates a handle on decoder->image that remains valid after the next calls to
+// avifDecoderNextImage() and avifDecoderNthImage() and after the decoder is destroyed (see
+// Decoder::frame_handle()). It must be destroyed with avifFrameHandleDestroy().
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderCreateFrameHandle(
+    decoder: *const avifDecoder,
+    outHandle: *mut *mut FrameHandle,
+) -> avifResult {
+    let rust_decoder = unsafe { &(*decoder).rust_decoder };
+    let res = rust_decoder.frame_handle();
+    if res.is_err() {
+        return to_avifResult(&res);
+    }
+    unsafe {
+        *outHandle = Box::into_raw(Box::new(res.unwrap()));
+    }
+    avifResult::Ok
+}
+
+// Fills outImage with a view of the image of handle. The view is valid until the handle is
+// destroyed.
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifFrameHandleGetImage(
+    handle: *const FrameHandle,
+    outImage: *mut avifImage,
+) {
+    unsafe {
+        *outImage = (*handle).image().into();
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifFrameHandleDestroy(handle: *mut FrameHandle) {
+    if !handle.is_null() {
+        let _ = unsafe { Box::from_raw(handle) };
+    }
+}
+
+#[repr(C)]
+pub struct avifTileView {
+    pub x: u32,
+    pub y: u32,
+    pub width: u32,
+    pub height: u32,
+    // The planes point into the buffers of the codec. The alpha plane is only set if the alpha
+    // is a grid with the same layout as the color (same number of rows and columns and same tile
+    // dimensions). Otherwise it is NULL and the alpha plane is in decoder->image if the alpha is
+    // not a grid.
+    pub image: avifImage,
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderTileCount(decoder: *const avifDecoder) -> u32 {
+    let rust_decoder = unsafe { &(*decoder).rust_decoder };
+    match rust_decoder.tile_views(Category::Color) {
+        Ok(tile_views) => tile_views.len() as u32,
+        Err(_) => 0,
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderTileView(
+    decoder: *const avifDecoder,
+    tileIndex: u32,
+    outTileView: *mut avifTileView,
+) -> avifResult {
+    let rust_decoder = unsafe { &(*decoder).rust_decoder };
+    let res = rust_decoder.tile_views(Category::Color);
+    if res.is_err() {
+        return to_avifResult(&res);
+    }
+    let color_tile_views = res.unwrap();
+    let tile_index = tileIndex as usize;
+    if tile_index >= color_tile_views.len() {
+        return avifResult::InvalidArgument;
+    }
+    let color_tile_view = &color_tile_views[tile_index];
+    let mut image: avifImage = color_tile_view.image.into();
+    if let Ok(alpha_tile_views) = rust_decoder.tile_views(Category::Alpha) {
+        if let Some(alpha_tile_view) = alpha_tile_views.get(tile_index) {
+            // The grids may have different numbers of rows, columns or tile dimensions. The
+            // alpha tile only covers the same area as the color tile if these match.
+            if alpha_tile_view.x == color_tile_view.x
+                && alpha_tile_view.y == color_tile_view.y
+                && alpha_tile_view.width == color_tile_view.width
+                && alpha_tile_view.height == color_tile_view.height
+                && alpha_tile_view.image.width == color_tile_view.image.width
+                && alpha_tile_view.image.height == color_tile_view.image.height
+            {
+                let alpha_image: avifImage = alpha_tile_view.image.into();
+                image.alphaPlane = alpha_image.alphaPlane;
+                image.alphaRowBytes = alpha_image.alphaRowBytes;
+            }
+        }
+    }
+    unsafe {
+        *outTileView = avifTileView {
+            x: color_tile_view.x,
+            y: color_tile_view.y,
+            width: color_tile_view.width,
+            height: color_tile_view.height,
+            image,
+        };
+    }
+    avifResult::Ok
+}
+
+// Returns the AHardwareBuffer that holds the color planes of decoder->image if
+// hardwareBufferOutput is set and the image was rendered into it. Returns NULL otherwise. The
+// buffer belongs to the decoder and stays valid until the next decoded image.
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderHardwareBuffer(
+    decoder: *const avifDecoder,
+) -> *mut c_void {
+    let rust_decoder = unsafe { &(*decoder).rust_decoder };
+    rust_decoder
+        .hardware_buffer()
+        .unwrap_or(std::ptr::null_mut())
+}
+
 #[allow(non_camel_case_types)]
 pub type avifExtent = Extent;
 
@@ -434,8 +916,111 @@ pub unsafe extern "C" fn crabby_avifDecoderNthImageMaxExtent(
     avifResult::Ok
 }
 
+// Writes the byte ranges needed to decode the frames from the nearest keyframe of
+// firstFrameIndex to lastFrameIndex into outRanges. planes selects the color (AVIF_PLANES_YUV)
+// and alpha (AVIF_PLANES_A) ranges. On input, *rangeCount is the number of elements of
+// outRanges. On output, it is the number of ranges. If outRanges is NULL or too small, only
+// *rangeCount is set (the latter returns AVIF_RESULT_INVALID_ARGUMENT).
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifDecoderByteRanges(
+    decoder: *const avifDecoder,
+    firstFrameIndex: u32,
+    lastFrameIndex: u32,
+    planes: avifPlanesFlags,
+    includeGainMap: avifBool,
+    includeMetadata: avifBool,
+    outRanges: *mut avifExtent,
+    rangeCount: *mut usize,
+) -> avifResult {
+    let rust_decoder = unsafe { &(*decoder).rust_decoder };
+    let categories = categories_from_planes(planes, includeGainMap);
+    let res = rust_decoder.byte_ranges(
+        firstFrameIndex,
+        lastFrameIndex,
+        &categories,
+        includeMetadata == AVIF_TRUE,
+    );
+    if res.is_err() {
+        return to_avifResult(&res);
+    }
+    let ranges = res.unwrap();
+    let capacity = unsafe { *rangeCount };
+    unsafe {
+        *rangeCount = ranges.len();
+    }
+    if outRanges.is_null() {
+        return avifResult::Ok;
+    }
+    if capacity < ranges.len() {
+        return avifResult::InvalidArgument;
+    }
+    unsafe {
+        std::ptr::copy_nonoverlapping(ranges.as_ptr(), outRanges, ranges.len());
+    }
+    avifResult::Ok
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn crabby_avifPeekCompatibleFileType(input: *const avifROData) -> avifBool {
     let data = unsafe { std::slice::from_raw_parts((*input).data, (*input).size) };
     to_avifBool(Decoder::peek_compatible_file_type(data))
 }
+
+// See ProbeInfo for the meaning of the fields.
+#[repr(C)]
+#[derive(Clone, Copy, Debug, Default)]
+pub struct avifProbeInfo {
+    pub source: Source,
+    pub width: u32,
+    pub height: u32,
+    pub depth: u32,
+    pub yuvFormat: PixelFormat,
+    pub alphaPresent: avifBool,
+    pub imageSequenceTrackPresent: avifBool,
+    pub timescale: u64,
+    pub durationInTimescales: u64,
+}
+
+impl From<&ProbeInfo> for avifProbeInfo {
+    fn from(info: &ProbeInfo) -> Self {
+        Self {
+            source: info.source,
+            width: info.width,
+            height: info.height,
+            depth: info.depth as u32,
+            yuvFormat: info.yuv_format,
+            alphaPresent: to_avifBool(info.alpha_present),
+            imageSequenceTrackPresent: to_avifBool(info.image_sequence_track_present),
+            timescale: info.timescale,
+            durationInTimescales: info.duration_in_timescales,
+        }
+    }
+}
+
+// Fills outInfo from input, which may be only the first bytes of a file. If input is too short,
+// returns AVIF_RESULT_WAITING_ON_IO and sets *outMoreBytesNeeded to the number of bytes to
+// append to input before calling this function again.
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifProbe(
+    input: *const avifROData,
+    outInfo: *mut avifProbeInfo,
+    outMoreBytesNeeded: *mut u64,
+) -> avifResult {
+    let data = unsafe { std::slice::from_raw_parts((*input).data, (*input).size) };
+    let res = Decoder::probe(data);
+    match res {
+        Ok(ProbeResult::Info(info)) => {
+            unsafe {
+                *outInfo = (&info).into();
+            }
+            avifResult::Ok
+        }
+        Ok(ProbeResult::NeedMoreBytes(size)) => {
+            unsafe {
+                *outMoreBytesNeeded = size;
+            }
+            avifResult::WaitingOnIo
+        }
+        Err(_) => to_avifResult(&res),
+    }
+}
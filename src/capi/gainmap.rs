@@ -18,6 +18,7 @@ use super::types::*;
 
 use crate::decoder::gainmap::*;
 use crate::image::YuvRange;
+use crate::internal_utils::*;
 use crate::parser::mp4box::*;
 use crate::*;
 
@@ -73,6 +74,32 @@ impl From<&GainMapMetadata> for avifGainMapMetadata {
     }
 }
 
+impl From<&avifGainMapMetadata> for GainMapMetadata {
+    fn from(m: &avifGainMapMetadata) -> Self {
+        let fractions = |n: &[i32; 3], d: &[u32; 3]| {
+            [
+                Fraction(n[0], d[0]),
+                Fraction(n[1], d[1]),
+                Fraction(n[2], d[2]),
+            ]
+        };
+        GainMapMetadata {
+            min: fractions(&m.gainMapMinN, &m.gainMapMinD),
+            max: fractions(&m.gainMapMaxN, &m.gainMapMaxD),
+            gamma: [
+                UFraction(m.gainMapGammaN[0], m.gainMapGammaD[0]),
+                UFraction(m.gainMapGammaN[1], m.gainMapGammaD[1]),
+                UFraction(m.gainMapGammaN[2], m.gainMapGammaD[2]),
+            ],
+            base_offset: fractions(&m.baseOffsetN, &m.baseOffsetD),
+            alternate_offset: fractions(&m.alternateOffsetN, &m.alternateOffsetD),
+            base_hdr_headroom: UFraction(m.baseHdrHeadroomN, m.baseHdrHeadroomD),
+            alternate_hdr_headroom: UFraction(m.alternateHdrHeadroomN, m.alternateHdrHeadroomD),
+            use_base_color_space: m.useBaseColorSpace == AVIF_TRUE,
+        }
+    }
+}
+
 #[repr(C)]
 #[derive(Debug)]
 pub struct avifGainMap {
@@ -19,7 +19,7 @@ use std::os::raw::c_char;
 use std::os::raw::c_void;
 
 use crate::decoder::GenericIO;
-use crate::internal_utils::io::DecoderFileIO;
+use crate::internal_utils::io::create_file_io;
 use crate::internal_utils::io::DecoderRawIO;
 use crate::*;
 
@@ -214,7 +214,14 @@ unsafe extern "C" fn cioRead(
             return avifResult::IoError;
         }
         let cio = (*io).data as *mut avifCIOWrapper;
+        let persistent = (*cio).io.persistent();
         match (*cio).io.read(offset, size) {
+            Ok(data) if persistent => {
+                // The data remains valid for the lifetime of the IO, no need to copy it.
+                (*out).data = data.as_ptr();
+                (*out).size = data.len();
+                return avifResult::Ok;
+            }
             Ok(data) => {
                 (*cio).buf.clear();
                 if (*cio).buf.try_reserve_exact(data.len()).is_err() {
@@ -264,12 +271,12 @@ pub unsafe extern "C" fn crabby_avifIOCreateMemoryReader(
 #[no_mangle]
 pub unsafe extern "C" fn crabby_avifIOCreateFileReader(filename: *const c_char) -> *mut avifIO {
     let filename = unsafe { String::from(CStr::from_ptr(filename).to_str().unwrap_or("")) };
-    let file_io = match DecoderFileIO::create(&filename) {
+    let file_io = match create_file_io(&filename) {
         Ok(x) => x,
         Err(_) => return std::ptr::null_mut(),
     };
     let cio = Box::new(avifCIOWrapper {
-        io: Box::new(file_io),
+        io: file_io,
         buf: Vec::new(),
     });
     let io = Box::new(avifIO {
@@ -277,7 +284,7 @@ pub unsafe extern "C" fn crabby_avifIOCreateFileReader(filename: *const c_char)
         read: cioRead,
         write: cioWrite,
         sizeHint: cio.io.size_hint(),
-        persistent: 0,
+        persistent: to_avifBool(cio.io.persistent()),
         data: Box::into_raw(cio) as *mut c_void,
     });
     Box::into_raw(io)
@@ -12,12 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+use super::gainmap::*;
 use super::image::*;
 use super::types::*;
 
+use crate::decoder::gainmap::GainMap;
 use crate::image;
 use crate::internal_utils::pixels::*;
 use crate::reformat::rgb;
+use crate::TransferCharacteristics;
 
 /// cbindgen:rename-all=CamelCase
 #[repr(C)]
@@ -144,3 +147,72 @@ pub unsafe extern "C" fn crabby_avifImageYUVToRGB(
     let image: image::Image = image.into();
     to_avifResult(&rgb.convert_from_yuv(&image))
 }
+
+// Converts only the rows [startRow, endRow) of image into the same rows of rgb. See
+// crabby_avifRGBImageConvertibleRowCount() to convert the rows as they are decoded.
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifImageYUVToRGBRows(
+    image: *const avifImage,
+    rgb: *mut avifRGBImage,
+    startRow: u32,
+    endRow: u32,
+) -> avifResult {
+    unsafe {
+        if (*image).yuvPlanes[0].is_null() {
+            return avifResult::Ok;
+        }
+    }
+    let mut rgb: rgb::Image = rgb.into();
+    let image: image::Image = image.into();
+    to_avifResult(&rgb.convert_row_range_from_yuv(&image, startRow, endRow))
+}
+
+// Returns the number of rows of rgb that crabby_avifImageYUVToRGBRows() can convert once the first
+// decodedRowCount rows of image are decoded (see crabby_avifDecoderDecodedRowCount()).
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifRGBImageConvertibleRowCount(
+    rgb: *const avifRGBImage,
+    image: *const avifImage,
+    decodedRowCount: u32,
+) -> u32 {
+    // Only the chroma upsampling matters, so the pixels are not wrapped.
+    let rgb = rgb::Image {
+        chroma_upsampling: unsafe { (*rgb).chroma_upsampling },
+        ..Default::default()
+    };
+    let image: image::Image = image.into();
+    rgb.convertible_row_count(&image, decodedRowCount)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn crabby_avifImageYUVToRGBWithGainMap(
+    image: *const avifImage,
+    gainMap: *const avifGainMap,
+    hdrHeadroom: f32,
+    outputTransferCharacteristics: TransferCharacteristics,
+    rgb: *mut avifRGBImage,
+) -> avifResult {
+    unsafe {
+        if gainMap.is_null() || (*gainMap).image.is_null() {
+            return avifResult::InvalidArgument;
+        }
+        if (*image).yuvPlanes[0].is_null() || (*(*gainMap).image).yuvPlanes[0].is_null() {
+            return avifResult::Ok;
+        }
+    }
+    let gainmap = unsafe { &(*gainMap) };
+    let gainmap = GainMap {
+        image: (gainmap.image as *const avifImage).into(),
+        metadata: (&gainmap.metadata).into(),
+        alt_color_primaries: gainmap.altColorPrimaries,
+        ..Default::default()
+    };
+    let mut rgb: rgb::Image = rgb.into();
+    let image: image::Image = image.into();
+    to_avifResult(&rgb.convert_from_yuv_with_gain_map(
+        &image,
+        &gainmap,
+        hdrHeadroom,
+        outputTransferCharacteristics,
+    ))
+}
@@ -201,7 +201,9 @@ impl avifDiagnostics {
 }
 
 #[repr(C)]
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
 pub enum avifCodecChoice {
+    #[default]
     Auto = 0,
     Aom = 1,
     Dav1d = 2,
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 use crate::codecs::Decoder;
+use crate::codecs::DecoderConfig;
 use crate::decoder::Category;
 use crate::image::Image;
 use crate::image::YuvRange;
@@ -22,15 +23,259 @@ use crate::*;
 
 use ndk_sys::bindings::*;
 
+use std::cmp::max;
+use std::collections::VecDeque;
 use std::ffi::CString;
 use std::os::raw::c_char;
+use std::os::raw::c_void;
 use std::ptr;
+use std::sync::Condvar;
+use std::sync::Mutex;
+use std::sync::OnceLock;
+use std::time::Duration;
+
+// Maximum time to wait for an input or an output buffer of the codec.
+const BUFFER_TIMEOUT: Duration = Duration::from_secs(1);
+
+// Width and height given to the codec and to the image reader when the dimensions of the frames
+// are not known. The codec adapts its buffers to the actual dimensions.
+const DEFAULT_DIMENSION: i32 = 200;
+
+// Returns the dimensions of the frames of |config|, or DEFAULT_DIMENSION if they are not known.
+fn frame_dimensions(config: &DecoderConfig) -> (i32, i32) {
+    match (i32::try_from(config.width), i32::try_from(config.height)) {
+        (Ok(width), Ok(height)) if width > 0 && height > 0 => (width, height),
+        _ => (DEFAULT_DIMENSION, DEFAULT_DIMENSION),
+    }
+}
+
+type SetAsyncNotifyCallback = unsafe extern "C" fn(
+    *mut AMediaCodec,
+    AMediaCodecOnAsyncNotifyCallback,
+    *mut c_void,
+) -> media_status_t;
+type ImageReaderNewWithUsage =
+    unsafe extern "C" fn(i32, i32, i32, u64, i32, *mut *mut AImageReader) -> media_status_t;
+type ImageReaderGetWindow =
+    unsafe extern "C" fn(*mut AImageReader, *mut *mut ANativeWindow) -> media_status_t;
+type ImageReaderAcquireNextImage =
+    unsafe extern "C" fn(*mut AImageReader, *mut *mut AImage) -> media_status_t;
+type ImageReaderSetImageListener =
+    unsafe extern "C" fn(*mut AImageReader, *mut AImageReader_ImageListener) -> media_status_t;
+type ImageReaderDelete = unsafe extern "C" fn(*mut AImageReader);
+type ImageGetHardwareBuffer =
+    unsafe extern "C" fn(*const AImage, *mut *mut AHardwareBuffer) -> media_status_t;
+type ImageGetDimension = unsafe extern "C" fn(*const AImage, *mut i32) -> media_status_t;
+type ImageDelete = unsafe extern "C" fn(*mut AImage);
+
+// The functions of libmediandk that are not available at all the API levels supported by this
+// library. They are looked up at runtime because linking to them would prevent the library from
+// being loaded on older devices.
+struct OptionalFunctions {
+    // API level 28.
+    set_async_notify_callback: Option<SetAsyncNotifyCallback>,
+    // API level 26.
+    image_reader: Option<ImageReaderFunctions>,
+}
+
+// The functions used to render the frames into hardware buffers.
+struct ImageReaderFunctions {
+    new_with_usage: ImageReaderNewWithUsage,
+    get_window: ImageReaderGetWindow,
+    acquire_next_image: ImageReaderAcquireNextImage,
+    set_image_listener: ImageReaderSetImageListener,
+    delete: ImageReaderDelete,
+    image_get_hardware_buffer: ImageGetHardwareBuffer,
+    image_get_width: ImageGetDimension,
+    image_get_height: ImageGetDimension,
+    image_delete: ImageDelete,
+}
+
+// Returns the function |name| (a nul terminated string) of |library| as a |T|, which must be the
+// function pointer type of that function.
+unsafe fn lookup<T: Copy>(library: *mut c_void, name: &[u8]) -> Option<T> {
+    if library.is_null() {
+        return None;
+    }
+    let symbol = unsafe { libc::dlsym(library, name.as_ptr() as *const c_char) };
+    if symbol.is_null() {
+        return None;
+    }
+    Some(unsafe { std::mem::transmute_copy::<*mut c_void, T>(&symbol) })
+}
+
+unsafe fn lookup_image_reader_functions(library: *mut c_void) -> Option<ImageReaderFunctions> {
+    unsafe {
+        Some(ImageReaderFunctions {
+            new_with_usage: lookup(library, b"AImageReader_newWithUsage\0")?,
+            get_window: lookup(library, b"AImageReader_getWindow\0")?,
+            acquire_next_image: lookup(library, b"AImageReader_acquireNextImage\0")?,
+            set_image_listener: lookup(library, b"AImageReader_setImageListener\0")?,
+            delete: lookup(library, b"AImageReader_delete\0")?,
+            image_get_hardware_buffer: lookup(library, b"AImage_getHardwareBuffer\0")?,
+            image_get_width: lookup(library, b"AImage_getWidth\0")?,
+            image_get_height: lookup(library, b"AImage_getHeight\0")?,
+            image_delete: lookup(library, b"AImage_delete\0")?,
+        })
+    }
+}
+
+fn optional_functions() -> &'static OptionalFunctions {
+    static FUNCTIONS: OnceLock<OptionalFunctions> = OnceLock::new();
+    FUNCTIONS.get_or_init(|| unsafe {
+        // The library is already loaded since the other functions are linked to it. It is never
+        // closed.
+        let library = libc::dlopen(
+            b"libmediandk.so\0".as_ptr() as *const c_char,
+            libc::RTLD_NOW,
+        );
+        OptionalFunctions {
+            set_async_notify_callback: lookup(library, b"AMediaCodec_setAsyncNotifyCallback\0"),
+            image_reader: lookup_image_reader_functions(library),
+        }
+    })
+}
+
+// Buffers and events reported by the callbacks of a codec in asynchronous mode.
+#[derive(Debug, Default)]
+struct AsyncEvents {
+    input_buffer_indices: VecDeque<usize>,
+    // Index and presentation time of the output buffers, in output order.
+    output_buffers: VecDeque<(usize, u64)>,
+    format_changed: bool,
+    // Number of images of the image reader that were reported as available but not acquired yet.
+    available_images: usize,
+    error: Option<String>,
+}
+
+// Shared with the thread of the codec that calls the callbacks.
+#[derive(Debug, Default)]
+struct AsyncState {
+    events: Mutex<AsyncEvents>,
+    condvar: Condvar,
+}
+
+impl AsyncState {
+    // The user data of the callbacks is a pointer to an AsyncState of the MediaCodec. It stays
+    // valid until the codec or the image reader that calls them is deleted.
+    unsafe fn notify(userdata: *mut c_void, f: impl FnOnce(&mut AsyncEvents)) {
+        let state = unsafe { &*(userdata as *const AsyncState) };
+        if let Ok(mut events) = state.events.lock() {
+            f(&mut events);
+        }
+        state.condvar.notify_all();
+    }
+
+    // Waits until |take| returns a value or an error is reported.
+    fn wait_for<T>(&self, mut take: impl FnMut(&mut AsyncEvents) -> Option<T>) -> AvifResult<T> {
+        let mut events = self
+            .events
+            .lock()
+            .map_err(|_| AvifError::UnknownError("mediacodec state poisoned".into()))?;
+        loop {
+            if let Some(error) = &events.error {
+                return Err(AvifError::UnknownError(error.clone()));
+            }
+            if let Some(value) = take(&mut events) {
+                return Ok(value);
+            }
+            let (guard, timeout) = self
+                .condvar
+                .wait_timeout(events, BUFFER_TIMEOUT)
+                .map_err(|_| AvifError::UnknownError("mediacodec state poisoned".into()))?;
+            events = guard;
+            if timeout.timed_out() && take(&mut events).is_none() {
+                return Err(AvifError::UnknownError(
+                    "timed out waiting for mediacodec".into(),
+                ));
+            }
+        }
+    }
+}
+
+unsafe extern "C" fn on_async_input_available(
+    _codec: *mut AMediaCodec,
+    userdata: *mut c_void,
+    index: i32,
+) {
+    unsafe {
+        AsyncState::notify(userdata, |events| {
+            events.input_buffer_indices.push_back(index as usize)
+        });
+    }
+}
+
+unsafe extern "C" fn on_async_output_available(
+    _codec: *mut AMediaCodec,
+    userdata: *mut c_void,
+    index: i32,
+    buffer_info: *mut AMediaCodecBufferInfo,
+) {
+    let pts = unsafe { (*buffer_info).presentationTimeUs } as u64;
+    unsafe {
+        AsyncState::notify(userdata, |events| {
+            events.output_buffers.push_back((index as usize, pts))
+        });
+    }
+}
+
+unsafe extern "C" fn on_async_format_changed(
+    _codec: *mut AMediaCodec,
+    userdata: *mut c_void,
+    _format: *mut AMediaFormat,
+) {
+    // The format is only valid during the callback. It is queried again with
+    // AMediaCodec_getOutputFormat() by the thread of the decoder.
+    unsafe {
+        AsyncState::notify(userdata, |events| events.format_changed = true);
+    }
+}
+
+unsafe extern "C" fn on_async_error(
+    _codec: *mut AMediaCodec,
+    userdata: *mut c_void,
+    error: media_status_t,
+    action_code: i32,
+    _detail: *const c_char,
+) {
+    unsafe {
+        AsyncState::notify(userdata, |events| {
+            events.error = Some(format!(
+                "mediacodec error {error} (action code {action_code})"
+            ))
+        });
+    }
+}
+
+unsafe extern "C" fn on_image_available(context: *mut c_void, _reader: *mut AImageReader) {
+    unsafe {
+        AsyncState::notify(context, |events| events.available_images += 1);
+    }
+}
+
+// The format of the images of the image reader. It is 8-bit.
+const IMAGE_READER_FORMAT: AIMAGE_FORMATS = AIMAGE_FORMATS_AIMAGE_FORMAT_YUV_420_888;
 
 #[derive(Debug, Default)]
 pub struct MediaCodec {
     codec: Option<*mut AMediaCodec>,
     format: Option<*mut AMediaFormat>,
     output_buffer_index: Option<usize>,
+    // Set if the codec runs in asynchronous mode (the buffers are reported by callbacks instead
+    // of being polled). Boxed so that its address, given to the callbacks, does not change.
+    async_state: Option<Box<AsyncState>>,
+    // True if the codec was initialized with a max_frame_delay larger than 1 (see
+    // send_sample()). Requires the asynchronous mode.
+    pipelined: bool,
+    // Set if the frames are rendered into the hardware buffers of this reader instead of being
+    // output in CPU-mapped buffers (see DecoderConfig::hardware_buffer_output).
+    image_reader: Option<*mut AImageReader>,
+    // Reports the images of image_reader as they become available. Boxed so that its address,
+    // given to the listener of the reader, does not change.
+    image_reader_state: Option<Box<AsyncState>>,
+    // The image of image_reader that holds the last output frame. Kept until the next frame is
+    // output.
+    output_image: Option<*mut AImage>,
 }
 
 macro_rules! c_str {
@@ -57,152 +302,309 @@ fn get_i32_from_str(format: *mut AMediaFormat, key: &str) -> Option<i32> {
     }
 }
 
-impl Decoder for MediaCodec {
-    fn initialize(&mut self, _operating_point: u8, _all_layers: bool) -> AvifResult<()> {
-        // Does not support operating point and all layers.
-        if self.codec.is_some() {
-            return Ok(()); // Already initialized.
+impl MediaCodec {
+    fn set_async_notify_callback(&mut self, codec: *mut AMediaCodec) {
+        // Requires API level 28. The buffers are polled on older devices.
+        let set_async_notify_callback = match optional_functions().set_async_notify_callback {
+            Some(set_async_notify_callback) => set_async_notify_callback,
+            None => return,
+        };
+        let state = Box::<AsyncState>::default();
+        let callback = AMediaCodecOnAsyncNotifyCallback {
+            onAsyncInputAvailable: Some(on_async_input_available),
+            onAsyncOutputAvailable: Some(on_async_output_available),
+            onAsyncFormatChanged: Some(on_async_format_changed),
+            onAsyncError: Some(on_async_error),
+        };
+        let userdata = &*state as *const AsyncState as *mut c_void;
+        // Fails if the codec does not support the asynchronous mode, in which case the buffers
+        // are polled.
+        if unsafe { set_async_notify_callback(codec, callback, userdata) }
+            == media_status_t_AMEDIA_OK
+        {
+            self.async_state = Some(state);
         }
-        //c_str!(codec_mime_type, codec_mime_type_tmp, "video/av01");
-        //let codec = unsafe { AMediaCodec_createDecoderByType(codec_mime_type) };
-        c_str!(codec_name, codec_name_tmp, "c2.android.av1.decoder");
-        let codec = unsafe { AMediaCodec_createCodecByName(codec_name) };
-        if codec.is_null() {
-            return Err(AvifError::NoCodecAvailable);
+    }
+
+    // Creates the reader of the hardware buffers that the frames are rendered into and returns
+    // its window. Returns null if the API level is lower than 26, in which case the frames are
+    // output in CPU-mapped buffers.
+    fn create_image_reader(&mut self, config: &DecoderConfig) -> *mut ANativeWindow {
+        let functions = match &optional_functions().image_reader {
+            Some(functions) => functions,
+            None => return ptr::null_mut(),
+        };
+        // One image is held until the next frame is output while the codec renders the frames
+        // in flight.
+        let max_images = i32::try_from(max(config.max_frame_delay, 1))
+            .unwrap_or(i32::MAX)
+            .saturating_add(1);
+        let (width, height) = frame_dimensions(config);
+        let mut reader: *mut AImageReader = ptr::null_mut();
+        if unsafe {
+            (functions.new_with_usage)(
+                width,
+                height,
+                IMAGE_READER_FORMAT as i32,
+                AHardwareBuffer_UsageFlags_AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE as u64,
+                max_images,
+                &mut reader as *mut _,
+            )
+        } != media_status_t_AMEDIA_OK
+            || reader.is_null()
+        {
+            return ptr::null_mut();
         }
-        let format = unsafe { AMediaFormat_new() };
-        if format.is_null() {
-            return Err(AvifError::UnknownError("".into()));
+        let state = Box::<AsyncState>::default();
+        // The listener is copied by the reader.
+        let mut listener = AImageReader_ImageListener {
+            context: &*state as *const AsyncState as *mut c_void,
+            onImageAvailable: Some(on_image_available),
+        };
+        let mut window: *mut ANativeWindow = ptr::null_mut();
+        if unsafe { (functions.set_image_listener)(reader, &mut listener as *mut _) }
+            != media_status_t_AMEDIA_OK
+            || unsafe { (functions.get_window)(reader, &mut window as *mut _) }
+                != media_status_t_AMEDIA_OK
+            || window.is_null()
+        {
+            unsafe { (functions.delete)(reader) };
+            return ptr::null_mut();
         }
-        unsafe {
-            c_str!(mime_type, mime_type_tmp, "video/av01");
-            AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, mime_type);
-            // TODO: Set actual width and height?
-            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, 200);
-            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, 200);
+        self.image_reader = Some(reader);
+        self.image_reader_state = Some(state);
+        window
+    }
 
-            // https://developer.android.com/reference/android/media/MediaCodecInfo.CodecCapabilities#COLOR_FormatYUV420Flexible
-            //AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, 2135033992);
-            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, 19);
+    fn release_output_image(&mut self) {
+        if let (Some(output_image), Some(functions)) =
+            (self.output_image.take(), &optional_functions().image_reader)
+        {
+            unsafe { (functions.image_delete)(output_image) };
+        }
+    }
 
-            // TODO: for 10-bit need to set format to 54 in order to get 10-bit
-            // output. Or maybe it is possible to get RGB 1010102 itself?
-            // int32_t COLOR_FormatYUVP010 = 54;
-            // rgb 1010102 = 2130750114
+    fn delete_image_reader(&mut self) {
+        self.release_output_image();
+        if let (Some(image_reader), Some(functions)) =
+            (self.image_reader.take(), &optional_functions().image_reader)
+        {
+            unsafe { (functions.delete)(image_reader) };
+        }
+        // The listener is not called anymore once the reader is deleted.
+        self.image_reader_state = None;
+    }
 
-            if AMediaCodec_configure(codec, format, ptr::null_mut(), ptr::null_mut(), 0)
-                != media_status_t_AMEDIA_OK
-            {
-                return Err(AvifError::NoCodecAvailable);
-            }
-            if AMediaCodec_start(codec) != media_status_t_AMEDIA_OK {
-                return Err(AvifError::NoCodecAvailable);
-            }
-            AMediaFormat_delete(format);
+    fn set_format(&mut self, format: *mut AMediaFormat) -> AvifResult<()> {
+        if format.is_null() {
+            return Err(AvifError::UnknownError("output format was null".into()));
+        }
+        if let Some(previous_format) = self.format.replace(format) {
+            unsafe { AMediaFormat_delete(previous_format) };
         }
-        self.codec = Some(codec);
         Ok(())
     }
 
-    fn get_next_image(
-        &mut self,
-        av1_payload: &[u8],
-        _spatial_id: u8,
-        image: &mut Image,
-        category: Category,
-    ) -> AvifResult<()> {
-        if self.codec.is_none() {
-            self.initialize(0, true)?;
-        }
-        let codec = self.codec.unwrap();
-        if self.output_buffer_index.is_some() {
-            // Release any existing output buffer.
+    fn release_output_buffer(&mut self) {
+        if let Some(output_buffer_index) = self.output_buffer_index.take() {
             unsafe {
-                AMediaCodec_releaseOutputBuffer(codec, self.output_buffer_index.unwrap(), false);
+                AMediaCodec_releaseOutputBuffer(self.codec.unwrap(), output_buffer_index, false);
             }
         }
-        unsafe {
-            let input_index = AMediaCodec_dequeueInputBuffer(codec, 0);
-            if input_index >= 0 {
-                let mut input_buffer_size: usize = 0;
-                let input_buffer = AMediaCodec_getInputBuffer(
-                    codec,
-                    input_index as usize,
-                    &mut input_buffer_size as *mut _,
-                );
-                if input_buffer.is_null() {
+    }
+
+    // Copies |av1_payload| into an input buffer of the codec and queues it. The copy cannot be
+    // avoided because the input buffers are owned by the codec.
+    fn queue_input_buffer(&mut self, av1_payload: &[u8], pts: u64) -> AvifResult<()> {
+        let codec = self.codec.unwrap();
+        let input_index = match &self.async_state {
+            Some(state) => state.wait_for(|events| events.input_buffer_indices.pop_front())?,
+            None => {
+                let input_index = unsafe { AMediaCodec_dequeueInputBuffer(codec, 0) };
+                if input_index < 0 {
                     return Err(AvifError::UnknownError(format!(
-                        "input buffer at index {input_index} was null"
+                        "got input index < 0: {input_index}"
                     )));
                 }
-                // TODO: Alternative is to create a slice from raw parts and use copy_from_slice.
-                ptr::copy_nonoverlapping(av1_payload.as_ptr(), input_buffer, av1_payload.len());
-                if AMediaCodec_queueInputBuffer(
-                    codec,
-                    usize_from_isize(input_index)?,
-                    /*offset=*/ 0,
-                    av1_payload.len(),
-                    /*pts=*/ 0,
-                    /*flags=*/ 0,
-                ) != media_status_t_AMEDIA_OK
-                {
-                    return Err(AvifError::UnknownError("".into()));
-                }
-            } else {
+                usize_from_isize(input_index)?
+            }
+        };
+        unsafe {
+            let mut input_buffer_size: usize = 0;
+            let input_buffer =
+                AMediaCodec_getInputBuffer(codec, input_index, &mut input_buffer_size as *mut _);
+            if input_buffer.is_null() {
+                return Err(AvifError::UnknownError(format!(
+                    "input buffer at index {input_index} was null"
+                )));
+            }
+            if input_buffer_size < av1_payload.len() {
                 return Err(AvifError::UnknownError(format!(
-                    "got input index < 0: {input_index}"
+                    "input buffer of size {input_buffer_size} is too small for the payload"
                 )));
             }
+            ptr::copy_nonoverlapping(av1_payload.as_ptr(), input_buffer, av1_payload.len());
+            if AMediaCodec_queueInputBuffer(
+                codec,
+                input_index,
+                /*offset=*/ 0,
+                av1_payload.len(),
+                pts,
+                /*flags=*/ 0,
+            ) != media_status_t_AMEDIA_OK
+            {
+                return Err(AvifError::UnknownError("".into()));
+            }
+        }
+        Ok(())
+    }
+
+    // Returns the index and the presentation time of the next output buffer of the codec.
+    fn dequeue_output_buffer(&mut self) -> AvifResult<(usize, u64)> {
+        let codec = self.codec.unwrap();
+        if self.async_state.is_some() {
+            let mut format_changed = false;
+            let output = self.async_state.unwrap_ref().wait_for(|events| {
+                format_changed |= std::mem::take(&mut events.format_changed);
+                events.output_buffers.pop_front()
+            })?;
+            if format_changed {
+                self.set_format(unsafe { AMediaCodec_getOutputFormat(codec) })?;
+            }
+            return Ok(output);
         }
-        let mut buffer: Option<*mut u8> = None;
-        let mut buffer_size: usize = 0;
         let mut retry_count = 0;
         let mut buffer_info = AMediaCodecBufferInfo::default();
         while retry_count < 100 {
             retry_count += 1;
-            unsafe {
-                let output_index =
-                    AMediaCodec_dequeueOutputBuffer(codec, &mut buffer_info as *mut _, 10000);
-                if output_index >= 0 {
-                    let output_buffer = AMediaCodec_getOutputBuffer(
-                        codec,
-                        usize_from_isize(output_index)?,
-                        &mut buffer_size as *mut _,
-                    );
-                    if output_buffer.is_null() {
-                        return Err(AvifError::UnknownError("output buffer is null".into()));
-                    }
-                    buffer = Some(output_buffer);
-                    self.output_buffer_index = Some(usize_from_isize(output_index)?);
-                    break;
-                } else if output_index == AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED as isize {
-                    // TODO: what to do?
-                    continue;
-                } else if output_index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED as isize {
-                    let format = AMediaCodec_getOutputFormat(codec);
-                    if format.is_null() {
-                        return Err(AvifError::UnknownError("output format was null".into()));
-                    }
-                    self.format = Some(format);
-                    continue;
-                } else if output_index == AMEDIACODEC_INFO_TRY_AGAIN_LATER as isize {
-                    continue;
-                } else {
-                    return Err(AvifError::UnknownError(format!(
-                        "mediacodec dequeue_output_buffer failed: {output_index}"
-                    )));
-                }
+            let output_index = unsafe {
+                AMediaCodec_dequeueOutputBuffer(codec, &mut buffer_info as *mut _, 10000)
+            };
+            if output_index >= 0 {
+                return Ok((
+                    usize_from_isize(output_index)?,
+                    buffer_info.presentationTimeUs as u64,
+                ));
+            } else if output_index == AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED as isize {
+                // TODO: what to do?
+                continue;
+            } else if output_index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED as isize {
+                self.set_format(unsafe { AMediaCodec_getOutputFormat(codec) })?;
+                continue;
+            } else if output_index == AMEDIACODEC_INFO_TRY_AGAIN_LATER as isize {
+                continue;
+            } else {
+                return Err(AvifError::UnknownError(format!(
+                    "mediacodec dequeue_output_buffer failed: {output_index}"
+                )));
             }
         }
-        if buffer.is_none() {
+        Err(AvifError::UnknownError(
+            "did not get buffer from mediacodec".into(),
+        ))
+    }
+
+    // Renders the output buffer |output_index| into the next image of image_reader, which is kept
+    // until the next frame is output. |image| only gets the properties of the frame. Its pixels
+    // are in the hardware buffer of that image (see hardware_buffer()).
+    fn output_hardware_buffer(
+        &mut self,
+        output_index: usize,
+        image: &mut Image,
+        category: Category,
+    ) -> AvifResult<()> {
+        let functions = optional_functions().image_reader.unwrap_ref();
+        if unsafe { AMediaCodec_releaseOutputBuffer(self.codec.unwrap(), output_index, true) }
+            != media_status_t_AMEDIA_OK
+        {
+            return Err(AvifError::UnknownError(
+                "could not render the output buffer".into(),
+            ));
+        }
+        self.release_output_image();
+        // The frame is rendered asynchronously. on_image_available() is called once it is.
+        self.image_reader_state.unwrap_ref().wait_for(|events| {
+            if events.available_images == 0 {
+                return None;
+            }
+            events.available_images -= 1;
+            Some(())
+        })?;
+        let mut output_image: *mut AImage = ptr::null_mut();
+        let status = unsafe {
+            (functions.acquire_next_image)(self.image_reader.unwrap(), &mut output_image as *mut _)
+        };
+        if status != media_status_t_AMEDIA_OK || output_image.is_null() {
+            return Err(AvifError::UnknownError(format!(
+                "could not acquire the output image: {status}"
+            )));
+        }
+        self.output_image = Some(output_image);
+        let mut width: i32 = 0;
+        let mut height: i32 = 0;
+        if unsafe { (functions.image_get_width)(output_image, &mut width as *mut _) }
+            != media_status_t_AMEDIA_OK
+            || unsafe { (functions.image_get_height)(output_image, &mut height as *mut _) }
+                != media_status_t_AMEDIA_OK
+        {
             return Err(AvifError::UnknownError(
-                "did not get buffer from mediacodec".into(),
+                "could not get the output image dimensions".into(),
             ));
         }
+        let color_range = self
+            .format
+            .and_then(|format| get_i32_from_str(format, "color-range"))
+            .unwrap_or(2);
+        image.width = u32_from_i32(width)?;
+        image.height = u32_from_i32(height)?;
+        // The depth of IMAGE_READER_FORMAT. Images of higher bit depths are not rendered into
+        // hardware buffers (see Decoder::create_tile_codec()).
+        image.depth = 8;
+        image.yuv_range = if color_range == 0 { YuvRange::Limited } else { YuvRange::Full };
+        let planes: &[usize] = match category {
+            Category::Alpha => &[3],
+            _ => {
+                image.yuv_format = PixelFormat::Yuv420;
+                image.chroma_sample_position = ChromaSamplePosition::Unknown;
+                image.color_primaries = ColorPrimaries::Unspecified;
+                image.transfer_characteristics = TransferCharacteristics::Unspecified;
+                image.matrix_coefficients = MatrixCoefficients::Unspecified;
+                &[0, 1, 2]
+            }
+        };
+        for &plane in planes {
+            image.planes[plane] = None;
+            image.row_bytes[plane] = 0;
+        }
+        Ok(())
+    }
+
+    // Points the planes of |image| to the output buffer |output_index|, which is kept until the
+    // next output buffer is requested.
+    fn output_image(
+        &mut self,
+        output_index: usize,
+        image: &mut Image,
+        category: Category,
+    ) -> AvifResult<()> {
+        if self.image_reader.is_some() {
+            return self.output_hardware_buffer(output_index, image, category);
+        }
+        self.output_buffer_index = Some(output_index);
+        let mut buffer_size: usize = 0;
+        let buffer = unsafe {
+            AMediaCodec_getOutputBuffer(
+                self.codec.unwrap(),
+                output_index,
+                &mut buffer_size as *mut _,
+            )
+        };
+        if buffer.is_null() {
+            return Err(AvifError::UnknownError("output buffer is null".into()));
+        }
         if self.format.is_none() {
             return Err(AvifError::UnknownError("format is none".into()));
         }
-        let buffer = buffer.unwrap();
         let format = self.format.unwrap();
         let width = get_i32(format, unsafe { AMEDIAFORMAT_KEY_WIDTH })
             .ok_or(AvifError::UnknownError("".into()))?;
@@ -272,28 +674,184 @@ impl Decoder for MediaCodec {
     }
 }
 
+impl Decoder for MediaCodec {
+    fn initialize(&mut self, config: &DecoderConfig) -> AvifResult<()> {
+        // Does not support operating point, all layers or the number of threads.
+        if self.codec.is_some() {
+            return Ok(()); // Already initialized.
+        }
+        //c_str!(codec_mime_type, codec_mime_type_tmp, "video/av01");
+        //let codec = unsafe { AMediaCodec_createDecoderByType(codec_mime_type) };
+        c_str!(codec_name, codec_name_tmp, "c2.android.av1.decoder");
+        let codec = unsafe { AMediaCodec_createCodecByName(codec_name) };
+        if codec.is_null() {
+            return Err(AvifError::NoCodecAvailable);
+        }
+        let format = unsafe { AMediaFormat_new() };
+        if format.is_null() {
+            unsafe { AMediaCodec_delete(codec) };
+            return Err(AvifError::UnknownError("".into()));
+        }
+        // Must be set before the codec is configured.
+        self.set_async_notify_callback(codec);
+        let surface = if config.hardware_buffer_output {
+            self.create_image_reader(config)
+        } else {
+            ptr::null_mut()
+        };
+        let started = unsafe {
+            c_str!(mime_type, mime_type_tmp, "video/av01");
+            AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, mime_type);
+            let (width, height) = frame_dimensions(config);
+            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, width);
+            AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, height);
+
+            // The color format is chosen by the codec when it renders into a surface.
+            if surface.is_null() {
+                // https://developer.android.com/reference/android/media/MediaCodecInfo.CodecCapabilities#COLOR_FormatYUV420Flexible
+                //AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, 2135033992);
+                AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, 19);
+            }
+
+            // TODO: for 10-bit need to set format to 54 in order to get 10-bit
+            // output. Or maybe it is possible to get RGB 1010102 itself?
+            // int32_t COLOR_FormatYUVP010 = 54;
+            // rgb 1010102 = 2130750114
+
+            AMediaCodec_configure(codec, format, surface, ptr::null_mut(), 0)
+                == media_status_t_AMEDIA_OK
+                && AMediaCodec_start(codec) == media_status_t_AMEDIA_OK
+        };
+        unsafe { AMediaFormat_delete(format) };
+        if !started {
+            unsafe { AMediaCodec_delete(codec) };
+            // The callbacks are not called anymore once the codec is deleted.
+            self.async_state = None;
+            self.delete_image_reader();
+            return Err(AvifError::NoCodecAvailable);
+        }
+        self.codec = Some(codec);
+        self.pipelined = config.max_frame_delay > 1 && self.async_state.is_some();
+        Ok(())
+    }
+
+    fn get_next_image(
+        &mut self,
+        av1_payload: &[u8],
+        _spatial_id: u8,
+        image: &mut Image,
+        category: Category,
+    ) -> AvifResult<()> {
+        if self.codec.is_none() {
+            self.initialize(&DecoderConfig {
+                operating_point: 0,
+                all_layers: true,
+                max_threads: 1,
+                max_frame_delay: 1,
+                ..Default::default()
+            })?;
+        }
+        // Release any existing output buffer.
+        self.release_output_buffer();
+        self.queue_input_buffer(av1_payload, /*pts=*/ 0)?;
+        let (output_index, _) = self.dequeue_output_buffer()?;
+        self.output_image(output_index, image, category)
+    }
+
+    fn can_pipeline_frames(&self) -> bool {
+        self.pipelined
+    }
+
+    fn send_sample(&mut self, av1_payload: &[u8], sample_index: u64) -> AvifResult<()> {
+        if !self.pipelined {
+            return Err(AvifError::NotImplemented);
+        }
+        // The presentation time is used to match the output buffers with the samples.
+        self.queue_input_buffer(av1_payload, sample_index)
+    }
+
+    fn receive_frame(
+        &mut self,
+        sample_index: u64,
+        _spatial_id: u8,
+        image: &mut Image,
+        category: Category,
+    ) -> AvifResult<()> {
+        if !self.pipelined {
+            return Err(AvifError::NotImplemented);
+        }
+        self.release_output_buffer();
+        loop {
+            let (output_index, pts) = self.dequeue_output_buffer()?;
+            if pts == sample_index {
+                return self.output_image(output_index, image, category);
+            }
+            unsafe { AMediaCodec_releaseOutputBuffer(self.codec.unwrap(), output_index, false) };
+            if pts > sample_index {
+                return Err(AvifError::UnknownError(format!(
+                    "mediacodec did not output a frame for sample {sample_index}"
+                )));
+            }
+            // Frame of an earlier sample that was not received.
+        }
+    }
+
+    fn flush(&mut self) -> AvifResult<()> {
+        let codec = match self.codec {
+            Some(codec) => codec,
+            None => return Ok(()),
+        };
+        self.release_output_buffer();
+        self.release_output_image();
+        if unsafe { AMediaCodec_flush(codec) } != media_status_t_AMEDIA_OK {
+            return Err(AvifError::UnknownError("mediacodec flush failed".into()));
+        }
+        if let Some(state) = &self.async_state {
+            // The buffers reported before the flush are not valid anymore and the codec reports
+            // its input buffers again once it is started again. A previous error is forgotten.
+            *state
+                .events
+                .lock()
+                .map_err(|_| AvifError::UnknownError("mediacodec state poisoned".into()))? =
+                AsyncEvents::default();
+            if unsafe { AMediaCodec_start(codec) } != media_status_t_AMEDIA_OK {
+                return Err(AvifError::UnknownError("mediacodec start failed".into()));
+            }
+        }
+        Ok(())
+    }
+
+    fn hardware_buffer(&self) -> Option<*mut c_void> {
+        let output_image = self.output_image?;
+        let functions = optional_functions().image_reader.as_ref()?;
+        let mut buffer: *mut AHardwareBuffer = ptr::null_mut();
+        if unsafe { (functions.image_get_hardware_buffer)(output_image, &mut buffer as *mut _) }
+            != media_status_t_AMEDIA_OK
+            || buffer.is_null()
+        {
+            return None;
+        }
+        Some(buffer as *mut c_void)
+    }
+}
+
 impl Drop for MediaCodec {
     fn drop(&mut self) {
         if self.codec.is_some() {
-            if self.output_buffer_index.is_some() {
-                unsafe {
-                    AMediaCodec_releaseOutputBuffer(
-                        self.codec.unwrap(),
-                        self.output_buffer_index.unwrap(),
-                        false,
-                    );
-                }
-                self.output_buffer_index = None;
-            }
+            self.release_output_buffer();
             unsafe {
                 AMediaCodec_stop(self.codec.unwrap());
                 AMediaCodec_delete(self.codec.unwrap());
             }
             self.codec = None;
         }
+        // After the codec, which renders into the window of the reader.
+        self.delete_image_reader();
         if self.format.is_some() {
             unsafe { AMediaFormat_delete(self.format.unwrap()) };
             self.format = None;
         }
+        // The callbacks are not called anymore once the codec is deleted, so async_state can be
+        // dropped.
     }
 }
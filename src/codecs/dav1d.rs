@@ -13,20 +13,51 @@
 // limitations under the License.
 
 use crate::codecs::Decoder;
+use crate::codecs::DecoderConfig;
+use crate::decoder::frame_allocator::*;
+use crate::decoder::frame_handle::FrameReference;
 use crate::decoder::Category;
 use crate::image::Image;
 use crate::image::YuvRange;
+use crate::internal_utils::create_vec_exact;
 use crate::internal_utils::pixels::*;
 use crate::*;
 
 use dav1d_sys::bindings::*;
 
+use std::collections::VecDeque;
+use std::ffi::c_void;
 use std::mem::MaybeUninit;
+use std::sync::Arc;
 
 #[derive(Debug, Default)]
 pub struct Dav1d {
     context: Option<*mut Dav1dContext>,
     picture: Option<Dav1dPicture>,
+    // True if the context was opened with a max_frame_delay larger than 1 (see send_sample()).
+    pipelined: bool,
+    // Frames that dav1d output while samples were being queued, in output order.
+    pending_pictures: VecDeque<Dav1dPicture>,
+    // The cookie of the Dav1dPicAllocator. It must outlive the context and the pictures that were
+    // allocated with it (see Dav1dPictureReference).
+    frame_allocator: Option<Arc<Arc<dyn FrameAllocator>>>,
+}
+
+// A reference on a picture obtained with dav1d_picture_ref().
+struct Dav1dPictureReference {
+    picture: Dav1dPicture,
+    _frame_allocator: Option<Arc<Arc<dyn FrameAllocator>>>,
+}
+
+// The reference counting of the pictures of dav1d is thread-safe.
+unsafe impl Send for Dav1dPictureReference {}
+
+impl FrameReference for Dav1dPictureReference {}
+
+impl Drop for Dav1dPictureReference {
+    fn drop(&mut self) {
+        unsafe { dav1d_picture_unref((&mut self.picture) as *mut _) };
+    }
 }
 
 unsafe extern "C" fn avif_dav1d_free_callback(
@@ -36,26 +67,109 @@ unsafe extern "C" fn avif_dav1d_free_callback(
     // Do nothing. The buffers are owned by the decoder.
 }
 
+unsafe extern "C" fn avif_dav1d_free_payload_callback(
+    _buf: *const u8,
+    cookie: *mut ::std::os::raw::c_void,
+) {
+    // The cookie is the copy of the payload made by send_sample().
+    drop(unsafe { Box::from_raw(cookie as *mut Vec<u8>) });
+}
+
 // See https://code.videolan.org/videolan/dav1d/-/blob/9849ede1304da1443cfb4a86f197765081034205/include/dav1d/common.h#L55-59
 const DAV1D_EAGAIN: i32 = if libc::EPERM > 0 { -libc::EAGAIN } else { libc::EAGAIN };
+const DAV1D_ENOMEM: i32 = if libc::EPERM > 0 { -libc::ENOMEM } else { libc::ENOMEM };
+
+// See DAV1D_PICTURE_ALIGNMENT in include/dav1d/picture.h.
+const DAV1D_PICTURE_ALIGNMENT: usize = 64;
+
+#[allow(clippy::unnecessary_cast)]
+unsafe extern "C" fn avif_dav1d_alloc_picture_callback(
+    pic: *mut Dav1dPicture,
+    cookie: *mut c_void,
+) -> i32 {
+    // The cookie is Dav1d::frame_allocator.
+    let frame_allocator = unsafe { &*(cookie as *const Arc<dyn FrameAllocator>) };
+    let pic = unsafe { &mut *pic };
+    let yuv_format = match pic.p.layout {
+        0 => PixelFormat::Yuv400,
+        1 => PixelFormat::Yuv420,
+        2 => PixelFormat::Yuv422,
+        3 => PixelFormat::Yuv444,
+        _ => return DAV1D_ENOMEM, // not reached.
+    };
+    // Same constraints as the default allocator of dav1d: the frames are decoded in blocks of up
+    // to 128x128 samples and the SIMD functions may read past the end of the planes.
+    let request = FrameBufferRequest {
+        width: (pic.p.w as u32).next_multiple_of(128),
+        height: (pic.p.h as u32).next_multiple_of(128),
+        depth: pic.p.bpc as u8,
+        yuv_format,
+        alignment: DAV1D_PICTURE_ALIGNMENT,
+        padding: DAV1D_PICTURE_ALIGNMENT,
+    };
+    let Ok(buffer) = frame_allocator.allocate(&request) else {
+        return DAV1D_ENOMEM;
+    };
+    let plane_count = request.plane_count();
+    // dav1d has a single stride for both chroma planes.
+    if buffer.validate(&request).is_err()
+        || (plane_count > 1 && buffer.row_bytes[1] != buffer.row_bytes[2])
+    {
+        frame_allocator.release(buffer);
+        return DAV1D_ENOMEM;
+    }
+    for plane in 0..3 {
+        pic.data[plane] = if plane < plane_count {
+            buffer.planes[plane] as *mut c_void
+        } else {
+            std::ptr::null_mut()
+        };
+    }
+    pic.stride[0] = buffer.row_bytes[0] as isize;
+    pic.stride[1] = if plane_count > 1 { buffer.row_bytes[1] as isize } else { 0 };
+    pic.allocator_data = Box::into_raw(Box::new(buffer)) as *mut c_void;
+    0
+}
+
+unsafe extern "C" fn avif_dav1d_release_picture_callback(
+    pic: *mut Dav1dPicture,
+    cookie: *mut c_void,
+) {
+    let frame_allocator = unsafe { &*(cookie as *const Arc<dyn FrameAllocator>) };
+    let buffer = unsafe { Box::from_raw((*pic).allocator_data as *mut FrameBuffer) };
+    frame_allocator.release(*buffer);
+}
+
+// See https://code.videolan.org/videolan/dav1d/-/blob/9849ede1304da1443cfb4a86f197765081034205/include/dav1d/dav1d.h#L45
+const DAV1D_MAX_THREADS: u32 = 256;
+const DAV1D_MAX_FRAME_DELAY: u32 = 256;
 
 // The type of the fields from dav1d_sys::bindings::* are dependent on the
 // compiler that is used to generate the bindings, version of dav1d, etc.
 // So allow clippy to ignore unnecessary cast warnings.
 #[allow(clippy::unnecessary_cast)]
 impl Decoder for Dav1d {
-    fn initialize(&mut self, operating_point: u8, all_layers: bool) -> AvifResult<()> {
+    fn initialize(&mut self, config: &DecoderConfig) -> AvifResult<()> {
         if self.context.is_some() {
             return Ok(());
         }
         let mut settings_uninit: MaybeUninit<Dav1dSettings> = MaybeUninit::uninit();
         unsafe { dav1d_default_settings(settings_uninit.as_mut_ptr()) };
         let mut settings = unsafe { settings_uninit.assume_init() };
-        settings.max_frame_delay = 1;
-        settings.n_threads = 8;
-        // settings.frame_size_limit = xx;
-        settings.operating_point = operating_point as i32;
-        settings.all_layers = if all_layers { 1 } else { 0 };
+        settings.max_frame_delay = config.max_frame_delay.clamp(1, DAV1D_MAX_FRAME_DELAY) as i32;
+        settings.n_threads = config.max_threads.clamp(1, DAV1D_MAX_THREADS) as i32;
+        settings.frame_size_limit = config.frame_size_limit;
+        settings.operating_point = config.operating_point as i32;
+        settings.all_layers = if config.all_layers { 1 } else { 0 };
+        if let Some(frame_allocator) = &config.frame_allocator {
+            let cookie = Arc::new(frame_allocator.clone());
+            settings.allocator = Dav1dPicAllocator {
+                cookie: Arc::as_ptr(&cookie) as *mut c_void,
+                alloc_picture_callback: Some(avif_dav1d_alloc_picture_callback),
+                release_picture_callback: Some(avif_dav1d_release_picture_callback),
+            };
+            self.frame_allocator = Some(cookie);
+        }
 
         let mut dec = MaybeUninit::uninit();
         let ret = unsafe { dav1d_open(dec.as_mut_ptr(), (&settings) as *const _) };
@@ -65,6 +179,7 @@ impl Decoder for Dav1d {
             )));
         }
         self.context = Some(unsafe { dec.assume_init() });
+        self.pipelined = settings.max_frame_delay > 1;
 
         Ok(())
     }
@@ -77,7 +192,13 @@ impl Decoder for Dav1d {
         category: Category,
     ) -> AvifResult<()> {
         if self.context.is_none() {
-            self.initialize(0, true)?;
+            self.initialize(&DecoderConfig {
+                operating_point: 0,
+                all_layers: true,
+                max_threads: 1,
+                max_frame_delay: 1,
+                ..Default::default()
+            })?;
         }
         unsafe {
             let mut data: Dav1dData = std::mem::zeroed();
@@ -175,6 +296,161 @@ impl Decoder for Dav1d {
             }
         }
 
+        self.output_picture(image, category)
+    }
+
+    fn can_pipeline_frames(&self) -> bool {
+        self.pipelined
+    }
+
+    fn send_sample(&mut self, av1_payload: &[u8], sample_index: u64) -> AvifResult<()> {
+        if !self.pipelined {
+            return Err(AvifError::NotImplemented);
+        }
+        // dav1d may still read the payload after this function returns, so it owns a copy.
+        let mut payload: Vec<u8> = create_vec_exact(av1_payload.len())?;
+        payload.extend_from_slice(av1_payload);
+        let payload_ptr = payload.as_ptr();
+        let payload_len = payload.len();
+        let cookie = Box::into_raw(Box::new(payload));
+        unsafe {
+            let mut data: Dav1dData = std::mem::zeroed();
+            let res = dav1d_data_wrap(
+                (&mut data) as *mut _,
+                payload_ptr,
+                payload_len,
+                Some(avif_dav1d_free_payload_callback),
+                cookie as *mut _,
+            );
+            if res != 0 {
+                drop(Box::from_raw(cookie));
+                return Err(AvifError::UnknownError(format!(
+                    "dav1d_data_wrap returned {res}"
+                )));
+            }
+            // Propagated by dav1d to the output frames. Used to match them with the samples.
+            data.m.timestamp = sample_index as i64;
+            loop {
+                let res = dav1d_send_data(self.context.unwrap(), (&mut data) as *mut _);
+                if res < 0 && res != DAV1D_EAGAIN {
+                    dav1d_data_unref((&mut data) as *mut _);
+                    return Err(AvifError::UnknownError(format!(
+                        "dav1d_send_data returned {res}"
+                    )));
+                }
+                if data.data.is_null() {
+                    return Ok(());
+                }
+                // The input of dav1d is full. Make room by taking an output frame.
+                let mut picture: Dav1dPicture = std::mem::zeroed();
+                let res = dav1d_get_picture(self.context.unwrap(), (&mut picture) as *mut _);
+                if res == 0 {
+                    self.pending_pictures.push_back(picture);
+                } else if res != DAV1D_EAGAIN {
+                    dav1d_data_unref((&mut data) as *mut _);
+                    return Err(AvifError::UnknownError(format!(
+                        "dav1d_get_picture returned {res}"
+                    )));
+                }
+            }
+        }
+    }
+
+    fn receive_frame(
+        &mut self,
+        sample_index: u64,
+        spatial_id: u8,
+        image: &mut Image,
+        category: Category,
+    ) -> AvifResult<()> {
+        if !self.pipelined {
+            return Err(AvifError::NotImplemented);
+        }
+        let timestamp = sample_index as i64;
+        let mut got_picture = false;
+        let mut drained = false;
+        unsafe {
+            loop {
+                let mut picture = match self.pending_pictures.pop_front() {
+                    Some(picture) => picture,
+                    None => {
+                        let mut picture: Dav1dPicture = std::mem::zeroed();
+                        let res =
+                            dav1d_get_picture(self.context.unwrap(), (&mut picture) as *mut _);
+                        if res == DAV1D_EAGAIN {
+                            if drained {
+                                break; // All the queued samples were decoded.
+                            }
+                            // With frame threading, the first call after dav1d_send_data() does
+                            // not wait for the frames in flight. There is nothing more to send,
+                            // so call it again to drain them.
+                            drained = true;
+                            continue;
+                        } else if res < 0 {
+                            return Err(AvifError::UnknownError(format!(
+                                "dav1d_get_picture returned {res}"
+                            )));
+                        }
+                        picture
+                    }
+                };
+                if picture.m.timestamp > timestamp {
+                    // The sample did not produce any frame. Keep this one for a later sample.
+                    self.pending_pictures.push_front(picture);
+                    break;
+                }
+                let frame_spatial_id = (*picture.frame_hdr).spatial_id as u8;
+                if picture.m.timestamp < timestamp
+                    || (spatial_id != 0xFF && spatial_id != frame_spatial_id)
+                {
+                    // Extra frame of an earlier sample or unwanted layer. This is what the
+                    // draining in get_next_image() would have discarded.
+                    dav1d_picture_unref((&mut picture) as *mut _);
+                    continue;
+                }
+                if let Some(mut previous_picture) = self.picture.take() {
+                    dav1d_picture_unref((&mut previous_picture) as *mut _);
+                }
+                self.picture = Some(picture);
+                got_picture = true;
+                break;
+            }
+        }
+        // Same special case for alpha as in get_next_image(): re-use the last frame.
+        if !got_picture && (category != Category::Alpha || self.picture.is_none()) {
+            return Err(AvifError::UnknownError("".into()));
+        }
+        self.output_picture(image, category)
+    }
+
+    fn flush(&mut self) -> AvifResult<()> {
+        for mut picture in self.pending_pictures.drain(..) {
+            unsafe { dav1d_picture_unref((&mut picture) as *mut _) };
+        }
+        if let Some(mut picture) = self.picture.take() {
+            unsafe { dav1d_picture_unref((&mut picture) as *mut _) };
+        }
+        if let Some(context) = self.context {
+            unsafe { dav1d_flush(context) };
+        }
+        Ok(())
+    }
+
+    fn reference_frame(&self) -> AvifResult<Box<dyn FrameReference>> {
+        let picture = self.picture.as_ref().ok_or(AvifError::NoContent)?;
+        let mut reference = Dav1dPictureReference {
+            picture: unsafe { std::mem::zeroed() },
+            _frame_allocator: self.frame_allocator.clone(),
+        };
+        unsafe { dav1d_picture_ref((&mut reference.picture) as *mut _, picture as *const _) };
+        Ok(Box::new(reference))
+    }
+}
+
+#[allow(clippy::unnecessary_cast)]
+impl Dav1d {
+    // Points the planes of |image| to the last output frame.
+    fn output_picture(&self, image: &mut Image, category: Category) -> AvifResult<()> {
         let dav1d_picture = self.picture.unwrap_ref();
         match category {
             Category::Alpha => {
@@ -242,6 +518,9 @@ impl Decoder for Dav1d {
 
 impl Drop for Dav1d {
     fn drop(&mut self) {
+        for picture in &mut self.pending_pictures {
+            unsafe { dav1d_picture_unref(picture as *mut _) };
+        }
         if self.picture.is_some() {
             unsafe { dav1d_picture_unref(self.picture.unwrap_mut() as *mut _) };
         }
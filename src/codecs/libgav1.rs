@@ -13,6 +13,9 @@
 // limitations under the License.
 
 use crate::codecs::Decoder;
+use crate::codecs::DecoderConfig;
+use crate::decoder::frame_allocator::*;
+use crate::decoder::frame_handle::FrameReference;
 use crate::decoder::Category;
 use crate::image::Image;
 use crate::image::YuvRange;
@@ -21,12 +24,114 @@ use crate::*;
 
 use libgav1_sys::bindings::*;
 
+use std::ffi::c_void;
 use std::mem::MaybeUninit;
+use std::os::raw::c_int;
+use std::sync::Arc;
 
 #[derive(Debug, Default)]
 pub struct Libgav1 {
     decoder: Option<*mut Libgav1Decoder>,
     image: Option<Libgav1DecoderBuffer>,
+    // The callback_private_data of the frame buffer callbacks. It must outlive the decoder.
+    frame_allocator: Option<Box<Arc<dyn FrameAllocator>>>,
+}
+
+// A buffer of the FrameAllocator. It is released once libgav1 is done with it and all the
+// Libgav1FrameReferences to it are dropped.
+struct SharedFrameBuffer {
+    buffer: FrameBuffer,
+    frame_allocator: Arc<dyn FrameAllocator>,
+}
+
+// The planes are only written by libgav1 before the buffer is shared.
+unsafe impl Send for SharedFrameBuffer {}
+unsafe impl Sync for SharedFrameBuffer {}
+
+impl Drop for SharedFrameBuffer {
+    fn drop(&mut self) {
+        self.frame_allocator.release(self.buffer);
+    }
+}
+
+struct Libgav1FrameReference {
+    _shared_buffer: Arc<SharedFrameBuffer>,
+}
+
+impl FrameReference for Libgav1FrameReference {}
+
+#[allow(non_upper_case_globals)]
+#[allow(clippy::too_many_arguments)]
+#[allow(clippy::unnecessary_cast)]
+unsafe extern "C" fn avif_libgav1_get_frame_buffer_callback(
+    callback_private_data: *mut c_void,
+    bitdepth: c_int,
+    image_format: Libgav1ImageFormat,
+    width: c_int,
+    height: c_int,
+    left_border: c_int,
+    right_border: c_int,
+    top_border: c_int,
+    bottom_border: c_int,
+    stride_alignment: c_int,
+    frame_buffer: *mut Libgav1FrameBuffer,
+) -> Libgav1StatusCode {
+    // The callback_private_data is Libgav1::frame_allocator.
+    let frame_allocator = unsafe { &*(callback_private_data as *const Arc<dyn FrameAllocator>) };
+    let yuv_format = match image_format {
+        Libgav1ImageFormat_kLibgav1ImageFormatMonochrome400 => PixelFormat::Yuv400,
+        Libgav1ImageFormat_kLibgav1ImageFormatYuv420 => PixelFormat::Yuv420,
+        Libgav1ImageFormat_kLibgav1ImageFormatYuv422 => PixelFormat::Yuv422,
+        Libgav1ImageFormat_kLibgav1ImageFormatYuv444 => PixelFormat::Yuv444,
+        _ => return Libgav1StatusCode_kLibgav1StatusInvalidArgument, // not reached.
+    };
+    // The buffer includes the borders, which are subsampled like the chroma planes.
+    let request = FrameBufferRequest {
+        width: (left_border + width + right_border) as u32,
+        height: (top_border + height + bottom_border) as u32,
+        depth: bitdepth as u8,
+        yuv_format,
+        alignment: stride_alignment.max(1) as usize,
+        padding: 0,
+    };
+    let Ok(buffer) = frame_allocator.allocate(&request) else {
+        return Libgav1StatusCode_kLibgav1StatusOutOfMemory;
+    };
+    if buffer.validate(&request).is_err() {
+        frame_allocator.release(buffer);
+        return Libgav1StatusCode_kLibgav1StatusOutOfMemory;
+    }
+    let frame_buffer = unsafe { &mut *frame_buffer };
+    for plane in 0..3 {
+        if plane >= request.plane_count() {
+            frame_buffer.plane[plane] = std::ptr::null_mut();
+            frame_buffer.stride[plane] = 0;
+            continue;
+        }
+        let (shift_x, shift_y) = if plane == 0 {
+            (0, 0)
+        } else {
+            (yuv_format.chroma_shift_x(), yuv_format.chroma_shift_y())
+        };
+        let row_bytes = buffer.row_bytes[plane] as usize;
+        let offset = (top_border as usize >> shift_y) * row_bytes
+            + (left_border as usize >> shift_x) * request.bytes_per_sample();
+        frame_buffer.plane[plane] = unsafe { buffer.planes[plane].add(offset) };
+        frame_buffer.stride[plane] = row_bytes as c_int;
+    }
+    let shared_buffer = SharedFrameBuffer {
+        buffer,
+        frame_allocator: frame_allocator.clone(),
+    };
+    frame_buffer.private_data = Arc::into_raw(Arc::new(shared_buffer)) as *mut c_void;
+    Libgav1StatusCode_kLibgav1StatusOk
+}
+
+unsafe extern "C" fn avif_libgav1_release_frame_buffer_callback(
+    _callback_private_data: *mut c_void,
+    buffer_private_data: *mut c_void,
+) {
+    drop(unsafe { Arc::from_raw(buffer_private_data as *const SharedFrameBuffer) });
 }
 
 #[allow(non_upper_case_globals)]
@@ -35,7 +140,7 @@ pub struct Libgav1 {
 // unnecessary cast warnings.
 #[allow(clippy::unnecessary_cast)]
 impl Decoder for Libgav1 {
-    fn initialize(&mut self, operating_point: u8, all_layers: bool) -> AvifResult<()> {
+    fn initialize(&mut self, config: &DecoderConfig) -> AvifResult<()> {
         if self.decoder.is_some() {
             return Ok(()); // Already initialized.
         }
@@ -44,9 +149,17 @@ impl Decoder for Libgav1 {
             Libgav1DecoderSettingsInitDefault(settings_uninit.as_mut_ptr());
         }
         let mut settings = unsafe { settings_uninit.assume_init() };
-        settings.threads = 8;
-        settings.operating_point = operating_point as i32;
-        settings.output_all_layers = if all_layers { 1 } else { 0 };
+        settings.threads = i32::try_from(config.max_threads.max(1)).unwrap_or(i32::MAX);
+        settings.operating_point = config.operating_point as i32;
+        settings.output_all_layers = if config.all_layers { 1 } else { 0 };
+        if let Some(frame_allocator) = &config.frame_allocator {
+            let callback_private_data = Box::new(frame_allocator.clone());
+            settings.get_frame_buffer = Some(avif_libgav1_get_frame_buffer_callback);
+            settings.release_frame_buffer = Some(avif_libgav1_release_frame_buffer_callback);
+            settings.callback_private_data =
+                (&*callback_private_data) as *const Arc<dyn FrameAllocator> as *mut c_void;
+            self.frame_allocator = Some(callback_private_data);
+        }
         unsafe {
             let mut dec = MaybeUninit::uninit();
             let ret = Libgav1DecoderCreate(&settings, dec.as_mut_ptr());
@@ -68,7 +181,13 @@ impl Decoder for Libgav1 {
         category: Category,
     ) -> AvifResult<()> {
         if self.decoder.is_none() {
-            self.initialize(0, true)?;
+            self.initialize(&DecoderConfig {
+                operating_point: 0,
+                all_layers: true,
+                max_threads: 1,
+                max_frame_delay: 1,
+                ..Default::default()
+            })?;
         }
         unsafe {
             let ret = Libgav1DecoderEnqueueFrame(
@@ -183,6 +302,40 @@ impl Decoder for Libgav1 {
         }
         Ok(())
     }
+
+    fn flush(&mut self) -> AvifResult<()> {
+        self.image = None;
+        if let Some(decoder) = self.decoder {
+            let ret = unsafe { Libgav1DecoderSignalEOS(decoder) };
+            if ret != Libgav1StatusCode_kLibgav1StatusOk {
+                return Err(AvifError::UnknownError(format!(
+                    "Libgav1DecoderSignalEOS returned {ret}"
+                )));
+            }
+        }
+        Ok(())
+    }
+
+    fn reference_frame(&self) -> AvifResult<Box<dyn FrameReference>> {
+        // The frame buffers of the internal allocator of libgav1 cannot outlive the next call to
+        // Libgav1DecoderDequeueFrame().
+        if self.frame_allocator.is_none() {
+            return Err(AvifError::NotImplemented);
+        }
+        let image = self.image.as_ref().ok_or(AvifError::NoContent)?;
+        let shared_buffer = image.buffer_private_data as *const SharedFrameBuffer;
+        if shared_buffer.is_null() {
+            return Err(AvifError::NoContent);
+        }
+        // The buffer_private_data is the one of avif_libgav1_get_frame_buffer_callback().
+        let shared_buffer = unsafe {
+            Arc::increment_strong_count(shared_buffer);
+            Arc::from_raw(shared_buffer)
+        };
+        Ok(Box::new(Libgav1FrameReference {
+            _shared_buffer: shared_buffer,
+        }))
+    }
 }
 
 impl Drop for Libgav1 {
@@ -21,12 +21,65 @@ pub mod libgav1;
 #[cfg(feature = "android_mediacodec")]
 pub mod android_mediacodec;
 
+use crate::decoder::frame_allocator::FrameAllocator;
+use crate::decoder::frame_handle::FrameReference;
 use crate::decoder::Category;
 use crate::image::Image;
+use crate::AvifError;
 use crate::AvifResult;
 
+use std::os::raw::c_void;
+use std::sync::Arc;
+
+#[derive(Clone, Debug, Default)]
+pub struct DecoderConfig {
+    pub operating_point: u8,
+    pub all_layers: bool,
+    // Maximum number of threads the codec instance may use. Always at least 1.
+    pub max_threads: u32,
+    // Maximum number of frames that the codec may keep in flight. Only codecs for which
+    // can_pipeline_frames() is true use values larger than 1.
+    pub max_frame_delay: u32,
+    // Maximum number of samples (width times height) of the frames that the codec decodes. 0
+    // means that there is no limit. Only dav1d supports it.
+    pub frame_size_limit: u32,
+    // If set, the codec decodes the frames into buffers allocated by this. Codecs that do not
+    // support it ignore it.
+    pub frame_allocator: Option<Arc<dyn FrameAllocator>>,
+    // If true, the codec renders the frames into hardware buffers instead of CPU-mapped buffers
+    // (see Decoder::hardware_buffer()). Only MediaCodec supports it (from Android API level 26).
+    pub hardware_buffer_output: bool,
+    // Dimensions of the frames that the codec decodes, or 0 if they are not known. Only MediaCodec
+    // uses them, to size its buffers.
+    pub width: u32,
+    pub height: u32,
+}
+
+impl DecoderConfig {
+    // Returns true if a codec instance initialized with this configuration behaves as if it was
+    // initialized with |other|.
+    pub(crate) fn matches(&self, other: &DecoderConfig) -> bool {
+        self.operating_point == other.operating_point
+            && self.all_layers == other.all_layers
+            && self.max_threads == other.max_threads
+            && self.max_frame_delay == other.max_frame_delay
+            && self.frame_size_limit == other.frame_size_limit
+            && self.hardware_buffer_output == other.hardware_buffer_output
+            // The hardware buffers are allocated with the dimensions of the frames.
+            && (!self.hardware_buffer_output
+                || (self.width == other.width && self.height == other.height))
+            && match (&self.frame_allocator, &other.frame_allocator) {
+                (Some(a), Some(b)) => {
+                    std::ptr::eq(Arc::as_ptr(a) as *const u8, Arc::as_ptr(b) as *const u8)
+                }
+                (None, None) => true,
+                _ => false,
+            }
+    }
+}
+
 pub trait Decoder {
-    fn initialize(&mut self, operating_point: u8, all_layers: bool) -> AvifResult<()>;
+    fn initialize(&mut self, config: &DecoderConfig) -> AvifResult<()>;
     fn get_next_image(
         &mut self,
         av1_payload: &[u8],
@@ -34,5 +87,46 @@ pub trait Decoder {
         image: &mut Image,
         category: Category,
     ) -> AvifResult<()>;
+    // True if the codec implements send_sample() and receive_frame(). Only meaningful after
+    // initialize() was called with a max_frame_delay larger than 1.
+    fn can_pipeline_frames(&self) -> bool {
+        false
+    }
+    // Queues a sample without waiting for it to be decoded. The payload is copied. The frames of
+    // the queued samples are output in order by receive_frame(). Only one sample may be queued
+    // per |sample_index|, in increasing order.
+    fn send_sample(&mut self, _av1_payload: &[u8], _sample_index: u64) -> AvifResult<()> {
+        Err(AvifError::NotImplemented)
+    }
+    // Outputs the frame of the queued sample |sample_index| into |image|. The frames of the
+    // earlier samples that were not received are dropped.
+    fn receive_frame(
+        &mut self,
+        _sample_index: u64,
+        _spatial_id: u8,
+        _image: &mut Image,
+        _category: Category,
+    ) -> AvifResult<()> {
+        Err(AvifError::NotImplemented)
+    }
+    // Drops the frames and the samples in flight so that the instance can decode an unrelated
+    // stream (with the same configuration) as if it was just initialized. The images that point
+    // into the buffers of the codec become invalid. Instances of codecs that do not implement
+    // this are not reused.
+    fn flush(&mut self) -> AvifResult<()> {
+        Err(AvifError::NotImplemented)
+    }
+    // Returns a reference on the frame buffer that the planes of the last output image point
+    // into. The planes of that image stay valid for as long as the reference is kept.
+    fn reference_frame(&self) -> AvifResult<Box<dyn FrameReference>> {
+        Err(AvifError::NotImplemented)
+    }
+    // Returns the AHardwareBuffer that holds the pixels of the last output image if the instance
+    // renders into hardware buffers. In that case, the image has no planes for its category. The
+    // buffer belongs to the instance and stays valid until the next frame is output or the
+    // instance is flushed or destroyed.
+    fn hardware_buffer(&self) -> Option<*mut c_void> {
+        None
+    }
     // Destruction must be implemented using Drop.
 }
@@ -0,0 +1,184 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use crate::*;
+
+use std::ffi::c_void;
+
+// The buffer that a codec needs for one decoded frame. The luma plane is |width| by |height|
+// samples and the chroma planes (if any, see PixelFormat::plane_count()) are subsampled according
+// to |yuv_format|, rounding up. The dimensions include the borders that the codec needs around the
+// frame, so they are usually larger than the dimensions of the image.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct FrameBufferRequest {
+    pub width: u32,
+    pub height: u32,
+    pub depth: u8,
+    pub yuv_format: PixelFormat,
+    // The planes and their row_bytes must be multiples of this power of two.
+    pub alignment: usize,
+    // Number of bytes that must be addressable past the last row of each plane.
+    pub padding: usize,
+}
+
+impl FrameBufferRequest {
+    pub fn plane_count(&self) -> usize {
+        self.yuv_format.plane_count()
+    }
+
+    pub fn bytes_per_sample(&self) -> usize {
+        if self.depth > 8 {
+            2
+        } else {
+            1
+        }
+    }
+
+    pub fn plane_width(&self, plane: usize) -> u32 {
+        if plane == 0 {
+            self.width
+        } else {
+            let shift_x = self.yuv_format.chroma_shift_x();
+            (self.width + (1 << shift_x) - 1) >> shift_x
+        }
+    }
+
+    pub fn plane_height(&self, plane: usize) -> u32 {
+        if plane == 0 {
+            self.height
+        } else {
+            let shift_y = self.yuv_format.chroma_shift_y();
+            (self.height + (1 << shift_y) - 1) >> shift_y
+        }
+    }
+
+    // The smallest row_bytes of |plane| that is a multiple of the alignment.
+    pub fn min_row_bytes(&self, plane: usize) -> usize {
+        let row_bytes = self.plane_width(plane) as usize * self.bytes_per_sample();
+        let alignment = self.alignment.max(1);
+        row_bytes.div_ceil(alignment) * alignment
+    }
+
+    // The smallest size of |plane| that fits |row_bytes| bytes per row and the padding.
+    pub fn min_plane_size(&self, plane: usize, row_bytes: usize) -> usize {
+        row_bytes * self.plane_height(plane) as usize + self.padding
+    }
+}
+
+#[derive(Clone, Copy, Debug)]
+pub struct FrameBuffer {
+    // Only the first FrameBufferRequest::plane_count() planes are used. Each plane must be at
+    // least FrameBufferRequest::min_plane_size() bytes for its row_bytes.
+    pub planes: [*mut u8; 3],
+    pub row_bytes: [u32; 3],
+    // Not used by the decoder. Passed back to FrameAllocator::release().
+    pub user_data: *mut c_void,
+}
+
+impl FrameBuffer {
+    // Returns an error if the planes or row_bytes that are used do not meet the alignment and
+    // size constraints of |request|.
+    pub fn validate(&self, request: &FrameBufferRequest) -> AvifResult<()> {
+        let alignment = request.alignment.max(1);
+        for plane in 0..request.plane_count() {
+            let row_bytes = self.row_bytes[plane] as usize;
+            if self.planes[plane].is_null()
+                || (self.planes[plane] as usize) % alignment != 0
+                || row_bytes < request.min_row_bytes(plane)
+                || row_bytes % alignment != 0
+            {
+                return Err(AvifError::UnknownError(format!(
+                    "invalid frame buffer for plane {plane}"
+                )));
+            }
+        }
+        Ok(())
+    }
+}
+
+// Allocates the buffers into which the codecs (dav1d and libgav1) decode the frames, instead of
+// their internal allocators. The planes of the decoded images then point directly into these
+// buffers (see Image::image_owns_planes). The methods may be called concurrently from the threads
+// of the codecs. Each allocated buffer is released once the codec does not use it anymore (at the
+// latest when the codec instance is destroyed), which is not before the next call to
+// Decoder::next_image() or Decoder::nth_image() if it backs the planes of an output image.
+pub trait FrameAllocator: Send + Sync {
+    fn allocate(&self, request: &FrameBufferRequest) -> AvifResult<FrameBuffer>;
+    fn release(&self, buffer: FrameBuffer);
+}
+
+impl std::fmt::Debug for dyn FrameAllocator {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str("FrameAllocator")
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn request(yuv_format: PixelFormat) -> FrameBufferRequest {
+        FrameBufferRequest {
+            width: 33,
+            height: 17,
+            depth: 10,
+            yuv_format,
+            alignment: 32,
+            padding: 16,
+        }
+    }
+
+    #[test]
+    fn plane_dimensions() {
+        let request = request(PixelFormat::Yuv420);
+        assert_eq!(request.plane_count(), 3);
+        assert_eq!((request.plane_width(0), request.plane_height(0)), (33, 17));
+        assert_eq!((request.plane_width(1), request.plane_height(1)), (17, 9));
+        assert_eq!(request.min_row_bytes(0), 96);
+        assert_eq!(request.min_row_bytes(2), 64);
+        assert_eq!(request.min_plane_size(1, 64), 64 * 9 + 16);
+        let request = FrameBufferRequest {
+            depth: 8,
+            ..self::request(PixelFormat::Yuv422)
+        };
+        assert_eq!((request.plane_width(1), request.plane_height(1)), (17, 17));
+        assert_eq!(request.min_row_bytes(1), 32);
+        assert_eq!(self::request(PixelFormat::Yuv400).plane_count(), 1);
+    }
+
+    #[test]
+    fn validate() {
+        let request = request(PixelFormat::Yuv420);
+        let mut storage = vec![0u64; 1024];
+        let base = storage.as_mut_ptr() as *mut u8;
+        let base = unsafe { base.add(base.align_offset(32)) };
+        let mut buffer = FrameBuffer {
+            planes: [base, unsafe { base.add(2048) }, unsafe { base.add(4096) }],
+            row_bytes: [96, 64, 64],
+            user_data: std::ptr::null_mut(),
+        };
+        assert!(buffer.validate(&request).is_ok());
+        buffer.row_bytes[1] = 32;
+        assert!(buffer.validate(&request).is_err());
+        buffer.row_bytes[1] = 80;
+        assert!(buffer.validate(&request).is_err());
+        buffer.row_bytes[1] = 64;
+        buffer.planes[2] = unsafe { base.add(1) };
+        assert!(buffer.validate(&request).is_err());
+        buffer.planes[2] = std::ptr::null_mut();
+        assert!(buffer.validate(&request).is_err());
+        // The chroma planes are not used for monochrome frames.
+        assert!(buffer.validate(&self::request(PixelFormat::Yuv400)).is_ok());
+    }
+}
@@ -0,0 +1,285 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use crate::image::*;
+use crate::internal_utils::pixels::*;
+use crate::internal_utils::*;
+use crate::utils::buffer_pool::BufferPool;
+use crate::*;
+
+/// cbindgen:field-names=[hits,misses,frameCount,size]
+#[repr(C)]
+#[derive(Clone, Copy, Debug, Default)]
+pub struct FrameCacheStats {
+    // Number of frames that were returned from the cache and number of frames that had to be
+    // decoded while the cache was enabled.
+    pub hits: u64,
+    pub misses: u64,
+    // Number of frames currently in the cache and total size in bytes of their planes.
+    pub frame_count: u32,
+    pub size: usize,
+}
+
+#[derive(Default)]
+struct CachedFrame {
+    index: u32,
+    keyframe: bool,
+    // Value of FrameCache::use_count when the frame was last inserted or returned.
+    last_use: u64,
+    image: Image,
+    size: usize,
+}
+
+// A bounded cache of decoded frames, keyed by image index. When one of the limits is exceeded,
+// the least recently used frame that is not a keyframe is evicted first. Keyframes are only
+// evicted when no other frame is left. The plane buffers are taken from and given back to a
+// BufferPool.
+#[derive(Default)]
+pub struct FrameCache {
+    // A limit of 0 means that there is no limit of that kind. The cache is disabled if both are 0.
+    size_limit: usize,
+    frame_limit: u32,
+    frames: Vec<CachedFrame>,
+    use_count: u64,
+    stats: FrameCacheStats,
+}
+
+impl FrameCache {
+    pub fn enabled(&self) -> bool {
+        self.size_limit != 0 || self.frame_limit != 0
+    }
+
+    pub fn stats(&self) -> FrameCacheStats {
+        self.stats
+    }
+
+    // Applies new limits, evicting frames if needed.
+    pub fn set_limits(&mut self, size_limit: usize, frame_limit: u32, pool: &mut BufferPool) {
+        self.size_limit = size_limit;
+        self.frame_limit = frame_limit;
+        if !self.enabled() {
+            self.clear(pool);
+            return;
+        }
+        while self.exceeds_limits(0, 0) {
+            self.evict(pool);
+        }
+    }
+
+    pub fn clear(&mut self, pool: &mut BufferPool) {
+        for mut frame in self.frames.drain(..) {
+            frame.image.release_planes_to_pool(pool);
+        }
+        self.stats.frame_count = 0;
+        self.stats.size = 0;
+    }
+
+    // Copies the planes of the cached frame |index| into |image| and returns true. Returns false
+    // (a miss) if the frame is not in the cache.
+    pub fn get(
+        &mut self,
+        index: u32,
+        image: &mut Image,
+        pool: &mut BufferPool,
+    ) -> AvifResult<bool> {
+        match self.frames.iter_mut().find(|frame| frame.index == index) {
+            Some(frame) => {
+                copy_planes(image, &frame.image, pool)?;
+                self.use_count += 1;
+                frame.last_use = self.use_count;
+                self.stats.hits += 1;
+                Ok(true)
+            }
+            None => {
+                self.stats.misses += 1;
+                Ok(false)
+            }
+        }
+    }
+
+    // Stores a copy of the planes of |image| as the frame |index|. Frames larger than the size
+    // limit are not stored.
+    pub fn insert(
+        &mut self,
+        index: u32,
+        keyframe: bool,
+        image: &Image,
+        pool: &mut BufferPool,
+    ) -> AvifResult<()> {
+        if self.frames.iter().any(|frame| frame.index == index) {
+            return Ok(());
+        }
+        let mut size: usize = 0;
+        for plane in ALL_PLANES {
+            if image.has_plane(plane) {
+                let pixel_size = if image.depth == 8 { 1 } else { 2 };
+                checked_incr!(
+                    size,
+                    checked_mul!(image.width(plane) * pixel_size, image.height(plane))?
+                );
+            }
+        }
+        if self.size_limit != 0 && size > self.size_limit {
+            return Ok(());
+        }
+        while self.exceeds_limits(1, size) {
+            self.evict(pool);
+        }
+        let mut frame = CachedFrame {
+            index,
+            keyframe,
+            size,
+            ..Default::default()
+        };
+        copy_planes(&mut frame.image, image, pool)?;
+        self.use_count += 1;
+        frame.last_use = self.use_count;
+        self.frames.push(frame);
+        self.stats.frame_count += 1;
+        self.stats.size += size;
+        Ok(())
+    }
+
+    // Returns true if adding |additional_frames| frames of |additional_size| bytes in total would
+    // exceed one of the limits.
+    fn exceeds_limits(&self, additional_frames: u32, additional_size: usize) -> bool {
+        if self.frames.is_empty() {
+            return false;
+        }
+        (self.frame_limit != 0 && self.stats.frame_count + additional_frames > self.frame_limit)
+            || (self.size_limit != 0 && self.stats.size + additional_size > self.size_limit)
+    }
+
+    fn evict(&mut self, pool: &mut BufferPool) {
+        let victim = self
+            .frames
+            .iter()
+            .enumerate()
+            .min_by_key(|(_, frame)| (frame.keyframe, frame.last_use))
+            .map(|(index, _)| index);
+        if let Some(victim) = victim {
+            let mut frame = self.frames.swap_remove(victim);
+            frame.image.release_planes_to_pool(pool);
+            self.stats.frame_count -= 1;
+            self.stats.size -= frame.size;
+        }
+    }
+}
+
+// Replaces the planes of |dst| by owned copies of the planes of |src| (and copies the
+// properties that may change from one frame to the next).
+fn copy_planes(dst: &mut Image, src: &Image, pool: &mut BufferPool) -> AvifResult<()> {
+    // Planes that are not owned (for example that point into the buffers of a codec) are dropped
+    // instead of being written to.
+    dst.release_planes_to_pool(pool);
+    dst.width = src.width;
+    dst.height = src.height;
+    dst.depth = src.depth;
+    dst.yuv_format = src.yuv_format;
+    dst.yuv_range = src.yuv_range;
+    dst.chroma_sample_position = src.chroma_sample_position;
+    dst.color_primaries = src.color_primaries;
+    dst.transfer_characteristics = src.transfer_characteristics;
+    dst.matrix_coefficients = src.matrix_coefficients;
+    for plane in ALL_PLANES {
+        if !src.has_plane(plane) {
+            continue;
+        }
+        let width = src.width(plane);
+        let height = src.height(plane) as u32;
+        let plane_size = checked_mul!(width, height as usize)?;
+        let pixels = if src.depth == 8 {
+            let mut buffer = pool.take(plane_size)?;
+            for y in 0..height {
+                buffer.extend_from_slice(&src.row(plane, y)?[..width]);
+            }
+            Pixels::Buffer(buffer)
+        } else {
+            let mut buffer = pool.take16(plane_size)?;
+            for y in 0..height {
+                buffer.extend_from_slice(&src.row16(plane, y)?[..width]);
+            }
+            Pixels::Buffer16(buffer)
+        };
+        let plane_index = plane.to_usize();
+        let pixel_size = if src.depth == 8 { 1 } else { 2 };
+        dst.planes[plane_index] = Some(pixels);
+        dst.row_bytes[plane_index] = u32_from_usize(checked_mul!(width, pixel_size)?)?;
+        dst.image_owns_planes[plane_index] = true;
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn create_frame(value: u8) -> AvifResult<Image> {
+        let mut image = Image {
+            width: 4,
+            height: 2,
+            depth: 8,
+            yuv_format: PixelFormat::Yuv420,
+            ..Default::default()
+        };
+        image.allocate_planes(decoder::Category::Color)?;
+        for plane in YUV_PLANES {
+            for y in 0..image.height(plane) as u32 {
+                image.row_mut(plane, y)?.fill(value);
+            }
+        }
+        Ok(image)
+    }
+
+    #[test]
+    fn eviction() -> AvifResult<()> {
+        let mut pool = BufferPool::default();
+        let mut cache = FrameCache::default();
+        assert!(!cache.enabled());
+        cache.set_limits(0, 3, &mut pool);
+        assert!(cache.enabled());
+        let frame_size = 4 * 2 + 2 * 2 * 1;
+        for index in 0..3 {
+            cache.insert(index, index == 0, &create_frame(index as u8)?, &mut pool)?;
+        }
+        assert_eq!(cache.stats().frame_count, 3);
+        assert_eq!(cache.stats().size, 3 * frame_size);
+
+        let mut image = Image::default();
+        // Frame 1 becomes more recently used than frame 2.
+        assert!(cache.get(1, &mut image, &mut pool)?);
+        assert_eq!(image.row(Plane::V, 0)?, &[1, 1]);
+        // Frame 2 (the least recently used frame that is not a keyframe) is evicted.
+        cache.insert(3, false, &create_frame(3)?, &mut pool)?;
+        assert!(!cache.get(2, &mut image, &mut pool)?);
+        assert!(cache.get(3, &mut image, &mut pool)?);
+        cache.insert(4, false, &create_frame(4)?, &mut pool)?;
+        // The keyframe is still there even though it is the least recently used frame.
+        assert!(cache.get(0, &mut image, &mut pool)?);
+        assert_eq!(image.row(Plane::Y, 1)?, &[0, 0, 0, 0]);
+        assert!(!cache.get(1, &mut image, &mut pool)?);
+        assert_eq!(cache.stats().hits, 3);
+        assert_eq!(cache.stats().misses, 2);
+
+        // Only one frame fits.
+        cache.set_limits(frame_size, 0, &mut pool);
+        assert_eq!(cache.stats().frame_count, 1);
+        assert!(cache.get(0, &mut image, &mut pool)?);
+        cache.set_limits(0, 0, &mut pool);
+        assert!(!cache.enabled());
+        assert_eq!(cache.stats().frame_count, 0);
+        assert_eq!(cache.stats().size, 0);
+        Ok(())
+    }
+}
@@ -0,0 +1,60 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use crate::image::Image;
+
+// A reference on a frame buffer of a codec (see codecs::Decoder::reference_frame()). The buffer
+// stays valid until the reference is dropped, even if the codec instance decoded other frames
+// or was destroyed in the meantime.
+pub trait FrameReference: Send {}
+
+// A decoded image that stays valid across the later calls to Decoder::next_image() and
+// Decoder::nth_image(), and after the Decoder is dropped (see Decoder::frame_handle()). The planes
+// that point into the frame buffers of the codecs are kept alive by references on these buffers
+// instead of being copied.
+#[derive(Default)]
+pub struct FrameHandle {
+    image: Image,
+    // The buffers that the planes of image point into, if any.
+    references: Vec<Box<dyn FrameReference>>,
+    copied_size: usize,
+}
+
+impl FrameHandle {
+    pub(crate) fn create(
+        image: Image,
+        references: Vec<Box<dyn FrameReference>>,
+        copied_size: usize,
+    ) -> Self {
+        Self {
+            image,
+            references,
+            copied_size,
+        }
+    }
+
+    pub fn image(&self) -> &Image {
+        &self.image
+    }
+
+    // Number of frame buffers of the codecs that are kept alive by this handle.
+    pub fn reference_count(&self) -> usize {
+        self.references.len()
+    }
+
+    // Number of bytes of the planes that could not be referenced and were copied instead.
+    pub fn copied_size(&self) -> usize {
+        self.copied_size
+    }
+}
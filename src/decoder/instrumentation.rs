@@ -0,0 +1,174 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use crate::decoder::CodecChoice;
+use crate::internal_utils::io::ReadStats;
+
+use std::cell::Cell;
+use std::rc::Rc;
+use std::time::Duration;
+use std::time::Instant;
+
+// The stages of the decoding that are measured when Settings::enable_decode_stats is true or
+// when a trace callback is set.
+#[repr(C)]
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum DecodeStage {
+    // Reads of the IO. These are also part of the time of the Parse stage when they are made by
+    // parse(). They are not reported to the trace callback.
+    Io = 0,
+    // Parsing of the boxes by parse().
+    Parse = 1,
+    // Decoding of the AV1 payloads by the codecs.
+    Codec = 2,
+    // Scaling of the decoded tiles to the dimensions of their item (Image::scale()).
+    Scale = 3,
+    // Copy of the decoded tiles into the planes of the output images.
+    TileCopy = 4,
+}
+
+impl DecodeStage {
+    pub const COUNT: usize = 5;
+
+    pub fn usize(self) -> usize {
+        self as usize
+    }
+}
+
+// Measurements accumulated since the last call to Decoder::parse().
+#[derive(Clone, Copy, Debug, Default)]
+pub struct DecodeStats {
+    // Wall time spent in each stage, indexed by DecodeStage::usize(). The time of the tiles that
+    // are decoded in parallel (see Settings::grid_tile_threads) is summed over the threads.
+    pub stage_durations: [Duration; DecodeStage::COUNT],
+    // Number of calls to IO::read() and number of bytes they returned.
+    pub read_count: u64,
+    pub read_size: u64,
+    // Number of tiles decoded by the codecs.
+    pub tile_count: u64,
+    // Number of bytes copied from the decoded tiles into the output images (by
+    // Image::copy_from_tile() and Image::steal_or_copy_from()).
+    pub copied_size: u64,
+    // The codec of the last codec instance that was created, if any.
+    pub codec: Option<CodecChoice>,
+}
+
+// Memory used by the buffers of a decoder (see Settings::memory_limit).
+/// cbindgen:field-names=[currentSize,peakSize]
+#[repr(C)]
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct MemoryStats {
+    // Total size in bytes of the buffers currently owned by the decoder: the planes of the output
+    // images and of the tiles that had to be converted or scaled, the merged item extents, the
+    // frame cache and the buffer pool. The buffers allocated by the codecs are not included.
+    pub current_size: usize,
+    // The largest total size since the last call to Decoder::parse(), including the buffers that
+    // were about to be allocated each time the memory limit was checked. It is only tracked if
+    // Settings::memory_limit is set or Settings::enable_decode_stats was true when parse() was
+    // called; otherwise it is the current size.
+    pub peak_size: usize,
+}
+
+#[derive(Clone, Copy, Debug)]
+pub struct TraceSpan {
+    pub stage: DecodeStage,
+    pub start: Instant,
+    pub duration: Duration,
+}
+
+// Called on the thread of the Decoder once a stage is done, possibly some time after the end of
+// the span (when the stage ran on a tile decoding thread).
+pub type TraceCallback = Box<dyn FnMut(&TraceSpan)>;
+
+// Runs |f| and returns its result along with its span if |timed| is true.
+pub(crate) fn timed<T>(
+    stage: DecodeStage,
+    timed: bool,
+    f: impl FnOnce() -> T,
+) -> (T, Option<TraceSpan>) {
+    if !timed {
+        return (f(), None);
+    }
+    let start = Instant::now();
+    let result = f();
+    let span = TraceSpan {
+        stage,
+        start,
+        duration: start.elapsed(),
+    };
+    (result, Some(span))
+}
+
+#[derive(Default)]
+pub(crate) struct Instrumentation {
+    pub enabled: bool,
+    stats: DecodeStats,
+    // Set if the IO was wrapped into a DecoderCountingIO.
+    pub read_stats: Option<Rc<Cell<ReadStats>>>,
+    pub trace_callback: Option<TraceCallback>,
+}
+
+impl Instrumentation {
+    pub fn timed(&self) -> bool {
+        self.enabled || self.trace_callback.is_some()
+    }
+
+    pub fn reset(&mut self) {
+        self.stats = DecodeStats::default();
+        if let Some(read_stats) = &self.read_stats {
+            read_stats.set(ReadStats::default());
+        }
+    }
+
+    pub fn report(&mut self, span: Option<TraceSpan>) {
+        let Some(span) = span else {
+            return;
+        };
+        if self.enabled {
+            self.stats.stage_durations[span.stage.usize()] += span.duration;
+        }
+        if let Some(trace_callback) = &mut self.trace_callback {
+            trace_callback(&span);
+        }
+    }
+
+    pub fn add_tile(&mut self) {
+        if self.enabled {
+            self.stats.tile_count += 1;
+        }
+    }
+
+    pub fn add_copied_size(&mut self, copied_size: usize) {
+        if self.enabled {
+            self.stats.copied_size += copied_size as u64;
+        }
+    }
+
+    pub fn set_codec(&mut self, codec: CodecChoice) {
+        if self.enabled {
+            self.stats.codec = Some(codec);
+        }
+    }
+
+    pub fn stats(&self) -> DecodeStats {
+        let mut stats = self.stats;
+        if let Some(read_stats) = &self.read_stats {
+            let read_stats = read_stats.get();
+            stats.read_count = read_stats.count;
+            stats.read_size = read_stats.size;
+            stats.stage_durations[DecodeStage::Io.usize()] = read_stats.duration;
+        }
+        stats
+    }
+}
@@ -142,7 +142,17 @@ impl Item {
         if self.should_skip() {
             return Ok(());
         }
+        self.harvest_ispe_unchecked(alpha_ispe_required, size_limit, dimension_limit)
+    }
 
+    // Same as harvest_ispe() but also harvests the ispe of items that are skipped by default
+    // (such as thumbnails).
+    pub fn harvest_ispe_unchecked(
+        &mut self,
+        alpha_ispe_required: bool,
+        size_limit: u32,
+        dimension_limit: u32,
+    ) -> AvifResult<()> {
         match find_property!(self.properties, ImageSpatialExtents) {
             Some(image_spatial_extents) => {
                 self.width = image_spatial_extents.width;
@@ -223,6 +233,10 @@ impl Item {
         find_property!(self.properties, CodecConfiguration)
     }
 
+    pub fn ispe(&self) -> Option<&ImageSpatialExtents> {
+        find_property!(self.properties, ImageSpatialExtents)
+    }
+
     pub fn pixi(&self) -> Option<&PixelInformation> {
         find_property!(self.properties, PixelInformation)
     }
@@ -246,6 +260,13 @@ impl Item {
     }
 
     pub fn should_skip(&self) -> bool {
+        self.should_skip_ignoring_thumbnail()
+            // Thumbnails are only used with Source::Thumbnail.
+            || self.thumbnail_for_id != 0
+    }
+
+    // Same as should_skip() but thumbnail items are not skipped.
+    pub fn should_skip_ignoring_thumbnail(&self) -> bool {
         // The item has no payload in idat or mdat. It cannot be a coded image item, a
         // non-identity derived image item, or Exif/XMP metadata.
         self.size == 0
@@ -253,8 +274,6 @@ impl Item {
             || self.has_unsupported_essential_property
             // Probably Exif/XMP or some other data.
             || (self.item_type != "av01" && self.item_type != "grid")
-            // libavif does not support thumbnails.
-            || self.thumbnail_for_id != 0
     }
 
     fn is_metadata(&self, item_type: &str, color_id: Option<u32>) -> bool {
@@ -280,51 +299,62 @@ impl Item {
         if !self.idat.is_empty() {
             return Ok(Extent::default());
         }
+        let mut extent = Extent::default();
+        for sample_extent in self.sample_extents(sample)? {
+            extent.merge(&sample_extent)?;
+        }
+        Ok(extent)
+    }
+
+    // Returns the parts of the extents of this item that contain |sample|, in order. Returns an
+    // empty list if the item is stored in the idat box (which is read along with the meta box).
+    pub fn sample_extents(&self, sample: &DecodeSample) -> AvifResult<Vec<Extent>> {
+        if !self.idat.is_empty() {
+            return Ok(Vec::new());
+        }
         if sample.size == 0 {
             return Err(AvifError::TruncatedData);
         }
         let mut remaining_offset = sample.offset;
-        let mut min_offset = u64::MAX;
-        let mut max_offset = 0;
         if self.extents.is_empty() {
             return Err(AvifError::TruncatedData);
         } else if self.extents.len() == 1 {
-            min_offset = sample.offset;
-            max_offset = checked_add!(sample.offset, u64_from_usize(sample.size)?)?;
-        } else {
-            let mut remaining_size = sample.size;
-            for extent in &self.extents {
-                let mut start_offset = extent.offset;
-                let mut size = extent.size;
-                let sizeu64 = u64_from_usize(size)?;
-                if remaining_offset != 0 {
-                    if remaining_offset >= sizeu64 {
-                        remaining_offset -= sizeu64;
-                        continue;
-                    } else {
-                        checked_incr!(start_offset, remaining_offset);
-                        checked_decr!(size, usize_from_u64(remaining_offset)?);
-                        remaining_offset = 0;
-                    }
-                }
-                // TODO(yguyon): Add comment to explain why it is fine to clip the extent size.
-                let used_extent_size = std::cmp::min(size, remaining_size);
-                let end_offset = checked_add!(start_offset, u64_from_usize(used_extent_size)?)?;
-                min_offset = std::cmp::min(min_offset, start_offset);
-                max_offset = std::cmp::max(max_offset, end_offset);
-                remaining_size -= used_extent_size;
-                if remaining_size == 0 {
-                    break;
+            return Ok(vec![Extent {
+                offset: sample.offset,
+                size: sample.size,
+            }]);
+        }
+        let mut sample_extents: Vec<Extent> = Vec::new();
+        let mut remaining_size = sample.size;
+        for extent in &self.extents {
+            let mut start_offset = extent.offset;
+            let mut size = extent.size;
+            let sizeu64 = u64_from_usize(size)?;
+            if remaining_offset != 0 {
+                if remaining_offset >= sizeu64 {
+                    remaining_offset -= sizeu64;
+                    continue;
+                } else {
+                    checked_incr!(start_offset, remaining_offset);
+                    checked_decr!(size, usize_from_u64(remaining_offset)?);
+                    remaining_offset = 0;
                 }
             }
-            if remaining_size != 0 {
-                return Err(AvifError::TruncatedData);
+            // TODO(yguyon): Add comment to explain why it is fine to clip the extent size.
+            let used_extent_size = std::cmp::min(size, remaining_size);
+            sample_extents.push(Extent {
+                offset: start_offset,
+                size: used_extent_size,
+            });
+            remaining_size -= used_extent_size;
+            if remaining_size == 0 {
+                break;
             }
         }
-        Ok(Extent {
-            offset: min_offset,
-            size: usize_from_u64(checked_sub!(max_offset, min_offset)?)?,
-        })
+        if remaining_size != 0 {
+            return Err(AvifError::TruncatedData);
+        }
+        Ok(sample_extents)
     }
 }
 
@@ -12,15 +12,31 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+pub mod frame_allocator;
+pub mod frame_cache;
+pub mod frame_handle;
 pub mod gainmap;
+pub mod instrumentation;
 pub mod item;
+pub mod probe;
+pub mod shared_parse;
+pub mod thread_budget;
 pub mod tile;
 pub mod track;
+mod worker_pool;
 
+use crate::decoder::frame_allocator::*;
+use crate::decoder::frame_cache::*;
+use crate::decoder::frame_handle::*;
 use crate::decoder::gainmap::*;
+use crate::decoder::instrumentation::*;
 use crate::decoder::item::*;
+use crate::decoder::probe::*;
+use crate::decoder::shared_parse::*;
+use crate::decoder::thread_budget::*;
 use crate::decoder::tile::*;
 use crate::decoder::track::*;
+use crate::decoder::worker_pool::*;
 
 #[cfg(feature = "dav1d")]
 use crate::codecs::dav1d::Dav1d;
@@ -31,6 +47,8 @@ use crate::codecs::libgav1::Libgav1;
 #[cfg(feature = "android_mediacodec")]
 use crate::codecs::android_mediacodec::MediaCodec;
 
+use crate::codecs::DecoderConfig;
+
 use crate::image::*;
 use crate::internal_utils::io::*;
 use crate::internal_utils::*;
@@ -38,10 +56,19 @@ use crate::parser::exif;
 use crate::parser::mp4box;
 use crate::parser::mp4box::*;
 use crate::parser::obu::Av1SequenceHeader;
+use crate::reformat::rgb;
+use crate::utils::buffer_pool::BufferPool;
+use crate::utils::clap::CropRect;
 use crate::*;
 
+use std::cell::Cell;
 use std::cmp::max;
 use std::cmp::min;
+use std::ops::Range;
+use std::os::raw::c_void;
+use std::rc::Rc;
+use std::sync::mpsc;
+use std::sync::Arc;
 
 pub trait IO {
     fn read(&mut self, offset: u64, max_read_size: usize) -> AvifResult<&[u8]>;
@@ -64,7 +91,7 @@ impl dyn IO {
 pub type GenericIO = Box<dyn IO>;
 pub type Codec = Box<dyn crate::codecs::Decoder>;
 
-#[derive(Debug, Default)]
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
 pub enum CodecChoice {
     #[default]
     Auto,
@@ -74,7 +101,8 @@ pub enum CodecChoice {
 }
 
 impl CodecChoice {
-    fn get_codec(&self) -> AvifResult<Codec> {
+    // Returns a codec instance along with the codec that was chosen (never Auto).
+    fn get_codec(&self) -> AvifResult<(Codec, CodecChoice)> {
         match self {
             CodecChoice::Auto => {
                 // Preferred order of codecs in Auto mode: Android MediaCodec, Dav1d, Libgav1.
@@ -85,19 +113,19 @@ impl CodecChoice {
             CodecChoice::Dav1d => {
                 #[cfg(feature = "dav1d")]
                 {
-                    return Ok(Box::<Dav1d>::default());
+                    return Ok((Box::<Dav1d>::default(), *self));
                 }
             }
             CodecChoice::Libgav1 => {
                 #[cfg(feature = "libgav1")]
                 {
-                    return Ok(Box::<Libgav1>::default());
+                    return Ok((Box::<Libgav1>::default(), *self));
                 }
             }
             CodecChoice::MediaCodec => {
                 #[cfg(feature = "android_mediacodec")]
                 {
-                    return Ok(Box::<MediaCodec>::default());
+                    return Ok((Box::<MediaCodec>::default(), *self));
                 }
             }
         }
@@ -112,7 +140,9 @@ pub enum Source {
     Auto = 0,
     PrimaryItem = 1,
     Tracks = 2,
-    // TODO: Thumbnail,
+    // The thumbnail item ('thmb' reference) of the primary item. Only that item (and its alpha
+    // auxiliary item, if any) is decoded.
+    Thumbnail = 3,
 }
 
 pub const DEFAULT_IMAGE_SIZE_LIMIT: u32 = 16384 * 16384;
@@ -133,6 +163,88 @@ pub struct Settings {
     pub image_size_limit: u32,
     pub image_dimension_limit: u32,
     pub image_count_limit: u32,
+    // Number of codec instances (and threads) used to decode the tiles of a grid image in
+    // parallel. A value of 1 decodes all the tiles serially on the calling thread.
+    pub grid_tile_threads: u32,
+    // Maximum number of threads used by the codec instances of the decoder. When
+    // grid_tile_threads is larger than 1, this is split between the codec instances that decode
+    // the grid tiles in parallel.
+    pub max_threads: u32,
+    // If set, max_threads is split between all the codec instances of the decoder and the threads
+    // that decode the grid tiles in parallel (which count as one thread each). Each of them
+    // reserves its share from this budget (which may be shared with other decoders) when it is
+    // created and gives it back when it is destroyed. The codec instances are destroyed once the
+    // last image is fully decoded (unless tiled_output is set, since the tile views point into
+    // their buffers), so that a decoder that is done does not hold any thread except the ones of
+    // the instances kept for reuse (see max_idle_codecs). Fewer threads may be used than
+    // requested if the budget is exhausted.
+    pub thread_budget: Option<Arc<ThreadBudget>>,
+    // If true, the tiles of grid images are not stitched into the planes of the output image.
+    // They are available through tile_views() instead and point directly into the buffers of the
+    // codec instances (one instance is used per tile). The output image only has the properties
+    // (dimensions, depth, format) of the grid and no planes for those categories.
+    pub tiled_output: bool,
+    // Maximum total size in bytes of the buffers (image planes and merged item extents) that the
+    // decoder keeps around for reuse when it is reset (for example when parse() is called again
+    // with a new IO). A value of 0 disables the reuse of buffers.
+    pub buffer_pool_size_limit: usize,
+    // Maximum number of initialized codec instances that the decoder keeps around for reuse when
+    // it is reset (for example when parse() is called again with a new IO). The instances are
+    // flushed instead of destroyed and are reused for the tiles that need the same codec choice
+    // and configuration (operating point, all_layers, requested number of threads, frame delay
+    // and frame allocator), which saves their initialization and thread creation. Kept
+    // instances keep their threads reserved from the thread budget and are only reused with the
+    // same budget. A value of 0 disables the reuse of codec instances.
+    pub max_idle_codecs: u32,
+    // If true, parse() stops after the box headers and the item and track properties have been
+    // parsed: the sample tables are not expanded, no codec is created and the images cannot be
+    // decoded. The image properties (dimensions, depth, format, alpha presence, CICP from the colr
+    // property), image_count (including the layers of progressive images), timescale and
+    // duration are still available. Exif/XMP metadata and gain maps are not looked up.
+    pub metadata_only: bool,
+    // If not 0, the IO is read at least this number of bytes at a time and the reads that fall
+    // inside the data of a previous read are served from memory. This is useful for IOs that
+    // have a high latency per read (see IOStats for the hit and miss counts). This is ignored for
+    // persistent IOs (such as the ones created by set_io_vec()), which are already served
+    // from memory.
+    pub io_min_read_size: usize,
+    // Maximum number of samples of an image sequence track that are kept in flight in the codec
+    // during playback. With a value larger than 1, codecs that support it (dav1d and MediaCodec
+    // from Android API level 28) decode several frames in parallel (if max_threads is larger than
+    // 1) and next_image() returns them in order. Calling nth_image() with any index other than the
+    // next one restarts the codec. This is also the maximum number of tiles of a grid item that
+    // are kept in flight in the single codec instance that decodes them all, unless
+    // grid_tile_threads is larger than 1 or tiled_output is set. Progressive items are always
+    // decoded one sample at a time.
+    pub frame_pipeline_depth: u32,
+    // Limits of the cache of decoded frames used by nth_image() and next_image(): the total size
+    // in bytes of the cached planes and the number of cached frames. A limit of 0 means that there
+    // is no limit of that kind and the cache is disabled if both are 0. Keyframes are kept longer
+    // than the other frames, which are evicted least recently used first (see
+    // Decoder::frame_cache_stats()). Not used with tiled_output or when a gain map is decoded.
+    pub frame_cache_size_limit: usize,
+    pub frame_cache_frame_limit: u32,
+    // If true, the time spent in each stage of the decoding and the number of reads, decoded tiles
+    // and copied bytes are measured from the next call to parse() (see Decoder::decode_stats()).
+    // The trace callback (see Decoder::set_trace_callback()) works regardless of this setting.
+    pub enable_decode_stats: bool,
+    // If set, the codecs that support it (dav1d and libgav1) decode the frames into buffers
+    // allocated by this instead of their own. The planes of the output images point into these
+    // buffers unless they have to be copied (grids, scaling, cached frames).
+    pub frame_allocator: Option<Arc<dyn FrameAllocator>>,
+    // If not 0, maximum total size in bytes of the buffers owned by the decoder (see
+    // MemoryStats::current_size). The size of the large buffers (image planes, merged item
+    // extents, copies of the tile payloads) is checked before they are allocated and the decoding
+    // fails with AvifError::OutOfMemory if they would exceed the limit. Frames are not added to
+    // the frame cache if they would exceed it. dav1d is also told not to decode frames whose planes
+    // would not fit in this number of bytes. The buffers allocated by the codecs are not counted.
+    // The RGB images allocated by Decoder::allocate_rgb_image() are checked against it too.
+    pub memory_limit: usize,
+    // If true, MediaCodec renders the frames of an 8-bit color image that is not a grid into
+    // AHardwareBuffers for direct use by the GPU instead of CPU-mapped buffers (from Android API
+    // level 26). The output image then has no color planes and the buffer of the current frame
+    // is returned by hardware_buffer(). Ignored by the other codecs. The frame cache is not used.
+    pub hardware_buffer_output: bool,
 }
 
 impl Default for Settings {
@@ -150,6 +262,21 @@ impl Default for Settings {
             image_size_limit: DEFAULT_IMAGE_SIZE_LIMIT,
             image_dimension_limit: DEFAULT_IMAGE_DIMENSION_LIMIT,
             image_count_limit: DEFAULT_IMAGE_COUNT_LIMIT,
+            grid_tile_threads: 1,
+            max_threads: 1,
+            thread_budget: None,
+            tiled_output: false,
+            buffer_pool_size_limit: 0,
+            max_idle_codecs: 0,
+            metadata_only: false,
+            io_min_read_size: 0,
+            frame_pipeline_depth: 1,
+            frame_cache_size_limit: 0,
+            frame_cache_frame_limit: 0,
+            enable_decode_stats: false,
+            frame_allocator: None,
+            memory_limit: 0,
+            hardware_buffer_output: false,
         }
     }
 }
@@ -240,12 +367,16 @@ enum ParseState {
     Complete,
 }
 
-/// cbindgen:field-names=[colorOBUSize,alphaOBUSize]
+/// cbindgen:field-names=[colorOBUSize,alphaOBUSize,readAheadHits,readAheadMisses]
 #[repr(C)]
 #[derive(Clone, Copy, Debug, Default)]
 pub struct IOStats {
     pub color_obu_size: usize,
     pub alpha_obu_size: usize,
+    // Number of reads that were served from memory and number of reads of the IO since it was
+    // set, if Settings::io_min_read_size was not 0 and the IO is not persistent.
+    pub read_ahead_hits: usize,
+    pub read_ahead_misses: usize,
 }
 
 #[derive(Default)]
@@ -253,6 +384,9 @@ pub struct Decoder {
     pub settings: Settings,
     image_count: u32,
     image_index: i32,
+    // Index of the last frame decoded by the codecs. Differs from image_index if the current
+    // image was taken from frame_cache.
+    codec_image_index: i32,
     image_timing: ImageTiming,
     timescale: u64,
     duration_in_timescales: u64,
@@ -260,19 +394,58 @@ pub struct Decoder {
     repetition_count: RepetitionCount,
     gainmap: GainMap,
     gainmap_present: bool,
+    // Gain map item whose tiles are only generated once the gain map is requested (see
+    // next_image_with_categories()), if Settings::enable_decoding_gainmap was false at parse time.
+    deferred_gainmap_item_id: Option<u32>,
     image: Image,
     source: Source,
     tile_info: [TileInfo; Category::COUNT],
     tiles: [Vec<Tile>; Category::COUNT],
     items: Items,
-    tracks: Vec<Track>,
+    tracks: Arc<Vec<Track>>,
     // To replicate the C-API, we need to keep this optional. Otherwise this
     // could be part of the initialization.
     io: Option<GenericIO>,
+    // Set if io was wrapped into a DecoderReadAheadIO.
+    read_ahead_stats: Option<Rc<Cell<ReadAheadStats>>>,
     codecs: Vec<Codec>,
+    // The codec choice and the configuration of each instance of codecs, with the number of
+    // threads that was requested rather than the number that was granted by the thread budget.
+    codec_configs: Vec<(CodecChoice, DecoderConfig)>,
+    // The threads reserved by each instance of codecs (see Settings::thread_budget).
+    // Must be declared after codecs so that it is dropped after the codec instances.
+    codec_thread_reservations: Vec<Option<ThreadReservation>>,
+    // Flushed codec instances that can be reused (see Settings::max_idle_codecs).
+    idle_codecs: Vec<IdleCodec>,
+    // Categories that were not requested by the last call to next_image_with_categories() or
+    // nth_image_with_categories(). Their samples are neither read nor decoded.
+    skipped_categories: [bool; Category::COUNT],
+    // True for the categories of a track whose codec was not sent some of the samples that
+    // precede codec_image_index. Such a codec can only resume at a keyframe.
+    codec_missed_samples: [bool; Category::COUNT],
+    // The threads reserved for the threads of worker_pool (see Settings::thread_budget).
+    tile_worker_reservation: Option<ThreadReservation>,
+    // Number of threads requested for each codec instance.
+    codec_max_threads: u32,
+    codec_max_frame_delay: u32,
+    // Set if the codecs of a track keep several samples in flight.
+    frame_pipeline: Option<FramePipeline>,
+    buffer_pool: BufferPool,
+    // Threads of decode_grid_tiles_in_parallel().
+    worker_pool: WorkerPool,
+    frame_cache: FrameCache,
     color_track_id: Option<u32>,
+    // Item described by the Exif and XMP metadata if the source is an item.
+    primary_item_id: Option<u32>,
     parse_state: ParseState,
     io_stats: IOStats,
+    instrumentation: Instrumentation,
+    // Size in bytes of the planes owned by the images of the tiles (see Tile::account_memory()).
+    tiles_memory_size: usize,
+    // Size in bytes of the merged item extents (Item::data_buffer).
+    items_memory_size: usize,
+    // See MemoryStats::peak_size.
+    peak_memory_size: usize,
 }
 
 #[derive(Clone, Copy, Debug, Default, PartialEq)]
@@ -285,7 +458,7 @@ pub enum Category {
 
 impl Category {
     const COUNT: usize = 3;
-    const ALL: [Category; Category::COUNT] = [Self::Color, Self::Alpha, Self::Gainmap];
+    pub const ALL: [Category; Category::COUNT] = [Self::Color, Self::Alpha, Self::Gainmap];
     const ALL_USIZE: [usize; Category::COUNT] = [0, 1, 2];
 
     pub fn usize(self) -> usize {
@@ -304,6 +477,114 @@ impl Category {
     }
 }
 
+// A codec instance that was flushed by Decoder::recycle_codecs().
+struct IdleCodec {
+    codec: Codec,
+    // The value of Settings::codec_choice when the instance was created.
+    requested_codec_choice: CodecChoice,
+    codec_choice: CodecChoice,
+    config: DecoderConfig,
+    // The threads of the instance stay reserved while it is idle (see Settings::thread_budget).
+    // Must be declared after codec so that it is dropped after the codec instance.
+    thread_reservation: Option<ThreadReservation>,
+}
+
+// State of the decoding of a track with codecs that keep several samples in flight (see
+// Settings::frame_pipeline_depth).
+#[derive(Debug)]
+struct FramePipeline {
+    // Index of the frame that the codecs output next.
+    next_frame: usize,
+    // Index of the next sample to send to the codec of each category.
+    next_sample: [usize; Category::COUNT],
+}
+
+// A tile (along with its payload) to be decoded by a TileDecodeWorker.
+struct TileDecodeJob<'a> {
+    tile_index: usize,
+    tile: &'a mut Tile,
+    payload: &'a [u8],
+    spatial_id: u8,
+}
+
+struct TileDecodeResult<'a> {
+    worker_index: usize,
+    job: TileDecodeJob<'a>,
+    // True if the codec successfully decoded the tile (status may still be an error).
+    decoded: bool,
+    status: AvifResult<()>,
+    codec_span: Option<TraceSpan>,
+    scale_span: Option<TraceSpan>,
+}
+
+// Decodes a list of tiles in order with a single codec instance on its own thread.
+struct TileDecodeWorker<'a> {
+    codec: &'a mut Codec,
+    jobs: Vec<TileDecodeJob<'a>>,
+    // Whether the spans of the stages are measured.
+    timed: bool,
+    // Memory that the finishing steps of each tile may use (see Settings::memory_limit).
+    available_memory: usize,
+}
+
+// SAFETY: The codecs are not bound to the thread that created them. A codec instance and the
+// tiles that it decodes (whose images may point to buffers owned by the codec) are only ever
+// accessed by one thread at a time: the worker waits for the calling thread to be done with a tile
+// before decoding the next one.
+unsafe impl Send for TileDecodeJob<'_> {}
+unsafe impl Send for TileDecodeWorker<'_> {}
+
+impl<'a> TileDecodeWorker<'a> {
+    fn run(
+        self,
+        worker_index: usize,
+        category: Category,
+        result_sender: mpsc::Sender<TileDecodeResult<'a>>,
+        ack_receiver: mpsc::Receiver<usize>,
+    ) {
+        let codec = self.codec;
+        // Tiles with an index greater than this do not need to be decoded.
+        let mut max_tile_index = usize::MAX;
+        for job in self.jobs {
+            if job.tile_index > max_tile_index {
+                return;
+            }
+            let (status, codec_span) =
+                instrumentation::timed(DecodeStage::Codec, self.timed, || {
+                    codec.get_next_image(job.payload, job.spatial_id, &mut job.tile.image, category)
+                });
+            let decoded = status.is_ok();
+            let mut scale_span = None;
+            let status = status.and_then(|_| {
+                scale_span = Decoder::finish_tile_decoding(
+                    job.tile,
+                    category,
+                    self.timed,
+                    self.available_memory,
+                )?;
+                Ok(())
+            });
+            let result = TileDecodeResult {
+                worker_index,
+                job,
+                decoded,
+                status,
+                codec_span,
+                scale_span,
+            };
+            if result_sender.send(result).is_err() {
+                return;
+            }
+            // Decoding the next tile may invalidate the planes of this tile, so wait until the
+            // calling thread is done with it.
+            match ack_receiver.recv() {
+                Ok(index) => max_tile_index = index,
+                Err(_) => return,
+            }
+        }
+    }
+}
+
 impl Decoder {
     pub fn image_count(&self) -> u32 {
         self.image_count
@@ -332,8 +613,86 @@ impl Decoder {
     pub fn gainmap_present(&self) -> bool {
         self.gainmap_present
     }
+    pub fn frame_cache_stats(&self) -> FrameCacheStats {
+        self.frame_cache.stats()
+    }
+
     pub fn io_stats(&self) -> IOStats {
-        self.io_stats
+        let mut io_stats = self.io_stats;
+        if let Some(read_ahead_stats) = &self.read_ahead_stats {
+            io_stats.read_ahead_hits = read_ahead_stats.get().hits;
+            io_stats.read_ahead_misses = read_ahead_stats.get().misses;
+        }
+        io_stats
+    }
+
+    // Returns the measurements made since the last call to parse() if
+    // Settings::enable_decode_stats was true at that time.
+    pub fn decode_stats(&self) -> DecodeStats {
+        self.instrumentation.stats()
+    }
+
+    pub fn memory_stats(&self) -> MemoryStats {
+        let current_size = self.memory_usage();
+        MemoryStats {
+            current_size,
+            peak_size: max(self.peak_memory_size, current_size),
+        }
+    }
+
+    // Total size in bytes of the buffers owned by the decoder (see MemoryStats::current_size).
+    fn memory_usage(&self) -> usize {
+        self.image.owned_planes_size(&ALL_PLANES)
+            + self.gainmap.image.owned_planes_size(&ALL_PLANES)
+            + self.frame_cache.stats().size
+            + self.buffer_pool.size()
+            + self.tiles_memory_size
+            + self.items_memory_size
+    }
+
+    // True if the memory usage has to be checked or measured.
+    fn memory_tracked(&self) -> bool {
+        self.settings.memory_limit != 0 || self.instrumentation.enabled
+    }
+
+    // Updates items_memory_size with the merged extents of all the items.
+    fn account_items_memory(&mut self) {
+        self.items_memory_size = self
+            .items
+            .values()
+            .filter_map(|item| item.data_buffer.as_ref())
+            .map(|data_buffer| data_buffer.capacity())
+            .sum();
+    }
+
+    // Number of bytes that can still be allocated without exceeding Settings::memory_limit.
+    fn available_memory(&self) -> usize {
+        if self.settings.memory_limit == 0 {
+            return usize::MAX;
+        }
+        self.settings
+            .memory_limit
+            .saturating_sub(self.memory_usage())
+    }
+
+    // Returns AvifError::OutOfMemory if allocating |size| more bytes would exceed
+    // Settings::memory_limit. Otherwise the allocation is accounted for in the peak size.
+    fn reserve_memory(&mut self, size: usize) -> AvifResult<()> {
+        if !self.memory_tracked() {
+            return Ok(());
+        }
+        let total_size = self.memory_usage().saturating_add(size);
+        if self.settings.memory_limit != 0 && total_size > self.settings.memory_limit {
+            return Err(AvifError::OutOfMemory);
+        }
+        self.peak_memory_size = max(self.peak_memory_size, total_size);
+        Ok(())
+    }
+
+    // Sets a callback that is given the span of each stage of the decoding (except Io) once it is
+    // done. The callback is kept when the decoder is reset.
+    pub fn set_trace_callback(&mut self, trace_callback: Option<TraceCallback>) {
+        self.instrumentation.trace_callback = trace_callback;
     }
 
     fn parsing_complete(&self) -> bool {
@@ -341,28 +700,49 @@ impl Decoder {
     }
 
     pub fn set_io_file(&mut self, filename: &String) -> AvifResult<()> {
-        self.io = Some(Box::new(DecoderFileIO::create(filename)?));
+        self.io = Some(create_file_io(filename)?);
+        self.read_ahead_stats = None;
+        self.instrumentation.read_stats = None;
         self.parse_state = ParseState::None;
         Ok(())
     }
 
     pub fn set_io_vec(&mut self, data: Vec<u8>) {
         self.io = Some(Box::new(DecoderMemoryIO { data }));
+        self.read_ahead_stats = None;
+        self.instrumentation.read_stats = None;
         self.parse_state = ParseState::None;
     }
 
     // This has an unsafe block and is intended for use only from the C API.
     pub fn set_io_raw(&mut self, data: *const u8, size: usize) -> AvifResult<()> {
         self.io = Some(Box::new(DecoderRawIO::create(data, size)));
+        self.read_ahead_stats = None;
+        self.instrumentation.read_stats = None;
         self.parse_state = ParseState::None;
         Ok(())
     }
 
     pub fn set_io(&mut self, io: GenericIO) {
         self.io = Some(io);
+        self.read_ahead_stats = None;
+        self.instrumentation.read_stats = None;
         self.parse_state = ParseState::None;
     }
 
+    // Returns the id of the first thumbnail item of |primary_item_id| that can be decoded.
+    fn find_thumbnail_item(&self, primary_item_id: u32) -> Option<u32> {
+        self.items
+            .iter()
+            .filter(|x| {
+                !x.1.should_skip_ignoring_thumbnail()
+                    && x.1.id != 0
+                    && x.1.thumbnail_for_id == primary_item_id
+            })
+            .map(|x| *x.0)
+            .min()
+    }
+
     fn find_alpha_item(&mut self, color_item_index: u32) -> AvifResult<Option<u32>> {
         let color_item = self.items.get(&color_item_index).unwrap();
         if let Some(item) = self.items.iter().find(|x| {
@@ -604,7 +984,10 @@ impl Decoder {
                 Some(search_size),
             )?;
             let io = &mut self.io.unwrap_mut();
-            let sample = &self.tiles[category.usize()][tile_index].input.samples[0];
+            let sample = self.tiles[category.usize()][tile_index]
+                .input
+                .samples
+                .get(0)?;
             let item_data_buffer = if sample.item_id == 0 {
                 &None
             } else {
@@ -679,7 +1062,91 @@ impl Decoder {
         Ok(())
     }
 
+    // Gives the buffers owned by the decoder to the buffer pool so that they can be reused after
+    // a reset.
+    fn recycle_buffers(&mut self) {
+        self.buffer_pool
+            .set_max_size(self.settings.buffer_pool_size_limit);
+        self.frame_cache.clear(&mut self.buffer_pool);
+        if self.buffer_pool.max_size() == 0 {
+            return;
+        }
+        self.image.release_planes_to_pool(&mut self.buffer_pool);
+        self.gainmap
+            .image
+            .release_planes_to_pool(&mut self.buffer_pool);
+        for tiles in &mut self.tiles {
+            for tile in tiles {
+                tile.image.release_planes_to_pool(&mut self.buffer_pool);
+                tile.account_memory(&mut self.tiles_memory_size);
+            }
+        }
+        for item in self.items.values_mut() {
+            if let Some(data_buffer) = item.data_buffer.take() {
+                self.buffer_pool.give(data_buffer);
+            }
+        }
+        self.items_memory_size = 0;
+    }
+
+    // Returns the pool of buffers that are reused by the decoder. The pool can also be used by
+    // the caller (for example to allocate the RGB images the decoded images are converted into).
+    pub fn buffer_pool(&mut self) -> &mut BufferPool {
+        &mut self.buffer_pool
+    }
+
+    // Same as rgb::Image::allocate_with_pool() with the pool of the decoder, but fails with
+    // AvifError::OutOfMemory if the buffer would exceed Settings::memory_limit. The buffer is
+    // owned by the caller, so it only counts towards MemoryStats::peak_size.
+    pub fn allocate_rgb_image(&mut self, rgb: &mut rgb::Image) -> AvifResult<()> {
+        rgb.release_to_pool(&mut self.buffer_pool);
+        // Only the part of the buffer that cannot be taken from the pool is a new allocation.
+        let is_16bit = rgb.channel_size() == 2;
+        let capacity = rgb.allocation_size()? / if is_16bit { 2 } else { 1 };
+        let size = self.buffer_pool.allocation_size(&[capacity], is_16bit)?;
+        self.reserve_memory(size)?;
+        rgb.allocate_with_pool(&mut self.buffer_pool)
+    }
+
+    // Flushes the codec instances into idle_codecs (up to Settings::max_idle_codecs of them) and
+    // destroys the other ones.
+    fn recycle_codecs(&mut self) {
+        let max_idle_codecs = self.settings.max_idle_codecs as usize;
+        self.idle_codecs.truncate(max_idle_codecs);
+        let codec_configs = std::mem::take(&mut self.codec_configs);
+        let thread_reservations = std::mem::take(&mut self.codec_thread_reservations);
+        self.tile_worker_reservation = None;
+        for ((mut codec, (codec_choice, config)), thread_reservation) in self
+            .codecs
+            .drain(..)
+            .zip(codec_configs)
+            .zip(thread_reservations)
+        {
+            if self.idle_codecs.len() < max_idle_codecs && codec.flush().is_ok() {
+                self.idle_codecs.push(IdleCodec {
+                    codec,
+                    requested_codec_choice: self.settings.codec_choice,
+                    codec_choice,
+                    config,
+                    thread_reservation,
+                });
+            } else {
+                // The threads are given back once the codec instance is destroyed.
+                drop(codec);
+                drop(thread_reservation);
+            }
+        }
+    }
+
+    // Returns the number of flushed codec instances that are kept for reuse (see
+    // Settings::max_idle_codecs).
+    pub fn idle_codec_count(&self) -> usize {
+        self.idle_codecs.len()
+    }
+
     fn reset(&mut self) {
+        self.recycle_buffers();
+        self.recycle_codecs();
         let decoder = Decoder::default();
         // Reset all fields to default except the following: settings, io, source.
         self.image_count = decoder.image_count;
@@ -690,14 +1157,28 @@ impl Decoder {
         self.repetition_count = decoder.repetition_count;
         self.gainmap = decoder.gainmap;
         self.gainmap_present = decoder.gainmap_present;
+        self.deferred_gainmap_item_id = decoder.deferred_gainmap_item_id;
         self.image = decoder.image;
         self.tile_info = decoder.tile_info;
         self.tiles = decoder.tiles;
+        self.tiles_memory_size = decoder.tiles_memory_size;
+        self.items_memory_size = decoder.items_memory_size;
         self.image_index = decoder.image_index;
+        self.codec_image_index = decoder.codec_image_index;
+        self.frame_cache = decoder.frame_cache;
         self.items = decoder.items;
         self.tracks = decoder.tracks;
         self.codecs = decoder.codecs;
+        self.codec_configs = decoder.codec_configs;
+        self.skipped_categories = decoder.skipped_categories;
+        self.codec_missed_samples = decoder.codec_missed_samples;
+        self.codec_thread_reservations = decoder.codec_thread_reservations;
+        self.tile_worker_reservation = decoder.tile_worker_reservation;
+        self.codec_max_threads = decoder.codec_max_threads;
+        self.codec_max_frame_delay = decoder.codec_max_frame_delay;
+        self.frame_pipeline = decoder.frame_pipeline;
         self.color_track_id = decoder.color_track_id;
+        self.primary_item_id = decoder.primary_item_id;
         self.parse_state = decoder.parse_state;
     }
 
@@ -709,13 +1190,55 @@ impl Decoder {
         if self.io.is_none() {
             return Err(AvifError::IoNotSet);
         }
+        if self.parse_state == ParseState::None {
+            self.instrumentation.enabled = self.settings.enable_decode_stats;
+            self.instrumentation.reset();
+            self.peak_memory_size = 0;
+        }
+        let timed = self.instrumentation.timed();
+        let (result, span) =
+            instrumentation::timed(DecodeStage::Parse, timed, || self.parse_boxes());
+        self.instrumentation.report(span);
+        // The extents of the metadata and derived items may have been merged while parsing.
+        self.account_items_memory();
+        result
+    }
+
+    // Wraps the IO into the IOs that measure the reads and that read ahead, as requested by the
+    // settings.
+    fn wrap_io(&mut self) {
+        if self.instrumentation.enabled && self.instrumentation.read_stats.is_none() {
+            let read_stats = Rc::new(Cell::new(ReadStats::default()));
+            self.io = Some(Box::new(DecoderCountingIO::create(
+                self.io.take().unwrap(),
+                read_stats.clone(),
+            )));
+            self.instrumentation.read_stats = Some(read_stats);
+        }
+        // The reads of a persistent IO are already served from memory.
+        if self.settings.io_min_read_size != 0
+            && self.read_ahead_stats.is_none()
+            && !self.io.unwrap_ref().persistent()
+        {
+            let read_ahead_stats = Rc::new(Cell::new(ReadAheadStats::default()));
+            self.io = Some(Box::new(DecoderReadAheadIO::create(
+                self.io.take().unwrap(),
+                self.settings.io_min_read_size,
+                read_ahead_stats.clone(),
+            )));
+            self.read_ahead_stats = Some(read_ahead_stats);
+        }
+    }
+
+    fn parse_boxes(&mut self) -> AvifResult<()> {
         if self.parse_state == ParseState::None {
             self.reset();
+            self.wrap_io();
             let avif_boxes = mp4box::parse(self.io.unwrap_mut())?;
-            self.tracks = avif_boxes.tracks;
+            self.tracks = Arc::new(avif_boxes.tracks);
             if !self.tracks.is_empty() {
                 self.image.image_sequence_track_present = true;
-                for track in &self.tracks {
+                for track in self.tracks.iter() {
                     if !track.check_limits(
                         self.settings.image_size_limit,
                         self.settings.image_dimension_limit,
@@ -750,6 +1273,7 @@ impl Decoder {
                 },
                 Source::Tracks => Source::Tracks,
                 Source::PrimaryItem => Source::PrimaryItem,
+                Source::Thumbnail => Source::Thumbnail,
             };
 
             let color_properties: &Vec<ItemProperty>;
@@ -759,7 +1283,9 @@ impl Decoder {
                     .iter()
                     .find(|x| x.is_color())
                     .ok_or(AvifError::NoContent)?;
-                if let Some(meta) = &color_track.meta {
+                if self.settings.metadata_only {
+                    // Exif/XMP metadata is not looked up.
+                } else if let Some(meta) = &color_track.meta {
                     let mut color_track_items = construct_items(meta)?;
                     Self::search_exif_or_xmp_metadata(
                         &mut color_track_items,
@@ -774,29 +1300,39 @@ impl Decoder {
                     .get_properties()
                     .ok_or(AvifError::BmffParseFailed("".into()))?;
 
-                self.tiles[Category::Color.usize()].push(Tile::create_from_track(
-                    color_track,
-                    self.settings.image_count_limit,
-                    self.io.unwrap_ref().size_hint(),
-                    Category::Color,
-                )?);
-                self.tile_info[Category::Color.usize()].tile_count = 1;
-
-                if let Some(alpha_track) = self.tracks.iter().find(|x| x.is_aux(color_track.id)) {
-                    self.tiles[Category::Alpha.usize()].push(Tile::create_from_track(
-                        alpha_track,
+                if self.settings.metadata_only {
+                    self.image_count = color_track
+                        .sample_table
+                        .unwrap_ref()
+                        .sample_count(self.settings.image_count_limit)?;
+                } else {
+                    self.tiles[Category::Color.usize()].push(Tile::create_from_track(
+                        color_track,
                         self.settings.image_count_limit,
                         self.io.unwrap_ref().size_hint(),
-                        Category::Alpha,
+                        Category::Color,
                     )?);
-                    self.tile_info[Category::Alpha.usize()].tile_count = 1;
+                    self.tile_info[Category::Color.usize()].tile_count = 1;
+                    self.image_count =
+                        self.tiles[Category::Color.usize()][0].input.samples.len() as u32;
+                }
+
+                if let Some(alpha_track) = self.tracks.iter().find(|x| x.is_aux(color_track.id)) {
+                    if !self.settings.metadata_only {
+                        self.tiles[Category::Alpha.usize()].push(Tile::create_from_track(
+                            alpha_track,
+                            self.settings.image_count_limit,
+                            self.io.unwrap_ref().size_hint(),
+                            Category::Alpha,
+                        )?);
+                        self.tile_info[Category::Alpha.usize()].tile_count = 1;
+                    }
                     self.image.alpha_present = true;
                     self.image.alpha_premultiplied = color_track.prem_by_id == Some(alpha_track.id);
                 }
 
                 self.image_index = -1;
-                self.image_count =
-                    self.tiles[Category::Color.usize()][0].input.samples.len() as u32;
+                self.codec_image_index = -1;
                 self.timescale = color_track.media_timescale as u64;
                 self.duration_in_timescales = color_track.media_duration;
                 if self.timescale != 0 {
@@ -810,11 +1346,14 @@ impl Decoder {
                 self.image.width = color_track.width;
                 self.image.height = color_track.height;
             } else {
-                assert_eq!(self.source, Source::PrimaryItem);
+                assert!(matches!(
+                    self.source,
+                    Source::PrimaryItem | Source::Thumbnail
+                ));
                 let mut item_ids: [u32; Category::COUNT] = [0; Category::COUNT];
 
                 // Mandatory color item (primary item).
-                let color_item_id = self
+                let primary_item_id = self
                     .items
                     .iter()
                     .find(|x| {
@@ -822,20 +1361,40 @@ impl Decoder {
                             && x.1.id != 0
                             && x.1.id == avif_boxes.meta.primary_item_id
                     })
-                    .map(|it| *it.0);
-
-                item_ids[Category::Color.usize()] = color_item_id.ok_or(AvifError::NoContent)?;
+                    .map(|it| *it.0)
+                    .ok_or(AvifError::NoContent)?;
+                self.primary_item_id = Some(primary_item_id);
+                item_ids[Category::Color.usize()] = if self.source == Source::Thumbnail {
+                    let thumbnail_item_id = self
+                        .find_thumbnail_item(primary_item_id)
+                        .ok_or(AvifError::NoContent)?;
+                    // Thumbnails are skipped when harvesting the ispe of all the items.
+                    self.items
+                        .get_mut(&thumbnail_item_id)
+                        .unwrap()
+                        .harvest_ispe_unchecked(
+                            self.settings.strictness.alpha_ispe_required(),
+                            self.settings.image_size_limit,
+                            self.settings.image_dimension_limit,
+                        )?;
+                    thumbnail_item_id
+                } else {
+                    primary_item_id
+                };
                 self.read_and_parse_item(item_ids[Category::Color.usize()], Category::Color)?;
                 self.populate_grid_item_ids(item_ids[Category::Color.usize()], Category::Color)?;
 
-                // Find exif/xmp from meta if any.
-                Self::search_exif_or_xmp_metadata(
-                    &mut self.items,
-                    Some(item_ids[Category::Color.usize()]),
-                    &self.settings,
-                    self.io.unwrap_mut(),
-                    &mut self.image,
-                )?;
+                // Find exif/xmp from meta if any. The metadata describes the primary item (which
+                // the thumbnail is a smaller version of).
+                if !self.settings.metadata_only {
+                    Self::search_exif_or_xmp_metadata(
+                        &mut self.items,
+                        Some(primary_item_id),
+                        &self.settings,
+                        self.io.unwrap_mut(),
+                        &mut self.image,
+                    )?;
+                }
 
                 // Optional alpha auxiliary item
                 if let Some(alpha_item_id) =
@@ -848,29 +1407,37 @@ impl Decoder {
                     item_ids[Category::Alpha.usize()] = alpha_item_id;
                 }
 
-                // Optional gainmap item
-                if let Some((tonemap_id, gainmap_id)) =
-                    self.find_gainmap_item(item_ids[Category::Color.usize()])?
-                {
-                    self.read_and_parse_item(gainmap_id, Category::Gainmap)?;
-                    self.populate_grid_item_ids(gainmap_id, Category::Gainmap)?;
-                    self.validate_gainmap_item(gainmap_id, tonemap_id)?;
-                    self.gainmap_present = true;
-                    if self.settings.enable_decoding_gainmap {
-                        item_ids[Category::Gainmap.usize()] = gainmap_id;
-                    }
-                    if self.settings.enable_parsing_gainmap_metadata {
-                        let tonemap_item = self
-                            .items
-                            .get_mut(&tonemap_id)
-                            .ok_or(AvifError::InvalidToneMappedImage("".into()))?;
-                        let mut stream = tonemap_item.stream(self.io.unwrap_mut())?;
-                        self.gainmap.metadata = mp4box::parse_tmap(&mut stream)?;
+                // Optional gainmap item. The gain map applies to the primary item only.
+                if self.source != Source::Thumbnail && !self.settings.metadata_only {
+                    if let Some((tonemap_id, gainmap_id)) =
+                        self.find_gainmap_item(item_ids[Category::Color.usize()])?
+                    {
+                        self.read_and_parse_item(gainmap_id, Category::Gainmap)?;
+                        self.populate_grid_item_ids(gainmap_id, Category::Gainmap)?;
+                        self.validate_gainmap_item(gainmap_id, tonemap_id)?;
+                        self.gainmap_present = true;
+                        if self.settings.enable_decoding_gainmap {
+                            item_ids[Category::Gainmap.usize()] = gainmap_id;
+                        } else {
+                            self.deferred_gainmap_item_id = Some(gainmap_id);
+                        }
+                        if self.settings.enable_parsing_gainmap_metadata {
+                            let tonemap_item = self
+                                .items
+                                .get_mut(&tonemap_id)
+                                .ok_or(AvifError::InvalidToneMappedImage("".into()))?;
+                            let mut stream = tonemap_item.stream(self.io.unwrap_mut())?;
+                            self.gainmap.metadata = mp4box::parse_tmap(&mut stream)?;
+                        }
                     }
                 }
 
                 self.image_index = -1;
+                self.codec_image_index = -1;
                 self.image_count = 1;
+                // Number of samples of the first color tile (that is the number of layers of a
+                // progressive image).
+                let mut color_sample_count = 0;
                 self.timescale = 1;
                 self.duration = 1.0;
                 self.duration_in_timescales = 1;
@@ -900,7 +1467,21 @@ impl Decoder {
                         alpha_item.height = height;
                     }
 
-                    self.tiles[category.usize()] = self.generate_tiles(item_id, category)?;
+                    if !self.settings.metadata_only {
+                        self.tiles[category.usize()] = self.generate_tiles(item_id, category)?;
+                        if category == Category::Color {
+                            color_sample_count = self.tiles[category.usize()]
+                                .first()
+                                .map_or(0, |tile| tile.input.samples.len());
+                        }
+                    } else if category == Category::Color {
+                        // The tiles are not kept but they give the progressive status of the
+                        // item and its number of layers, so that image_count is the same as with
+                        // a full parse.
+                        let tiles = self.generate_tiles(item_id, category)?;
+                        color_sample_count =
+                            tiles.first().map_or(0, |tile| tile.input.samples.len());
+                    }
                     let item = self.items.get(&item_id).unwrap();
                     // Made up alpha item does not contain the pixi property. So do not try to
                     // validate it.
@@ -917,27 +1498,14 @@ impl Decoder {
 
                 if color_item.progressive {
                     self.image.progressive_state = ProgressiveState::Available;
-                    let sample_count = self.tiles[Category::Color.usize()][0].input.samples.len();
-                    if sample_count > 1 {
+                    if color_sample_count > 1 {
                         self.image.progressive_state = ProgressiveState::Active;
-                        self.image_count = sample_count as u32;
+                        self.image_count = color_sample_count as u32;
                     }
                 }
 
                 if item_ids[Category::Gainmap.usize()] != 0 {
-                    let gainmap_item = self
-                        .items
-                        .get(&item_ids[Category::Gainmap.usize()])
-                        .unwrap();
-                    self.gainmap.image.width = gainmap_item.width;
-                    self.gainmap.image.height = gainmap_item.height;
-                    #[allow(non_snake_case)]
-                    let av1C = gainmap_item
-                        .av1C()
-                        .ok_or(AvifError::BmffParseFailed("".into()))?;
-                    self.gainmap.image.depth = av1C.depth();
-                    self.gainmap.image.yuv_format = av1C.pixel_format();
-                    self.gainmap.image.chroma_sample_position = av1C.chroma_sample_position;
+                    self.set_gainmap_image_properties(item_ids[Category::Gainmap.usize()])?;
                 }
 
                 // This borrow has to be in the end of this branch.
@@ -951,21 +1519,15 @@ impl Decoder {
             // Check validity of samples.
             for tiles in &self.tiles {
                 for tile in tiles {
-                    for sample in &tile.input.samples {
-                        if sample.size == 0 {
-                            return Err(AvifError::BmffParseFailed(
-                                "sample has invalid size.".into(),
-                            ));
+                    let total_size = tile.input.samples.total_size()?;
+                    match tile.input.category {
+                        Category::Color => {
+                            checked_incr!(self.io_stats.color_obu_size, total_size)
                         }
-                        match tile.input.category {
-                            Category::Color => {
-                                checked_incr!(self.io_stats.color_obu_size, sample.size)
-                            }
-                            Category::Alpha => {
-                                checked_incr!(self.io_stats.alpha_obu_size, sample.size)
-                            }
-                            _ => {}
+                        Category::Alpha => {
+                            checked_incr!(self.io_stats.alpha_obu_size, total_size)
                         }
+                        _ => {}
                     }
                 }
             }
@@ -1021,6 +1583,42 @@ impl Decoder {
         Ok(())
     }
 
+    fn set_gainmap_image_properties(&mut self, gainmap_item_id: u32) -> AvifResult<()> {
+        let gainmap_item = self.items.get(&gainmap_item_id).unwrap();
+        self.gainmap.image.width = gainmap_item.width;
+        self.gainmap.image.height = gainmap_item.height;
+        #[allow(non_snake_case)]
+        let av1C = gainmap_item
+            .av1C()
+            .ok_or(AvifError::BmffParseFailed("".into()))?;
+        self.gainmap.image.depth = av1C.depth();
+        self.gainmap.image.yuv_format = av1C.pixel_format();
+        self.gainmap.image.chroma_sample_position = av1C.chroma_sample_position;
+        Ok(())
+    }
+
+    // Generates the tiles of the gain map that was not set up at parse time, along with their
+    // codec instances if the other codecs were already created.
+    fn generate_deferred_gainmap_tiles(&mut self) -> AvifResult<()> {
+        let gainmap_item_id = match self.deferred_gainmap_item_id.take() {
+            Some(gainmap_item_id) => gainmap_item_id,
+            None => return Ok(()),
+        };
+        let tiles = self.generate_tiles(gainmap_item_id, Category::Gainmap)?;
+        let item = self.items.get(&gainmap_item_id).unwrap();
+        item.validate_properties(&self.items, self.settings.strictness.pixi_required())?;
+        self.tiles[Category::Gainmap.usize()] = tiles;
+        self.set_gainmap_image_properties(gainmap_item_id)?;
+        if !self.codecs.is_empty() {
+            for tile_index in 0..self.tiles[Category::Gainmap.usize()].len() {
+                self.create_tile_codec(Category::Gainmap, tile_index)?;
+                self.tiles[Category::Gainmap.usize()][tile_index].codec_index =
+                    self.codecs.len() - 1;
+            }
+        }
+        Ok(())
+    }
+
     fn read_and_parse_item(&mut self, item_id: u32, category: Category) -> AvifResult<()> {
         if item_id == 0 {
             return Ok(());
@@ -1038,9 +1636,8 @@ impl Decoder {
         #[cfg(feature = "android_mediacodec")]
         {
             // Android MediaCodec does not support using a single codec instance for images of
-            // varying formats (which could happen when image contains alpha).
-            // TODO: return false for now. But investigate cases where it is possible to use a
-            // single codec instance (it may work for grids).
+            // varying formats (which could happen when image contains alpha). The tiles of a grid
+            // may still share an instance (see can_share_codecs_across_tiles()).
             return Ok(false);
         }
         let total_tile_count = checked_add!(
@@ -1079,38 +1676,275 @@ impl Decoder {
         Ok(true)
     }
 
-    fn create_codec(&mut self, operating_point: u8, all_layers: bool) -> AvifResult<()> {
-        let mut codec: Codec = self.settings.codec_choice.get_codec()?;
-        codec.initialize(operating_point, all_layers)?;
+    // Returns true if the tiles of |category| form a grid that can be decoded by a pool of codec
+    // instances, each of which decodes several tiles one after the other.
+    fn can_share_codecs_across_tiles(&self, category: Category) -> bool {
+        let tiles = &self.tiles[category.usize()];
+        if !self.tile_info[category.usize()].is_grid() || tiles.len() <= 1 {
+            return false;
+        }
+        let operating_point = tiles[0].operating_point;
+        let all_layers = tiles[0].input.all_layers;
+        tiles.iter().all(|tile| {
+            tile.operating_point == operating_point && tile.input.all_layers == all_layers
+        })
+    }
+
+    fn create_codec(
+        &mut self,
+        operating_point: u8,
+        all_layers: bool,
+        frame_size_limit: u32,
+        hardware_buffer_output: bool,
+        (width, height): (u32, u32),
+    ) -> AvifResult<()> {
+        // The idle instances are matched on the requested number of threads, since the number of
+        // granted threads depends on the state of the thread budget.
+        let config = DecoderConfig {
+            operating_point,
+            all_layers,
+            max_threads: self.codec_max_threads,
+            max_frame_delay: self.codec_max_frame_delay,
+            frame_size_limit,
+            frame_allocator: self.settings.frame_allocator.clone(),
+            hardware_buffer_output,
+            width,
+            height,
+        };
+        let idle_codec_index = self.idle_codecs.iter().position(|idle_codec| {
+            idle_codec.requested_codec_choice == self.settings.codec_choice
+                && idle_codec.config.matches(&config)
+                && match (&idle_codec.thread_reservation, &self.settings.thread_budget) {
+                    (Some(reservation), Some(budget)) => reservation.is_from(budget),
+                    (None, None) => true,
+                    _ => false,
+                }
+        });
+        let (codec, codec_choice, thread_reservation) = match idle_codec_index {
+            Some(index) => {
+                let idle_codec = self.idle_codecs.swap_remove(index);
+                (
+                    idle_codec.codec,
+                    idle_codec.codec_choice,
+                    idle_codec.thread_reservation,
+                )
+            }
+            None => {
+                let thread_reservation = self
+                    .settings
+                    .thread_budget
+                    .as_ref()
+                    .map(|budget| ThreadBudget::reserve(budget, self.codec_max_threads));
+                let (mut codec, codec_choice) = self.settings.codec_choice.get_codec()?;
+                codec.initialize(&DecoderConfig {
+                    max_threads: thread_reservation
+                        .as_ref()
+                        .map_or(config.max_threads, |reservation| reservation.thread_count()),
+                    ..config.clone()
+                })?;
+                (codec, codec_choice, thread_reservation)
+            }
+        };
         self.codecs.push(codec);
+        self.codec_configs.push((codec_choice, config));
+        self.codec_thread_reservations.push(thread_reservation);
+        self.instrumentation.set_codec(codec_choice);
         Ok(())
     }
 
+    // Creates a codec instance for the tile |tile_index| of |category|. It may also decode other
+    // tiles of that category, but not of the other categories.
+    fn create_tile_codec(&mut self, category: Category, tile_index: usize) -> AvifResult<()> {
+        let tile = &self.tiles[category.usize()][tile_index];
+        // Hardware buffers cannot be stitched into a grid. The frames are rendered in the 8-bit
+        // YUV_420_888 format, so the images of higher bit depths are output in CPU-mapped buffers.
+        let hardware_buffer_output = self.settings.hardware_buffer_output
+            && category == Category::Color
+            && !self.tile_info[category.usize()].is_grid()
+            && self.image.depth == 8;
+        self.create_codec(
+            tile.operating_point,
+            tile.input.all_layers,
+            self.frame_size_limit(category),
+            hardware_buffer_output,
+            (tile.width, tile.height),
+        )
+    }
+
+    // Returns the maximum number of pixels of the frames decoded for |category|. With
+    // Settings::memory_limit, it is the number of pixels whose planes fit in the limit, given the
+    // depth and the chroma subsampling of the image.
+    fn frame_size_limit(&self, category: Category) -> u32 {
+        if self.settings.memory_limit == 0 {
+            return self.settings.image_size_limit;
+        }
+        let image = match category {
+            Category::Gainmap => &self.gainmap.image,
+            _ => &self.image,
+        };
+        // Number of samples per pixel in all the planes, in halves. Only the luma samples of the
+        // alpha frames are counted.
+        let half_samples_per_pixel = match (category, image.yuv_format) {
+            (Category::Alpha, _) | (_, PixelFormat::Yuv400) => 2,
+            (_, PixelFormat::Yuv420) => 3,
+            (_, PixelFormat::Yuv422) => 4,
+            _ => 6,
+        };
+        let bytes_per_sample = if image.depth > 8 { 2 } else { 1 };
+        let max_pixels =
+            self.settings.memory_limit / (half_samples_per_pixel * bytes_per_sample) * 2;
+        min(
+            self.settings.image_size_limit,
+            u32::try_from(max_pixels).unwrap_or(u32::MAX),
+        )
+    }
+
+    // Returns the number of threads to request for each of |codec_count| codec instances that
+    // share |max_threads| threads.
+    fn codec_threads(&self, max_threads: u32, codec_count: usize) -> u32 {
+        if self.settings.thread_budget.is_none() {
+            return max_threads;
+        }
+        max(
+            max_threads / u32::try_from(codec_count).unwrap_or(u32::MAX).max(1),
+            1,
+        )
+    }
+
     fn create_codecs(&mut self) -> AvifResult<()> {
         if !self.codecs.is_empty() {
             return Ok(());
         }
+        let max_threads = max(self.settings.max_threads, 1);
+        self.codec_max_threads = max_threads;
+        self.codec_max_frame_delay = 1;
         if matches!(self.source, Source::Tracks) {
             // In this case, we will use at most two codec instances (one for the color planes and
             // one for the alpha plane). Gain maps are not supported.
             self.codecs = create_vec_exact(2)?;
-            self.create_codec(
-                self.tiles[Category::Color.usize()][0].operating_point,
-                self.tiles[Category::Color.usize()][0].input.all_layers,
-            )?;
+            let codec_count = if self.tiles[Category::Alpha.usize()].is_empty() { 1 } else { 2 };
+            self.codec_max_threads = self.codec_threads(max_threads, codec_count);
+            // Each instance decodes the consecutive samples of a single track, so they can be
+            // kept in flight.
+            self.codec_max_frame_delay = max(self.settings.frame_pipeline_depth, 1);
+            self.create_tile_codec(Category::Color, 0)?;
             self.tiles[Category::Color.usize()][0].codec_index = 0;
             if !self.tiles[Category::Alpha.usize()].is_empty() {
-                self.create_codec(
-                    self.tiles[Category::Alpha.usize()][0].operating_point,
-                    self.tiles[Category::Alpha.usize()][0].input.all_layers,
-                )?;
+                self.create_tile_codec(Category::Alpha, 0)?;
                 self.tiles[1][0].codec_index = 1;
             }
-        } else if self.can_use_single_codec()? {
+            if self.codec_max_frame_delay > 1
+                && self.codecs.iter().all(|codec| codec.can_pipeline_frames())
+            {
+                let next_frame = usize_from_i32(checked_add!(self.image_index, 1)?)?;
+                self.frame_pipeline = Some(FramePipeline {
+                    next_frame,
+                    next_sample: [next_frame; Category::COUNT],
+                });
+            }
+        } else if self.settings.grid_tile_threads > 1
+            && !self.settings.tiled_output
+            && Category::ALL
+                .iter()
+                .any(|c| self.can_share_codecs_across_tiles(*c))
+        {
+            // Each grid category gets a pool of at most grid_tile_threads codec instances and
+            // its tiles are distributed over them in a round robin fashion. Every other category
+            // gets one codec instance per tile.
+            let mut max_pool_size = self.settings.grid_tile_threads as usize;
+            if let Some(budget) = &self.settings.thread_budget {
+                // Each pool instance runs on its own tile worker thread, which is taken from the
+                // threads of the decoder.
+                let reservation = ThreadBudget::reserve(
+                    budget,
+                    min(self.settings.grid_tile_threads, max_threads),
+                );
+                max_pool_size = reservation.thread_count() as usize;
+                self.tile_worker_reservation = Some(reservation);
+            }
+            let mut codec_count = 0;
+            for category in Category::ALL {
+                let tile_count = self.tiles[category.usize()].len();
+                codec_count += if self.can_share_codecs_across_tiles(category) {
+                    min(tile_count, max_pool_size)
+                } else {
+                    tile_count
+                };
+            }
+            self.codecs = create_vec_exact(codec_count)?;
+            // The instances of a pool run concurrently, so they share the threads.
+            self.codec_max_threads = match self.settings.thread_budget {
+                Some(_) => self.codec_threads(
+                    max_threads.saturating_sub(max_pool_size as u32),
+                    codec_count,
+                ),
+                None => max(max_threads / self.settings.grid_tile_threads, 1),
+            };
+            for category in Category::ALL {
+                let pool_size = if self.can_share_codecs_across_tiles(category) {
+                    min(self.tiles[category.usize()].len(), max_pool_size)
+                } else {
+                    self.tiles[category.usize()].len()
+                };
+                let first_codec_index = self.codecs.len();
+                for tile_index in 0..self.tiles[category.usize()].len() {
+                    if tile_index < pool_size {
+                        self.create_tile_codec(category, tile_index)?;
+                    }
+                    self.tiles[category.usize()][tile_index].codec_index =
+                        first_codec_index + tile_index % pool_size;
+                }
+            }
+        } else if self.settings.frame_pipeline_depth > 1
+            && !self.settings.tiled_output
+            && self.image_count == 1
+            && Category::ALL
+                .iter()
+                .any(|c| self.can_share_codecs_across_tiles(*c))
+        {
+            // Each grid category gets a single codec instance that keeps several of its tiles in
+            // flight (see decode_grid_tiles_pipelined()). Every other category gets one codec
+            // instance per tile.
+            let codec_count = Category::ALL
+                .iter()
+                .map(|c| {
+                    if self.can_share_codecs_across_tiles(*c) {
+                        1
+                    } else {
+                        self.tiles[c.usize()].len()
+                    }
+                })
+                .sum();
+            self.codecs = create_vec_exact(codec_count)?;
+            self.codec_max_threads = self.codec_threads(max_threads, codec_count);
+            for category in Category::ALL {
+                let shared = self.can_share_codecs_across_tiles(category);
+                self.codec_max_frame_delay =
+                    if shared { self.settings.frame_pipeline_depth } else { 1 };
+                for tile_index in 0..self.tiles[category.usize()].len() {
+                    if tile_index == 0 || !shared {
+                        self.create_tile_codec(category, tile_index)?;
+                    }
+                    self.tiles[category.usize()][tile_index].codec_index = self.codecs.len() - 1;
+                }
+            }
+            self.codec_max_frame_delay = 1;
+        } else if !self.settings.tiled_output && self.can_use_single_codec()? {
             self.codecs = create_vec_exact(1)?;
+            // The instance decodes the frames of all the categories.
+            let frame_size_limit = Category::ALL
+                .iter()
+                .filter(|category| !self.tiles[category.usize()].is_empty())
+                .map(|category| self.frame_size_limit(*category))
+                .max()
+                .unwrap_or(self.settings.image_size_limit);
+            let color_tile = &self.tiles[Category::Color.usize()][0];
             self.create_codec(
-                self.tiles[Category::Color.usize()][0].operating_point,
-                self.tiles[Category::Color.usize()][0].input.all_layers,
+                color_tile.operating_point,
+                color_tile.input.all_layers,
+                frame_size_limit,
+                false,
+                (color_tile.width, color_tile.height),
             )?;
             for tiles in &mut self.tiles {
                 for tile in tiles {
@@ -1118,12 +1952,13 @@ impl Decoder {
                 }
             }
         } else {
-            self.codecs = create_vec_exact(self.tiles.iter().map(|tiles| tiles.len()).sum())?;
-            for category in Category::ALL_USIZE {
-                for tile_index in 0..self.tiles[category].len() {
-                    let tile = &self.tiles[category][tile_index];
-                    self.create_codec(tile.operating_point, tile.input.all_layers)?;
-                    self.tiles[category][tile_index].codec_index = self.codecs.len() - 1;
+            let codec_count = self.tiles.iter().map(|tiles| tiles.len()).sum();
+            self.codecs = create_vec_exact(codec_count)?;
+            self.codec_max_threads = self.codec_threads(max_threads, codec_count);
+            for category in Category::ALL {
+                for tile_index in 0..self.tiles[category.usize()].len() {
+                    self.create_tile_codec(category, tile_index)?;
+                    self.tiles[category.usize()][tile_index].codec_index = self.codecs.len() - 1;
                 }
             }
         }
@@ -1138,18 +1973,16 @@ impl Decoder {
         max_num_bytes: Option<usize>, // Bytes read past that size will be ignored.
     ) -> AvifResult<()> {
         let tile = &mut self.tiles[category.usize()][tile_index];
-        if tile.input.samples.len() <= image_index {
-            return Err(AvifError::NoImagesRemaining);
-        }
-        let sample = &tile.input.samples[image_index];
+        let sample = tile.input.samples.get(image_index)?;
         if sample.item_id == 0 {
             // Data comes from a track. Nothing to prepare.
             return Ok(());
         }
         // Data comes from an item.
+        let item_id = sample.item_id;
         let item = self
             .items
-            .get_mut(&sample.item_id)
+            .get(&item_id)
             .ok_or(AvifError::BmffParseFailed("".into()))?;
         if item.extents.len() == 1 {
             // Item has only one extent. Nothing to prepare.
@@ -1165,17 +1998,41 @@ impl Decoder {
         }
         // Item has multiple extents, merge them into a contiguous buffer.
         if item.data_buffer.is_none() {
-            item.data_buffer = Some(create_vec_exact(item.size)?);
+            let size = self.buffer_pool.allocation_size(&[item.size], false)?;
+            self.reserve_memory(size)?;
+        }
+        let item = self.items.get_mut(&item_id).unwrap();
+        if item.data_buffer.is_none() {
+            let data_buffer = self.buffer_pool.take(item.size)?;
+            self.items_memory_size += data_buffer.capacity();
+            item.data_buffer = Some(data_buffer);
         }
         let data = item.data_buffer.unwrap_mut();
         let mut bytes_to_skip = data.len(); // These extents were already merged.
-        for extent in &item.extents {
+        let mut extent_index = 0;
+        while extent_index < item.extents.len() {
+            let extent = &item.extents[extent_index];
+            extent_index += 1;
             if bytes_to_skip != 0 {
                 checked_decr!(bytes_to_skip, extent.size);
                 continue;
             }
+            // Extents that directly follow each other are read at once (until max_num_bytes is
+            // reached).
+            let mut read_size = extent.size;
+            let mut end_offset = checked_add!(extent.offset, u64_from_usize(extent.size)?)?;
+            while extent_index < item.extents.len()
+                && item.extents[extent_index].offset == end_offset
+                && !max_num_bytes
+                    .is_some_and(|max_num_bytes| data.len() + read_size >= max_num_bytes)
+            {
+                let next_extent = &item.extents[extent_index];
+                checked_incr!(read_size, next_extent.size);
+                checked_incr!(end_offset, u64_from_usize(next_extent.size)?);
+                extent_index += 1;
+            }
             let io = self.io.unwrap_mut();
-            data.extend_from_slice(io.read_exact(extent.offset, extent.size)?);
+            data.extend_from_slice(io.read_exact(extent.offset, read_size)?);
             if max_num_bytes.is_some_and(|max_num_bytes| data.len() >= max_num_bytes) {
                 return Ok(()); // There are enough merged extents to satisfy max_num_bytes.
             }
@@ -1187,6 +2044,9 @@ impl Decoder {
 
     fn prepare_samples(&mut self, image_index: usize) -> AvifResult<()> {
         for category in Category::ALL {
+            if self.skipped_categories[category.usize()] {
+                continue;
+            }
             for tile_index in 0..self.tiles[category.usize()].len() {
                 self.prepare_sample(image_index, category, tile_index, None)?;
             }
@@ -1194,145 +2054,834 @@ impl Decoder {
         Ok(())
     }
 
-    fn decode_tile(
-        &mut self,
-        image_index: usize,
-        category: Category,
-        tile_index: usize,
-    ) -> AvifResult<()> {
-        // Split the tiles array into two mutable arrays so that we can validate the
-        // properties of tiles with index > 0 with that of the first tile.
-        let (tiles_slice1, tiles_slice2) = self.tiles[category.usize()].split_at_mut(tile_index);
-        let tile = &mut tiles_slice2[0];
-        let sample = &tile.input.samples[image_index];
-        let io = &mut self.io.unwrap_mut();
-
-        let codec = &mut self.codecs[tile.codec_index];
-        let item_data_buffer = if sample.item_id == 0 {
-            &None
-        } else {
-            &self.items.get(&sample.item_id).unwrap().data_buffer
-        };
-        let data = sample.data(io, item_data_buffer)?;
-        codec.get_next_image(data, sample.spatial_id, &mut tile.image, category)?;
-        checked_incr!(self.tile_info[category.usize()].decoded_tile_count, 1);
+    // Returns an upper bound of the size in bytes of the buffers that finish_tile_decoding()
+    // allocates for |tile|.
+    fn tile_finishing_size(tile: &Tile, category: Category) -> AvifResult<usize> {
+        let image = &tile.image;
+        let mut size: usize = 0;
+        if category == Category::Alpha
+            && image.yuv_range == YuvRange::Limited
+            && image.planes[3]
+                .as_ref()
+                .is_some_and(|pixels| pixels.is_pointer())
+        {
+            // The planes of the codec are copied.
+            checked_incr!(size, image.category_planes_size(category)?);
+        }
+        if image.width != tile.width || image.height != tile.height {
+            // The source planes are copied and the scaled planes are allocated.
+            let scaled_image = Image {
+                width: tile.width,
+                height: tile.height,
+                depth: image.depth,
+                yuv_format: image.yuv_format,
+                ..Default::default()
+            };
+            checked_incr!(size, image.owned_planes_size(category.planes()));
+            checked_incr!(size, scaled_image.category_planes_size(category)?);
+        }
+        Ok(size)
+    }
 
+    // Performs the steps that follow the decoding of a tile and that only involve the tile
+    // itself. Fails if that needs more than |available_memory| bytes. Returns the span of the
+    // scaling if |timed| is true.
+    fn finish_tile_decoding(
+        tile: &mut Tile,
+        category: Category,
+        timed: bool,
+        available_memory: usize,
+    ) -> AvifResult<Option<TraceSpan>> {
+        if Self::tile_finishing_size(tile, category)? > available_memory {
+            return Err(AvifError::OutOfMemory);
+        }
         if category == Category::Alpha && tile.image.yuv_range == YuvRange::Limited {
             tile.image.alpha_to_full_range()?;
         }
-        tile.image.scale(tile.width, tile.height, category)?;
+        let (result, span) = instrumentation::timed(DecodeStage::Scale, timed, || {
+            tile.image.scale(tile.width, tile.height, category)
+        });
+        result.map(|_| span)
+    }
 
-        if self.tile_info[category.usize()].is_grid() {
-            if tile_index == 0 {
-                // Validate the grid image size
-                let grid = &self.tile_info[category.usize()].grid;
-                if checked_mul!(tile.image.width, grid.columns)? < grid.width
-                    || checked_mul!(tile.image.height, grid.rows)? < grid.height
-                {
-                    return Err(AvifError::InvalidImageGrid(
-                        "Grid image tiles do not completely cover the image (HEIF (ISO/IEC 23008-12:2017), Section 6.6.2.3.1)".into(),
-                    ));
-                }
-                if checked_mul!(tile.image.width, grid.columns - 1)? >= grid.width
-                    || checked_mul!(tile.image.height, grid.rows - 1)? >= grid.height
-                {
-                    return Err(AvifError::InvalidImageGrid(
-                        "Grid image tiles in the rightmost column and bottommost row do not overlap the reconstructed image grid canvas. See MIAF (ISO/IEC 23000-22:2019), Section 7.3.11.4.2, Figure 2".into(),
-                    ));
-                }
+    // Validates the dimensions of a decoded tile against the canvas of its |grid|.
+    fn validate_grid_tile_size(grid: &Grid, tile: &Tile) -> AvifResult<()> {
+        if checked_mul!(tile.image.width, grid.columns)? < grid.width
+            || checked_mul!(tile.image.height, grid.rows)? < grid.height
+        {
+            return Err(AvifError::InvalidImageGrid(
+                "Grid image tiles do not completely cover the image (HEIF (ISO/IEC 23008-12:2017), Section 6.6.2.3.1)".into(),
+            ));
+        }
+        if checked_mul!(tile.image.width, grid.columns - 1)? >= grid.width
+            || checked_mul!(tile.image.height, grid.rows - 1)? >= grid.height
+        {
+            return Err(AvifError::InvalidImageGrid(
+                "Grid image tiles in the rightmost column and bottommost row do not overlap the reconstructed image grid canvas. See MIAF (ISO/IEC 23000-22:2019), Section 7.3.11.4.2, Figure 2".into(),
+            ));
+        }
+        Ok(())
+    }
+
+    // Validates that a decoded grid tile has the same properties as the first decoded tile of
+    // the grid.
+    fn validate_grid_tile_properties(tile: &Tile, first_tile: &Tile) -> AvifResult<()> {
+        let first_tile_image = &first_tile.image;
+        if tile.image.width != first_tile_image.width
+            || tile.image.height != first_tile_image.height
+            || tile.image.depth != first_tile_image.depth
+            || tile.image.yuv_format != first_tile_image.yuv_format
+            || tile.image.yuv_range != first_tile_image.yuv_range
+            || tile.image.color_primaries != first_tile_image.color_primaries
+            || tile.image.transfer_characteristics != first_tile_image.transfer_characteristics
+            || tile.image.matrix_coefficients != first_tile_image.matrix_coefficients
+        {
+            return Err(AvifError::InvalidImageGrid(
+                "grid image contains mismatched tiles".into(),
+            ));
+        }
+        Ok(())
+    }
 
+    // Validates a decoded tile and copies (or steals) its planes into |image|. |first_tile| is
+    // the first tile of the category and must be None when |tile_index| is 0. If |tiled_output|
+    // is true, grid tiles are only validated and |image| does not get any planes. Returns the
+    // number of bytes that were copied.
+    fn copy_tile_into_image(
+        image: &mut Image,
+        tile_info: &TileInfo,
+        tile: &Tile,
+        first_tile: Option<&Tile>,
+        tile_index: usize,
+        category: Category,
+        tiled_output: bool,
+        buffer_pool: &mut BufferPool,
+    ) -> AvifResult<usize> {
+        if tile_info.is_grid() {
+            if tile_index == 0 {
+                let grid = &tile_info.grid;
+                Self::validate_grid_tile_size(grid, tile)?;
                 match category {
-                    Category::Color => {
-                        self.image.width = grid.width;
-                        self.image.height = grid.height;
+                    Category::Color | Category::Gainmap => {
+                        image.width = grid.width;
+                        image.height = grid.height;
                         // Adopt the yuv_format and depth.
-                        self.image.yuv_format = tile.image.yuv_format;
-                        self.image.depth = tile.image.depth;
-                        self.image.allocate_planes(category)?;
+                        image.yuv_format = tile.image.yuv_format;
+                        image.depth = tile.image.depth;
+                        if !tiled_output {
+                            image.allocate_planes_with_pool(category, buffer_pool)?;
+                        }
                     }
                     Category::Alpha => {
                         // Alpha is always just one plane and the depth has been validated
                         // to be the same as the color planes' depth.
-                        self.image.allocate_planes(category)?;
-                    }
-                    Category::Gainmap => {
-                        self.gainmap.image.width = grid.width;
-                        self.gainmap.image.height = grid.height;
-                        // Adopt the yuv_format and depth.
-                        self.gainmap.image.yuv_format = tile.image.yuv_format;
-                        self.gainmap.image.depth = tile.image.depth;
-                        self.gainmap.image.allocate_planes(category)?;
+                        if !tiled_output {
+                            image.allocate_planes_with_pool(category, buffer_pool)?;
+                        }
                     }
                 }
             }
-            if !tiles_slice1.is_empty() {
-                let first_tile_image = &tiles_slice1[0].image;
-                if tile.image.width != first_tile_image.width
-                    || tile.image.height != first_tile_image.height
-                    || tile.image.depth != first_tile_image.depth
-                    || tile.image.yuv_format != first_tile_image.yuv_format
-                    || tile.image.yuv_range != first_tile_image.yuv_range
-                    || tile.image.color_primaries != first_tile_image.color_primaries
-                    || tile.image.transfer_characteristics
-                        != first_tile_image.transfer_characteristics
-                    || tile.image.matrix_coefficients != first_tile_image.matrix_coefficients
-                {
-                    return Err(AvifError::InvalidImageGrid(
-                        "grid image contains mismatched tiles".into(),
-                    ));
-                }
+            if let Some(first_tile) = first_tile {
+                Self::validate_grid_tile_properties(tile, first_tile)?;
             }
-            match category {
-                Category::Gainmap => self.gainmap.image.copy_from_tile(
-                    &tile.image,
-                    &self.tile_info[category.usize()],
-                    tile_index as u32,
-                    category,
-                )?,
-                _ => {
-                    self.image.copy_from_tile(
-                        &tile.image,
-                        &self.tile_info[category.usize()],
-                        tile_index as u32,
-                        category,
-                    )?;
-                }
+            if tiled_output {
+                Ok(0)
+            } else {
+                image.copy_from_tile(&tile.image, tile_info, tile_index as u32, category)
             }
         } else {
             // Non grid path, steal or copy planes from the only tile.
             match category {
-                Category::Color => {
-                    self.image.width = tile.image.width;
-                    self.image.height = tile.image.height;
-                    self.image.depth = tile.image.depth;
-                    self.image.yuv_format = tile.image.yuv_format;
-                    self.image.steal_or_copy_from(&tile.image, category)?;
+                Category::Color | Category::Gainmap => {
+                    image.width = tile.image.width;
+                    image.height = tile.image.height;
+                    image.depth = tile.image.depth;
+                    image.yuv_format = tile.image.yuv_format;
+                    image.steal_or_copy_from(&tile.image, category)
                 }
                 Category::Alpha => {
-                    if !self.image.has_same_properties(&tile.image) {
+                    if !image.has_same_properties(&tile.image) {
                         return Err(AvifError::DecodeAlphaFailed);
                     }
-                    self.image.steal_or_copy_from(&tile.image, category)?;
-                }
-                Category::Gainmap => {
-                    self.gainmap.image.width = tile.image.width;
-                    self.gainmap.image.height = tile.image.height;
-                    self.gainmap.image.depth = tile.image.depth;
-                    self.gainmap.image.yuv_format = tile.image.yuv_format;
-                    self.gainmap
-                        .image
-                        .steal_or_copy_from(&tile.image, category)?;
+                    image.steal_or_copy_from(&tile.image, category)
                 }
             }
         }
-        Ok(())
     }
 
-    fn decode_tiles(&mut self, image_index: usize) -> AvifResult<()> {
-        for category in Category::ALL {
+    fn decode_tile(
+        &mut self,
+        image_index: usize,
+        category: Category,
+        tile_index: usize,
+    ) -> AvifResult<()> {
+        let available_memory = self.available_memory();
+        let tile = &mut self.tiles[category.usize()][tile_index];
+        let sample = tile.input.samples.get(image_index)?;
+        let io = &mut self.io.unwrap_mut();
+
+        let codec = &mut self.codecs[tile.codec_index];
+        let item_data_buffer = if sample.item_id == 0 {
+            &None
+        } else {
+            &self.items.get(&sample.item_id).unwrap().data_buffer
+        };
+        let data = sample.data(io, item_data_buffer)?;
+        let timed = self.instrumentation.timed();
+        let (result, span) = instrumentation::timed(DecodeStage::Codec, timed, || {
+            codec.get_next_image(data, sample.spatial_id, &mut tile.image, category)
+        });
+        self.instrumentation.report(span);
+        result?;
+        self.output_decoded_tile(category, tile_index, available_memory)
+    }
+
+    // Finishes the decoding of the tile |tile_index| of |category|, into which the codec just
+    // output a frame, and copies it into the image. Fails if finishing the tile needs more than
+    // |available_memory| bytes.
+    fn output_decoded_tile(
+        &mut self,
+        category: Category,
+        tile_index: usize,
+        available_memory: usize,
+    ) -> AvifResult<()> {
+        // Split the tiles array into two mutable arrays so that we can validate the
+        // properties of tiles with index > 0 with that of the first tile.
+        let (tiles_slice1, tiles_slice2) = self.tiles[category.usize()].split_at_mut(tile_index);
+        let tile = &mut tiles_slice2[0];
+        let timed = self.instrumentation.timed();
+        checked_incr!(self.tile_info[category.usize()].decoded_tile_count, 1);
+        self.instrumentation.add_tile();
+        let span = Self::finish_tile_decoding(tile, category, timed, available_memory);
+        tile.account_memory(&mut self.tiles_memory_size);
+        self.instrumentation.report(span?);
+
+        let image = match category {
+            Category::Gainmap => &mut self.gainmap.image,
+            _ => &mut self.image,
+        };
+        let (result, span) = instrumentation::timed(DecodeStage::TileCopy, timed, || {
+            Self::copy_tile_into_image(
+                image,
+                &self.tile_info[category.usize()],
+                tile,
+                tiles_slice1.first(),
+                tile_index,
+                category,
+                self.settings.tiled_output,
+                &mut self.buffer_pool,
+            )
+        });
+        self.instrumentation.report(span);
+        self.instrumentation.add_copied_size(result?);
+        Ok(())
+    }
+
+    // Returns the dimensions of the canvas of |category| as signaled in the file.
+    fn category_dimensions(&self, category: Category) -> (u32, u32) {
+        let tile_info = &self.tile_info[category.usize()];
+        if tile_info.is_grid() {
+            (tile_info.grid.width, tile_info.grid.height)
+        } else {
+            let tile = &self.tiles[category.usize()][0];
+            (tile.width, tile.height)
+        }
+    }
+
+    // Returns |region| (in the coordinates of the color image) in the coordinates of |category|.
+    // The gain map may be smaller than the color image, in which case the region is scaled and
+    // rounded outwards, with its top left corner at even coordinates.
+    fn category_region(&self, category: Category, region: &CropRect) -> AvifResult<CropRect> {
+        if category != Category::Gainmap {
+            return Ok(*region);
+        }
+        let (color_width, color_height) = self.category_dimensions(Category::Color);
+        let (width, height) = self.category_dimensions(category);
+        let scale = |start: u32, size: u32, from: u32, to: u32| -> AvifResult<(u32, u32)> {
+            let from = u64::from(from);
+            let to = u64::from(to);
+            let end = checked_add!(u64::from(start), u64::from(size))?;
+            let scaled_start = (u64::from(start) * to / from) & !1;
+            let scaled_end = min((end * to).div_ceil(from), to);
+            Ok((
+                u32_from_u64(scaled_start)?,
+                u32_from_u64(scaled_end - scaled_start)?,
+            ))
+        };
+        let (x, width) = scale(region.x, region.width, color_width, width)?;
+        let (y, height) = scale(region.y, region.height, color_height, height)?;
+        Ok(CropRect {
+            x,
+            y,
+            width,
+            height,
+        })
+    }
+
+    // Returns the indices of the tiles of |category| that intersect |region|, in decoding order.
+    fn tiles_in_region(&self, category: Category, region: &CropRect) -> AvifResult<Vec<usize>> {
+        let tile_info = &self.tile_info[category.usize()];
+        if !tile_info.is_grid() {
+            return Ok(vec![0]);
+        }
+        let grid = &tile_info.grid;
+        let tile = &self.tiles[category.usize()][0];
+        if tile.width == 0 || tile.height == 0 {
+            return Err(AvifError::InvalidImageGrid(
+                "invalid tile dimensions".into(),
+            ));
+        }
+        let first_column = region.x / tile.width;
+        let last_column = min(
+            (checked_add!(region.x, region.width)? - 1) / tile.width,
+            grid.columns - 1,
+        );
+        let first_row = region.y / tile.height;
+        let last_row = min(
+            (checked_add!(region.y, region.height)? - 1) / tile.height,
+            grid.rows - 1,
+        );
+        let mut tile_indices = Vec::new();
+        for row in first_row..=last_row {
+            for column in first_column..=last_column {
+                tile_indices.push(usize_from_u32(checked_add!(
+                    checked_mul!(row, grid.columns)?,
+                    column
+                )?)?);
+            }
+        }
+        Ok(tile_indices)
+    }
+
+    // Same as copy_tile_into_image() but only the part of the tile that intersects |region| is
+    // copied, into an image that has the dimensions of |region|. |first_tile| is the first tile of
+    // the category that was decoded for the region and must be None for that tile itself.
+    #[allow(clippy::too_many_arguments)]
+    fn copy_tile_into_region(
+        image: &mut Image,
+        tile_info: &TileInfo,
+        tile: &Tile,
+        first_tile: Option<&Tile>,
+        tile_index: usize,
+        category: Category,
+        region: &CropRect,
+        buffer_pool: &mut BufferPool,
+    ) -> AvifResult<usize> {
+        if tile_info.is_grid() {
+            match first_tile {
+                Some(first_tile) => Self::validate_grid_tile_properties(tile, first_tile)?,
+                None => Self::validate_grid_tile_size(&tile_info.grid, tile)?,
+            }
+        }
+        if first_tile.is_none() {
+            match category {
+                Category::Color | Category::Gainmap => {
+                    image.width = region.width;
+                    image.height = region.height;
+                    image.yuv_format = tile.image.yuv_format;
+                    image.depth = tile.image.depth;
+                }
+                Category::Alpha => {
+                    if tile.image.depth != image.depth {
+                        return Err(AvifError::DecodeAlphaFailed);
+                    }
+                }
+            }
+            // The planes may point into the buffers of the codecs.
+            image.release_category_planes_to_pool(category, buffer_pool);
+            image.allocate_planes_with_pool(category, buffer_pool)?;
+        }
+        let (tile_x, tile_y) = if tile_info.is_grid() {
+            let tile_index = u32_from_usize(tile_index)?;
+            (
+                checked_mul!(tile_index % tile_info.grid.columns, tile.image.width)?,
+                checked_mul!(tile_index / tile_info.grid.columns, tile.image.height)?,
+            )
+        } else {
+            (0, 0)
+        };
+        image.copy_region_from_tile(&tile.image, tile_x, tile_y, region, category)
+    }
+
+    fn decode_region_tile(
+        &mut self,
+        category: Category,
+        tile_index: usize,
+        first_tile_index: Option<usize>,
+        region: &CropRect,
+    ) -> AvifResult<()> {
+        let available_memory = self.available_memory();
+        let tile = &mut self.tiles[category.usize()][tile_index];
+        let sample = tile.input.samples.get(0)?;
+        let codec = &mut self.codecs[tile.codec_index];
+        let item_data_buffer = &self.items.get(&sample.item_id).unwrap().data_buffer;
+        let data = sample.data(self.io.unwrap_mut(), item_data_buffer)?;
+        let timed = self.instrumentation.timed();
+        let (result, span) = instrumentation::timed(DecodeStage::Codec, timed, || {
+            codec.get_next_image(data, sample.spatial_id, &mut tile.image, category)
+        });
+        self.instrumentation.report(span);
+        result?;
+        self.instrumentation.add_tile();
+        let span = Self::finish_tile_decoding(tile, category, timed, available_memory);
+        tile.account_memory(&mut self.tiles_memory_size);
+        self.instrumentation.report(span?);
+
+        let tiles = &self.tiles[category.usize()];
+        let image = match category {
+            Category::Gainmap => &mut self.gainmap.image,
+            _ => &mut self.image,
+        };
+        let (result, span) = instrumentation::timed(DecodeStage::TileCopy, timed, || {
+            Self::copy_tile_into_region(
+                image,
+                &self.tile_info[category.usize()],
+                &tiles[tile_index],
+                first_tile_index.map(|index| &tiles[index]),
+                tile_index,
+                category,
+                region,
+                &mut self.buffer_pool,
+            )
+        });
+        self.instrumentation.report(span);
+        self.instrumentation.add_copied_size(result?);
+        Ok(())
+    }
+
+    // Creates one thread of worker_pool per codec instance used by the tiles of |category| from
+    // |first_tile_index|. Returns false if the threads cannot be created, in which case the tiles
+    // have to be decoded one after the other.
+    fn create_grid_tile_threads(&mut self, category: Category, first_tile_index: usize) -> bool {
+        let mut codec_indices: Vec<usize> = self.tiles[category.usize()][first_tile_index..]
+            .iter()
+            .map(|tile| tile.codec_index)
+            .collect();
+        codec_indices.sort_unstable();
+        codec_indices.dedup();
+        self.worker_pool.create_threads(codec_indices.len()).is_ok()
+    }
+
+    // Decodes the tiles of a grid category starting at |first_tile_index| with one thread per
+    // codec instance. The payloads are read on the calling thread (the IO is not thread safe) and
+    // each tile is validated and copied into the output image on the calling thread as soon as it
+    // has been decoded. The returned error and the resulting decoded_tile_count are the same as
+    // if the tiles had been decoded one after the other by decode_tile().
+    fn decode_grid_tiles_in_parallel(
+        &mut self,
+        image_index: usize,
+        category: Category,
+        first_tile_index: usize,
+    ) -> AvifResult<()> {
+        // The payloads point into the merged extents of the items and into the data of the IO if
+        // it is persistent. Otherwise they have to be copied since each read may invalidate the
+        // data of the previous one.
+        let persistent = self.io.unwrap_ref().persistent();
+        let is_copied = |sample: &DecodeSample, items: &Items| {
+            !persistent
+                && (sample.item_id == 0
+                    || items.get(&sample.item_id).unwrap().data_buffer.is_none())
+        };
+        let mut copies_size: usize = 0;
+        for tile in &self.tiles[category.usize()][first_tile_index..] {
+            let sample = tile.input.samples.get(image_index)?;
+            if is_copied(&sample, &self.items) {
+                checked_incr!(copies_size, sample.size);
+            }
+        }
+        self.reserve_memory(copies_size)?;
+        let available_memory = self.available_memory();
+
+        enum Payload<'a> {
+            Borrowed(&'a [u8]),
+            Copied(usize), // Index in copies.
+        }
+        let tile_count = self.tiles[category.usize()].len();
+        let mut read_payloads: Vec<Payload> = create_vec_exact(tile_count - first_tile_index)?;
+        let mut copies: Vec<Vec<u8>> = Vec::new();
+        let mut read_error = None;
+        for tile in &self.tiles[category.usize()][first_tile_index..] {
+            let sample = tile.input.samples.get(image_index)?;
+            let copied = is_copied(&sample, &self.items);
+            let item_data_buffer = if sample.item_id == 0 {
+                &None
+            } else {
+                &self.items.get(&sample.item_id).unwrap().data_buffer
+            };
+            match sample.data(self.io.unwrap_mut(), item_data_buffer) {
+                Ok(data) if copied => {
+                    let mut payload = create_vec_exact(data.len())?;
+                    payload.extend_from_slice(data);
+                    copies.push(payload);
+                    read_payloads.push(Payload::Copied(copies.len() - 1));
+                }
+                Ok(data) => {
+                    // SAFETY: The data of a persistent IO stays valid until the IO is destroyed
+                    // and the items are not modified before the end of this function.
+                    read_payloads.push(Payload::Borrowed(unsafe {
+                        std::slice::from_raw_parts(data.as_ptr(), data.len())
+                    }));
+                }
+                Err(err) => {
+                    // Decode whatever is available (this is the same as the serial path
+                    // stopping at the first tile whose data cannot be read).
+                    read_error = Some(err);
+                    break;
+                }
+            }
+        }
+        let payloads: Vec<&[u8]> = read_payloads
+            .iter()
+            .map(|payload| match payload {
+                Payload::Borrowed(data) => *data,
+                Payload::Copied(index) => &copies[*index][..],
+            })
+            .collect();
+        let readable_tile_count = payloads.len();
+        // Each tile may use an equal share of the memory that is left for the finishing steps.
+        let tile_available_memory = if readable_tile_count == 0 {
+            0
+        } else {
+            available_memory / readable_tile_count
+        };
+
+        // Group the tiles by codec instance. The tiles of a given instance have to be decoded in
+        // order on the same thread.
+        let (decoded_tiles, pending_tiles) =
+            self.tiles[category.usize()].split_at_mut(first_tile_index);
+        let mut codecs: Vec<Option<&mut Codec>> = self.codecs.iter_mut().map(Some).collect();
+        let mut worker_indices: Vec<Option<usize>> = vec![None; codecs.len()];
+        let mut workers: Vec<TileDecodeWorker> = Vec::new();
+        for (offset, (tile, payload)) in pending_tiles.iter_mut().zip(payloads).enumerate() {
+            let codec_index = tile.codec_index;
+            if codec_index >= codecs.len() {
+                return Err(AvifError::UnknownError("invalid codec index".into()));
+            }
+            let worker_index = match worker_indices[codec_index] {
+                Some(worker_index) => worker_index,
+                None => {
+                    workers.push(TileDecodeWorker {
+                        codec: codecs[codec_index].take().unwrap(),
+                        jobs: Vec::new(),
+                        timed: self.instrumentation.timed(),
+                        available_memory: tile_available_memory,
+                    });
+                    worker_indices[codec_index] = Some(workers.len() - 1);
+                    workers.len() - 1
+                }
+            };
+            let spatial_id = tile.input.samples.get(image_index)?.spatial_id;
+            workers[worker_index].jobs.push(TileDecodeJob {
+                tile_index: first_tile_index + offset,
+                tile,
+                payload,
+                spatial_id,
+            });
+        }
+
+        let tiled_output = self.settings.tiled_output;
+        let tile_info = &self.tile_info[category.usize()];
+        let buffer_pool = &mut self.buffer_pool;
+        let instrumentation = &mut self.instrumentation;
+        let timed = instrumentation.timed();
+        let image = match category {
+            Category::Gainmap => &mut self.gainmap.image,
+            _ => &mut self.image,
+        };
+        // The lowest tile index for which an error occurred, whether that error occurred after
+        // the tile was decoded, and the error itself.
+        let mut first_error: Option<(usize, bool, AvifError)> = None;
+        let (result_sender, result_receiver) = mpsc::channel();
+        let mut ack_senders = Vec::with_capacity(workers.len());
+        let mut tasks: Vec<Task> = Vec::with_capacity(workers.len());
+        for (worker_index, worker) in workers.into_iter().enumerate() {
+            let (ack_sender, ack_receiver) = mpsc::channel();
+            ack_senders.push(ack_sender);
+            let result_sender = result_sender.clone();
+            tasks.push(Box::new(move || {
+                worker.run(worker_index, category, result_sender, ack_receiver)
+            }));
+        }
+        drop(result_sender);
+        // The threads were created by create_grid_tile_threads() so this does not fail.
+        self.worker_pool.run(tasks, || {
+            // The first tile has to be processed before any other since it determines the
+            // dimensions of the output image. Tiles that finish earlier are kept aside.
+            let mut first_tile: Option<&Tile> = decoded_tiles.first();
+            let mut first_tile_processed = first_tile_index > 0;
+            let mut waiting_results: Vec<TileDecodeResult> = Vec::new();
+            for result in result_receiver {
+                let mut ready_results = vec![result];
+                if !first_tile_processed {
+                    if ready_results[0].job.tile_index != 0 {
+                        waiting_results.append(&mut ready_results);
+                        continue;
+                    }
+                    first_tile_processed = true;
+                    waiting_results.sort_by_key(|result| result.job.tile_index);
+                    ready_results.append(&mut waiting_results);
+                }
+                for result in ready_results {
+                    let tile_index = result.job.tile_index;
+                    let skip = first_error
+                        .as_ref()
+                        .is_some_and(|error| error.0 < tile_index);
+                    instrumentation.report(result.codec_span);
+                    instrumentation.report(result.scale_span);
+                    if result.decoded {
+                        instrumentation.add_tile();
+                    }
+                    if !skip {
+                        let tile: &Tile = result.job.tile;
+                        let status = result.status.and_then(|_| {
+                            let (result, span) =
+                                instrumentation::timed(DecodeStage::TileCopy, timed, || {
+                                    Self::copy_tile_into_image(
+                                        image,
+                                        tile_info,
+                                        tile,
+                                        first_tile,
+                                        tile_index,
+                                        category,
+                                        tiled_output,
+                                        buffer_pool,
+                                    )
+                                });
+                            instrumentation.report(span);
+                            instrumentation.add_copied_size(result?);
+                            Ok(())
+                        });
+                        if tile_index == 0 {
+                            first_tile = Some(tile);
+                        }
+                        if let Err(err) = status {
+                            first_error = Some((tile_index, result.decoded, err));
+                        }
+                    }
+                    // Let the worker move on to its next tile (if it is still needed).
+                    let max_tile_index = first_error.as_ref().map_or(usize::MAX, |error| error.0);
+                    let _ = ack_senders[result.worker_index].send(max_tile_index);
+                }
+            }
+        })?;
+        for tile in &mut self.tiles[category.usize()][first_tile_index..] {
+            tile.account_memory(&mut self.tiles_memory_size);
+        }
+
+        let tile_info = &mut self.tile_info[category.usize()];
+        if let Some((tile_index, decoded, err)) = first_error {
+            tile_info.decoded_tile_count = u32_from_usize(tile_index + usize::from(decoded))?;
+            return Err(err);
+        }
+        tile_info.decoded_tile_count = u32_from_usize(first_tile_index + readable_tile_count)?;
+        match read_error {
+            Some(err) => Err(err),
+            None => Ok(()),
+        }
+    }
+
+    // Decodes the frame |image_index| of a track with the codecs of the frame pipeline. Each codec
+    // is first sent the samples that follow the last one it was sent, up to frame_pipeline_depth
+    // samples starting at |image_index|.
+    fn decode_pipelined_frame(&mut self, image_index: usize) -> AvifResult<()> {
+        let available_memory = self.available_memory();
+        let pipeline = self.frame_pipeline.unwrap_mut();
+        let io = self.io.unwrap_mut();
+        let timed = self.instrumentation.timed();
+        for category in Category::ALL {
+            let tile_info = &mut self.tile_info[category.usize()];
+            if self.tiles[category.usize()].is_empty()
+                || tile_info.is_fully_decoded()
+                || self.skipped_categories[category.usize()]
+            {
+                continue;
+            }
+            let tile = &mut self.tiles[category.usize()][0];
+            let codec = &mut self.codecs[tile.codec_index];
+            let end_sample = min(
+                checked_add!(image_index, self.settings.frame_pipeline_depth as usize)?,
+                tile.input.samples.len(),
+            );
+            let next_sample = &mut pipeline.next_sample[category.usize()];
+            if self.codec_missed_samples[category.usize()] {
+                // Resuming at a keyframe. The samples that were skipped are not needed.
+                *next_sample = max(*next_sample, image_index);
+            }
+            while *next_sample < end_sample {
+                let sample = tile.input.samples.get(*next_sample)?;
+                let data = match sample.data(io, &None) {
+                    Ok(data) => data,
+                    // The samples that follow the requested frame may not be available yet.
+                    Err(AvifError::WaitingOnIo) if *next_sample > image_index => break,
+                    Err(err) => return Err(err),
+                };
+                let sample_index = u64_from_usize(*next_sample)?;
+                let (result, span) = instrumentation::timed(DecodeStage::Codec, timed, || {
+                    codec.send_sample(data, sample_index)
+                });
+                self.instrumentation.report(span);
+                result?;
+                *next_sample += 1;
+            }
+            let spatial_id = tile.input.samples.get(image_index)?.spatial_id;
+            let sample_index = u64_from_usize(image_index)?;
+            let (result, span) = instrumentation::timed(DecodeStage::Codec, timed, || {
+                codec.receive_frame(sample_index, spatial_id, &mut tile.image, category)
+            });
+            self.instrumentation.report(span);
+            result?;
+            checked_incr!(tile_info.decoded_tile_count, 1);
+            self.instrumentation.add_tile();
+            let span = Self::finish_tile_decoding(tile, category, timed, available_memory);
+            tile.account_memory(&mut self.tiles_memory_size);
+            self.instrumentation.report(span?);
+            let (result, span) = instrumentation::timed(DecodeStage::TileCopy, timed, || {
+                Self::copy_tile_into_image(
+                    &mut self.image,
+                    tile_info,
+                    tile,
+                    None,
+                    0,
+                    category,
+                    self.settings.tiled_output,
+                    &mut self.buffer_pool,
+                )
+            });
+            self.instrumentation.report(span);
+            self.instrumentation.add_copied_size(result?);
+        }
+        pipeline.next_frame = checked_add!(image_index, 1)?;
+        Ok(())
+    }
+
+    // Returns true if the tiles of the grid |category| are decoded by a single codec instance that
+    // can keep several of them in flight (see Settings::frame_pipeline_depth).
+    fn can_pipeline_grid_tiles(&self, category: Category) -> bool {
+        let tiles = &self.tiles[category.usize()];
+        !self.settings.tiled_output
+            && self.can_share_codecs_across_tiles(category)
+            && tiles
+                .iter()
+                .all(|tile| tile.codec_index == tiles[0].codec_index)
+            && self
+                .codecs
+                .get(tiles[0].codec_index)
+                .is_some_and(|codec| codec.can_pipeline_frames())
+    }
+
+    // Decodes the tiles of the grid |category| from |first_tile_index| with the codec instance
+    // that they share. The codec is sent up to frame_pipeline_depth tiles ahead of the one that
+    // it outputs, so that it decodes them in parallel. The sample index of a tile is its index.
+    fn decode_grid_tiles_pipelined(
+        &mut self,
+        image_index: usize,
+        category: Category,
+        first_tile_index: usize,
+    ) -> AvifResult<()> {
+        let result = self.send_and_receive_grid_tiles(image_index, category, first_tile_index);
+        if result.is_err() {
+            // Drops the tiles in flight so that the tiles that were not output can be sent again
+            // by the next call (see Settings::allow_incremental).
+            let codec_index = self.tiles[category.usize()][0].codec_index;
+            let _ = self.codecs[codec_index].flush();
+        }
+        result
+    }
+
+    fn send_and_receive_grid_tiles(
+        &mut self,
+        image_index: usize,
+        category: Category,
+        first_tile_index: usize,
+    ) -> AvifResult<()> {
+        let timed = self.instrumentation.timed();
+        let tile_count = self.tiles[category.usize()].len();
+        let mut next_tile_index = first_tile_index;
+        for tile_index in first_tile_index..tile_count {
+            let end_tile_index = min(
+                checked_add!(tile_index, self.settings.frame_pipeline_depth as usize)?,
+                tile_count,
+            );
+            while next_tile_index < end_tile_index {
+                let tile = &self.tiles[category.usize()][next_tile_index];
+                let sample = tile.input.samples.get(image_index)?;
+                let item_data_buffer = if sample.item_id == 0 {
+                    &None
+                } else {
+                    &self.items.get(&sample.item_id).unwrap().data_buffer
+                };
+                let data = match sample.data(self.io.unwrap_mut(), item_data_buffer) {
+                    Ok(data) => data,
+                    // The tiles that follow the next one to output may not be available yet.
+                    Err(AvifError::WaitingOnIo) if next_tile_index > tile_index => break,
+                    Err(err) => return Err(err),
+                };
+                let codec = &mut self.codecs[tile.codec_index];
+                let sample_index = u64_from_usize(next_tile_index)?;
+                let (result, span) = instrumentation::timed(DecodeStage::Codec, timed, || {
+                    codec.send_sample(data, sample_index)
+                });
+                self.instrumentation.report(span);
+                result?;
+                next_tile_index += 1;
+            }
+            let available_memory = self.available_memory();
+            let tile = &mut self.tiles[category.usize()][tile_index];
+            let spatial_id = tile.input.samples.get(image_index)?.spatial_id;
+            let codec = &mut self.codecs[tile.codec_index];
+            let sample_index = u64_from_usize(tile_index)?;
+            let (result, span) = instrumentation::timed(DecodeStage::Codec, timed, || {
+                codec.receive_frame(sample_index, spatial_id, &mut tile.image, category)
+            });
+            self.instrumentation.report(span);
+            result?;
+            self.output_decoded_tile(category, tile_index, available_memory)?;
+        }
+        Ok(())
+    }
+
+    fn decode_tiles(&mut self, image_index: usize) -> AvifResult<()> {
+        for category in Category::ALL {
+            if self.skipped_categories[category.usize()] {
+                continue;
+            }
             let previous_decoded_tile_count =
                 self.tile_info[category.usize()].decoded_tile_count as usize;
             let tile_count = self.tiles[category.usize()].len();
+            if previous_decoded_tile_count == 0
+                && self.tile_info[category.usize()].is_grid()
+                && !self.settings.tiled_output
+            {
+                // The tiles are copied into planes of the dimensions of the grid. The planes that
+                // the image already owns and the pooled buffers are reused.
+                let image = match category {
+                    Category::Gainmap => &self.gainmap.image,
+                    _ => &self.image,
+                };
+                let size = image.planes_allocation_size(category, &self.buffer_pool)?;
+                self.reserve_memory(size)?;
+            }
+            if self.settings.grid_tile_threads > 1
+                && !self.settings.tiled_output
+                && self.can_share_codecs_across_tiles(category)
+                && tile_count - previous_decoded_tile_count > 1
+                && self.create_grid_tile_threads(category, previous_decoded_tile_count)
+            {
+                self.decode_grid_tiles_in_parallel(
+                    image_index,
+                    category,
+                    previous_decoded_tile_count,
+                )?;
+                continue;
+            }
+            if self.can_pipeline_grid_tiles(category) {
+                self.decode_grid_tiles_pipelined(
+                    image_index,
+                    category,
+                    previous_decoded_tile_count,
+                )?;
+                continue;
+            }
             for tile_index in previous_decoded_tile_count..tile_count {
                 self.decode_tile(image_index, category, tile_index)?;
             }
@@ -1341,33 +2890,276 @@ impl Decoder {
     }
 
     pub fn next_image(&mut self) -> AvifResult<()> {
+        self.next_image_with_categories(&Category::ALL)
+    }
+
+    // Same as next_image() but only the samples of |categories| are read and decoded. The planes
+    // of the other categories are released. The gain map is decoded if it is requested even if
+    // Settings::enable_decoding_gainmap was false at parse time. A frame whose decoding is in
+    // progress (see Settings::allow_incremental) must be requested with the same categories until
+    // it is fully decoded.
+    pub fn next_image_with_categories(&mut self, categories: &[Category]) -> AvifResult<()> {
         if self.io.is_none() {
             return Err(AvifError::IoNotSet);
         }
-        if !self.parsing_complete() {
+        if !self.parsing_complete() || self.tiles[Category::Color.usize()].is_empty() {
+            // Nothing to decode (for example if Settings::metadata_only was set at parse time).
             return Err(AvifError::NoContent);
         }
-        if self.is_current_frame_fully_decoded() {
+        self.request_categories(categories)?;
+        let next_image_index = checked_add!(self.image_index, 1)?;
+        if next_image_index >= i32_from_u32(self.image_count)? {
+            return Err(AvifError::NoImagesRemaining);
+        }
+        if self.get_frame_from_cache(next_image_index)? {
+            return Ok(());
+        }
+        if self.codec_image_index == self.image_index && !self.requested_codec_missed_samples() {
+            self.decode_frame(next_image_index)
+        } else {
+            // The current image was taken from the frame cache.
+            self.decode_frames_until(next_image_index)
+        }
+    }
+
+    fn request_categories(&mut self, categories: &[Category]) -> AvifResult<()> {
+        for category in Category::ALL {
+            self.skipped_categories[category.usize()] = !categories.contains(&category);
+        }
+        if categories.contains(&Category::Gainmap) {
+            self.generate_deferred_gainmap_tiles()?;
+        }
+        Ok(())
+    }
+
+    // Returns true if the codec of one of the requested categories cannot decode the frame that
+    // follows codec_image_index.
+    fn requested_codec_missed_samples(&self) -> bool {
+        Category::ALL_USIZE.iter().any(|&category| {
+            !self.skipped_categories[category] && self.codec_missed_samples[category]
+        })
+    }
+
+    fn can_use_frame_cache(&self) -> bool {
+        self.frame_cache.enabled()
+            && !self.settings.tiled_output
+            && !self.settings.hardware_buffer_output
+            && self.tiles[Category::Gainmap.usize()].is_empty()
+    }
+
+    // Returns true if the frame |index| was taken from the frame cache.
+    fn get_frame_from_cache(&mut self, index: i32) -> AvifResult<bool> {
+        // The limits may have changed since the previous call.
+        self.frame_cache.set_limits(
+            self.settings.frame_cache_size_limit,
+            self.settings.frame_cache_frame_limit,
+            &mut self.buffer_pool,
+        );
+        if !self.can_use_frame_cache()
+            || (!self.is_current_frame_fully_decoded()
+                && self
+                    .tile_info
+                    .iter()
+                    .any(|info| info.decoded_tile_count != 0))
+        {
+            // The decoding of a frame that is in progress is never interrupted.
+            return Ok(false);
+        }
+        if !self
+            .frame_cache
+            .get(u32_from_i32(index)?, &mut self.image, &mut self.buffer_pool)?
+        {
+            return Ok(false);
+        }
+        for tile_info in &mut self.tile_info {
+            tile_info.decoded_tile_count = tile_info.tile_count;
+        }
+        self.image_index = index;
+        self.image_timing = self.nth_image_timing(index as u32)?;
+        Ok(true)
+    }
+
+    // Makes the frame |index| the current image again without decoding it if it is the last
+    // frame decoded by the codecs (which happens when the current image was taken from the frame
+    // cache). The tiles still hold the output of the codecs for that frame. Returns false if
+    // that output is not available.
+    fn restore_codec_output(&mut self, index: i32) -> AvifResult<bool> {
+        if index != self.codec_image_index
+            || index == self.image_index
+            || !matches!(self.source, Source::Tracks)
+            || self.requested_codec_missed_samples()
+        {
+            return Ok(false);
+        }
+        self.release_skipped_planes();
+        for category in [Category::Color, Category::Alpha] {
+            if self.skipped_categories[category.usize()] || self.tiles[category.usize()].is_empty()
+            {
+                continue;
+            }
+            let copied_size = Self::copy_tile_into_image(
+                &mut self.image,
+                &self.tile_info[category.usize()],
+                &self.tiles[category.usize()][0],
+                None,
+                0,
+                category,
+                self.settings.tiled_output,
+                &mut self.buffer_pool,
+            )?;
+            self.instrumentation.add_copied_size(copied_size);
+        }
+        self.image_index = index;
+        self.image_timing = self.nth_image_timing(index as u32)?;
+        Ok(true)
+    }
+
+    // Decodes the frames up to |index| with the codecs, starting from the frame that follows the
+    // last one they decoded or from the nearest keyframe of |index|.
+    fn decode_frames_until(&mut self, index: i32) -> AvifResult<()> {
+        if self.restore_codec_output(index)? {
+            return Ok(());
+        }
+        let nearest_keyframe = i32_from_u32(self.nearest_keyframe(u32_from_i32(index)?))?;
+        let mut next_index = checked_add!(self.codec_image_index, 1)?;
+        if nearest_keyframe > next_index
+            || index < next_index
+            || self.requested_codec_missed_samples()
+        {
+            next_index = nearest_keyframe;
+        }
+        while next_index <= index {
+            self.decode_frame(next_index)?;
+            next_index += 1;
+        }
+        Ok(())
+    }
+
+    fn decode_frame(&mut self, index: i32) -> AvifResult<()> {
+        // The tiles decoded so far are only kept when resuming the decoding of the frame that
+        // follows the last decoded one (see Settings::allow_incremental) or when decoding more
+        // categories of the current image of items.
+        let resuming = index == checked_add!(self.codec_image_index, 1)?
+            || (index == self.codec_image_index && !matches!(self.source, Source::Tracks));
+        if self.is_current_frame_fully_decoded() || !resuming {
             for category in Category::ALL_USIZE {
                 self.tile_info[category].decoded_tile_count = 0;
             }
+            self.release_skipped_planes();
+        }
+        if self
+            .frame_pipeline
+            .as_ref()
+            .is_some_and(|pipeline| pipeline.next_frame != index as usize)
+        {
+            // Seeking. The samples in flight are not needed anymore, so start over with flushed
+            // (or new) codec instances.
+            self.frame_pipeline = None;
+            self.recycle_codecs();
         }
-
-        let next_image_index = checked_add!(self.image_index, 1)?;
         self.create_codecs()?;
-        self.prepare_samples(next_image_index as usize)?;
-        self.decode_tiles(next_image_index as usize)?;
-        self.image_index = next_image_index;
+        if self.frame_pipeline.is_some() {
+            self.decode_pipelined_frame(index as usize)?;
+        } else {
+            self.prepare_samples(index as usize)?;
+            self.decode_tiles(index as usize)?;
+        }
+        if matches!(self.source, Source::Tracks) {
+            for category in Category::ALL_USIZE {
+                if self.skipped_categories[category] {
+                    self.codec_missed_samples[category] |= !self.tiles[category].is_empty();
+                } else {
+                    self.codec_missed_samples[category] = false;
+                }
+            }
+        }
+        self.image_index = index;
+        self.codec_image_index = index;
         self.image_timing = self.nth_image_timing(self.image_index as u32)?;
+        // Only the frames with all their categories are cached.
+        if self.can_use_frame_cache() && self.tile_info.iter().all(|info| info.is_fully_decoded()) {
+            // The copy takes its buffers from the pool when possible.
+            let mut capacities: Vec<usize> = Vec::new();
+            for plane in ALL_PLANES {
+                if self.image.has_plane(plane) {
+                    capacities.push(checked_mul!(
+                        self.image.width(plane),
+                        self.image.height(plane)
+                    )?);
+                }
+            }
+            let size = self
+                .buffer_pool
+                .allocation_size(&capacities, self.image.depth > 8)?;
+            // Caching is optional, so it is skipped rather than failing the decoding when the
+            // copy would exceed Settings::memory_limit.
+            if size <= self.available_memory() {
+                self.reserve_memory(size)?;
+                let index = index as u32;
+                let keyframe = self.is_keyframe(index);
+                self.frame_cache
+                    .insert(index, keyframe, &self.image, &mut self.buffer_pool)?;
+            }
+        }
+        if self.memory_tracked() {
+            self.peak_memory_size = max(self.peak_memory_size, self.memory_usage());
+        }
+        if index == i32_from_u32(self.image_count)? - 1 {
+            self.release_threads_if_done()?;
+        }
         Ok(())
     }
 
+    // Destroys the codec instances (or makes them idle) once the last image is fully decoded so
+    // that their threads are given back to Settings::thread_budget. The planes that point into
+    // the buffers of the codec instances are copied first.
+    fn release_threads_if_done(&mut self) -> AvifResult<()> {
+        // The hardware buffer of the last image belongs to its codec instance.
+        if self.settings.thread_budget.is_none()
+            || self.settings.tiled_output
+            || self.hardware_buffer().is_some()
+            || !self.tile_info.iter().all(|info| info.is_fully_decoded())
+        {
+            return Ok(());
+        }
+        for category in Category::ALL {
+            let image = match category {
+                Category::Gainmap => &mut self.gainmap.image,
+                _ => &mut self.image,
+            };
+            let copied_size = image.own_category_planes(category)?;
+            self.instrumentation.add_copied_size(copied_size);
+        }
+        self.frame_pipeline = None;
+        self.recycle_codecs();
+        // The next decoded frame starts over from a keyframe with new codec instances.
+        self.codec_image_index = -1;
+        Ok(())
+    }
+
+    // Releases the planes of the categories that are not requested so that they do not hold the
+    // pixels of a previous frame.
+    fn release_skipped_planes(&mut self) {
+        for category in Category::ALL {
+            if !self.skipped_categories[category.usize()] {
+                continue;
+            }
+            let image = match category {
+                Category::Gainmap => &mut self.gainmap.image,
+                _ => &mut self.image,
+            };
+            image.release_category_planes_to_pool(category, &mut self.buffer_pool);
+        }
+    }
+
+    // Returns true if the tiles of all the requested categories of the current frame were
+    // decoded.
     fn is_current_frame_fully_decoded(&self) -> bool {
         if !self.parsing_complete() {
             return false;
         }
         for category in Category::ALL_USIZE {
-            if !self.tile_info[category].is_fully_decoded() {
+            if !self.skipped_categories[category] && !self.tile_info[category].is_fully_decoded() {
                 return false;
             }
         }
@@ -1375,7 +3167,17 @@ impl Decoder {
     }
 
     pub fn nth_image(&mut self, index: u32) -> AvifResult<()> {
-        if !self.parsing_complete() {
+        self.nth_image_with_categories(index, &Category::ALL)
+    }
+
+    // Same as nth_image() but only the samples of |categories| are read and decoded (see
+    // next_image_with_categories()).
+    pub fn nth_image_with_categories(
+        &mut self,
+        index: u32,
+        categories: &[Category],
+    ) -> AvifResult<()> {
+        if !self.parsing_complete() || self.tiles[Category::Color.usize()].is_empty() {
             return Err(AvifError::NoContent);
         }
         if index >= self.image_count {
@@ -1383,23 +3185,72 @@ impl Decoder {
         }
         let requested_index = i32_from_u32(index)?;
         if requested_index == checked_add!(self.image_index, 1)? {
-            return self.next_image();
+            return self.next_image_with_categories(categories);
         }
+        self.request_categories(categories)?;
         if requested_index == self.image_index && self.is_current_frame_fully_decoded() {
             // Current frame which is already fully decoded has been requested. Do nothing.
             return Ok(());
         }
-        let nearest_keyframe = i32_from_u32(self.nearest_keyframe(index))?;
-        if nearest_keyframe > checked_add!(self.image_index, 1)?
-            || requested_index <= self.image_index
+        if self.io.is_none() {
+            return Err(AvifError::IoNotSet);
+        }
+        if self.get_frame_from_cache(requested_index)? {
+            return Ok(());
+        }
+        self.decode_frames_until(requested_index)
+    }
+
+    // Decodes the part of the image that is inside |region| (in the coordinates of the color
+    // image) into the output image, which gets the dimensions of |region|. Only the tiles of the
+    // grids that intersect |region| are read and decoded, one after the other on the calling
+    // thread. Images that are not grids are decoded entirely and cropped. The alpha plane is
+    // cropped to the same region and the gain map (if any, as with next_image()) to the region
+    // scaled to its dimensions. This is only supported for still images that are not progressive
+    // and without Settings::tiled_output. The output image does not count as a decoded frame:
+    // next_image() and nth_image() decode the whole image afterwards.
+    pub fn decode_region(&mut self, region: CropRect) -> AvifResult<()> {
+        if self.io.is_none() {
+            return Err(AvifError::IoNotSet);
+        }
+        if !self.parsing_complete() || self.tiles[Category::Color.usize()].is_empty() {
+            return Err(AvifError::NoContent);
+        }
+        if matches!(self.source, Source::Tracks)
+            || self.image_count != 1
+            || self.settings.tiled_output
         {
-            // Start decoding from the nearest keyframe.
-            self.image_index = nearest_keyframe - 1;
+            return Err(AvifError::NotImplemented);
         }
-        loop {
-            self.next_image()?;
-            if requested_index == self.image_index {
-                break;
+        let (width, height) = self.category_dimensions(Category::Color);
+        if !region.is_valid(width, height, self.image.yuv_format) {
+            return Err(AvifError::InvalidArgument);
+        }
+        if !self.tiles[Category::Alpha.usize()].is_empty()
+            && self.category_dimensions(Category::Alpha) != (width, height)
+        {
+            return Err(AvifError::DecodeAlphaFailed);
+        }
+        self.request_categories(&Category::ALL)?;
+        // Any frame that was in progress is decoded again from its first tile.
+        for tile_info in &mut self.tile_info {
+            tile_info.decoded_tile_count = 0;
+        }
+        self.release_skipped_planes();
+        self.create_codecs()?;
+        for category in Category::ALL {
+            if self.skipped_categories[category.usize()] || self.tiles[category.usize()].is_empty()
+            {
+                continue;
+            }
+            let category_region = self.category_region(category, &region)?;
+            let tile_indices = self.tiles_in_region(category, &category_region)?;
+            for &tile_index in &tile_indices {
+                self.prepare_sample(0, category, tile_index, None)?;
+            }
+            for (i, &tile_index) in tile_indices.iter().enumerate() {
+                let first_tile_index = if i == 0 { None } else { Some(tile_indices[0]) };
+                self.decode_region_tile(category, tile_index, first_tile_index, &category_region)?;
             }
         }
         Ok(())
@@ -1413,6 +3264,169 @@ impl Decoder {
         }
     }
 
+    // Returns the parsed state of the image sequence, to create other decoders of the same file
+    // with create_from_shared_parse(). Only the sources that are tracks can be shared.
+    pub fn shared_parse(&self) -> AvifResult<Arc<SharedParse>> {
+        if !self.parsing_complete() || self.tiles[Category::Color.usize()].is_empty() {
+            return Err(AvifError::NoContent);
+        }
+        if self.source != Source::Tracks {
+            return Err(AvifError::NotImplemented);
+        }
+        let mut shared_parse = SharedParse {
+            tracks: self.tracks.clone(),
+            image_count: self.image_count,
+            timescale: self.timescale,
+            duration_in_timescales: self.duration_in_timescales,
+            duration: self.duration,
+            repetition_count: self.repetition_count,
+            color_track_id: self.color_track_id,
+            io_stats: self.io_stats,
+            ..Default::default()
+        };
+        shared_parse.image.0.copy_properties_from(&self.image);
+        for category in Category::ALL_USIZE {
+            for tile in &self.tiles[category] {
+                shared_parse.tiles[category].push(SharedTile {
+                    width: tile.width,
+                    height: tile.height,
+                    samples: tile.input.samples.clone(),
+                });
+            }
+        }
+        Ok(Arc::new(shared_parse))
+    }
+
+    // Creates a decoder of the file of |shared_parse| that reads it from |io|, without parsing it
+    // again. The decoder has its own codec instances and can be used on another thread than the
+    // decoder that created |shared_parse|. The settings that only affect the parsing are ignored.
+    pub fn create_from_shared_parse(
+        shared_parse: &Arc<SharedParse>,
+        settings: Settings,
+        io: GenericIO,
+    ) -> Decoder {
+        let mut decoder = Decoder {
+            settings,
+            io: Some(io),
+            source: Source::Tracks,
+            tracks: shared_parse.tracks.clone(),
+            image_count: shared_parse.image_count,
+            image_index: -1,
+            codec_image_index: -1,
+            timescale: shared_parse.timescale,
+            duration_in_timescales: shared_parse.duration_in_timescales,
+            duration: shared_parse.duration,
+            repetition_count: shared_parse.repetition_count,
+            color_track_id: shared_parse.color_track_id,
+            io_stats: shared_parse.io_stats,
+            parse_state: ParseState::Complete,
+            ..Default::default()
+        };
+        decoder.instrumentation.enabled = decoder.settings.enable_decode_stats;
+        decoder.wrap_io();
+        decoder.image.copy_properties_from(&shared_parse.image.0);
+        for category in Category::ALL {
+            for tile in &shared_parse.tiles[category.usize()] {
+                decoder.tiles[category.usize()].push(Tile {
+                    width: tile.width,
+                    height: tile.height,
+                    input: DecodeInput {
+                        samples: tile.samples.clone(),
+                        category,
+                        ..DecodeInput::default()
+                    },
+                    ..Tile::default()
+                });
+            }
+            decoder.tile_info[category.usize()].tile_count =
+                shared_parse.tiles[category.usize()].len() as u32;
+        }
+        decoder
+    }
+
+    // Returns a handle on the current image (see image()) that remains valid after the next calls
+    // to next_image() and nth_image(). The color and alpha planes that point into the frame
+    // buffers of the codecs are shared with the handle if the codec supports it (see
+    // codecs::Decoder::reference_frame()). The other planes are copied.
+    pub fn frame_handle(&self) -> AvifResult<FrameHandle> {
+        if !self.parsing_complete() || !self.image.has_plane(Plane::Y) {
+            return Err(AvifError::NoContent);
+        }
+        let mut image = Image::default();
+        image.copy_properties_from(&self.image);
+        let mut references: Vec<Box<dyn FrameReference>> = Vec::new();
+        let mut copied_size: usize = 0;
+        for category in [Category::Color, Category::Alpha] {
+            let plane = category.planes()[0];
+            if !self.image.has_plane(plane) {
+                continue;
+            }
+            // Only the planes of a non-grid image can point into the buffers of a codec.
+            let reference = match self.tiles[category.usize()].first() {
+                Some(tile)
+                    if !self.image.image_owns_planes[plane.to_usize()]
+                        && !self.tile_info[category.usize()].is_grid() =>
+                {
+                    self.codecs
+                        .get(tile.codec_index)
+                        .map(|codec| codec.reference_frame())
+                }
+                _ => None,
+            };
+            match reference {
+                Some(Ok(reference)) => {
+                    image.steal_or_copy_from(&self.image, category)?;
+                    references.push(reference);
+                }
+                _ => checked_incr!(copied_size, image.copy_planes_from(&self.image, category)?),
+            }
+        }
+        Ok(FrameHandle::create(image, references, copied_size))
+    }
+
+    // Returns the AHardwareBuffer that holds the color planes of the current image when
+    // Settings::hardware_buffer_output is enabled and the codec rendered the image into it. The
+    // buffer belongs to the decoder and stays valid until the next call to next_image(),
+    // nth_image() or reset().
+    pub fn hardware_buffer(&self) -> Option<*mut c_void> {
+        if !self.settings.hardware_buffer_output
+            || self.tile_info[Category::Color.usize()].is_grid()
+        {
+            return None;
+        }
+        let tile = self.tiles[Category::Color.usize()].first()?;
+        self.codecs.get(tile.codec_index)?.hardware_buffer()
+    }
+
+    // Returns the decoded tiles of the grid of |category| when Settings::tiled_output is enabled.
+    // The views remain valid until the next call to next_image() or nth_image().
+    pub fn tile_views(&self, category: Category) -> AvifResult<Vec<TileView<'_>>> {
+        let tile_info = &self.tile_info[category.usize()];
+        if !self.settings.tiled_output || !tile_info.is_grid() {
+            return Err(AvifError::NoContent);
+        }
+        let grid = &tile_info.grid;
+        let decoded_tile_count = tile_info.decoded_tile_count as usize;
+        let mut tile_views = create_vec_exact(decoded_tile_count)?;
+        for (tile_index, tile) in self.tiles[category.usize()]
+            .iter()
+            .take(decoded_tile_count)
+            .enumerate()
+        {
+            let tile_index = u32_from_usize(tile_index)?;
+            let x = checked_mul!(tile.image.width, tile_index % grid.columns)?;
+            let y = checked_mul!(tile.image.height, tile_index / grid.columns)?;
+            tile_views.push(TileView {
+                image: &tile.image,
+                x,
+                y,
+                width: min(tile.image.width, checked_sub!(grid.width, x)?),
+                height: min(tile.image.height, checked_sub!(grid.height, y)?),
+            });
+        }
+        Ok(tile_views)
+    }
+
     pub fn nth_image_timing(&self, n: u32) -> AvifResult<ImageTiming> {
         if !self.parsing_complete() {
             return Err(AvifError::NoContent);
@@ -1436,8 +3450,8 @@ impl Decoder {
     // next to retrieve the number of top rows that can be immediately accessed from the luma plane
     // of decoder->image, and alpha if any. The corresponding rows from the chroma planes,
     // if any, can also be accessed (half rounded up if subsampled, same number of rows otherwise).
-    // If a gain map is present, and enable_decoding_gainmap is also on, the gain map's planes can
-    // also be accessed in the same way. The number of available gain map rows is at least:
+    // If a gain map is present and decoded, the gain map's planes can also be accessed in the
+    // same way. The number of available gain map rows is at least:
     //   decoder.decoded_row_count() * decoder.gainmap.image.height / decoder.image.height
     // When gain map scaling is needed, callers might choose to use a few less rows depending on how
     // many rows are needed by the scaling algorithm, to avoid the last row(s) changing when more
@@ -1447,13 +3461,12 @@ impl Decoder {
     pub fn decoded_row_count(&self) -> u32 {
         let mut min_row_count = self.image.height;
         for category in Category::ALL_USIZE {
-            if self.tiles[category].is_empty() {
+            if self.tiles[category].is_empty() || self.skipped_categories[category] {
                 continue;
             }
             let first_tile_height = self.tiles[category][0].height;
             let row_count = if category == Category::Gainmap.usize()
                 && self.gainmap_present()
-                && self.settings.enable_decoding_gainmap
                 && self.gainmap.image.height != 0
                 && self.gainmap.image.height != self.image.height
             {
@@ -1492,7 +3505,7 @@ impl Decoder {
         // All the tiles for the requested index must be a keyframe.
         for category in Category::ALL_USIZE {
             for tile in &self.tiles[category] {
-                if index >= tile.input.samples.len() || !tile.input.samples[index].sync {
+                if !tile.input.samples.is_sync(index) {
                     return false;
                 }
             }
@@ -1500,6 +3513,48 @@ impl Decoder {
         true
     }
 
+    // Returns the ranges of frame indices that start at a keyframe and end before the next
+    // keyframe (or at image_count()). Each segment can be decoded without the frames of the
+    // others (see decode_segment()).
+    pub fn keyframe_segments(&self) -> Vec<Range<u32>> {
+        let mut segments: Vec<Range<u32>> = Vec::new();
+        if !self.parsing_complete() {
+            return segments;
+        }
+        for index in 0..self.image_count {
+            if index == 0 || self.is_keyframe(index) {
+                if let Some(segment) = segments.last_mut() {
+                    segment.end = index;
+                }
+                segments.push(index..self.image_count);
+            }
+        }
+        segments
+    }
+
+    // Decodes the frames of |segment| in order and calls |callback| once each of them is the
+    // current image. |segment| must start at a keyframe (see keyframe_segments()).
+    pub fn decode_segment(
+        &mut self,
+        segment: Range<u32>,
+        mut callback: impl FnMut(&Decoder) -> AvifResult<()>,
+    ) -> AvifResult<()> {
+        if !self.parsing_complete() {
+            return Err(AvifError::NoContent);
+        }
+        if segment.is_empty() || segment.end > self.image_count || !self.is_keyframe(segment.start)
+        {
+            return Err(AvifError::InvalidArgument);
+        }
+        self.nth_image(segment.start)?;
+        callback(self)?;
+        for _ in segment.start + 1..segment.end {
+            self.next_image()?;
+            callback(self)?;
+        }
+        Ok(())
+    }
+
     pub fn nearest_keyframe(&self, mut index: u32) -> u32 {
         if !self.parsing_complete() {
             return 0;
@@ -1524,13 +3579,10 @@ impl Decoder {
         for current_index in start_index..=end_index {
             for category in Category::ALL_USIZE {
                 for tile in &self.tiles[category] {
-                    if current_index >= tile.input.samples.len() {
-                        return Err(AvifError::NoImagesRemaining);
-                    }
-                    let sample = &tile.input.samples[current_index];
+                    let sample = tile.input.samples.get(current_index)?;
                     let sample_extent = if sample.item_id != 0 {
                         let item = self.items.get(&sample.item_id).unwrap();
-                        item.max_extent(sample)?
+                        item.max_extent(&sample)?
                     } else {
                         Extent {
                             offset: sample.offset,
@@ -1544,9 +3596,116 @@ impl Decoder {
         Ok(extent)
     }
 
+    // Returns the byte ranges of the file that are needed to decode the images from
+    // nearest_keyframe(first_index) to last_index (inclusive) for the given categories, and the
+    // ranges of the Exif and XMP metadata if include_metadata is true. The ranges are sorted by
+    // offset. Overlapping and adjacent ranges are merged but the others are kept separate so
+    // that only the needed bytes are covered. The categories that are not decoded do not have any
+    // range. The gain map that is not decoded yet (if Settings::enable_decoding_gainmap was false
+    // at parse time) is covered in full.
+    pub fn byte_ranges(
+        &self,
+        first_index: u32,
+        last_index: u32,
+        categories: &[Category],
+        include_metadata: bool,
+    ) -> AvifResult<Vec<Extent>> {
+        if !self.parsing_complete() {
+            return Err(AvifError::NoContent);
+        }
+        if first_index > last_index {
+            return Err(AvifError::InvalidArgument);
+        }
+        let mut ranges: Vec<Extent> = Vec::new();
+        let start_index = self.nearest_keyframe(first_index) as usize;
+        for index in start_index..=last_index as usize {
+            for category in categories {
+                for tile in &self.tiles[category.usize()] {
+                    let sample = tile.input.samples.get(index)?;
+                    if sample.item_id == 0 {
+                        ranges.push(Extent {
+                            offset: sample.offset,
+                            size: sample.size,
+                        });
+                    } else {
+                        let item = self.items.get(&sample.item_id).unwrap();
+                        ranges.extend(item.sample_extents(&sample)?);
+                    }
+                }
+            }
+        }
+        if let Some(gainmap_item_id) = self.deferred_gainmap_item_id {
+            if categories.contains(&Category::Gainmap) {
+                Self::push_item_ranges(&self.items, gainmap_item_id, &mut ranges)?;
+            }
+        }
+        if include_metadata {
+            if let Some(primary_item_id) = self.primary_item_id {
+                Self::push_metadata_ranges(&self.items, Some(primary_item_id), &mut ranges);
+            } else if let Some(color_track_id) = self.color_track_id {
+                let color_track = self
+                    .tracks
+                    .iter()
+                    .find(|x| x.id == color_track_id)
+                    .ok_or(AvifError::NoContent)?;
+                if let Some(meta) = &color_track.meta {
+                    Self::push_metadata_ranges(&construct_items(meta)?, None, &mut ranges);
+                }
+            }
+        }
+
+        ranges.retain(|range| range.size != 0);
+        ranges.sort_by_key(|range| range.offset);
+        let mut merged_ranges: Vec<Extent> = Vec::new();
+        for range in ranges {
+            if let Some(last_range) = merged_ranges.last_mut() {
+                let last_range_end =
+                    checked_add!(last_range.offset, u64_from_usize(last_range.size)?)?;
+                if range.offset <= last_range_end {
+                    last_range.merge(&range)?;
+                    continue;
+                }
+            }
+            merged_ranges.push(range);
+        }
+        Ok(merged_ranges)
+    }
+
+    // Pushes the extents of the item |item_id|, or of its cells if it is a grid.
+    fn push_item_ranges(items: &Items, item_id: u32, ranges: &mut Vec<Extent>) -> AvifResult<()> {
+        let item = items.get(&item_id).ok_or(AvifError::MissingImageItem)?;
+        if item.grid_item_ids.is_empty() {
+            // Items stored in the idat box are read along with the meta box.
+            if item.idat.is_empty() {
+                ranges.extend_from_slice(&item.extents);
+            }
+            return Ok(());
+        }
+        for grid_item_id in &item.grid_item_ids {
+            Self::push_item_ranges(items, *grid_item_id, ranges)?;
+        }
+        Ok(())
+    }
+
+    fn push_metadata_ranges(items: &Items, color_item_id: Option<u32>, ranges: &mut Vec<Extent>) {
+        for item in items.values() {
+            // Items stored in the idat box are read along with the meta box.
+            if (item.is_exif(color_item_id) || item.is_xmp(color_item_id)) && item.idat.is_empty() {
+                ranges.extend_from_slice(&item.extents);
+            }
+        }
+    }
+
     pub fn peek_compatible_file_type(data: &[u8]) -> bool {
         mp4box::peek_compatible_file_type(data).unwrap_or(false)
     }
+
+    // Returns the dimensions, depth, format and presence of alpha and tracks of the file of which
+    // |data| is a prefix, or how many more bytes are needed to know them. This does not need an IO
+    // nor a call to parse(). See probe::probe().
+    pub fn probe(data: &[u8]) -> AvifResult<ProbeResult> {
+        probe::probe(data)
+    }
 }
 
 #[cfg(test)]
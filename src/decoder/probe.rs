@@ -0,0 +1,151 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use crate::decoder::item::*;
+use crate::decoder::track::*;
+use crate::decoder::Source;
+use crate::parser::mp4box;
+use crate::parser::mp4box::*;
+use crate::*;
+
+// What Decoder::parse() would report about the image with the default Settings, as far as it is
+// known from the boxes describing the image. The limits of the Settings are not checked.
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct ProbeInfo {
+    // Source::PrimaryItem or Source::Tracks, as selected by Source::Auto.
+    pub source: Source,
+    pub width: u32,
+    pub height: u32,
+    pub depth: u8,
+    pub yuv_format: PixelFormat,
+    pub alpha_present: bool,
+    // True if the file contains tracks, even if the source is the primary item.
+    pub image_sequence_track_present: bool,
+    // Only set for Source::Tracks.
+    pub timescale: u64,
+    pub duration_in_timescales: u64,
+}
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum ProbeResult {
+    Info(ProbeInfo),
+    // The prefix is too short. The value is the number of bytes to append to the prefix before
+    // probing again, which may still not be enough. If the prefix was the whole file, the file is
+    // truncated.
+    NeedMoreBytes(u64),
+}
+
+#[allow(non_snake_case)]
+fn set_codec_configuration(
+    info: &mut ProbeInfo,
+    av1C: Option<&CodecConfiguration>,
+    pixi: Option<&PixelInformation>,
+) -> AvifResult<()> {
+    match (av1C, pixi) {
+        (Some(av1C), _) => {
+            info.depth = av1C.depth();
+            info.yuv_format = av1C.pixel_format();
+        }
+        // The pixel format is only known from the AV1 payload in that case.
+        (None, Some(pixi)) if !pixi.plane_depths.is_empty() => info.depth = pixi.plane_depths[0],
+        _ => return Err(AvifError::BmffParseFailed("missing av1C property".into())),
+    }
+    Ok(())
+}
+
+fn probe_primary_item(meta: &MetaBox, info: &mut ProbeInfo) -> AvifResult<()> {
+    let items = construct_items(meta)?;
+    let color_item = items
+        .values()
+        .find(|x| !x.should_skip() && x.id != 0 && x.id == meta.primary_item_id)
+        .ok_or(AvifError::NoContent)?;
+    let ispe = color_item.ispe().ok_or(AvifError::BmffParseFailed(
+        "item is missing mandatory ispe property".into(),
+    ))?;
+    info.width = ispe.width;
+    info.height = ispe.height;
+    // The codec configuration of a grid is the one of its tiles, which all have to match. So is
+    // the presence of alpha if it is not associated with the grid itself.
+    let first_tile = items
+        .values()
+        .filter(|x| x.dimg_for_id == color_item.id)
+        .min_by_key(|x| x.dimg_index);
+    let coded_item = match first_tile {
+        Some(tile) if color_item.item_type == "grid" => tile,
+        _ => color_item,
+    };
+    set_codec_configuration(info, coded_item.av1C(), coded_item.pixi())?;
+    info.alpha_present = items.values().any(|x| {
+        !x.should_skip()
+            && (x.aux_for_id == color_item.id || x.aux_for_id == coded_item.id)
+            && x.is_auxiliary_alpha()
+    });
+    Ok(())
+}
+
+fn has_av1_sample_description(track: &Track) -> bool {
+    track.id != 0
+        && track
+            .sample_table
+            .as_ref()
+            .is_some_and(|sample_table| sample_table.has_av1_sample())
+}
+
+fn probe_tracks(tracks: &[Track], info: &mut ProbeInfo) -> AvifResult<()> {
+    let color_track = tracks
+        .iter()
+        .find(|x| has_av1_sample_description(x) && x.aux_for_id.is_none())
+        .ok_or(AvifError::NoContent)?;
+    info.width = color_track.width;
+    info.height = color_track.height;
+    #[allow(non_snake_case)]
+    let av1C = color_track.get_properties().and_then(|properties| {
+        properties.iter().find_map(|x| match x {
+            ItemProperty::CodecConfiguration(av1C) => Some(av1C),
+            _ => None,
+        })
+    });
+    set_codec_configuration(info, av1C, None)?;
+    info.alpha_present = tracks
+        .iter()
+        .any(|x| has_av1_sample_description(x) && x.aux_for_id == Some(color_track.id));
+    info.timescale = color_track.media_timescale as u64;
+    info.duration_in_timescales = color_track.media_duration;
+    Ok(())
+}
+
+// Returns the ProbeInfo of the file of which |data| is a prefix. Only the boxes describing the
+// image need to be in |data|, not the samples nor the sample tables.
+pub fn probe(data: &[u8]) -> AvifResult<ProbeResult> {
+    let boxes = match mp4box::probe(data)? {
+        Probed::Done(boxes) => boxes,
+        Probed::NeedBytes(size) => return Ok(ProbeResult::NeedMoreBytes(size - data.len() as u64)),
+    };
+    let mut info = ProbeInfo {
+        image_sequence_track_present: !boxes.tracks.is_empty(),
+        ..ProbeInfo::default()
+    };
+    // Same as Source::Auto in Decoder::parse().
+    info.source = match boxes.ftyp.major_brand.as_str() {
+        "avis" => Source::Tracks,
+        "avif" => Source::PrimaryItem,
+        _ if boxes.tracks.is_empty() => Source::PrimaryItem,
+        _ => Source::Tracks,
+    };
+    match info.source {
+        Source::Tracks => probe_tracks(&boxes.tracks, &mut info)?,
+        _ => probe_primary_item(boxes.meta.as_ref().ok_or(AvifError::NoContent)?, &mut info)?,
+    }
+    Ok(ProbeResult::Info(info))
+}
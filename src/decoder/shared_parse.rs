@@ -0,0 +1,60 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use crate::decoder::tile::*;
+use crate::decoder::track::*;
+use crate::decoder::*;
+use crate::image::Image;
+
+use std::sync::Arc;
+
+// The properties of the parsed images. They do not have any planes.
+#[derive(Default)]
+pub(crate) struct ImageProperties(pub Image);
+
+// SAFETY: The image does not have any planes, so it does not point to any buffer.
+unsafe impl Send for ImageProperties {}
+unsafe impl Sync for ImageProperties {}
+
+// The input of a tile of a track.
+pub(crate) struct SharedTile {
+    pub width: u32,
+    pub height: u32,
+    pub samples: DecodeSamples,
+}
+
+// The state of a parsed image sequence that does not change while it is decoded: the tracks, the
+// sample index of each tile and the properties of the images (see Decoder::shared_parse()). It
+// can be sent to other threads to create decoders of the same file that do not parse it again
+// (see Decoder::create_from_shared_parse()), for example to decode the segments returned by
+// Decoder::keyframe_segments() in parallel.
+#[derive(Default)]
+pub struct SharedParse {
+    pub(crate) tracks: Arc<Vec<Track>>,
+    pub(crate) tiles: [Vec<SharedTile>; Category::COUNT],
+    pub(crate) image: ImageProperties,
+    pub(crate) image_count: u32,
+    pub(crate) timescale: u64,
+    pub(crate) duration_in_timescales: u64,
+    pub(crate) duration: f64,
+    pub(crate) repetition_count: RepetitionCount,
+    pub(crate) color_track_id: Option<u32>,
+    pub(crate) io_stats: IOStats,
+}
+
+impl SharedParse {
+    pub fn image_count(&self) -> u32 {
+        self.image_count
+    }
+}
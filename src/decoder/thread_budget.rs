@@ -0,0 +1,110 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use std::sync::Arc;
+use std::sync::Mutex;
+
+// A fixed number of threads that is shared by all the decoders that use it. Each decoder reserves
+// threads from the budget when it creates its codec instances and gives them back when the codec
+// instances are destroyed.
+#[derive(Debug)]
+pub struct ThreadBudget {
+    max_threads: u32,
+    available_threads: Mutex<u32>,
+}
+
+impl ThreadBudget {
+    pub fn create(max_threads: u32) -> Arc<ThreadBudget> {
+        let max_threads = max_threads.max(1);
+        Arc::new(ThreadBudget {
+            max_threads,
+            available_threads: Mutex::new(max_threads),
+        })
+    }
+
+    pub fn max_threads(&self) -> u32 {
+        self.max_threads
+    }
+
+    pub fn available_threads(&self) -> u32 {
+        *self.available_threads.lock().unwrap()
+    }
+
+    // Reserves up to |requested_threads| threads. The reservation always grants at least one
+    // thread (the calling thread of the decoder) even if the budget is exhausted, but that thread
+    // is not taken from the budget in that case.
+    pub fn reserve(budget: &Arc<ThreadBudget>, requested_threads: u32) -> ThreadReservation {
+        let mut available_threads = budget.available_threads.lock().unwrap();
+        let reserved_threads = requested_threads.min(*available_threads);
+        *available_threads -= reserved_threads;
+        ThreadReservation {
+            budget: budget.clone(),
+            reserved_threads,
+        }
+    }
+}
+
+// Threads that were reserved from a ThreadBudget. They are given back when this is dropped.
+#[derive(Debug)]
+pub struct ThreadReservation {
+    budget: Arc<ThreadBudget>,
+    reserved_threads: u32,
+}
+
+impl ThreadReservation {
+    pub fn thread_count(&self) -> u32 {
+        self.reserved_threads.max(1)
+    }
+
+    // Returns true if the threads were reserved from |budget|.
+    pub(crate) fn is_from(&self, budget: &Arc<ThreadBudget>) -> bool {
+        Arc::ptr_eq(&self.budget, budget)
+    }
+}
+
+impl Drop for ThreadReservation {
+    fn drop(&mut self) {
+        let mut available_threads = self.budget.available_threads.lock().unwrap();
+        *available_threads += self.reserved_threads;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn reserve_and_release() {
+        let budget = ThreadBudget::create(8);
+        assert_eq!(budget.max_threads(), 8);
+        let reservation1 = ThreadBudget::reserve(&budget, 6);
+        assert_eq!(reservation1.thread_count(), 6);
+        assert_eq!(budget.available_threads(), 2);
+        assert!(reservation1.is_from(&budget));
+        assert!(!reservation1.is_from(&ThreadBudget::create(8)));
+        let reservation2 = ThreadBudget::reserve(&budget, 6);
+        assert_eq!(reservation2.thread_count(), 2);
+        assert_eq!(budget.available_threads(), 0);
+        // An exhausted budget still lets the decoder run on its calling thread.
+        let reservation3 = ThreadBudget::reserve(&budget, 6);
+        assert_eq!(reservation3.thread_count(), 1);
+        assert_eq!(budget.available_threads(), 0);
+        drop(reservation1);
+        assert_eq!(budget.available_threads(), 6);
+        drop(reservation3);
+        assert_eq!(budget.available_threads(), 6);
+        drop(reservation2);
+        assert_eq!(budget.available_threads(), 8);
+    }
+}
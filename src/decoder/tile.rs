@@ -12,12 +12,20 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+use crate::decoder::track::*;
 use crate::decoder::*;
 use crate::*;
 
+use std::sync::Arc;
+use std::sync::OnceLock;
+
 pub const MAX_AV1_LAYER_COUNT: usize = 4;
 
-#[derive(Debug, Default)]
+// The offset of every CHECKPOINT_INTERVAL-th sample of a track is stored in its SampleIndex so
+// that the offset of any sample can be computed with at most CHECKPOINT_INTERVAL - 1 additions.
+const CHECKPOINT_INTERVAL: usize = 64;
+
+#[derive(Clone, Copy, Debug, Default)]
 pub struct DecodeSample {
     pub item_id: u32, // 1-based. 0 if it comes from a track.
     pub offset: u64,
@@ -61,9 +69,326 @@ impl DecodeSample {
     }
 }
 
+// A run of consecutive chunks of a track that all have the same number of samples.
+#[derive(Debug)]
+struct ChunkRun {
+    first_chunk: usize, // 0-based
+    samples_per_chunk: usize,
+    first_sample: usize, // Index of the first sample of first_chunk.
+}
+
+// Compact index of the samples of a track. The samples are not expanded: the offset and size of
+// each sample are computed on demand from the sample table of the track. Creating the index only
+// walks the chunks. The sizes of the samples (which the parsing of the sample table already
+// expanded) are summed, but their offsets are only computed when a sample is first accessed.
+#[derive(Debug)]
+pub struct SampleIndex {
+    sample_table: Arc<SampleTable>,
+    chunk_runs: Vec<ChunkRun>,
+    // Offsets of the samples whose index is a multiple of CHECKPOINT_INTERVAL, computed by the
+    // first call to get(). Unused if all the samples have the same size.
+    checkpoints: OnceLock<Vec<u64>>,
+    sample_count: usize,
+    total_size: usize,
+    sync_samples_sorted: bool,
+}
+
+impl SampleIndex {
+    fn create(sample_table: &Arc<SampleTable>, size_hint: u64) -> AvifResult<SampleIndex> {
+        let chunk_count = sample_table.chunk_offsets.len();
+        let mut chunk_runs: Vec<ChunkRun> = Vec::new();
+        let mut sample_count: usize = 0;
+        for (index, entry) in sample_table.sample_to_chunk.iter().enumerate() {
+            // first_chunk is 1-based and strictly increasing.
+            let first_chunk = usize_from_u32(entry.first_chunk)?.saturating_sub(1);
+            let end_chunk = match sample_table.sample_to_chunk.get(index + 1) {
+                Some(next_entry) => usize_from_u32(next_entry.first_chunk)?.saturating_sub(1),
+                None => chunk_count,
+            }
+            .min(chunk_count);
+            if first_chunk >= end_chunk {
+                continue;
+            }
+            if chunk_runs.is_empty() && first_chunk != 0 {
+                // The chunks before the first entry have no samples.
+                break;
+            }
+            let samples_per_chunk = usize_from_u32(entry.samples_per_chunk)?;
+            if samples_per_chunk == 0 {
+                break;
+            }
+            chunk_runs.push(ChunkRun {
+                first_chunk,
+                samples_per_chunk,
+                first_sample: sample_count,
+            });
+            checked_incr!(
+                sample_count,
+                checked_mul!(end_chunk - first_chunk, samples_per_chunk)?
+            );
+        }
+        let covered_chunk_count = match chunk_runs.last() {
+            Some(run) => {
+                run.first_chunk + (sample_count - run.first_sample) / run.samples_per_chunk
+            }
+            None => 0,
+        };
+        if covered_chunk_count != chunk_count {
+            return Err(AvifError::BmffParseFailed(
+                "chunk with 0 samples found".into(),
+            ));
+        }
+        match &sample_table.sample_size {
+            SampleSize::FixedSize(fixed_size) => {
+                if *fixed_size == 0 && sample_count > 0 {
+                    return Err(AvifError::BmffParseFailed(
+                        "sample has invalid size.".into(),
+                    ));
+                }
+            }
+            SampleSize::Sizes(sizes) => {
+                if sizes.len() < sample_count {
+                    return Err(AvifError::BmffParseFailed(
+                        "not enough sampel sizes in the table".into(),
+                    ));
+                }
+            }
+        }
+
+        // Validate the chunks. The samples of a chunk are contiguous, so only the end of each
+        // chunk has to be checked against size_hint.
+        let mut total_size: usize = 0;
+        let mut sample_index: usize = 0;
+        for (run_index, run) in chunk_runs.iter().enumerate() {
+            let end_chunk = chunk_runs
+                .get(run_index + 1)
+                .map_or(chunk_count, |next_run| next_run.first_chunk);
+            for chunk_offset in &sample_table.chunk_offsets[run.first_chunk..end_chunk] {
+                let chunk_size = match &sample_table.sample_size {
+                    SampleSize::FixedSize(fixed_size) => {
+                        checked_mul!(run.samples_per_chunk, usize_from_u32(*fixed_size)?)?
+                    }
+                    SampleSize::Sizes(sizes) => {
+                        let mut chunk_size: usize = 0;
+                        for size in &sizes[sample_index..sample_index + run.samples_per_chunk] {
+                            if *size == 0 {
+                                return Err(AvifError::BmffParseFailed(
+                                    "sample has invalid size.".into(),
+                                ));
+                            }
+                            checked_incr!(chunk_size, usize_from_u32(*size)?);
+                        }
+                        chunk_size
+                    }
+                };
+                sample_index += run.samples_per_chunk;
+                let chunk_end = checked_add!(*chunk_offset, u64_from_usize(chunk_size)?)?;
+                if size_hint != 0 && chunk_end > size_hint {
+                    return Err(AvifError::BmffParseFailed("exceeded size_hint".into()));
+                }
+                checked_incr!(total_size, chunk_size);
+            }
+        }
+
+        for sync_sample_number in &sample_table.sync_samples {
+            let index = usize_from_u32(*sync_sample_number)?;
+            // sample_table.sync_samples is 1-based.
+            if index == 0 || index > sample_count {
+                return Err(AvifError::BmffParseFailed(format!(
+                    "invalid sync sample number {}",
+                    index
+                )));
+            }
+        }
+        Ok(SampleIndex {
+            sample_table: sample_table.clone(),
+            chunk_runs,
+            checkpoints: OnceLock::new(),
+            sample_count,
+            total_size,
+            sync_samples_sorted: sample_table.sync_samples.windows(2).all(|x| x[0] < x[1]),
+        })
+    }
+
+    // Computes the offsets of the samples whose index is a multiple of CHECKPOINT_INTERVAL. The
+    // offsets cannot overflow since the end of each chunk was validated by create().
+    fn compute_checkpoints(&self) -> AvifResult<Vec<u64>> {
+        let mut checkpoints: Vec<u64> =
+            create_vec_exact(self.sample_count.div_ceil(CHECKPOINT_INTERVAL))?;
+        let mut sample_index: usize = 0;
+        for (run_index, run) in self.chunk_runs.iter().enumerate() {
+            let end_sample = match self.chunk_runs.get(run_index + 1) {
+                Some(next_run) => next_run.first_sample,
+                None => self.sample_count,
+            };
+            let mut chunk_index = run.first_chunk;
+            while sample_index < end_sample {
+                let mut sample_offset = self.sample_table.chunk_offsets[chunk_index];
+                for _ in 0..run.samples_per_chunk {
+                    if sample_index % CHECKPOINT_INTERVAL == 0 {
+                        checkpoints.push(sample_offset);
+                    }
+                    checked_incr!(
+                        sample_offset,
+                        self.sample_table.sample_size(sample_index)? as u64
+                    );
+                    sample_index += 1;
+                }
+                chunk_index += 1;
+            }
+        }
+        Ok(checkpoints)
+    }
+
+    fn checkpoints(&self) -> AvifResult<&[u64]> {
+        if self.checkpoints.get().is_none() {
+            // Concurrent callers may compute the same checkpoints, only one of them is kept.
+            let _ = self.checkpoints.set(self.compute_checkpoints()?);
+        }
+        Ok(self.checkpoints.get().unwrap())
+    }
+
+    fn get(&self, index: usize) -> AvifResult<DecodeSample> {
+        if index >= self.sample_count {
+            return Err(AvifError::NoImagesRemaining);
+        }
+        let run_index = self
+            .chunk_runs
+            .partition_point(|run| run.first_sample <= index)
+            - 1;
+        let run = &self.chunk_runs[run_index];
+        let chunk_index = run.first_chunk + (index - run.first_sample) / run.samples_per_chunk;
+        let index_in_chunk = (index - run.first_sample) % run.samples_per_chunk;
+        let size = self.sample_table.sample_size(index)?;
+        let offset = if let SampleSize::FixedSize(fixed_size) = &self.sample_table.sample_size {
+            checked_add!(
+                self.sample_table.chunk_offsets[chunk_index],
+                checked_mul!(u64::from(*fixed_size), u64_from_usize(index_in_chunk)?)?
+            )?
+        } else {
+            // Start from the beginning of the chunk or from the closest checkpoint, whichever is
+            // closer.
+            let first_sample_of_chunk = index - index_in_chunk;
+            let checkpoint = index - index % CHECKPOINT_INTERVAL;
+            let checkpoints = self.checkpoints()?;
+            let (mut offset, first_sample) = if checkpoint > first_sample_of_chunk {
+                (checkpoints[checkpoint / CHECKPOINT_INTERVAL], checkpoint)
+            } else {
+                (
+                    self.sample_table.chunk_offsets[chunk_index],
+                    first_sample_of_chunk,
+                )
+            };
+            for sample_index in first_sample..index {
+                checked_incr!(offset, self.sample_table.sample_size(sample_index)? as u64);
+            }
+            offset
+        };
+        Ok(DecodeSample {
+            item_id: 0,
+            offset,
+            size,
+            // Legal spatial_id values are [0,1,2,3], so this serves as a sentinel value for "do
+            // not filter by spatial_id"
+            spatial_id: 0xff,
+            sync: self.is_sync(index),
+        })
+    }
+
+    fn is_sync(&self, index: usize) -> bool {
+        // Assume first sample is always sync (in case stss box was missing).
+        if index == 0 {
+            return true;
+        }
+        // sample_table.sync_samples is 1-based.
+        let sync_sample_number = match u32::try_from(index + 1) {
+            Ok(sync_sample_number) => sync_sample_number,
+            Err(_) => return false,
+        };
+        let sync_samples = &self.sample_table.sync_samples;
+        if self.sync_samples_sorted {
+            sync_samples.binary_search(&sync_sample_number).is_ok()
+        } else {
+            sync_samples.contains(&sync_sample_number)
+        }
+    }
+}
+
+#[derive(Clone, Debug)]
+pub enum DecodeSamples {
+    // One entry per sample (used for items).
+    Expanded(Vec<DecodeSample>),
+    // The samples of a track. Shared by the decoders created from the same SharedParse.
+    Indexed(Arc<SampleIndex>),
+}
+
+impl Default for DecodeSamples {
+    fn default() -> Self {
+        Self::Expanded(Vec::new())
+    }
+}
+
+impl DecodeSamples {
+    pub fn len(&self) -> usize {
+        match self {
+            Self::Expanded(samples) => samples.len(),
+            Self::Indexed(sample_index) => sample_index.sample_count,
+        }
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    pub fn get(&self, index: usize) -> AvifResult<DecodeSample> {
+        match self {
+            Self::Expanded(samples) => samples
+                .get(index)
+                .copied()
+                .ok_or(AvifError::NoImagesRemaining),
+            Self::Indexed(sample_index) => sample_index.get(index),
+        }
+    }
+
+    pub fn is_sync(&self, index: usize) -> bool {
+        match self {
+            Self::Expanded(samples) => samples.get(index).is_some_and(|sample| sample.sync),
+            Self::Indexed(sample_index) => {
+                index < sample_index.sample_count && sample_index.is_sync(index)
+            }
+        }
+    }
+
+    // Returns the sum of the sizes of all the samples. Fails if any sample is empty.
+    pub fn total_size(&self) -> AvifResult<usize> {
+        match self {
+            Self::Expanded(samples) => {
+                let mut total_size: usize = 0;
+                for sample in samples {
+                    if sample.size == 0 {
+                        return Err(AvifError::BmffParseFailed(
+                            "sample has invalid size.".into(),
+                        ));
+                    }
+                    checked_incr!(total_size, sample.size);
+                }
+                Ok(total_size)
+            }
+            Self::Indexed(sample_index) => Ok(sample_index.total_size),
+        }
+    }
+
+    fn push(&mut self, sample: DecodeSample) {
+        match self {
+            Self::Expanded(samples) => samples.push(sample),
+            Self::Indexed(_) => unreachable!(),
+        }
+    }
+}
+
 #[derive(Debug, Default)]
 pub struct DecodeInput {
-    pub samples: Vec<DecodeSample>,
+    pub samples: DecodeSamples,
     pub all_layers: bool,
     pub category: Category,
 }
@@ -114,6 +439,20 @@ impl TileInfo {
     }
 }
 
+// A decoded tile of a grid image (see Settings::tiled_output). The planes of |image| point into
+// the buffers of the codec instance that decoded the tile.
+pub struct TileView<'a> {
+    pub image: &'a Image,
+    // Position of the top left corner of the tile in the grid image.
+    pub x: u32,
+    pub y: u32,
+    // Size of the part of the tile that is inside the grid image. It is smaller than the size of
+    // the tile for the tiles of the rightmost column and the bottommost row when the grid image
+    // dimensions are not a multiple of the tile dimensions.
+    pub width: u32,
+    pub height: u32,
+}
+
 #[derive(Default)]
 pub struct Tile {
     pub width: u32,
@@ -122,9 +461,20 @@ pub struct Tile {
     pub image: Image,
     pub input: DecodeInput,
     pub codec_index: usize,
+    // Size of the planes owned by the image the last time it was accounted for (see
+    // account_memory()).
+    pub(crate) memory_size: usize,
 }
 
 impl Tile {
+    // Updates |total_size| (the size of the planes owned by the images of all the tiles) with the
+    // change in the size of the planes owned by the image since the last call.
+    pub(crate) fn account_memory(&mut self, total_size: &mut usize) {
+        let size = self.image.owned_planes_size(&ALL_PLANES);
+        *total_size = *total_size - self.memory_size + size;
+        self.memory_size = size;
+    }
+
     pub fn create_from_item(
         item: &mut Item,
         allow_progressive: bool,
@@ -256,83 +606,141 @@ impl Tile {
 
     pub fn create_from_track(
         track: &Track,
-        mut image_count_limit: u32,
+        image_count_limit: u32,
         size_hint: u64,
         category: Category,
     ) -> AvifResult<Tile> {
-        let mut tile = Tile {
+        let sample_table = track.sample_table.unwrap_ref();
+        // Fails early if there are too many samples.
+        sample_table.sample_count(image_count_limit)?;
+        Ok(Tile {
             width: track.width,
             height: track.height,
             operating_point: 0, // No way to set operating point via tracks
             input: DecodeInput {
+                samples: DecodeSamples::Indexed(Arc::new(SampleIndex::create(
+                    sample_table,
+                    size_hint,
+                )?)),
                 category,
                 ..DecodeInput::default()
             },
             ..Tile::default()
-        };
-        let sample_table = &track.sample_table.unwrap_ref();
+        })
+    }
+}
 
-        if image_count_limit != 0 {
-            for (chunk_index, _chunk_offset) in sample_table.chunk_offsets.iter().enumerate() {
-                // Figure out how many samples are in this chunk.
-                let sample_count = sample_table.get_sample_count_of_chunk(chunk_index as u32);
-                if sample_count == 0 {
-                    return Err(AvifError::BmffParseFailed(
-                        "chunk with 0 samples found".into(),
-                    ));
-                }
-                if sample_count > image_count_limit {
-                    return Err(AvifError::BmffParseFailed(
-                        "exceeded image_count_limit".into(),
-                    ));
-                }
-                image_count_limit -= sample_count;
-            }
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn create_sample_table(sample_size: SampleSize) -> SampleTable {
+        SampleTable {
+            chunk_offsets: vec![1000, 5000, 9000, 20000],
+            sample_to_chunk: vec![
+                SampleToChunk {
+                    first_chunk: 1,
+                    samples_per_chunk: 3,
+                    sample_description_index: 1,
+                },
+                SampleToChunk {
+                    first_chunk: 3,
+                    samples_per_chunk: 100,
+                    sample_description_index: 1,
+                },
+            ],
+            sample_size,
+            sync_samples: vec![1, 50, 150],
+            ..Default::default()
         }
+    }
 
-        let mut sample_size_index: usize = 0;
+    // Expands the samples the same way as the sample index is supposed to.
+    fn expand(sample_table: &SampleTable) -> AvifResult<Vec<DecodeSample>> {
+        let mut samples: Vec<DecodeSample> = Vec::new();
         for (chunk_index, chunk_offset) in sample_table.chunk_offsets.iter().enumerate() {
-            // Figure out how many samples are in this chunk.
-            let sample_count = sample_table.get_sample_count_of_chunk(chunk_index as u32);
-            if sample_count == 0 {
-                return Err(AvifError::BmffParseFailed(
-                    "chunk with 0 samples found".into(),
-                ));
-            }
-
-            let mut sample_offset = *chunk_offset;
-            for _ in 0..sample_count {
-                let sample_size = sample_table.sample_size(sample_size_index)?;
-                let sample_size_hint = checked_add!(sample_offset, sample_size as u64)?;
-                if size_hint != 0 && sample_size_hint > size_hint {
-                    return Err(AvifError::BmffParseFailed("exceeded size_hint".into()));
-                }
-                let sample = DecodeSample {
+            let mut offset = *chunk_offset;
+            for _ in 0..sample_table.get_sample_count_of_chunk(chunk_index as u32) {
+                let size = sample_table.sample_size(samples.len())?;
+                samples.push(DecodeSample {
                     item_id: 0,
-                    offset: sample_offset,
-                    size: sample_size,
-                    // Legal spatial_id values are [0,1,2,3], so this serves as a sentinel value for "do
-                    // not filter by spatial_id"
+                    offset,
+                    size,
                     spatial_id: 0xff,
-                    // Assume first sample is always sync (in case stss box was missing).
-                    sync: tile.input.samples.is_empty(),
-                };
-                tile.input.samples.push(sample);
-                checked_incr!(sample_offset, sample_size as u64);
-                checked_incr!(sample_size_index, 1);
+                    sync: samples.is_empty()
+                        || sample_table
+                            .sync_samples
+                            .contains(&(samples.len() as u32 + 1)),
+                });
+                offset += size as u64;
             }
         }
-        for sync_sample_number in &sample_table.sync_samples {
-            let index = usize_from_u32(*sync_sample_number)?;
-            // sample_table.sync_samples is 1-based.
-            if index == 0 || index > tile.input.samples.len() {
-                return Err(AvifError::BmffParseFailed(format!(
-                    "invalid sync sample number {}",
-                    index
-                )));
+        Ok(samples)
+    }
+
+    #[test]
+    fn sample_index() -> AvifResult<()> {
+        for sample_size in [
+            SampleSize::FixedSize(10),
+            SampleSize::Sizes((0..206).map(|i| i % 7 + 1).collect()),
+        ] {
+            let sample_table = Arc::new(create_sample_table(sample_size));
+            let samples = DecodeSamples::Indexed(Arc::new(SampleIndex::create(&sample_table, 0)?));
+            let expected_samples = expand(&sample_table)?;
+            assert_eq!(samples.len(), 206);
+            assert_eq!(samples.len(), expected_samples.len());
+            // Random access order.
+            for index in (0..206).rev().chain(0..206) {
+                let sample = samples.get(index)?;
+                let expected_sample = &expected_samples[index];
+                assert_eq!(sample.offset, expected_sample.offset);
+                assert_eq!(sample.size, expected_sample.size);
+                assert_eq!(sample.sync, expected_sample.sync);
+                assert_eq!(samples.is_sync(index), expected_sample.sync);
             }
-            tile.input.samples[index - 1].sync = true;
+            assert_eq!(
+                samples.total_size()?,
+                expected_samples.iter().map(|x| x.size).sum::<usize>()
+            );
+            assert!(matches!(
+                samples.get(206),
+                Err(AvifError::NoImagesRemaining)
+            ));
+            assert!(!samples.is_sync(206));
+            // The last sample ends after offset 20000.
+            assert!(SampleIndex::create(&sample_table, 20000).is_err());
+            assert!(SampleIndex::create(&sample_table, 30000).is_ok());
+        }
+        Ok(())
+    }
+
+    #[test]
+    fn sample_index_invalid() {
+        // The first chunk has no samples.
+        let mut sample_table = create_sample_table(SampleSize::FixedSize(10));
+        sample_table.sample_to_chunk[0].first_chunk = 2;
+        assert!(SampleIndex::create(&Arc::new(sample_table), 0).is_err());
+        // Not enough sample sizes.
+        let sample_table = create_sample_table(SampleSize::Sizes(vec![1; 205]));
+        assert!(SampleIndex::create(&Arc::new(sample_table), 0).is_err());
+        // Empty sample.
+        let sample_table = create_sample_table(SampleSize::FixedSize(0));
+        assert!(SampleIndex::create(&Arc::new(sample_table), 0).is_err());
+        // Invalid sync sample.
+        let mut sample_table = create_sample_table(SampleSize::FixedSize(10));
+        sample_table.sync_samples.push(207);
+        assert!(SampleIndex::create(&Arc::new(sample_table), 0).is_err());
+        // Chunk offset overflow, even if the size of the IO is unknown.
+        for sample_size in [
+            SampleSize::FixedSize(10),
+            SampleSize::Sizes((0..206).map(|i| i % 7 + 1).collect()),
+        ] {
+            let mut sample_table = create_sample_table(sample_size);
+            sample_table.chunk_offsets[3] = u64::MAX - 5;
+            assert!(matches!(
+                SampleIndex::create(&Arc::new(sample_table), 0),
+                Err(AvifError::BmffParseFailed(_))
+            ));
         }
-        Ok(tile)
     }
 }
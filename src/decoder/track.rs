@@ -17,6 +17,8 @@ use crate::parser::mp4box::ItemProperty;
 use crate::parser::mp4box::MetaBox;
 use crate::*;
 
+use std::sync::Arc;
+
 #[derive(Clone, Copy, Debug, PartialEq)]
 pub enum RepetitionCount {
     Unknown,
@@ -42,7 +44,7 @@ pub struct Track {
     pub is_repeating: bool,
     pub width: u32,
     pub height: u32,
-    pub sample_table: Option<SampleTable>,
+    pub sample_table: Option<Arc<SampleTable>>,
     pub elst_seen: bool,
     pub meta: Option<MetaBox>,
 }
@@ -189,6 +191,26 @@ impl SampleTable {
         0
     }
 
+    // Returns the total number of samples without expanding the sample table.
+    pub fn sample_count(&self, image_count_limit: u32) -> AvifResult<u32> {
+        let mut sample_count: u32 = 0;
+        for chunk_index in 0..self.chunk_offsets.len() {
+            let chunk_sample_count = self.get_sample_count_of_chunk(chunk_index as u32);
+            if chunk_sample_count == 0 {
+                return Err(AvifError::BmffParseFailed(
+                    "chunk with 0 samples found".into(),
+                ));
+            }
+            checked_incr!(sample_count, chunk_sample_count);
+            if image_count_limit != 0 && sample_count > image_count_limit {
+                return Err(AvifError::BmffParseFailed(
+                    "exceeded image_count_limit".into(),
+                ));
+            }
+        }
+        Ok(sample_count)
+    }
+
     pub fn get_properties(&self) -> Option<&Vec<ItemProperty>> {
         Some(
             &self
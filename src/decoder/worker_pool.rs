@@ -0,0 +1,191 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use crate::*;
+
+use std::sync::mpsc;
+use std::thread::JoinHandle;
+
+pub(crate) type Task<'a> = Box<dyn FnOnce() + Send + 'a>;
+
+struct Worker {
+    task_sender: mpsc::Sender<Task<'static>>,
+    thread: JoinHandle<()>,
+}
+
+impl Worker {
+    fn create() -> AvifResult<Self> {
+        let (task_sender, task_receiver) = mpsc::channel::<Task<'static>>();
+        let thread = std::thread::Builder::new()
+            .spawn(move || {
+                for task in task_receiver {
+                    // The panic is reported by the DoneGuard of the task. The thread is kept.
+                    let _ = std::panic::catch_unwind(std::panic::AssertUnwindSafe(task));
+                }
+            })
+            .map_err(|err| AvifError::UnknownError(format!("could not create thread: {err}")))?;
+        Ok(Self {
+            task_sender,
+            thread,
+        })
+    }
+}
+
+// Signals the completion of a task, even if the task panicked.
+struct DoneGuard(mpsc::Sender<bool>);
+
+impl Drop for DoneGuard {
+    fn drop(&mut self) {
+        let _ = self.0.send(std::thread::panicking());
+    }
+}
+
+// Waits for the completion of |count| tasks, even if the caller panicked.
+struct WaitGuard {
+    done_receiver: mpsc::Receiver<bool>,
+    count: usize,
+    panicked: bool,
+}
+
+impl WaitGuard {
+    fn wait(&mut self) {
+        while self.count > 0 {
+            match self.done_receiver.recv() {
+                Ok(panicked) => self.panicked |= panicked,
+                // All the guards were dropped, so no task is running anymore.
+                Err(_) => return,
+            }
+            self.count -= 1;
+        }
+    }
+}
+
+impl Drop for WaitGuard {
+    fn drop(&mut self) {
+        self.wait();
+    }
+}
+
+// Threads that are kept across the calls to Decoder::decode_grid_tiles_in_parallel() so that they
+// are not created again for each frame. Idle threads wait for their next task.
+#[derive(Default)]
+pub(crate) struct WorkerPool {
+    workers: Vec<Worker>,
+}
+
+impl WorkerPool {
+    #[cfg(test)]
+    pub fn thread_count(&self) -> usize {
+        self.workers.len()
+    }
+
+    // Makes sure that at least |count| threads are available to run().
+    pub fn create_threads(&mut self, count: usize) -> AvifResult<()> {
+        while self.workers.len() < count {
+            self.workers.push(Worker::create()?);
+        }
+        Ok(())
+    }
+
+    // Runs each of |tasks| on its own thread while |f| runs on the calling thread, and returns
+    // the result of |f| once all the tasks are done. The tasks may borrow the data of the caller.
+    // Returns an error without running anything if the threads cannot be created. The tasks are
+    // never run on the calling thread since they may wait for |f|.
+    // Panics if one of the tasks panicked.
+    pub fn run<'a, R>(&mut self, tasks: Vec<Task<'a>>, f: impl FnOnce() -> R) -> AvifResult<R> {
+        self.create_threads(tasks.len())?;
+        let (done_sender, done_receiver) = mpsc::channel();
+        let mut wait_guard = WaitGuard {
+            done_receiver,
+            count: 0,
+            panicked: false,
+        };
+        for (index, task) in tasks.into_iter().enumerate() {
+            let done_guard = DoneGuard(done_sender.clone());
+            let task: Task<'a> = Box::new(move || {
+                let _done_guard = done_guard;
+                task();
+            });
+            // SAFETY: This function does not return (nor unwind) before all the tasks are done,
+            // which is ensured by wait_guard. So the data borrowed by the task outlives it.
+            let task: Task<'static> = unsafe { std::mem::transmute(task) };
+            wait_guard.count += 1;
+            // The workers only stop receiving tasks when the pool is dropped, so this cannot
+            // fail. Even if it did, the task would be dropped, which signals its completion.
+            let _ = self.workers[index].task_sender.send(task);
+        }
+        drop(done_sender);
+        let result = f();
+        wait_guard.wait();
+        if wait_guard.panicked {
+            panic!("a worker thread panicked");
+        }
+        Ok(result)
+    }
+}
+
+impl Drop for WorkerPool {
+    fn drop(&mut self) {
+        for worker in self.workers.drain(..) {
+            drop(worker.task_sender);
+            let _ = worker.thread.join();
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::sync::atomic::AtomicUsize;
+    use std::sync::atomic::Ordering;
+
+    #[test]
+    fn run_borrows_and_reuses_threads() {
+        let mut pool = WorkerPool::default();
+        let counter = AtomicUsize::new(0);
+        for _ in 0..3 {
+            let tasks: Vec<Task> = (0..4)
+                .map(|_| {
+                    Box::new(|| {
+                        counter.fetch_add(1, Ordering::Relaxed);
+                    }) as Task
+                })
+                .collect();
+            assert_eq!(pool.run(tasks, || 5), Ok(5));
+        }
+        assert_eq!(counter.load(Ordering::Relaxed), 12);
+        assert_eq!(pool.thread_count(), 4);
+    }
+
+    #[test]
+    fn run_keeps_panicked_threads() {
+        let mut pool = WorkerPool::default();
+        let result = std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| {
+            pool.run(vec![Box::new(|| panic!("test")) as Task], || ())
+        }));
+        assert!(result.is_err());
+        let counter = AtomicUsize::new(0);
+        assert!(pool
+            .run(
+                vec![Box::new(|| {
+                    counter.fetch_add(1, Ordering::Relaxed);
+                }) as Task],
+                || (),
+            )
+            .is_ok());
+        assert_eq!(counter.load(Ordering::Relaxed), 1);
+        assert_eq!(pool.thread_count(), 1);
+    }
+}
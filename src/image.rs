@@ -18,9 +18,14 @@ use crate::decoder::ProgressiveState;
 use crate::internal_utils::pixels::*;
 use crate::internal_utils::*;
 use crate::parser::mp4box::*;
+use crate::utils::buffer_pool::BufferPool;
 use crate::utils::clap::CleanAperture;
+use crate::utils::clap::CropRect;
 use crate::*;
 
+use std::cmp::max;
+use std::cmp::min;
+
 #[derive(Clone, Copy, Debug, PartialEq)]
 pub enum Plane {
     Y = 0,
@@ -225,6 +230,54 @@ impl Image {
         })
     }
 
+    // Returns an image that points to |row_count| rows of this image starting at |first_row|.
+    // |first_row| must be a multiple of the vertical chroma subsampling factor. The returned
+    // image does not own its planes and must not be used after this image is modified or
+    // dropped.
+    pub(crate) fn row_band_view(&self, first_row: u32, row_count: u32) -> AvifResult<Image> {
+        let chroma_shift_y = self.yuv_format.chroma_shift_y();
+        if checked_add!(first_row, row_count)? > self.height
+            || (first_row >> chroma_shift_y) << chroma_shift_y != first_row
+        {
+            return Err(AvifError::InvalidArgument);
+        }
+        let mut view = Image {
+            width: self.width,
+            height: row_count,
+            depth: self.depth,
+            yuv_format: self.yuv_format,
+            yuv_range: self.yuv_range,
+            chroma_sample_position: self.chroma_sample_position,
+            alpha_present: self.alpha_present,
+            alpha_premultiplied: self.alpha_premultiplied,
+            color_primaries: self.color_primaries,
+            transfer_characteristics: self.transfer_characteristics,
+            matrix_coefficients: self.matrix_coefficients,
+            ..Default::default()
+        };
+        for plane in ALL_PLANES {
+            if !self.has_plane(plane) {
+                continue;
+            }
+            let plane_index = plane.to_usize();
+            let plane_first_row = match plane {
+                Plane::U | Plane::V => first_row >> chroma_shift_y,
+                _ => first_row,
+            };
+            let offset =
+                usize_from_u32(checked_mul!(plane_first_row, self.row_bytes[plane_index])?)?;
+            let pixels = self.planes[plane_index].unwrap_ref();
+            let ptr = if self.depth == 8 { pixels.ptr() } else { pixels.ptr16() as *const u8 };
+            // The view is only used for reading.
+            view.planes[plane_index] = Some(Pixels::from_raw_pointer(
+                unsafe { ptr.add(offset) as *mut u8 },
+                self.depth as u32,
+            ));
+            view.row_bytes[plane_index] = self.row_bytes[plane_index];
+        }
+        Ok(view)
+    }
+
     pub fn clear_chroma_planes(&mut self) {
         for plane in [Plane::U, Plane::V] {
             let plane = plane.to_usize();
@@ -234,7 +287,112 @@ impl Image {
         }
     }
 
+    // Size in bytes of the planes of |category| allocated by allocate_planes().
+    pub(crate) fn category_planes_size(&self, category: Category) -> AvifResult<usize> {
+        let pixel_size: usize = if self.depth == 8 { 1 } else { 2 };
+        let mut size: usize = 0;
+        for plane in category.planes() {
+            let plane_size = checked_mul!(self.width(*plane), self.height(*plane))?;
+            checked_incr!(size, checked_mul!(plane_size, pixel_size)?);
+        }
+        Ok(size)
+    }
+
+    // Total size in bytes of the buffers owned by |planes|.
+    pub(crate) fn owned_planes_size(&self, planes: &[Plane]) -> usize {
+        let mut size: usize = 0;
+        for plane in planes {
+            let plane = plane.to_usize();
+            if let (Some(pixels), true) = (&self.planes[plane], self.image_owns_planes[plane]) {
+                size += pixels.size() * pixels.pixel_bit_size() / 8;
+            }
+        }
+        size
+    }
+
+    // Number of bytes that allocate_planes_with_pool() would allocate for |category|. The planes
+    // that are kept and the buffers that would be reused from |pool| are not counted, and neither
+    // are the buffers of the replaced planes since they are given back first.
+    pub(crate) fn planes_allocation_size(
+        &self,
+        category: Category,
+        pool: &BufferPool,
+    ) -> AvifResult<usize> {
+        let pixel_size: usize = if self.depth == 8 { 1 } else { 2 };
+        let mut capacities: Vec<usize> = Vec::new();
+        let mut replaced_planes: Vec<Plane> = Vec::new();
+        for plane in category.planes() {
+            let plane_size = checked_mul!(self.width(*plane), self.height(*plane))?;
+            if !self.plane_fits(plane.to_usize(), plane_size, pixel_size) {
+                capacities.push(plane_size);
+                replaced_planes.push(*plane);
+            }
+        }
+        Ok(pool
+            .allocation_size(&capacities, pixel_size == 2)?
+            .saturating_sub(self.owned_planes_size(&replaced_planes)))
+    }
+
+    // True if the plane |plane_index| is allocated with |plane_size| pixels of |pixel_size|
+    // bytes.
+    fn plane_fits(&self, plane_index: usize, plane_size: usize, pixel_size: usize) -> bool {
+        self.planes[plane_index].as_ref().is_some_and(|pixels| {
+            pixels.size() == plane_size
+                && (pixels.pixel_bit_size() == 0 || pixels.pixel_bit_size() == pixel_size * 8)
+        })
+    }
+
     pub fn allocate_planes(&mut self, category: Category) -> AvifResult<()> {
+        self.allocate_planes_impl(category, None)
+    }
+
+    // Same as allocate_planes() but the buffers are taken from |pool| and the buffers that are
+    // replaced are given back to it.
+    pub fn allocate_planes_with_pool(
+        &mut self,
+        category: Category,
+        pool: &mut BufferPool,
+    ) -> AvifResult<()> {
+        self.allocate_planes_impl(category, Some(pool))
+    }
+
+    // Gives the buffers owned by the planes to |pool|. The image does not have any planes after
+    // this.
+    pub fn release_planes_to_pool(&mut self, pool: &mut BufferPool) {
+        for plane_index in 0..self.planes.len() {
+            if let Some(pixels) = self.planes[plane_index].take() {
+                if self.image_owns_planes[plane_index] {
+                    pool.give_pixels(pixels);
+                }
+            }
+            self.row_bytes[plane_index] = 0;
+            self.image_owns_planes[plane_index] = false;
+        }
+    }
+
+    // Same as release_planes_to_pool() for the planes of |category| only.
+    pub(crate) fn release_category_planes_to_pool(
+        &mut self,
+        category: Category,
+        pool: &mut BufferPool,
+    ) {
+        for plane in category.planes() {
+            let plane_index = plane.to_usize();
+            if let Some(pixels) = self.planes[plane_index].take() {
+                if self.image_owns_planes[plane_index] {
+                    pool.give_pixels(pixels);
+                }
+            }
+            self.row_bytes[plane_index] = 0;
+            self.image_owns_planes[plane_index] = false;
+        }
+    }
+
+    fn allocate_planes_impl(
+        &mut self,
+        category: Category,
+        mut pool: Option<&mut BufferPool>,
+    ) -> AvifResult<()> {
         let pixel_size: usize = if self.depth == 8 { 1 } else { 2 };
         for plane in category.planes() {
             let plane = *plane;
@@ -242,18 +400,31 @@ impl Image {
             let width = self.width(plane);
             let plane_size = checked_mul!(width, self.height(plane))?;
             let default_value = if plane == Plane::A { self.max_channel() } else { 0 };
-            if self.planes[plane_index].is_some()
-                && self.planes[plane_index].unwrap_ref().size() == plane_size
-                && (self.planes[plane_index].unwrap_ref().pixel_bit_size() == 0
-                    || self.planes[plane_index].unwrap_ref().pixel_bit_size() == pixel_size * 8)
-            {
+            if self.plane_fits(plane_index, plane_size, pixel_size) {
                 // TODO: need to memset to 0 maybe?
                 continue;
             }
-            self.planes[plane_index] = Some(if self.depth == 8 {
-                Pixels::Buffer(Vec::new())
-            } else {
-                Pixels::Buffer16(Vec::new())
+            let previous_pixels = self.planes[plane_index].take();
+            self.planes[plane_index] = Some(match pool.as_deref_mut() {
+                Some(pool) => {
+                    if let Some(previous_pixels) = previous_pixels {
+                        if self.image_owns_planes[plane_index] {
+                            pool.give_pixels(previous_pixels);
+                        }
+                    }
+                    if self.depth == 8 {
+                        Pixels::Buffer(pool.take(plane_size)?)
+                    } else {
+                        Pixels::Buffer16(pool.take16(plane_size)?)
+                    }
+                }
+                None => {
+                    if self.depth == 8 {
+                        Pixels::Buffer(Vec::new())
+                    } else {
+                        Pixels::Buffer16(Vec::new())
+                    }
+                }
             });
             let pixels = self.planes[plane_index].unwrap_mut();
             pixels.resize(plane_size, default_value)?;
@@ -265,26 +436,101 @@ impl Image {
 
     // If src contains pointers, this function will simply make a copy of the pointer without
     // copying the actual pixels (stealing). If src contains buffer, this function will clone the
-    // buffers (copying).
-    pub fn steal_or_copy_from(&mut self, src: &Image, category: Category) -> AvifResult<()> {
-        match category {
-            Category::Alpha => {
-                if src.planes[3].is_some() {
-                    self.planes[3] = Some(src.planes[3].unwrap_ref().clone());
-                    self.row_bytes[3] = src.row_bytes[3];
-                }
+    // buffers (copying). Returns the number of bytes that were copied.
+    pub fn steal_or_copy_from(&mut self, src: &Image, category: Category) -> AvifResult<usize> {
+        let planes: &[usize] = match category {
+            Category::Alpha => &[3],
+            _ => &[0, 1, 2],
+        };
+        let mut copied_size: usize = 0;
+        for &plane in planes {
+            if src.planes[plane].is_none() {
+                continue;
             }
-            _ => {
-                for plane in 0..3usize {
-                    if src.planes[plane].is_none() {
-                        continue;
-                    }
-                    self.planes[plane] = Some(src.planes[plane].unwrap_ref().clone());
-                    self.row_bytes[plane] = src.row_bytes[plane];
+            let pixels = src.planes[plane].unwrap_ref();
+            self.planes[plane] = Some(pixels.clone());
+            self.row_bytes[plane] = src.row_bytes[plane];
+            self.image_owns_planes[plane] = !pixels.is_pointer();
+            checked_incr!(copied_size, pixels.size() * pixels.pixel_bit_size() / 8);
+        }
+        Ok(copied_size)
+    }
+
+    // Copies everything but the planes from |src|.
+    pub(crate) fn copy_properties_from(&mut self, src: &Image) {
+        self.width = src.width;
+        self.height = src.height;
+        self.depth = src.depth;
+        self.yuv_format = src.yuv_format;
+        self.yuv_range = src.yuv_range;
+        self.chroma_sample_position = src.chroma_sample_position;
+        self.alpha_present = src.alpha_present;
+        self.alpha_premultiplied = src.alpha_premultiplied;
+        self.color_primaries = src.color_primaries;
+        self.transfer_characteristics = src.transfer_characteristics;
+        self.matrix_coefficients = src.matrix_coefficients;
+        self.clli = src.clli;
+        self.pasp = src.pasp;
+        self.clap = src.clap;
+        self.irot_angle = src.irot_angle;
+        self.imir_axis = src.imir_axis;
+        self.exif.clone_from(&src.exif);
+        self.icc.clone_from(&src.icc);
+        self.xmp.clone_from(&src.xmp);
+        self.image_sequence_track_present = src.image_sequence_track_present;
+        self.progressive_state = src.progressive_state;
+    }
+
+    // Replaces the planes of |category| by owned copies of the planes of |src|, which must have
+    // the same dimensions, depth and format. Returns the number of bytes that were copied.
+    pub(crate) fn copy_planes_from(
+        &mut self,
+        src: &Image,
+        category: Category,
+    ) -> AvifResult<usize> {
+        self.allocate_planes(category)?;
+        let mut copied_size: usize = 0;
+        for plane in category.planes() {
+            let plane = *plane;
+            if !src.has_plane(plane) {
+                continue;
+            }
+            let width = src.width(plane);
+            for y in 0..src.height(plane) as u32 {
+                if src.depth == 8 {
+                    self.row_mut(plane, y)?[..width].copy_from_slice(&src.row(plane, y)?[..width]);
+                } else {
+                    self.row16_mut(plane, y)?[..width]
+                        .copy_from_slice(&src.row16(plane, y)?[..width]);
                 }
             }
+            let pixel_size = if src.depth == 8 { 1 } else { 2 };
+            checked_incr!(copied_size, width * src.height(plane) * pixel_size);
         }
-        Ok(())
+        Ok(copied_size)
+    }
+
+    // Replaces the planes of |category| that point into buffers that are not owned by the image
+    // (the frame buffers of a codec instance for example) by owned copies. Returns the number of
+    // bytes that were copied.
+    pub(crate) fn own_category_planes(&mut self, category: Category) -> AvifResult<usize> {
+        if category
+            .planes()
+            .iter()
+            .all(|plane| !self.has_plane(*plane) || self.image_owns_planes[plane.to_usize()])
+        {
+            return Ok(0);
+        }
+        let mut copy = Image::default();
+        copy.copy_properties_from(self);
+        let copied_size = copy.copy_planes_from(self, category)?;
+        for plane in category.planes() {
+            let plane = plane.to_usize();
+            self.planes[plane] = copy.planes[plane].take();
+            self.row_bytes[plane] = copy.row_bytes[plane];
+            self.image_owns_planes[plane] = self.planes[plane].is_some();
+        }
+        Ok(copied_size)
     }
 
     pub fn copy_from_tile(
@@ -293,8 +539,10 @@ impl Image {
         tile_info: &TileInfo,
         tile_index: u32,
         category: Category,
-    ) -> AvifResult<()> {
+    ) -> AvifResult<usize> {
         // This function is used only when |tile| contains pointers and self contains buffers.
+        // Returns the number of bytes that were copied.
+        let mut copied_size: usize = 0;
         let row_index = u64::from(tile_index / tile_info.grid.columns);
         let column_index = u64::from(tile_index % tile_info.grid.columns);
         for plane in category.planes() {
@@ -353,7 +601,91 @@ impl Image {
                     dst_slice.copy_from_slice(src_slice);
                 }
             }
+            let copied_row_size = if self.depth == 8 {
+                src_width_to_copy
+            } else {
+                checked_mul!(src_width_to_copy, 2)?
+            };
+            checked_incr!(
+                copied_size,
+                checked_mul!(copied_row_size, usize_from_u64(src_height_to_copy)?)?
+            );
         }
-        Ok(())
+        Ok(copied_size)
+    }
+
+    // Copies the part of |tile| that intersects |region| into self, which has the dimensions of
+    // |region|. The top left corner of |tile| is at (|tile_x|, |tile_y|) in the coordinates of
+    // |region|, which are those of the luma plane of the whole image. Returns the number of bytes
+    // that were copied.
+    pub fn copy_region_from_tile(
+        &mut self,
+        tile: &Image,
+        tile_x: u32,
+        tile_y: u32,
+        region: &CropRect,
+        category: Category,
+    ) -> AvifResult<usize> {
+        let x_start = max(tile_x, region.x);
+        let y_start = max(tile_y, region.y);
+        let x_end = min(
+            checked_add!(tile_x, tile.width)?,
+            checked_add!(region.x, region.width)?,
+        );
+        let y_end = min(
+            checked_add!(tile_y, tile.height)?,
+            checked_add!(region.y, region.height)?,
+        );
+        if x_start >= x_end || y_start >= y_end {
+            return Ok(0);
+        }
+        let mut copied_size: usize = 0;
+        for plane in category.planes() {
+            let plane = *plane;
+            let Some(src_plane) = tile.plane_data(plane) else {
+                continue;
+            };
+            let (shift_x, shift_y) = match plane {
+                Plane::U | Plane::V => (
+                    self.yuv_format.chroma_shift_x(),
+                    self.yuv_format.chroma_shift_y(),
+                ),
+                _ => (0, 0),
+            };
+            let src_x = usize_from_u32((x_start - tile_x) >> shift_x)?;
+            let src_y = (y_start - tile_y) >> shift_y;
+            let dst_x = usize_from_u32((x_start - region.x) >> shift_x)?;
+            let dst_y = (y_start - region.y) >> shift_y;
+            // Round up the extent of the subsampled planes, within the bounds of both planes.
+            let width = min(
+                usize_from_u32((x_end - x_start).div_ceil(1 << shift_x))?,
+                min(
+                    (src_plane.width as usize).saturating_sub(src_x),
+                    self.width(plane).saturating_sub(dst_x),
+                ),
+            );
+            let height = min(
+                (y_end - y_start).div_ceil(1 << shift_y),
+                min(
+                    src_plane.height.saturating_sub(src_y),
+                    u32_from_usize(self.height(plane))?.saturating_sub(dst_y),
+                ),
+            );
+            for y in 0..height {
+                if self.depth == 8 {
+                    let src_row = &tile.row(plane, src_y + y)?[src_x..src_x + width];
+                    self.row_mut(plane, dst_y + y)?[dst_x..dst_x + width].copy_from_slice(src_row);
+                } else {
+                    let src_row = &tile.row16(plane, src_y + y)?[src_x..src_x + width];
+                    self.row16_mut(plane, dst_y + y)?[dst_x..dst_x + width]
+                        .copy_from_slice(src_row);
+                }
+            }
+            checked_incr!(
+                copied_size,
+                checked_mul!(width * src_plane.pixel_size as usize, height as usize)?
+            );
+        }
+        Ok(copied_size)
     }
 }
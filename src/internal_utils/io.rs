@@ -14,10 +14,36 @@
 
 use crate::internal_utils::*;
 
+use std::cell::Cell;
+use std::cmp::min;
 use std::fs::File;
 use std::io::Read;
 use std::io::Seek;
 use std::io::SeekFrom;
+use std::ops::Range;
+use std::rc::Rc;
+use std::time::Duration;
+use std::time::Instant;
+
+#[cfg(all(unix, feature = "mmap"))]
+use std::os::unix::io::AsRawFd;
+
+// Returns at most |max_read_size| bytes of |data| starting at |offset|. This is the read() of the
+// IOs that hold all of their data in memory.
+fn read_slice(data: &[u8], offset: u64, max_read_size: usize) -> AvifResult<&[u8]> {
+    let data_len = data.len() as u64;
+    if offset > data_len {
+        return Err(AvifError::IoError);
+    }
+    let available_size: usize = (data_len - offset) as usize;
+    let size_to_read: usize =
+        if max_read_size > available_size { available_size } else { max_read_size };
+    let slice_start = usize_from_u64(offset)?;
+    let slice_end = checked_add!(slice_start, size_to_read)?;
+    let range = slice_start..slice_end;
+    check_slice_range(data.len(), &range)?;
+    Ok(&data[range])
+}
 
 #[derive(Debug, Default)]
 pub struct DecoderFileIO {
@@ -79,6 +105,86 @@ impl decoder::IO for DecoderFileIO {
     }
 }
 
+// Read-only memory mapping of a whole file. The slices returned by read() point directly into the
+// mapping, so this IO is persistent. The mapping remains valid after the file is closed. Note
+// that, as with any file mapping, truncating the file while it is mapped results in undefined
+// behavior.
+#[cfg(all(unix, feature = "mmap"))]
+#[derive(Debug)]
+pub struct DecoderMmapIO {
+    data: *mut u8,
+    size: usize,
+}
+
+#[cfg(all(unix, feature = "mmap"))]
+impl DecoderMmapIO {
+    pub fn create(filename: &String) -> AvifResult<DecoderMmapIO> {
+        let file = File::open(filename).or(Err(AvifError::IoError))?;
+        let metadata = file.metadata().or(Err(AvifError::IoError))?;
+        if !metadata.is_file() || metadata.len() == 0 {
+            // Empty files cannot be mapped. Others (pipes etc.) may not have a meaningful size.
+            return Err(AvifError::IoError);
+        }
+        let size = usize_from_u64(metadata.len())?;
+        let data = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                size,
+                libc::PROT_READ,
+                libc::MAP_PRIVATE,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if data == libc::MAP_FAILED {
+            return Err(AvifError::IoError);
+        }
+        Ok(DecoderMmapIO {
+            data: data as *mut u8,
+            size,
+        })
+    }
+
+    fn data(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.data, self.size) }
+    }
+}
+
+#[cfg(all(unix, feature = "mmap"))]
+impl Drop for DecoderMmapIO {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.data as *mut libc::c_void, self.size);
+        }
+    }
+}
+
+#[cfg(all(unix, feature = "mmap"))]
+impl decoder::IO for DecoderMmapIO {
+    fn read(&mut self, offset: u64, max_read_size: usize) -> AvifResult<&[u8]> {
+        read_slice(self.data(), offset, max_read_size)
+    }
+
+    fn size_hint(&self) -> u64 {
+        self.size as u64
+    }
+
+    fn persistent(&self) -> bool {
+        true
+    }
+}
+
+// Returns a persistent memory mapped IO for |filename| if the mmap feature is enabled and the
+// file can be mapped, and a regular file IO otherwise (non unix platforms, mmap feature disabled,
+// empty or special files, mmap failures).
+pub fn create_file_io(filename: &String) -> AvifResult<decoder::GenericIO> {
+    #[cfg(all(unix, feature = "mmap"))]
+    if let Ok(mmap_io) = DecoderMmapIO::create(filename) {
+        return Ok(Box::new(mmap_io));
+    }
+    Ok(Box::new(DecoderFileIO::create(filename)?))
+}
+
 pub struct DecoderRawIO<'a> {
     pub data: &'a [u8],
 }
@@ -93,18 +199,7 @@ impl DecoderRawIO<'_> {
 
 impl decoder::IO for DecoderRawIO<'_> {
     fn read(&mut self, offset: u64, max_read_size: usize) -> AvifResult<&[u8]> {
-        let data_len = self.data.len() as u64;
-        if offset > data_len {
-            return Err(AvifError::IoError);
-        }
-        let available_size: usize = (data_len - offset) as usize;
-        let size_to_read: usize =
-            if max_read_size > available_size { available_size } else { max_read_size };
-        let slice_start = usize_from_u64(offset)?;
-        let slice_end = checked_add!(slice_start, size_to_read)?;
-        let range = slice_start..slice_end;
-        check_slice_range(self.data.len(), &range)?;
-        Ok(&self.data[range])
+        read_slice(&self.data, offset, max_read_size)
     }
 
     fn size_hint(&self) -> u64 {
@@ -122,18 +217,7 @@ pub struct DecoderMemoryIO {
 
 impl decoder::IO for DecoderMemoryIO {
     fn read(&mut self, offset: u64, max_read_size: usize) -> AvifResult<&[u8]> {
-        let data_len = self.data.len() as u64;
-        if offset > data_len {
-            return Err(AvifError::IoError);
-        }
-        let available_size: usize = (data_len - offset) as usize;
-        let size_to_read: usize =
-            if max_read_size > available_size { available_size } else { max_read_size };
-        let slice_start = usize_from_u64(offset)?;
-        let slice_end = checked_add!(slice_start, size_to_read)?;
-        let range = slice_start..slice_end;
-        check_slice_range(self.data.len(), &range)?;
-        Ok(&self.data[range])
+        read_slice(&self.data, offset, max_read_size)
     }
 
     fn size_hint(&self) -> u64 {
@@ -144,3 +228,219 @@ impl decoder::IO for DecoderMemoryIO {
         true
     }
 }
+
+// Number of reads served from the buffer of a DecoderReadAheadIO (hits) and from the IO it
+// wraps (misses).
+#[derive(Clone, Copy, Debug, Default)]
+pub struct ReadAheadStats {
+    pub hits: usize,
+    pub misses: usize,
+}
+
+// Wraps an IO with a high latency per read (for example one doing network range requests) so
+// that it is read at least min_read_size bytes at a time. The data of the last such read is kept
+// and the subsequent reads that fall inside of it (box headers, small adjacent boxes and extents)
+// are served from it without accessing the wrapped IO.
+pub struct DecoderReadAheadIO {
+    io: decoder::GenericIO,
+    min_read_size: usize,
+    buffer: Vec<u8>,
+    buffer_offset: u64,
+    stats: Rc<Cell<ReadAheadStats>>,
+}
+
+impl DecoderReadAheadIO {
+    pub fn create(
+        io: decoder::GenericIO,
+        min_read_size: usize,
+        stats: Rc<Cell<ReadAheadStats>>,
+    ) -> Self {
+        Self {
+            io,
+            min_read_size,
+            buffer: Vec::new(),
+            buffer_offset: 0,
+            stats,
+        }
+    }
+
+    fn buffered_range(&self, offset: u64, max_read_size: usize) -> Option<Range<usize>> {
+        if self.buffer.is_empty() || offset < self.buffer_offset {
+            return None;
+        }
+        let start = usize::try_from(offset - self.buffer_offset).ok()?;
+        if start > self.buffer.len() {
+            return None;
+        }
+        let end = start.checked_add(max_read_size)?;
+        if end <= self.buffer.len() {
+            return Some(start..end);
+        }
+        // Reads past the end of the data return what is available.
+        let size_hint = self.io.size_hint();
+        let buffer_end = self.buffer_offset + self.buffer.len() as u64;
+        if size_hint != 0 && buffer_end >= size_hint {
+            return Some(start..self.buffer.len());
+        }
+        None
+    }
+}
+
+impl decoder::IO for DecoderReadAheadIO {
+    fn read(&mut self, offset: u64, max_read_size: usize) -> AvifResult<&[u8]> {
+        let mut stats = self.stats.get();
+        if let Some(range) = self.buffered_range(offset, max_read_size) {
+            stats.hits += 1;
+            self.stats.set(stats);
+            return Ok(&self.buffer[range]);
+        }
+        stats.misses += 1;
+        self.stats.set(stats);
+        if max_read_size >= self.min_read_size {
+            // Large reads are not buffered.
+            return self.io.read(offset, max_read_size);
+        }
+        let size_hint = self.io.size_hint();
+        let read_size = if size_hint > offset {
+            // Do not read past the end of the data.
+            min(self.min_read_size as u64, size_hint - offset) as usize
+        } else {
+            self.min_read_size
+        }
+        .max(max_read_size);
+        let read_ahead_failed = match self.io.read(offset, read_size) {
+            Ok(data) => {
+                self.buffer.clear();
+                if self.buffer.try_reserve(data.len()).is_err() {
+                    return Err(AvifError::OutOfMemory);
+                }
+                self.buffer.extend_from_slice(data);
+                self.buffer_offset = offset;
+                false
+            }
+            Err(err) => {
+                if read_size == max_read_size {
+                    return Err(err);
+                }
+                true
+            }
+        };
+        if read_ahead_failed {
+            // The data past the requested range may not be available yet (for example during
+            // incremental decoding). Only read what was requested.
+            self.buffer.clear();
+            return self.io.read(offset, max_read_size);
+        }
+        let size = min(max_read_size, self.buffer.len());
+        Ok(&self.buffer[..size])
+    }
+
+    fn size_hint(&self) -> u64 {
+        self.io.size_hint()
+    }
+
+    fn persistent(&self) -> bool {
+        false
+    }
+}
+
+// Number of reads of a DecoderCountingIO, number of bytes they returned and time spent in them.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct ReadStats {
+    pub count: u64,
+    pub size: u64,
+    pub duration: Duration,
+}
+
+// Wraps an IO to measure its reads (see Settings::enable_decode_stats).
+pub struct DecoderCountingIO {
+    io: decoder::GenericIO,
+    stats: Rc<Cell<ReadStats>>,
+}
+
+impl DecoderCountingIO {
+    pub fn create(io: decoder::GenericIO, stats: Rc<Cell<ReadStats>>) -> Self {
+        Self { io, stats }
+    }
+}
+
+impl decoder::IO for DecoderCountingIO {
+    fn read(&mut self, offset: u64, max_read_size: usize) -> AvifResult<&[u8]> {
+        let start = Instant::now();
+        let result = self.io.read(offset, max_read_size);
+        let mut stats = self.stats.get();
+        stats.count += 1;
+        stats.duration += start.elapsed();
+        if let Ok(data) = &result {
+            stats.size += data.len() as u64;
+        }
+        self.stats.set(stats);
+        result
+    }
+
+    fn size_hint(&self) -> u64 {
+        self.io.size_hint()
+    }
+
+    fn persistent(&self) -> bool {
+        self.io.persistent()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use crate::decoder::IO;
+    use std::io::Write;
+
+    fn create_file(data: &[u8]) -> tempfile::NamedTempFile {
+        let mut file = tempfile::NamedTempFile::new().expect("could not create temp file");
+        file.write_all(data).expect("could not write temp file");
+        file
+    }
+
+    fn check_reads(io: &mut dyn decoder::IO, data: &[u8]) {
+        assert_eq!(io.size_hint(), data.len() as u64);
+        assert_eq!(io.read(0, 4), Ok(&data[..4]));
+        assert_eq!(io.read(3, 100), Ok(&data[3..]));
+        assert_eq!(io.read(data.len() as u64 + 1, 10), Err(AvifError::IoError));
+    }
+
+    #[test]
+    fn file_io() {
+        let data: Vec<u8> = (0..100).collect();
+        let file = create_file(&data);
+        let filename = file.path().to_str().unwrap().to_string();
+        let mut io = DecoderFileIO::create(&filename).expect("could not create io");
+        assert!(!io.persistent());
+        check_reads(&mut io, &data);
+        assert!(DecoderFileIO::create(&format!("{filename}.missing")).is_err());
+    }
+
+    #[cfg(all(unix, feature = "mmap"))]
+    #[test]
+    fn mmap_io() {
+        let data: Vec<u8> = (0..100).collect();
+        let file = create_file(&data);
+        let filename = file.path().to_str().unwrap().to_string();
+        let mut io = DecoderMmapIO::create(&filename).expect("could not create io");
+        assert!(io.persistent());
+        check_reads(&mut io, &data);
+        // Empty files cannot be mapped, so create_file_io() falls back to DecoderFileIO.
+        let empty_file = create_file(&[]);
+        let empty_filename = empty_file.path().to_str().unwrap().to_string();
+        assert!(DecoderMmapIO::create(&empty_filename).is_err());
+        assert!(!create_file_io(&empty_filename).unwrap().persistent());
+    }
+
+    #[test]
+    fn create_file_io_type() {
+        let data: Vec<u8> = (0..100).collect();
+        let file = create_file(&data);
+        let filename = file.path().to_str().unwrap().to_string();
+        let mut io = create_file_io(&filename).expect("could not create io");
+        assert_eq!(io.persistent(), cfg!(all(unix, feature = "mmap")));
+        check_reads(io.as_mut(), &data);
+    }
+}
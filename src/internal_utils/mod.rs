@@ -142,6 +142,7 @@ macro_rules! conversion_function {
 conversion_function!(usize_from_u64, usize, u64);
 conversion_function!(usize_from_u32, usize, u32);
 conversion_function!(usize_from_u16, usize, u16);
+conversion_function!(usize_from_i32, usize, i32);
 #[cfg(feature = "android_mediacodec")]
 conversion_function!(usize_from_isize, usize, isize);
 conversion_function!(u64_from_usize, u64, usize);
@@ -173,6 +174,23 @@ clamp_function!(clamp_u16, u16);
 clamp_function!(clamp_f32, f32);
 clamp_function!(clamp_i32, i32);
 
+// Same as `value as $type`, including the saturation (NaN becomes 0). Unlike the `as` conversion,
+// which is expanded into scalar code for each lane, this one has a vector instruction, so that the
+// loops that use it can be vectorized.
+macro_rules! saturating_from_f32_function {
+    ($func:ident, $type:ty) => {
+        #[inline(always)]
+        pub(crate) fn $func(value: f32) -> $type {
+            let value = value.max(0.0).min(<$type>::MAX as f32);
+            // SAFETY: |value| is in the range of $type, which fits in an i32.
+            unsafe { value.to_int_unchecked::<i32>() as $type }
+        }
+    };
+}
+
+saturating_from_f32_function!(saturating_u8_from_f32, u8);
+saturating_from_f32_function!(saturating_u16_from_f32, u16);
+
 // Returns the colr nclx property. Returns an error if there are multiple ones.
 pub fn find_nclx(properties: &[ItemProperty]) -> AvifResult<Option<&Nclx>> {
     let mut single_nclx: Option<&Nclx> = None;
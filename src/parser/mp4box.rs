@@ -23,6 +23,8 @@ use crate::internal_utils::*;
 use crate::utils::clap::CleanAperture;
 use crate::*;
 
+use std::sync::Arc;
+
 #[derive(Debug, PartialEq)]
 pub enum BoxSize {
     FixedSize(usize), // In bytes, header exclusive.
@@ -1431,7 +1433,7 @@ fn parse_stbl(stream: &mut IStream, track: &mut Track) -> AvifResult<()> {
             boxes_seen.insert(header.box_type.clone());
         }
     }
-    track.sample_table = Some(sample_table);
+    track.sample_table = Some(Arc::new(sample_table));
     Ok(())
 }
 
@@ -1713,6 +1715,231 @@ pub fn peek_compatible_file_type(data: &[u8]) -> AvifResult<bool> {
     Ok(ftyp.is_avif())
 }
 
+// Result of the functions below that parse a prefix of a file.
+#[derive(Debug, PartialEq)]
+pub enum Probed<T> {
+    Done(T),
+    // The prefix is too short. The value is the size of the prefix needed to go further, which is
+    // not necessarily enough to finish.
+    NeedBytes(u64),
+}
+
+// Evaluates to the value of a Probed::Done(). Returns the Probed::NeedBytes() otherwise.
+macro_rules! probed {
+    ($probed:expr) => {
+        match $probed? {
+            Probed::Done(value) => value,
+            Probed::NeedBytes(size) => return Ok(Probed::NeedBytes(size)),
+        }
+    };
+}
+
+#[derive(Debug)]
+pub struct ProbedBoxes {
+    pub ftyp: FileTypeBox,
+    pub meta: Option<MetaBox>,
+    // The sample tables of these tracks only contain the sample descriptions.
+    pub tracks: Vec<Track>,
+}
+
+// A box located in the file, whose payload may not be in the prefix yet.
+struct ProbedBox {
+    box_type: String,
+    // Offsets of the payload of the box in the file.
+    start: u64,
+    end: u64,
+}
+
+fn probe_header(
+    data: &[u8],
+    offset: u64,
+    parent_end: Option<u64>,
+) -> AvifResult<Probed<ProbedBox>> {
+    // The size and type are followed by the optional largesize and usertype (see parse_header()).
+    let mut header_size = 8;
+    if checked_add!(offset, header_size)? > u64_from_usize(data.len())? {
+        return Ok(Probed::NeedBytes(offset + header_size));
+    }
+    let header_data = &data[usize_from_u64(offset)?..];
+    let mut stream = IStream::create(&header_data[..8]);
+    if stream.read_u32()? == 1 {
+        header_size += 8;
+    }
+    if stream.read_string(4)? == "uuid" {
+        header_size += 16;
+    }
+    if header_size > u64_from_usize(header_data.len())? {
+        return Ok(Probed::NeedBytes(offset + header_size));
+    }
+    // The payload is not in the stream, so its size is checked against |parent_end| below.
+    let header = parse_header(
+        &mut IStream::create(&header_data[..usize_from_u64(header_size)?]),
+        /*top_level=*/ true,
+    )?;
+    let BoxSize::FixedSize(size) = header.size else {
+        // Not allowed for non-top-level boxes. For top-level boxes, the end of the file is not
+        // known from a prefix.
+        return Err(AvifError::BmffParseFailed(format!(
+            "cannot probe box {} of size 0",
+            header.box_type
+        )));
+    };
+    let start = offset + header_size;
+    let end = checked_add!(start, u64_from_usize(size)?)?;
+    if parent_end.is_some_and(|parent_end| end > parent_end) {
+        return Err(AvifError::BmffParseFailed("possibly truncated box".into()));
+    }
+    Ok(Probed::Done(ProbedBox {
+        box_type: header.box_type,
+        start,
+        end,
+    }))
+}
+
+fn probe_payload<'a>(data: &'a [u8], probed_box: &ProbedBox) -> AvifResult<Probed<IStream<'a>>> {
+    if probed_box.end > u64_from_usize(data.len())? {
+        return Ok(Probed::NeedBytes(probed_box.end));
+    }
+    Ok(Probed::Done(IStream::create(
+        &data[usize_from_u64(probed_box.start)?..usize_from_u64(probed_box.end)?],
+    )))
+}
+
+// Calls |f| on each child box of |parent| until it returns false. The payloads of the children
+// that are not used by |f| do not have to be in |data|.
+fn probe_children(
+    data: &[u8],
+    parent: &ProbedBox,
+    mut f: impl FnMut(&ProbedBox) -> AvifResult<Probed<bool>>,
+) -> AvifResult<Probed<()>> {
+    let mut offset = parent.start;
+    while offset < parent.end {
+        let child = probed!(probe_header(data, offset, Some(parent.end)));
+        if !probed!(f(&child)) {
+            break;
+        }
+        offset = child.end;
+    }
+    Ok(Probed::Done(()))
+}
+
+fn probe_stbl(data: &[u8], stbl: &ProbedBox, track: &mut Track) -> AvifResult<Probed<()>> {
+    if track.sample_table.is_some() {
+        return Err(AvifError::BmffParseFailed(
+            "duplicate stbl for track.".into(),
+        ));
+    }
+    let mut sample_table = SampleTable::default();
+    // Only the sample descriptions are needed, so stop at the stsd box. The other boxes of stbl
+    // are the largest part of the trak box.
+    probed!(probe_children(data, stbl, |child| {
+        if child.box_type != "stsd" {
+            return Ok(Probed::Done(true));
+        }
+        parse_stsd(&mut probed!(probe_payload(data, child)), &mut sample_table)?;
+        Ok(Probed::Done(false))
+    }));
+    track.sample_table = Some(Arc::new(sample_table));
+    Ok(Probed::Done(()))
+}
+
+fn probe_trak(data: &[u8], trak: &ProbedBox) -> AvifResult<Probed<Track>> {
+    let mut track = Track::default();
+    let mut tkhd_seen = false;
+    // Same as parse_trak(), parse_mdia() and parse_minf() but without the edts and meta boxes.
+    probed!(probe_children(data, trak, |child| {
+        match child.box_type.as_str() {
+            "tkhd" => {
+                if tkhd_seen {
+                    return Err(AvifError::BmffParseFailed(
+                        "trak box contains multiple tkhd boxes".into(),
+                    ));
+                }
+                parse_tkhd(&mut probed!(probe_payload(data, child)), &mut track)?;
+                tkhd_seen = true;
+            }
+            "tref" => parse_tref(&mut probed!(probe_payload(data, child)), &mut track)?,
+            "mdia" => {
+                probed!(probe_children(data, child, |child| {
+                    match child.box_type.as_str() {
+                        "mdhd" => parse_mdhd(&mut probed!(probe_payload(data, child)), &mut track)?,
+                        "minf" => {
+                            probed!(probe_children(data, child, |child| {
+                                if child.box_type == "stbl" {
+                                    probed!(probe_stbl(data, child, &mut track));
+                                }
+                                Ok(Probed::Done(true))
+                            }));
+                        }
+                        _ => {}
+                    }
+                    Ok(Probed::Done(true))
+                }));
+            }
+            _ => {}
+        }
+        Ok(Probed::Done(true))
+    }));
+    if !tkhd_seen {
+        return Err(AvifError::BmffParseFailed(
+            "trak box did not contain a tkhd box".into(),
+        ));
+    }
+    Ok(Probed::Done(track))
+}
+
+fn probe_moov(data: &[u8], moov: &ProbedBox) -> AvifResult<Probed<Vec<Track>>> {
+    let mut tracks: Vec<Track> = Vec::new();
+    probed!(probe_children(data, moov, |child| {
+        if child.box_type == "trak" {
+            tracks.push(probed!(probe_trak(data, child)));
+        }
+        Ok(Probed::Done(true))
+    }));
+    if tracks.is_empty() {
+        return Err(AvifError::BmffParseFailed(
+            "moov box does not contain any tracks".into(),
+        ));
+    }
+    Ok(Probed::Done(tracks))
+}
+
+// Same as parse() but on the prefix |data| of a file. Only the top-level boxes that parse() would
+// read and their headers need to be in |data|, and only the parts of the moov box that describe
+// the tracks.
+pub fn probe(data: &[u8]) -> AvifResult<Probed<ProbedBoxes>> {
+    let mut ftyp: Option<FileTypeBox> = None;
+    let mut meta: Option<MetaBox> = None;
+    let mut tracks: Option<Vec<Track>> = None;
+    let mut offset: u64 = 0;
+    loop {
+        if let Some(ftyp) = &ftyp {
+            if (!ftyp.needs_meta() || meta.is_some()) && (!ftyp.needs_moov() || tracks.is_some()) {
+                break;
+            }
+        }
+        let probed_box = probed!(probe_header(data, offset, None));
+        match probed_box.box_type.as_str() {
+            "ftyp" => {
+                let file_type = parse_ftyp(&mut probed!(probe_payload(data, &probed_box)))?;
+                if !file_type.is_avif() {
+                    return Err(AvifError::InvalidFtyp);
+                }
+                ftyp = Some(file_type);
+            }
+            "meta" => meta = Some(parse_meta(&mut probed!(probe_payload(data, &probed_box)))?),
+            "moov" => tracks = Some(probed!(probe_moov(data, &probed_box))),
+            _ => {}
+        }
+        offset = probed_box.end;
+    }
+    Ok(Probed::Done(ProbedBoxes {
+        ftyp: ftyp.unwrap(),
+        meta,
+        tracks: tracks.unwrap_or_default(),
+    }))
+}
+
 pub fn parse_tmap(stream: &mut IStream) -> AvifResult<GainMapMetadata> {
     // Experimental, not yet specified.
 
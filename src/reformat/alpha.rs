@@ -20,25 +20,194 @@ use super::rgb;
 use crate::decoder::Category;
 use crate::image::Plane;
 use crate::internal_utils::*;
-use crate::reformat::rgb::Format;
 use crate::*;
 
+// The functions below return the same values as their floating point definitions (for example
+// floor(pixel * alpha / 255) for premultiply_u8()) but are written so that the loops that use
+// them are vectorized: the values are never negative so the truncating conversions are used as
+// floor(), and the exact integer division by a constant replaces the f32 one in premultiply_u8().
+
 fn premultiply_u8(pixel: u8, alpha: u8) -> u8 {
-    ((pixel as f32) * (alpha as f32) / 255.0).floor() as u8
+    ((pixel as u16) * (alpha as u16) / 255) as u8
 }
 
-fn premultiply_u16(pixel: u16, alpha: u16, max_channel_f: f32) -> u16 {
-    ((pixel as f32) * (alpha as f32) / max_channel_f).floor() as u16
+pub(crate) fn premultiply_u16(pixel: u16, alpha: u16, max_channel_f: f32) -> u16 {
+    saturating_u16_from_f32((pixel as f32) * (alpha as f32) / max_channel_f)
 }
 
 fn unpremultiply_u8(pixel: u8, alpha: u8) -> u8 {
-    ((pixel as f32) * 255.0 / (alpha as f32)).floor().min(255.0) as u8
+    saturating_u8_from_f32(((pixel as f32) * 255.0 / (alpha as f32)).min(255.0))
+}
+
+pub(crate) fn unpremultiply_u16(pixel: u16, alpha: u16, max_channel_f: f32) -> u16 {
+    saturating_u16_from_f32(((pixel as f32) * max_channel_f / (alpha as f32)).min(max_channel_f))
+}
+
+// The number of pixels processed at once by process_color_channels().
+const COLOR_CHANNELS_BLOCK_SIZE: usize = 64;
+
+// Replaces each color channel of the interleaved pixels of |row| by f(channel, alpha). The alpha
+// values of each block of pixels are first copied to all the channels of their pixel in a scratch
+// buffer, so that the second loop processes the channels independently of their position in the
+// pixel. f() is also computed for the alpha channels, whose results are discarded. Both loops are
+// vectorized, which is not the case of a single loop over the pixels because of the shuffles it
+// would need.
+#[inline(always)]
+fn process_color_channels<T: Copy + Default, const ALPHA_OFFSET: usize>(
+    row: &mut [T],
+    f: impl Fn(T, T) -> T,
+) {
+    let mut alphas = [T::default(); COLOR_CHANNELS_BLOCK_SIZE * 4];
+    for block in row.chunks_mut(COLOR_CHANNELS_BLOCK_SIZE * 4) {
+        let alphas = &mut alphas[..block.len()];
+        for (pixel_alphas, pixel) in alphas.chunks_exact_mut(4).zip(block.chunks_exact(4)) {
+            pixel_alphas.fill(pixel[ALPHA_OFFSET]);
+        }
+        for (index, (value, &alpha)) in block.iter_mut().zip(alphas.iter()).enumerate() {
+            let processed = f(*value, alpha);
+            *value = if index % 4 == ALPHA_OFFSET { alpha } else { processed };
+        }
+    }
+}
+
+#[inline(always)]
+fn process_color_channels_at<T: Copy + Default>(
+    row: &mut [T],
+    alpha_offset: usize,
+    f: impl Fn(T, T) -> T,
+) {
+    if alpha_offset == 0 {
+        process_color_channels::<T, 0>(row, f);
+    } else {
+        process_color_channels::<T, 3>(row, f);
+    }
+}
+
+cpu_dispatched! {
+    fn premultiply_row_u8(row: &mut [u8], alpha_offset: usize) {
+        // premultiply_u8() returns the pixel if alpha is 255 and 0 if alpha is 0.
+        process_color_channels_at(row, alpha_offset, premultiply_u8);
+    }
+}
+
+cpu_dispatched! {
+    fn premultiply_row_u16(row: &mut [u16], alpha_offset: usize, max_channel: u16) {
+        let max_channel_f = max_channel as f32;
+        // premultiply_u16() returns 0 if alpha is 0.
+        process_color_channels_at(row, alpha_offset, |pixel, alpha| {
+            let premultiplied = premultiply_u16(pixel, alpha, max_channel_f);
+            if alpha >= max_channel {
+                pixel
+            } else {
+                premultiplied
+            }
+        });
+    }
+}
+
+cpu_dispatched! {
+    fn unpremultiply_row_u8(row: &mut [u8], alpha_offset: usize) {
+        // unpremultiply_u8() returns the pixel if alpha is 255.
+        process_color_channels_at(row, alpha_offset, |pixel, alpha| {
+            let unpremultiplied = unpremultiply_u8(pixel, alpha);
+            if alpha == 0 {
+                0
+            } else {
+                unpremultiplied
+            }
+        });
+    }
+}
+
+cpu_dispatched! {
+    fn unpremultiply_row_u16(row: &mut [u16], alpha_offset: usize, max_channel: u16) {
+        let max_channel_f = max_channel as f32;
+        process_color_channels_at(row, alpha_offset, |pixel, alpha| {
+            let unpremultiplied = unpremultiply_u16(pixel, alpha, max_channel_f);
+            if alpha >= max_channel {
+                pixel
+            } else if alpha == 0 {
+                0
+            } else {
+                unpremultiplied
+            }
+        });
+    }
+}
+
+// Writes the alpha values of |src| rescaled from |src_max_channel_f| to |dst_max_channel| into the
+// interleaved pixels of |dst|.
+#[inline(always)]
+fn rescale_alpha_row<S: Copy + Into<u16>, D: Copy, const ALPHA_OFFSET: usize>(
+    src: &[S],
+    dst: &mut [D],
+    src_max_channel_f: f32,
+    dst_max_channel: u16,
+    convert: impl Fn(u16) -> D,
+) {
+    for (pixel, &alpha) in dst.chunks_exact_mut(4).zip(src) {
+        pixel[ALPHA_OFFSET] = convert(rgb::Image::rescale_alpha_value(
+            alpha.into(),
+            src_max_channel_f,
+            dst_max_channel,
+        ));
+    }
+}
+
+macro_rules! rescale_alpha_row_function {
+    ($func:ident, $src:ty, $dst:ty) => {
+        cpu_dispatched! {
+            fn $func(
+                src: &[$src],
+                dst: &mut [$dst],
+                dst_alpha_offset: usize,
+                src_max_channel_f: f32,
+                dst_max_channel: u16
+            ) {
+                let convert = |value: u16| value as $dst;
+                if dst_alpha_offset == 0 {
+                    rescale_alpha_row::<_, _, 0>(src, dst, src_max_channel_f, dst_max_channel, convert);
+                } else {
+                    rescale_alpha_row::<_, _, 3>(src, dst, src_max_channel_f, dst_max_channel, convert);
+                }
+            }
+        }
+    };
+}
+
+rescale_alpha_row_function!(rescale_alpha_row_u16_to_u16, u16, u16);
+rescale_alpha_row_function!(rescale_alpha_row_u16_to_u8, u16, u8);
+rescale_alpha_row_function!(rescale_alpha_row_u8_to_u16, u8, u16);
+
+cpu_dispatched! {
+    fn alpha_row_to_full_range_u8(row: &mut [u8]) {
+        for pixel in row {
+            *pixel = limited_to_full_y(8, *pixel as u16) as u8;
+        }
+    }
 }
 
-fn unpremultiply_u16(pixel: u16, alpha: u16, max_channel_f: f32) -> u16 {
-    ((pixel as f32) * max_channel_f / (alpha as f32))
-        .floor()
-        .min(max_channel_f) as u16
+#[inline(always)]
+fn alpha_row_to_full_range<const DEPTH: u8>(row: &mut [u16]) {
+    for pixel in row {
+        *pixel = limited_to_full_y(DEPTH, *pixel);
+    }
+}
+
+cpu_dispatched! {
+    fn alpha_row_to_full_range_u16(row: &mut [u16], depth: u8) {
+        // The depth is a constant of each loop so that the divisions of limited_to_full_y() are
+        // done with multiplications.
+        match depth {
+            10 => alpha_row_to_full_range::<10>(row),
+            12 => alpha_row_to_full_range::<12>(row),
+            _ => {
+                for pixel in row {
+                    *pixel = limited_to_full_y(depth, *pixel);
+                }
+            }
+        }
+    }
 }
 
 impl rgb::Image {
@@ -60,57 +229,17 @@ impl rgb::Image {
             }
         }
 
-        let (alpha_offset, rgb_offsets) = match self.format {
-            Format::Rgba | Format::Bgra => (3, [0, 1, 2]),
-            _ => (0, [1, 2, 3]),
-        };
-
+        let alpha_offset = self.format.alpha_offset();
+        let width = usize_from_u32(self.width)?;
         if self.depth > 8 {
             let max_channel = self.max_channel();
-            let max_channel_f = self.max_channel_f();
             for j in 0..self.height {
-                let width = self.width;
-                let row = self.row16_mut(j)?;
-                for i in 0..width as usize {
-                    let offset = i * 4;
-                    let alpha = row[offset + alpha_offset];
-                    if alpha >= max_channel {
-                        continue;
-                    }
-                    if alpha == 0 {
-                        for rgb_offset in rgb_offsets {
-                            row[offset + rgb_offset] = 0;
-                        }
-                        continue;
-                    }
-                    for rgb_offset in rgb_offsets {
-                        row[offset + rgb_offset] =
-                            premultiply_u16(row[offset + rgb_offset], alpha, max_channel_f);
-                    }
-                }
+                let row = &mut self.row16_mut(j)?[..width * 4];
+                premultiply_row_u16(row, alpha_offset, max_channel);
             }
         } else {
             for j in 0..self.height {
-                let width = self.width;
-                let row = self.row_mut(j)?;
-                for i in 0..width as usize {
-                    let offset = i * 4;
-                    let alpha = row[offset + alpha_offset];
-                    match alpha {
-                        0 => {
-                            for rgb_offset in rgb_offsets {
-                                row[offset + rgb_offset] = 0;
-                            }
-                        }
-                        255 => {}
-                        _ => {
-                            for rgb_offset in rgb_offsets {
-                                row[offset + rgb_offset] =
-                                    premultiply_u8(row[offset + rgb_offset], alpha);
-                            }
-                        }
-                    }
-                }
+                premultiply_row_u8(&mut self.row_mut(j)?[..width * 4], alpha_offset);
             }
         }
         Ok(())
@@ -134,57 +263,17 @@ impl rgb::Image {
             }
         }
 
-        let (alpha_offset, rgb_offsets) = match self.format {
-            Format::Rgba | Format::Bgra => (3, [0, 1, 2]),
-            _ => (0, [1, 2, 3]),
-        };
-
+        let alpha_offset = self.format.alpha_offset();
+        let width = usize_from_u32(self.width)?;
         if self.depth > 8 {
             let max_channel = self.max_channel();
-            let max_channel_f = self.max_channel_f();
             for j in 0..self.height {
-                let width = self.width;
-                let row = self.row16_mut(j)?;
-                for i in 0..width as usize {
-                    let offset = i * 4;
-                    let alpha = row[offset + alpha_offset];
-                    if alpha >= max_channel {
-                        continue;
-                    }
-                    if alpha == 0 {
-                        for rgb_offset in rgb_offsets {
-                            row[offset + rgb_offset] = 0;
-                        }
-                        continue;
-                    }
-                    for rgb_offset in rgb_offsets {
-                        row[offset + rgb_offset] =
-                            unpremultiply_u16(row[offset + rgb_offset], alpha, max_channel_f);
-                    }
-                }
+                let row = &mut self.row16_mut(j)?[..width * 4];
+                unpremultiply_row_u16(row, alpha_offset, max_channel);
             }
         } else {
             for j in 0..self.height {
-                let width = self.width;
-                let row = self.row_mut(j)?;
-                for i in 0..width as usize {
-                    let offset = i * 4;
-                    let alpha = row[offset + alpha_offset];
-                    match alpha {
-                        0 => {
-                            for rgb_offset in rgb_offsets {
-                                row[offset + rgb_offset] = 0;
-                            }
-                        }
-                        255 => {}
-                        _ => {
-                            for rgb_offset in rgb_offsets {
-                                row[offset + rgb_offset] =
-                                    unpremultiply_u8(row[offset + rgb_offset], alpha);
-                            }
-                        }
-                    }
-                }
+                unpremultiply_row_u8(&mut self.row_mut(j)?[..width * 4], alpha_offset);
             }
         }
         Ok(())
@@ -218,10 +307,14 @@ impl rgb::Image {
         Ok(())
     }
 
-    fn rescale_alpha_value(value: u16, src_max_channel_f: f32, dst_max_channel: u16) -> u16 {
+    pub(crate) fn rescale_alpha_value(
+        value: u16,
+        src_max_channel_f: f32,
+        dst_max_channel: u16,
+    ) -> u16 {
         let alpha_f = (value as f32) / src_max_channel_f;
         let dst_max_channel_f = dst_max_channel as f32;
-        let alpha = (0.5 + (alpha_f * dst_max_channel_f)) as u16;
+        let alpha = saturating_u16_from_f32(0.5 + (alpha_f * dst_max_channel_f));
         clamp_u16(alpha, 0, dst_max_channel)
     }
 
@@ -256,45 +349,48 @@ impl rgb::Image {
             return Ok(());
         }
         let max_channel = self.max_channel();
+        let src_max_channel_f = image.max_channel_f();
         if image.depth > 8 {
             if self.depth > 8 {
                 // u16 to u16 depth rescaling.
                 for y in 0..self.height {
-                    let dst_row = self.row16_mut(y)?;
-                    let src_row = image.row16(Plane::A, y)?;
-                    for x in 0..width {
-                        dst_row[(x * 4) + dst_alpha_offset] = Self::rescale_alpha_value(
-                            src_row[x],
-                            image.max_channel_f(),
-                            max_channel,
-                        );
-                    }
+                    let src_row = &image.row16(Plane::A, y)?[..width];
+                    let dst_row = &mut self.row16_mut(y)?[..width * 4];
+                    rescale_alpha_row_u16_to_u16(
+                        src_row,
+                        dst_row,
+                        dst_alpha_offset,
+                        src_max_channel_f,
+                        max_channel,
+                    );
                 }
                 return Ok(());
             }
             // u16 to u8 depth rescaling.
             for y in 0..self.height {
-                let dst_row = self.row_mut(y)?;
-                let src_row = image.row16(Plane::A, y)?;
-                for x in 0..width {
-                    dst_row[(x * 4) + dst_alpha_offset] =
-                        Self::rescale_alpha_value(src_row[x], image.max_channel_f(), max_channel)
-                            as u8;
-                }
+                let src_row = &image.row16(Plane::A, y)?[..width];
+                let dst_row = &mut self.row_mut(y)?[..width * 4];
+                rescale_alpha_row_u16_to_u8(
+                    src_row,
+                    dst_row,
+                    dst_alpha_offset,
+                    src_max_channel_f,
+                    max_channel,
+                );
             }
             return Ok(());
         }
         // u8 to u16 depth rescaling.
         for y in 0..self.height {
-            let dst_row = self.row16_mut(y)?;
-            let src_row = image.row(Plane::A, y)?;
-            for x in 0..width {
-                dst_row[(x * 4) + dst_alpha_offset] = Self::rescale_alpha_value(
-                    src_row[x] as u16,
-                    image.max_channel_f(),
-                    max_channel,
-                );
-            }
+            let src_row = &image.row(Plane::A, y)?[..width];
+            let dst_row = &mut self.row16_mut(y)?[..width * 4];
+            rescale_alpha_row_u8_to_u16(
+                src_row,
+                dst_row,
+                dst_alpha_offset,
+                src_max_channel_f,
+                max_channel,
+            );
         }
         Ok(())
     }
@@ -325,34 +421,24 @@ impl image::Image {
             self.allocate_planes(Category::Alpha)?;
             if depth > 8 {
                 for y in 0..self.height {
-                    let src_row = src.row16(Plane::A, y)?;
-                    let dst_row = self.row16_mut(Plane::A, y)?;
-                    for x in 0..width {
-                        dst_row[x] = limited_to_full_y(depth, src_row[x]);
-                    }
+                    let dst_row = &mut self.row16_mut(Plane::A, y)?[..width];
+                    dst_row.copy_from_slice(&src.row16(Plane::A, y)?[..width]);
+                    alpha_row_to_full_range_u16(dst_row, depth);
                 }
             } else {
                 for y in 0..self.height {
-                    let src_row = src.row(Plane::A, y)?;
-                    let dst_row = self.row_mut(Plane::A, y)?;
-                    for x in 0..width {
-                        dst_row[x] = limited_to_full_y(8, src_row[x] as u16) as u8;
-                    }
+                    let dst_row = &mut self.row_mut(Plane::A, y)?[..width];
+                    dst_row.copy_from_slice(&src.row(Plane::A, y)?[..width]);
+                    alpha_row_to_full_range_u8(dst_row);
                 }
             }
         } else if depth > 8 {
             for y in 0..self.height {
-                let row = self.row16_mut(Plane::A, y)?;
-                for pixel in row.iter_mut().take(width) {
-                    *pixel = limited_to_full_y(depth, *pixel);
-                }
+                alpha_row_to_full_range_u16(&mut self.row16_mut(Plane::A, y)?[..width], depth);
             }
         } else {
             for y in 0..self.height {
-                let row = self.row_mut(Plane::A, y)?;
-                for pixel in row.iter_mut().take(width) {
-                    *pixel = limited_to_full_y(8, *pixel as u16) as u8;
-                }
+                alpha_row_to_full_range_u8(&mut self.row_mut(Plane::A, y)?[..width]);
             }
         }
         Ok(())
@@ -449,6 +535,194 @@ mod tests {
         Ok(())
     }
 
+    // Returns pixels with all the combinations of |values| as color channel and alpha, with the
+    // alpha at |alpha_offset|.
+    fn pixels_with_alpha(values: &[u16], alpha_offset: usize) -> Vec<u16> {
+        let mut pixels = Vec::new();
+        for &alpha in values {
+            for &value in values {
+                let mut pixel = [
+                    value,
+                    value / 2,
+                    values[values.len() - 1] - value / 3,
+                    value,
+                ];
+                pixel[alpha_offset] = alpha;
+                pixels.extend_from_slice(&pixel);
+            }
+        }
+        pixels
+    }
+
+    #[test]
+    fn per_pixel_functions_match_float_definitions() {
+        for pixel in 0..=255u8 {
+            for alpha in 0..=255u8 {
+                assert_eq!(
+                    premultiply_u8(pixel, alpha),
+                    ((pixel as f32) * (alpha as f32) / 255.0).floor() as u8
+                );
+                assert_eq!(
+                    unpremultiply_u8(pixel, alpha),
+                    ((pixel as f32) * 255.0 / (alpha as f32)).floor().min(255.0) as u8
+                );
+            }
+        }
+        for depth in [10, 12, 16] {
+            let max_channel = ((1u32 << depth) - 1) as u16;
+            let max_channel_f = max_channel as f32;
+            let values: Vec<u16> = (0..=65535u16).step_by(61).chain([max_channel]).collect();
+            for &pixel in &values {
+                for &alpha in &values {
+                    assert_eq!(
+                        premultiply_u16(pixel, alpha, max_channel_f),
+                        ((pixel as f32) * (alpha as f32) / max_channel_f).floor() as u16
+                    );
+                    assert_eq!(
+                        unpremultiply_u16(pixel, alpha, max_channel_f),
+                        ((pixel as f32) * max_channel_f / (alpha as f32))
+                            .floor()
+                            .min(max_channel_f) as u16
+                    );
+                }
+            }
+        }
+        for value in [
+            -1.0,
+            -0.5,
+            0.0,
+            0.5,
+            254.9,
+            255.0,
+            255.5,
+            65535.9,
+            1e10,
+            f32::NAN,
+        ] {
+            assert_eq!(saturating_u8_from_f32(value), value as u8);
+            assert_eq!(saturating_u16_from_f32(value), value as u16);
+        }
+    }
+
+    #[test]
+    fn row_functions_match_per_pixel_functions() {
+        for alpha_offset in [0, 3] {
+            let values: Vec<u16> = (0..256).collect();
+            let pixels = pixels_with_alpha(&values, alpha_offset);
+            let mut premultiplied: Vec<u8> = pixels.iter().map(|&v| v as u8).collect();
+            let mut unpremultiplied = premultiplied.clone();
+            premultiply_row_u8(&mut premultiplied, alpha_offset);
+            unpremultiply_row_u8(&mut unpremultiplied, alpha_offset);
+            for (i, &pixel) in pixels.iter().enumerate() {
+                let alpha = pixels[i - (i % 4) + alpha_offset] as u8;
+                let (expected_premultiplied, expected_unpremultiplied) = match alpha {
+                    _ if i % 4 == alpha_offset => (alpha, alpha),
+                    0 => (0, 0),
+                    255 => (pixel as u8, pixel as u8),
+                    _ => (
+                        premultiply_u8(pixel as u8, alpha),
+                        unpremultiply_u8(pixel as u8, alpha),
+                    ),
+                };
+                assert_eq!(premultiplied[i], expected_premultiplied);
+                assert_eq!(unpremultiplied[i], expected_unpremultiplied);
+            }
+
+            for depth in [10, 12, 16] {
+                let max_channel = ((1u32 << depth) - 1) as u16;
+                let max_channel_f = max_channel as f32;
+                // Includes values above the maximum for the depth.
+                let values: Vec<u16> = (0..=65535u32)
+                    .step_by(97)
+                    .map(|v| (v % (2 << depth).min(65536)) as u16)
+                    .chain([0, 1, max_channel - 1, max_channel])
+                    .collect();
+                let pixels = pixels_with_alpha(&values, alpha_offset);
+                let mut premultiplied = pixels.clone();
+                let mut unpremultiplied = pixels.clone();
+                premultiply_row_u16(&mut premultiplied, alpha_offset, max_channel);
+                unpremultiply_row_u16(&mut unpremultiplied, alpha_offset, max_channel);
+                for (i, &pixel) in pixels.iter().enumerate() {
+                    let alpha = pixels[i - (i % 4) + alpha_offset];
+                    let (expected_premultiplied, expected_unpremultiplied) = match alpha {
+                        _ if i % 4 == alpha_offset || alpha >= max_channel => (pixel, pixel),
+                        0 => (0, 0),
+                        _ => (
+                            premultiply_u16(pixel, alpha, max_channel_f),
+                            unpremultiply_u16(pixel, alpha, max_channel_f),
+                        ),
+                    };
+                    assert_eq!(premultiplied[i], expected_premultiplied);
+                    assert_eq!(unpremultiplied[i], expected_unpremultiplied);
+                }
+            }
+        }
+
+        let values: Vec<u8> = (0..=255).collect();
+        let mut full_range = values.clone();
+        alpha_row_to_full_range_u8(&mut full_range);
+        for (&value, &full) in values.iter().zip(&full_range) {
+            assert_eq!(full, limited_to_full_y(8, value as u16) as u8);
+        }
+        let values: Vec<u16> = (0..=65535).collect();
+        for depth in [10, 12, 16] {
+            let mut full_range = values.clone();
+            alpha_row_to_full_range_u16(&mut full_range, depth);
+            for (&value, &full) in values.iter().zip(&full_range) {
+                assert_eq!(full, limited_to_full_y(depth, value));
+            }
+        }
+
+        for (src_depth, dst_depth) in [(10, 12), (12, 10), (16, 10), (10, 8), (8, 12)] {
+            let src_max_channel_f = ((1u32 << src_depth) - 1) as f32;
+            let dst_max_channel = ((1u32 << dst_depth) - 1) as u16;
+            let src: Vec<u16> = (0..(1u32 << src_depth)).map(|v| v as u16).collect();
+            let expected: Vec<u16> = src
+                .iter()
+                .map(|&v| rgb::Image::rescale_alpha_value(v, src_max_channel_f, dst_max_channel))
+                .collect();
+            for alpha_offset in [0, 3] {
+                let alphas: Vec<u16> = if dst_depth == 8 {
+                    let mut dst = vec![0u8; src.len() * 4];
+                    rescale_alpha_row_u16_to_u8(
+                        &src,
+                        &mut dst,
+                        alpha_offset,
+                        src_max_channel_f,
+                        dst_max_channel,
+                    );
+                    dst.iter()
+                        .skip(alpha_offset)
+                        .step_by(4)
+                        .map(|&v| v as u16)
+                        .collect()
+                } else {
+                    let mut dst = vec![0u16; src.len() * 4];
+                    if src_depth == 8 {
+                        let src: Vec<u8> = src.iter().map(|&v| v as u8).collect();
+                        rescale_alpha_row_u8_to_u16(
+                            &src,
+                            &mut dst,
+                            alpha_offset,
+                            src_max_channel_f,
+                            dst_max_channel,
+                        );
+                    } else {
+                        rescale_alpha_row_u16_to_u16(
+                            &src,
+                            &mut dst,
+                            alpha_offset,
+                            src_max_channel_f,
+                            dst_max_channel,
+                        );
+                    }
+                    dst.iter().skip(alpha_offset).step_by(4).copied().collect()
+                };
+                assert_eq!(alphas, expected);
+            }
+        }
+    }
+
     #[test]
     fn rescale_alpha_value() {
         // 8bit to 10bit.
@@ -0,0 +1,575 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use super::rgb;
+use super::rgb::*;
+use super::rgb_impl::UnormRowConverter;
+
+use crate::decoder::gainmap::*;
+use crate::image::Plane;
+use crate::internal_utils::*;
+use crate::*;
+
+use std::cmp::min;
+
+// Number of intervals of the lookup tables of the transfer functions. The values between the
+// samples are linearly interpolated.
+const LINEARIZE_LUT_SIZE: usize = 4096;
+const ENCODE_LUT_SIZE: usize = 16384;
+
+// Luminance of the SDR white in nits, used to place SDR relative values on the absolute scale of
+// PQ (see ITU-R BT.2408).
+const SDR_WHITE_NITS: f32 = 203.0;
+const PQ_MAX_NITS: f32 = 10000.0;
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+enum Transfer {
+    Linear,
+    Srgb,
+    Bt709,
+    Gamma(f32),
+    // Linear values are relative to PQ_MAX_NITS.
+    Pq,
+}
+
+impl Transfer {
+    fn create(transfer_characteristics: TransferCharacteristics) -> AvifResult<Self> {
+        match transfer_characteristics {
+            TransferCharacteristics::Linear => Ok(Self::Linear),
+            TransferCharacteristics::Srgb | TransferCharacteristics::Unspecified => Ok(Self::Srgb),
+            TransferCharacteristics::Bt709
+            | TransferCharacteristics::Bt601
+            | TransferCharacteristics::Bt2020_10bit
+            | TransferCharacteristics::Bt2020_12bit => Ok(Self::Bt709),
+            TransferCharacteristics::Bt470m => Ok(Self::Gamma(2.2)),
+            TransferCharacteristics::Bt470bg => Ok(Self::Gamma(2.8)),
+            TransferCharacteristics::Pq => Ok(Self::Pq),
+            _ => Err(AvifError::NotImplemented),
+        }
+    }
+
+    fn to_linear(self, v: f32) -> f32 {
+        match self {
+            Self::Linear => v,
+            Self::Srgb => {
+                if v <= 0.04045 {
+                    v / 12.92
+                } else {
+                    ((v + 0.055) / 1.055).powf(2.4)
+                }
+            }
+            Self::Bt709 => {
+                if v < 0.081 {
+                    v / 4.5
+                } else {
+                    ((v + 0.099) / 1.099).powf(1.0 / 0.45)
+                }
+            }
+            Self::Gamma(gamma) => v.powf(gamma),
+            Self::Pq => {
+                let (m1, m2, c1, c2, c3) = Self::pq_constants();
+                let p = v.powf(1.0 / m2);
+                (f32::max(p - c1, 0.0) / (c2 - c3 * p)).powf(1.0 / m1)
+            }
+        }
+    }
+
+    fn from_linear(self, v: f32) -> f32 {
+        match self {
+            Self::Linear => v,
+            Self::Srgb => {
+                if v <= 0.0031308 {
+                    v * 12.92
+                } else {
+                    1.055 * v.powf(1.0 / 2.4) - 0.055
+                }
+            }
+            Self::Bt709 => {
+                if v < 0.018 {
+                    v * 4.5
+                } else {
+                    1.099 * v.powf(0.45) - 0.099
+                }
+            }
+            Self::Gamma(gamma) => v.powf(1.0 / gamma),
+            Self::Pq => {
+                let (m1, m2, c1, c2, c3) = Self::pq_constants();
+                let p = v.powf(m1);
+                ((c1 + c2 * p) / (1.0 + c3 * p)).powf(m2)
+            }
+        }
+    }
+
+    // SMPTE ST 2084.
+    fn pq_constants() -> (f32, f32, f32, f32, f32) {
+        (
+            2610.0 / 16384.0,
+            2523.0 / 4096.0 * 128.0,
+            3424.0 / 4096.0,
+            2413.0 / 4096.0 * 32.0,
+            2392.0 / 4096.0 * 32.0,
+        )
+    }
+
+    // Linear values of this transfer function are multiplied by this to be relative to the SDR
+    // white.
+    fn sdr_relative_scale(self) -> f32 {
+        match self {
+            Self::Pq => PQ_MAX_NITS / SDR_WHITE_NITS,
+            _ => 1.0,
+        }
+    }
+}
+
+// Samples of a function over [0, 1]. The input of get() is clamped to [0, 1] and the values
+// between the samples are linearly interpolated.
+struct Lut {
+    values: Vec<f32>,
+    scale: f32,
+}
+
+impl Lut {
+    fn create(intervals: usize, f: impl Fn(f32) -> f32) -> AvifResult<Self> {
+        let mut values: Vec<f32> = create_vec_exact(intervals + 1)?;
+        for i in 0..=intervals {
+            values.push(f(i as f32 / intervals as f32));
+        }
+        Ok(Self {
+            values,
+            scale: intervals as f32,
+        })
+    }
+
+    fn get(&self, v: f32) -> f32 {
+        let position = clamp_f32(v, 0.0, 1.0) * self.scale;
+        let index = min(position as usize, self.values.len() - 2);
+        let fraction = position - index as f32;
+        self.values[index] + (self.values[index + 1] - self.values[index]) * fraction
+    }
+}
+
+fn fraction_to_f32(fraction: &Fraction) -> AvifResult<f32> {
+    if fraction.1 == 0 {
+        return Err(AvifError::InvalidArgument);
+    }
+    Ok(fraction.0 as f32 / fraction.1 as f32)
+}
+
+fn ufraction_to_f32(fraction: &UFraction) -> AvifResult<f32> {
+    if fraction.1 == 0 {
+        return Err(AvifError::InvalidArgument);
+    }
+    Ok(fraction.0 as f32 / fraction.1 as f32)
+}
+
+// Returns the weight of the gain map for a display of |hdr_headroom| (log2 of the ratio between
+// the peak and the SDR white), as specified in ISO 21496-1.
+fn gain_map_weight(metadata: &GainMapMetadata, hdr_headroom: f32) -> AvifResult<f32> {
+    let base_hdr_headroom = ufraction_to_f32(&metadata.base_hdr_headroom)?;
+    let alternate_hdr_headroom = ufraction_to_f32(&metadata.alternate_hdr_headroom)?;
+    if base_hdr_headroom == alternate_hdr_headroom {
+        return Ok(0.0);
+    }
+    Ok(clamp_f32(
+        (hdr_headroom - base_hdr_headroom) / (alternate_hdr_headroom - base_hdr_headroom),
+        0.0,
+        1.0,
+    ))
+}
+
+fn to_half_float(v: f32) -> u16 {
+    let v = clamp_f32(v, 0.0, 65504.0) * rgb::Image::half_float_multiplier(1.0);
+    (u32::from_le_bytes(v.to_le_bytes()) >> 13) as u16
+}
+
+// Produces the rows of the gain map bilinearly upsampled to the size of the base image. Each row
+// of the gain map is converted and horizontally upsampled once: the two rows needed for the
+// vertical interpolation are kept from one output row to the next.
+struct GainMapRows<'a> {
+    image: &'a image::Image,
+    converter: UnormRowConverter,
+    x0: Vec<usize>,
+    x1: Vec<usize>,
+    fx: Vec<f32>,
+    scratch: Vec<[f32; 3]>,
+    rows: [(Option<u32>, Vec<[f32; 3]>); 2],
+}
+
+impl<'a> GainMapRows<'a> {
+    fn create(image: &'a image::Image, width: u32) -> AvifResult<Self> {
+        let converter = UnormRowConverter::create(image, ChromaUpsampling::Nearest)?;
+        let width = usize_from_u32(width)?;
+        let mut x0: Vec<usize> = create_vec_exact(width)?;
+        let mut x1: Vec<usize> = create_vec_exact(width)?;
+        let mut fx: Vec<f32> = create_vec_exact(width)?;
+        for i in 0..width {
+            let (i0, i1, f) = Self::source_position(i as u32, width as u32, image.width);
+            x0.push(i0 as usize);
+            x1.push(i1 as usize);
+            fx.push(f);
+        }
+        Ok(Self {
+            image,
+            converter,
+            x0,
+            x1,
+            fx,
+            scratch: vec![[0.0; 3]; usize_from_u32(image.width)?],
+            rows: [(None, vec![[0.0; 3]; width]), (None, vec![[0.0; 3]; width])],
+        })
+    }
+
+    // Returns the two source samples surrounding the center of the destination sample |dst| and
+    // the interpolation weight of the second one.
+    fn source_position(dst: u32, dst_size: u32, src_size: u32) -> (u32, u32, f32) {
+        let position = (dst as f32 + 0.5) * src_size as f32 / dst_size as f32 - 0.5;
+        let position = clamp_f32(position, 0.0, (src_size - 1) as f32);
+        let p0 = position as u32;
+        (p0, min(p0 + 1, src_size - 1), position - p0 as f32)
+    }
+
+    // Converts the gain map row |y| and upsamples it horizontally into the slot |slot|.
+    fn fill(&mut self, slot: usize, y: u32) -> AvifResult<()> {
+        if self.rows[slot].0 == Some(y) {
+            return Ok(());
+        }
+        self.converter
+            .convert_row(self.image, y, &mut self.scratch)?;
+        for (i, value) in self.rows[slot].1.iter_mut().enumerate() {
+            let v0 = self.scratch[self.x0[i]];
+            let v1 = self.scratch[self.x1[i]];
+            for c in 0..3 {
+                value[c] = v0[c] + (v1[c] - v0[c]) * self.fx[i];
+            }
+        }
+        self.rows[slot].0 = Some(y);
+        Ok(())
+    }
+
+    // Writes the upsampled gain map values of the row |j| of a base image of |height| rows into
+    // |dst|.
+    fn row(&mut self, j: u32, height: u32, dst: &mut [[f32; 3]]) -> AvifResult<()> {
+        let (y0, y1, fy) = Self::source_position(j, height, self.image.height);
+        // Rows are consumed in increasing order, so the second row of the previous output row is
+        // usually the first row of this one.
+        if self.rows[1].0 == Some(y0) {
+            self.rows.swap(0, 1);
+        }
+        self.fill(0, y0)?;
+        let row1 = if y1 == y0 {
+            0
+        } else {
+            self.fill(1, y1)?;
+            1
+        };
+        let (row0, row1) = (&self.rows[0].1, &self.rows[row1].1);
+        for ((dst, v0), v1) in dst.iter_mut().zip(row0).zip(row1) {
+            for c in 0..3 {
+                dst[c] = v0[c] + (v1[c] - v0[c]) * fy;
+            }
+        }
+        Ok(())
+    }
+}
+
+impl rgb::Image {
+    // Converts |image| into RGB tone mapped for a display of |hdr_headroom| (log2 of the ratio
+    // between the peak and the SDR white) by applying |gainmap|, in a single pass over the base
+    // image and the gain map. The gain map is bilinearly upsampled on the fly. The RGB values are
+    // encoded with |transfer_characteristics|. Integer values are relative to the peak of the
+    // tone mapped image (or absolute for PQ). Half float values are linear, with 1.0 being the
+    // SDR white, so |transfer_characteristics| must be Linear. The pixels of this image must be
+    // allocated and its size must be the size of |image|.
+    pub fn convert_from_yuv_with_gain_map(
+        &mut self,
+        image: &image::Image,
+        gainmap: &GainMap,
+        hdr_headroom: f32,
+        transfer_characteristics: TransferCharacteristics,
+    ) -> AvifResult<()> {
+        let gainmap_image = &gainmap.image;
+        for yuv in [image, gainmap_image] {
+            if !yuv.has_plane(Plane::Y) || !yuv.depth_valid() || yuv.width == 0 || yuv.height == 0 {
+                return Err(AvifError::ReformatFailed);
+            }
+            check_yuv_conversion_supported(yuv)?;
+        }
+        if self.width != image.width || self.height != image.height || !self.depth_valid() {
+            return Err(AvifError::InvalidArgument);
+        }
+        let metadata = &gainmap.metadata;
+        if self.format == Format::Rgb565
+            || (self.is_float && transfer_characteristics != TransferCharacteristics::Linear)
+            || (self.has_alpha()
+                && image.has_alpha()
+                && (self.premultiply_alpha || image.alpha_premultiplied))
+            || (!metadata.use_base_color_space
+                && gainmap.alt_color_primaries != ColorPrimaries::Unspecified
+                && gainmap.alt_color_primaries != image.color_primaries)
+        {
+            return Err(AvifError::NotImplemented);
+        }
+        let base_transfer = Transfer::create(image.transfer_characteristics)?;
+        let output_transfer = Transfer::create(transfer_characteristics)?;
+
+        let weight = gain_map_weight(metadata, hdr_headroom)?;
+        let mut gain_luts: Vec<Lut> = create_vec_exact(3)?;
+        let mut base_offset = [0.0; 3];
+        let mut alternate_offset = [0.0; 3];
+        for c in 0..3 {
+            let gain_min = fraction_to_f32(&metadata.min[c])?;
+            let gain_max = fraction_to_f32(&metadata.max[c])?;
+            let gamma = ufraction_to_f32(&metadata.gamma[c])?;
+            if gamma == 0.0 {
+                return Err(AvifError::InvalidArgument);
+            }
+            base_offset[c] = fraction_to_f32(&metadata.base_offset[c])?;
+            alternate_offset[c] = fraction_to_f32(&metadata.alternate_offset[c])?;
+            // One interval per code value, so that full range codes fall on the samples.
+            gain_luts.push(Lut::create(gainmap_image.max_channel() as usize, |v| {
+                let log2_gain = gain_min + (gain_max - gain_min) * v.powf(1.0 / gamma);
+                (log2_gain * weight).exp2()
+            })?);
+        }
+        let base_scale = base_transfer.sdr_relative_scale();
+        let linearize = Lut::create(LINEARIZE_LUT_SIZE, |v| {
+            base_transfer.to_linear(v) * base_scale
+        })?;
+        // Maps the SDR relative tone mapped values to the [0, 1] linear input of the encoding.
+        let output_scale = if output_transfer == Transfer::Pq {
+            SDR_WHITE_NITS / PQ_MAX_NITS
+        } else {
+            let base_hdr_headroom = ufraction_to_f32(&metadata.base_hdr_headroom)?;
+            let alternate_hdr_headroom = ufraction_to_f32(&metadata.alternate_hdr_headroom)?;
+            let headroom =
+                base_hdr_headroom + (alternate_hdr_headroom - base_hdr_headroom) * weight;
+            1.0 / f32::max(headroom, 0.0).exp2()
+        };
+        let encode = if self.is_float {
+            None
+        } else {
+            Some(Lut::create(ENCODE_LUT_SIZE, |v| {
+                output_transfer.from_linear(v)
+            })?)
+        };
+
+        let base_converter = UnormRowConverter::create(image, self.chroma_upsampling)?;
+        let mut gainmap_rows = GainMapRows::create(gainmap_image, image.width)?;
+        let width = usize_from_u32(image.width)?;
+        let mut base_row: Vec<[f32; 3]> = vec![[0.0; 3]; width];
+        let mut gain_row: Vec<[f32; 3]> = vec![[0.0; 3]; width];
+        let offsets = self.format.offsets();
+        let channel_count = self.channel_count() as usize;
+        let has_alpha = self.has_alpha();
+        let yuv_max_channel = image.max_channel();
+        let rgb_max_channel = self.max_channel();
+        let rgb_max_channel_f = self.max_channel_f();
+        let mut values: Vec<[f32; 3]> = vec![[0.0; 3]; width];
+        for j in 0..image.height {
+            base_converter.convert_row(image, j, &mut base_row)?;
+            gainmap_rows.row(j, image.height, &mut gain_row)?;
+            for ((value, base), gain) in values.iter_mut().zip(&base_row).zip(&gain_row) {
+                for c in 0..3 {
+                    let linear = linearize.get(base[c]);
+                    let factor = gain_luts[c].get(gain[c]);
+                    value[c] = (linear + base_offset[c]) * factor - alternate_offset[c];
+                }
+            }
+            let alpha_row = if has_alpha && image.has_alpha() {
+                Some(image.row_generic(Plane::A, j)?)
+            } else {
+                None
+            };
+            let alpha = |i: usize| -> f32 {
+                match alpha_row {
+                    Some(image::PlaneRow::Depth8(row)) => row[i] as f32 / yuv_max_channel as f32,
+                    Some(image::PlaneRow::Depth16(row)) => {
+                        min(row[i], yuv_max_channel) as f32 / yuv_max_channel as f32
+                    }
+                    None => 1.0,
+                }
+            };
+            match &encode {
+                None => {
+                    let dst = self.row16_mut(j)?;
+                    for (i, (pixel, value)) in
+                        dst.chunks_exact_mut(channel_count).zip(&values).enumerate()
+                    {
+                        for c in 0..3 {
+                            pixel[offsets[c]] = to_half_float(value[c]);
+                        }
+                        if has_alpha {
+                            pixel[offsets[3]] = to_half_float(alpha(i));
+                        }
+                    }
+                }
+                Some(encode) => {
+                    let quantize = |v: f32| 0.5 + encode.get(v * output_scale) * rgb_max_channel_f;
+                    if self.depth == 8 {
+                        let dst = self.row_mut(j)?;
+                        for (i, (pixel, value)) in
+                            dst.chunks_exact_mut(channel_count).zip(&values).enumerate()
+                        {
+                            for c in 0..3 {
+                                pixel[offsets[c]] = quantize(value[c]) as u8;
+                            }
+                            if has_alpha {
+                                pixel[offsets[3]] = (0.5 + alpha(i) * rgb_max_channel_f) as u8;
+                            }
+                        }
+                    } else {
+                        let dst = self.row16_mut(j)?;
+                        for (i, (pixel, value)) in
+                            dst.chunks_exact_mut(channel_count).zip(&values).enumerate()
+                        {
+                            for c in 0..3 {
+                                pixel[offsets[c]] = min(quantize(value[c]) as u16, rgb_max_channel);
+                            }
+                            if has_alpha {
+                                pixel[offsets[3]] = (0.5 + alpha(i) * rgb_max_channel_f) as u16;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn metadata(base_hdr_headroom: u32, alternate_hdr_headroom: u32) -> GainMapMetadata {
+        GainMapMetadata {
+            min: [Fraction(0, 1); 3],
+            max: [Fraction(2, 1); 3],
+            gamma: [UFraction(1, 1); 3],
+            base_offset: [Fraction(1, 64); 3],
+            alternate_offset: [Fraction(1, 64); 3],
+            base_hdr_headroom: UFraction(base_hdr_headroom, 1),
+            alternate_hdr_headroom: UFraction(alternate_hdr_headroom, 1),
+            use_base_color_space: true,
+        }
+    }
+
+    #[test]
+    fn weight() -> AvifResult<()> {
+        assert_eq!(gain_map_weight(&metadata(0, 2), 0.0)?, 0.0);
+        assert_eq!(gain_map_weight(&metadata(0, 2), 1.0)?, 0.5);
+        assert_eq!(gain_map_weight(&metadata(0, 2), 3.0)?, 1.0);
+        // HDR base image.
+        assert_eq!(gain_map_weight(&metadata(2, 0), 0.0)?, 1.0);
+        assert_eq!(gain_map_weight(&metadata(2, 0), 2.0)?, 0.0);
+        assert_eq!(gain_map_weight(&metadata(1, 1), 3.0)?, 0.0);
+        let mut invalid = metadata(0, 2);
+        invalid.alternate_hdr_headroom = UFraction(2, 0);
+        assert!(matches!(
+            gain_map_weight(&invalid, 1.0),
+            Err(AvifError::InvalidArgument)
+        ));
+        Ok(())
+    }
+
+    #[test]
+    fn transfer_round_trip() {
+        for transfer in [
+            Transfer::Srgb,
+            Transfer::Bt709,
+            Transfer::Gamma(2.2),
+            Transfer::Pq,
+        ] {
+            for i in 0..=100 {
+                let v = i as f32 / 100.0;
+                let round_trip = transfer.from_linear(transfer.to_linear(v));
+                assert!(
+                    (round_trip - v).abs() < 1e-3,
+                    "{transfer:?} {v} {round_trip}"
+                );
+            }
+        }
+    }
+
+    fn create_image(width: u32, height: u32, value: u8) -> AvifResult<image::Image> {
+        let mut image = image::Image {
+            width,
+            height,
+            depth: 8,
+            yuv_format: PixelFormat::Yuv400,
+            yuv_range: image::YuvRange::Full,
+            transfer_characteristics: TransferCharacteristics::Srgb,
+            ..Default::default()
+        };
+        image.allocate_planes(decoder::Category::Color)?;
+        for y in 0..height {
+            image.row_mut(Plane::Y, y)?.fill(value);
+        }
+        Ok(image)
+    }
+
+    #[test]
+    fn apply() -> AvifResult<()> {
+        let image = create_image(8, 4, 128)?;
+        let mut gainmap = GainMap {
+            image: create_image(4, 2, 255)?,
+            metadata: metadata(0, 2),
+            ..Default::default()
+        };
+        gainmap.metadata.base_offset = [Fraction(0, 1); 3];
+        gainmap.metadata.alternate_offset = [Fraction(0, 1); 3];
+        let mut rgb = rgb::Image::create_from_yuv(&image);
+        rgb.format = Format::Rgba;
+        rgb.depth = 8;
+        rgb.allocate()?;
+
+        // With a weight of 0, the gain map has no effect.
+        rgb.convert_from_yuv_with_gain_map(&image, &gainmap, 0.0, TransferCharacteristics::Srgb)?;
+        for y in 0..4 {
+            for pixel in rgb.row(y)?.chunks_exact(4) {
+                assert!(
+                    pixel[..3].iter().all(|&v| v.abs_diff(128) <= 1),
+                    "{pixel:?}"
+                );
+                assert_eq!(pixel[3], 255);
+            }
+        }
+
+        // With a weight of 1, the gain map multiplies the linear values by 4, which is also the
+        // peak the output is normalized to.
+        rgb.convert_from_yuv_with_gain_map(&image, &gainmap, 2.0, TransferCharacteristics::Srgb)?;
+        assert!(rgb.row(0)?[..3].iter().all(|&v| v.abs_diff(128) <= 1));
+
+        // Extended linear half float output.
+        rgb.depth = 16;
+        rgb.is_float = true;
+        rgb.allocate()?;
+        rgb.convert_from_yuv_with_gain_map(&image, &gainmap, 2.0, TransferCharacteristics::Linear)?;
+        let expected = to_half_float(Transfer::Srgb.to_linear(128.0 / 255.0) * 4.0);
+        for &v in &rgb.row16(3)?[..3] {
+            assert!(v.abs_diff(expected) <= 2, "{v} {expected}");
+        }
+        assert_eq!(rgb.row16(3)?[3], 0x3c00);
+        assert!(matches!(
+            rgb.convert_from_yuv_with_gain_map(
+                &image,
+                &gainmap,
+                2.0,
+                TransferCharacteristics::Srgb
+            ),
+            Err(AvifError::NotImplemented)
+        ));
+        Ok(())
+    }
+}
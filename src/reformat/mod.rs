@@ -12,6 +12,48 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// Defines a function whose body is compiled three times on x86_64: for the baseline target
+// (SSE2), with SSE4.1 and with AVX2 enabled, which lets the compiler vectorize its loops with more
+// instructions (such as the 16-bit minimum and the 32-bit to 16-bit packing of SSE4.1) and wider
+// registers. The best version supported by the CPU is used. All versions perform the same
+// operations, so their results are identical. The other architectures only have the baseline
+// version (which is already vectorized with NEON on aarch64, where NEON is always available).
+// Defined before the modules below so that they can use it.
+macro_rules! cpu_dispatched {
+    ($vis:vis fn $name:ident($($arg:ident: $type:ty),* $(,)?) $body:block) => {
+        cpu_dispatched! { $vis fn $name($($arg: $type),*) -> () $body }
+    };
+    ($vis:vis fn $name:ident($($arg:ident: $type:ty),* $(,)?) -> $ret:ty $body:block) => {
+        $vis fn $name($($arg: $type),*) -> $ret {
+            #[inline(always)]
+            fn implementation($($arg: $type),*) -> $ret $body
+
+            #[cfg(target_arch = "x86_64")]
+            {
+                #[target_feature(enable = "avx2")]
+                unsafe fn implementation_avx2($($arg: $type),*) -> $ret {
+                    implementation($($arg),*)
+                }
+
+                #[target_feature(enable = "sse4.1")]
+                unsafe fn implementation_sse41($($arg: $type),*) -> $ret {
+                    implementation($($arg),*)
+                }
+
+                if std::is_x86_feature_detected!("avx2") {
+                    // SAFETY: The CPU supports AVX2.
+                    return unsafe { implementation_avx2($($arg),*) };
+                }
+                if std::is_x86_feature_detected!("sse4.1") {
+                    // SAFETY: The CPU supports SSE4.1.
+                    return unsafe { implementation_sse41($($arg),*) };
+                }
+            }
+            implementation($($arg),*)
+        }
+    };
+}
+
 #[cfg(feature = "libyuv")]
 pub mod libyuv;
 #[cfg(feature = "libyuv")]
@@ -19,6 +61,7 @@ pub mod scale;
 
 pub mod alpha;
 pub mod coeffs;
+pub mod gainmap;
 pub mod rgb;
 pub mod rgb_impl;
 
@@ -19,8 +19,55 @@ use crate::image::Plane;
 use crate::image::YuvRange;
 use crate::internal_utils::pixels::*;
 use crate::internal_utils::*;
+use crate::utils::buffer_pool::BufferPool;
 use crate::*;
 
+use std::cmp::min;
+
+// Minimum number of rows converted by each thread in convert_from_yuv().
+const MIN_ROWS_PER_THREAD: u32 = 64;
+
+// Number of rows around the rows converted by convert_row_range_from_yuv() (or by each thread of
+// convert_from_yuv()) that are also converted when libyuv may upsample the chroma of 4:2:0
+// images. Each row only depends on the chroma rows of the adjacent rows.
+const LIBYUV_BAND_MARGIN: u32 = 2;
+
+// A band of rows of the image that is converted on its own thread.
+struct ConversionBand<'a> {
+    rgb: Image,
+    yuv: image::Image,
+    image: &'a image::Image,
+    first_row: u32,
+    // If set, the rows of |image| (first_row, end_row) around the band are converted into a
+    // temporary image and only the rows of the band are copied into rgb (see
+    // LIBYUV_BAND_MARGIN).
+    margin_band: Option<(u32, u32)>,
+}
+
+// The views of a band point to disjoint rows of the output image and the input image is only
+// read.
+unsafe impl Send for ConversionBand<'_> {}
+
+impl ConversionBand<'_> {
+    fn convert(&mut self, alpha_multiply_mode: AlphaMultiplyMode) -> AvifResult<()> {
+        match self.margin_band {
+            Some(band) => self.rgb.convert_rows_through_band(
+                self.image,
+                band,
+                (self.first_row, self.first_row + self.rgb.height),
+                self.first_row,
+                alpha_multiply_mode,
+            ),
+            None => self.rgb.convert_rows_from_yuv(
+                self.image,
+                &self.yuv,
+                self.first_row,
+                alpha_multiply_mode,
+            ),
+        }
+    }
+}
+
 #[repr(C)]
 #[derive(Clone, Copy, Default, PartialEq)]
 pub enum Format {
@@ -116,7 +163,7 @@ pub struct Image {
     pub row_bytes: u32,
 }
 
-#[derive(Debug, Default, PartialEq)]
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
 pub enum AlphaMultiplyMode {
     #[default]
     NoOp,
@@ -189,6 +236,14 @@ impl Image {
             .slice16_mut(checked_mul!(row, self.row_bytes / 2)?, self.row_bytes / 2)
     }
 
+    // Returns the size in bytes of the buffer allocated by allocate().
+    pub(crate) fn allocation_size(&self) -> AvifResult<usize> {
+        usize_from_u32(checked_mul!(
+            checked_mul!(self.width, self.pixel_size())?,
+            self.height
+        )?)
+    }
+
     pub fn allocate(&mut self) -> AvifResult<()> {
         let row_bytes = checked_mul!(self.width, self.pixel_size())?;
         if self.channel_size() == 1 {
@@ -204,6 +259,34 @@ impl Image {
         Ok(())
     }
 
+    // Same as allocate() but the buffer is taken from |pool|.
+    pub fn allocate_with_pool(&mut self, pool: &mut BufferPool) -> AvifResult<()> {
+        self.release_to_pool(pool);
+        let row_bytes = checked_mul!(self.width, self.pixel_size())?;
+        if self.channel_size() == 1 {
+            let buffer_size: usize = usize_from_u32(checked_mul!(row_bytes, self.height)?)?;
+            let mut buffer = pool.take(buffer_size)?;
+            buffer.resize(buffer_size, 0);
+            self.pixels = Some(Pixels::Buffer(buffer));
+        } else {
+            let buffer_size: usize = usize_from_u32(checked_mul!(row_bytes / 2, self.height)?)?;
+            let mut buffer = pool.take16(buffer_size)?;
+            buffer.resize(buffer_size, 0);
+            self.pixels = Some(Pixels::Buffer16(buffer));
+        }
+        self.row_bytes = row_bytes;
+        Ok(())
+    }
+
+    // Gives the buffer of the image (if it owns one) to |pool|. The image does not have any
+    // pixels after this.
+    pub fn release_to_pool(&mut self, pool: &mut BufferPool) {
+        if let Some(pixels) = self.pixels.take() {
+            pool.give_pixels(pixels);
+        }
+        self.row_bytes = 0;
+    }
+
     pub fn depth_valid(&self) -> bool {
         match (self.format, self.is_float, self.depth) {
             (Format::Rgb565, false, 8) => true,
@@ -254,57 +337,307 @@ impl Image {
                 }
             }
         }
-        // This constant comes from libyuv. For details, see here:
-        // https://chromium.googlesource.com/libyuv/libyuv/+/2f87e9a7/source/row_common.cc#3537
-        let reinterpret_f32_as_u32 = |f: f32| u32::from_le_bytes(f.to_le_bytes());
-        let multiplier = 1.925_93e-34 * scale;
+        let multiplier = Self::half_float_multiplier(scale);
         for y in 0..self.height {
             let row = self.row16_mut(y)?;
             for pixel in row {
-                *pixel = (reinterpret_f32_as_u32((*pixel as f32) * multiplier) >> 13) as u16;
+                *pixel = Self::to_half_float(*pixel, multiplier);
             }
         }
         Ok(())
     }
 
+    pub(crate) fn half_float_multiplier(scale: f32) -> f32 {
+        // This constant comes from libyuv. For details, see here:
+        // https://chromium.googlesource.com/libyuv/libyuv/+/2f87e9a7/source/row_common.cc#3537
+        1.925_93e-34 * scale
+    }
+
+    pub(crate) fn to_half_float(pixel: u16, multiplier: f32) -> u16 {
+        let reinterpret_f32_as_u32 = |f: f32| u32::from_le_bytes(f.to_le_bytes());
+        (reinterpret_f32_as_u32((pixel as f32) * multiplier) >> 13) as u16
+    }
+
     pub fn convert_from_yuv(&mut self, image: &image::Image) -> AvifResult<()> {
         if !image.has_plane(Plane::Y) || !image.depth_valid() {
             return Err(AvifError::ReformatFailed);
         }
-        if matches!(
-            image.matrix_coefficients,
-            MatrixCoefficients::Reserved
-                | MatrixCoefficients::Bt2020Cl
-                | MatrixCoefficients::Smpte2085
-                | MatrixCoefficients::ChromaDerivedCl
-                | MatrixCoefficients::Ictcp
-        ) {
-            return Err(AvifError::NotImplemented);
+        check_yuv_conversion_supported(image)?;
+
+        let alpha_multiply_mode = self.alpha_multiply_mode(image);
+
+        // Each band is converted by a separate thread.
+        let bands = self.conversion_bands(image);
+        if bands.len() == 1 {
+            return self.convert_rows_from_yuv(image, image, 0, alpha_multiply_mode);
         }
-        if image.matrix_coefficients == MatrixCoefficients::Ycgco
-            && image.yuv_range == YuvRange::Limited
-        {
-            return Err(AvifError::NotImplemented);
+        let use_margin_bands = self.may_use_libyuv_bilinear_420(image);
+        let mut conversion_bands: Vec<ConversionBand> = create_vec_exact(bands.len())?;
+        for (first_row, row_count) in bands {
+            // The bands start on a chroma row, and so do the bands with a margin.
+            let margin_band = if use_margin_bands {
+                Some((
+                    first_row.saturating_sub(LIBYUV_BAND_MARGIN),
+                    min(first_row + row_count + LIBYUV_BAND_MARGIN, self.height),
+                ))
+            } else {
+                None
+            };
+            conversion_bands.push(ConversionBand {
+                rgb: self.row_band_view(first_row, row_count)?,
+                yuv: image.row_band_view(first_row, row_count)?,
+                image,
+                first_row,
+                margin_band,
+            });
         }
-        if image.matrix_coefficients == MatrixCoefficients::Identity
-            && !matches!(image.yuv_format, PixelFormat::Yuv444 | PixelFormat::Yuv400)
+        let mut first_band = conversion_bands.remove(0);
+        std::thread::scope(|scope| {
+            let handles: Vec<_> = conversion_bands
+                .into_iter()
+                .map(|mut band| scope.spawn(move || band.convert(alpha_multiply_mode)))
+                .collect();
+            // The calling thread converts the first band.
+            let mut result = first_band.convert(alpha_multiply_mode);
+            for handle in handles {
+                // A panic in a band is propagated as if the band had been converted by the
+                // calling thread.
+                let band_result = handle
+                    .join()
+                    .unwrap_or_else(|panic| std::panic::resume_unwind(panic));
+                if result.is_ok() {
+                    result = band_result;
+                }
+            }
+            result
+        })
+    }
+
+    // Converts the rows [start_row, end_row) of |image| into the same rows of this image, which
+    // must have the same dimensions. The other rows are not written, so converting the rows of
+    // |image| as they are decoded (see Decoder::decoded_row_count() and convertible_row_count())
+    // gives the same result as a single call to convert_from_yuv() at the end.
+    pub fn convert_row_range_from_yuv(
+        &mut self,
+        image: &image::Image,
+        start_row: u32,
+        end_row: u32,
+    ) -> AvifResult<()> {
+        if !image.has_plane(Plane::Y) || !image.depth_valid() {
+            return Err(AvifError::ReformatFailed);
+        }
+        check_yuv_conversion_supported(image)?;
+        if self.width != image.width
+            || self.height != image.height
+            || start_row > end_row
+            || end_row > self.height
         {
-            return Err(AvifError::NotImplemented);
+            return Err(AvifError::InvalidArgument);
+        }
+        if start_row == end_row {
+            return Ok(());
+        }
+        let alpha_multiply_mode = self.alpha_multiply_mode(image);
+        let chroma_shift_y = image.yuv_format.chroma_shift_y();
+        let align_down = |row: u32| (row >> chroma_shift_y) << chroma_shift_y;
+        if self.may_use_libyuv_bilinear_420(image) {
+            // libyuv treats the band as a separate image, so only the rows that are far enough
+            // from the edges of the band are the same as when converting the whole image.
+            let band_first_row = align_down(start_row.saturating_sub(LIBYUV_BAND_MARGIN));
+            let band_end_row = min(checked_add!(end_row, LIBYUV_BAND_MARGIN)?, self.height);
+            return self.convert_rows_through_band(
+                image,
+                (band_first_row, band_end_row),
+                (start_row, end_row),
+                0,
+                alpha_multiply_mode,
+            );
+        }
+        let mut first_row = start_row;
+        if align_down(start_row) != start_row {
+            // The views of the planes of |image| can only start on a chroma row.
+            let band_first_row = align_down(start_row);
+            let band_end_row = min(band_first_row + (1 << chroma_shift_y), self.height);
+            self.convert_rows_through_band(
+                image,
+                (band_first_row, band_end_row),
+                (start_row, start_row + 1),
+                0,
+                alpha_multiply_mode,
+            )?;
+            first_row += 1;
+            if first_row == end_row {
+                return Ok(());
+            }
         }
+        let row_count = end_row - first_row;
+        let mut rgb = self.row_band_view(first_row, row_count)?;
+        let yuv = image.row_band_view(first_row, row_count)?;
+        rgb.convert_rows_from_yuv(image, &yuv, first_row, alpha_multiply_mode)
+    }
 
-        let mut alpha_multiply_mode = AlphaMultiplyMode::NoOp;
+    // Converts the |band| (first_row, end_row) of |image| into a temporary image and copies its
+    // |rows| (start_row, end_row) into the same rows of this image, whose first row is the row
+    // |dst_first_row| of |image|.
+    fn convert_rows_through_band(
+        &mut self,
+        image: &image::Image,
+        band: (u32, u32),
+        rows: (u32, u32),
+        dst_first_row: u32,
+        alpha_multiply_mode: AlphaMultiplyMode,
+    ) -> AvifResult<()> {
+        let mut rgb = Image {
+            width: self.width,
+            height: band.1 - band.0,
+            depth: self.depth,
+            format: self.format,
+            chroma_upsampling: self.chroma_upsampling,
+            chroma_downsampling: self.chroma_downsampling,
+            premultiply_alpha: self.premultiply_alpha,
+            is_float: self.is_float,
+            max_threads: 1,
+            pixels: None,
+            row_bytes: 0,
+        };
+        rgb.allocate()?;
+        let yuv = image.row_band_view(band.0, rgb.height)?;
+        rgb.convert_rows_from_yuv(image, &yuv, band.0, alpha_multiply_mode)?;
+        for y in rows.0..rows.1 {
+            if self.channel_size() == 1 {
+                let src = rgb.row(y - band.0)?;
+                self.row_mut(y - dst_first_row)?[..src.len()].copy_from_slice(src);
+            } else {
+                let src = rgb.row16(y - band.0)?;
+                self.row16_mut(y - dst_first_row)?[..src.len()].copy_from_slice(src);
+            }
+        }
+        Ok(())
+    }
+
+    // Returns the number of rows of this image that convert_row_range_from_yuv() can convert
+    // once the first |decoded_row_count| rows of |image| are decoded. The bilinear chroma
+    // upsampling of 4:2:0 images also reads the chroma row below each pair of rows.
+    pub fn convertible_row_count(&self, image: &image::Image, decoded_row_count: u32) -> u32 {
+        if decoded_row_count >= image.height {
+            return image.height;
+        }
+        if image.yuv_format != PixelFormat::Yuv420 {
+            return decoded_row_count;
+        }
+        // Only the chroma rows of the complete pairs of luma rows are decoded.
+        let decoded_row_count = decoded_row_count & !1;
+        if self.chroma_upsampling.bilinear_or_better_filter_allowed() {
+            decoded_row_count.saturating_sub(1)
+        } else {
+            decoded_row_count
+        }
+    }
+
+    fn alpha_multiply_mode(&self, image: &image::Image) -> AlphaMultiplyMode {
         if image.has_alpha() && self.has_alpha() {
             if !image.alpha_premultiplied && self.premultiply_alpha {
-                alpha_multiply_mode = AlphaMultiplyMode::Multiply;
+                return AlphaMultiplyMode::Multiply;
             } else if image.alpha_premultiplied && !self.premultiply_alpha {
-                alpha_multiply_mode = AlphaMultiplyMode::UnMultiply;
+                return AlphaMultiplyMode::UnMultiply;
             }
         }
+        AlphaMultiplyMode::NoOp
+    }
 
+    // Returns true if |image| may be converted by libyuv with bilinear upsampling of 4:2:0, which
+    // treats every band of rows as a separate image.
+    fn may_use_libyuv_bilinear_420(&self, image: &image::Image) -> bool {
+        cfg!(feature = "libyuv")
+            && self.depth == 8
+            && image.yuv_format == PixelFormat::Yuv420
+            && self.chroma_upsampling.bilinear_or_better_filter_allowed()
+    }
+
+    // Returns the (first_row, row_count) bands of rows that can be converted independently, one
+    // per thread. The bands are aligned on the chroma subsampling. The bilinear chroma
+    // upsampling of the conversion functions of this crate reads the chroma rows adjacent to a
+    // band from the whole image, but the one of libyuv treats each band as a separate image, so
+    // 4:2:0 images that may be converted by libyuv with bilinear upsampling are converted with a
+    // margin of LIBYUV_BAND_MARGIN rows around each band.
+    fn conversion_bands(&self, image: &image::Image) -> Vec<(u32, u32)> {
+        let mut band_count = if self.max_threads > 1 { self.max_threads as u32 } else { 1 };
+        band_count = min(band_count, image.height / MIN_ROWS_PER_THREAD);
+        if self.width != image.width || self.height != image.height {
+            band_count = 1;
+        }
+        if band_count <= 1 {
+            return vec![(0, image.height)];
+        }
+        let chroma_shift_y = image.yuv_format.chroma_shift_y();
+        let rows_per_band = image.height.div_ceil(band_count);
+        let rows_per_band = ((rows_per_band + chroma_shift_y) >> chroma_shift_y) << chroma_shift_y;
+        (0..image.height)
+            .step_by(rows_per_band as usize)
+            .map(|first_row| (first_row, min(rows_per_band, image.height - first_row)))
+            .collect()
+    }
+
+    // Returns an image that points to |row_count| rows of this image starting at |first_row|.
+    fn row_band_view(&mut self, first_row: u32, row_count: u32) -> AvifResult<Image> {
+        if checked_add!(first_row, row_count)? > self.height {
+            return Err(AvifError::InvalidArgument);
+        }
+        let offset = usize_from_u32(checked_mul!(first_row, self.row_bytes)?)?;
+        Ok(Image {
+            width: self.width,
+            height: row_count,
+            depth: self.depth,
+            format: self.format,
+            chroma_upsampling: self.chroma_upsampling,
+            chroma_downsampling: self.chroma_downsampling,
+            premultiply_alpha: self.premultiply_alpha,
+            is_float: self.is_float,
+            max_threads: 1,
+            pixels: Some(Pixels::from_raw_pointer(
+                unsafe { self.pixels().add(offset) },
+                self.depth as u32,
+            )),
+            row_bytes: self.row_bytes,
+        })
+    }
+
+    // Returns true if rgb_impl::yuv_to_rgba_fused() can be used instead of the separate passes of
+    // conversion, alpha import, alpha (un)premultiplication and half float conversion, with the
+    // same results.
+    fn can_use_fused_conversion(
+        &self,
+        image: &image::Image,
+        alpha_multiply_mode: AlphaMultiplyMode,
+    ) -> bool {
+        if !self.has_alpha()
+            || !(matches!(
+                self.chroma_upsampling,
+                ChromaUpsampling::Nearest | ChromaUpsampling::Fastest
+            ) || image.yuv_format == PixelFormat::Yuv444)
+        {
+            return false;
+        }
+        // The 8-bit alpha (un)premultiplication of libyuv does not round the same way.
+        !(cfg!(feature = "libyuv")
+            && alpha_multiply_mode != AlphaMultiplyMode::NoOp
+            && self.depth == 8
+            && matches!(self.format, Format::Rgba | Format::Bgra))
+    }
+
+    // Converts the rows of |yuv| into the rows of this image. |yuv| is either |image| or a view
+    // of the rows of |image| starting at |first_row|.
+    fn convert_rows_from_yuv(
+        &mut self,
+        image: &image::Image,
+        yuv: &image::Image,
+        first_row: u32,
+        mut alpha_multiply_mode: AlphaMultiplyMode,
+    ) -> AvifResult<()> {
         let mut converted_with_libyuv: bool = false;
         let mut alpha_reformatted_with_libyuv = false;
         if alpha_multiply_mode == AlphaMultiplyMode::NoOp || self.has_alpha() {
-            match libyuv::yuv_to_rgb(image, self) {
+            match libyuv::yuv_to_rgb(yuv, self) {
                 Ok(alpha_reformatted) => {
                     alpha_reformatted_with_libyuv = alpha_reformatted;
                     converted_with_libyuv = true;
@@ -316,9 +649,19 @@ impl Image {
                 }
             }
         }
+        if !converted_with_libyuv && self.can_use_fused_conversion(yuv, alpha_multiply_mode) {
+            match rgb_impl::yuv_to_rgba_fused(yuv, self, alpha_multiply_mode) {
+                Ok(_) => return Ok(()),
+                Err(err) => {
+                    if err != AvifError::NotImplemented {
+                        return Err(err);
+                    }
+                }
+            }
+        }
         if self.has_alpha() && !alpha_reformatted_with_libyuv {
-            if image.has_alpha() {
-                self.import_alpha_from(image)?;
+            if yuv.has_alpha() {
+                self.import_alpha_from(yuv)?;
             } else {
                 self.set_opaque()?;
             }
@@ -331,7 +674,25 @@ impl Image {
             ) || matches!(image.yuv_format, PixelFormat::Yuv444 | PixelFormat::Yuv400))
                 && (alpha_multiply_mode == AlphaMultiplyMode::NoOp || self.format.has_alpha())
             {
-                match rgb_impl::yuv_to_rgb_fast(image, self) {
+                match rgb_impl::yuv_to_rgb_fast(yuv, self) {
+                    Ok(_) => converted_by_fast_path = true,
+                    Err(err) => {
+                        if err != AvifError::NotImplemented {
+                            return Err(err);
+                        }
+                    }
+                }
+            }
+            // yuv_to_rgb_any() (un)premultiplies the alpha before quantization, so the bilinear
+            // fast path is only equivalent when there is nothing to (un)premultiply.
+            if !converted_by_fast_path
+                && alpha_multiply_mode == AlphaMultiplyMode::NoOp
+                && !matches!(
+                    self.chroma_upsampling,
+                    ChromaUpsampling::Nearest | ChromaUpsampling::Fastest
+                )
+            {
+                match rgb_impl::yuv16_to_rgb16_bilinear(image, self, first_row) {
                     Ok(_) => converted_by_fast_path = true,
                     Err(err) => {
                         if err != AvifError::NotImplemented {
@@ -341,7 +702,7 @@ impl Image {
                 }
             }
             if !converted_by_fast_path {
-                rgb_impl::yuv_to_rgb_any(image, self, alpha_multiply_mode)?;
+                rgb_impl::yuv_to_rgb_any(image, self, alpha_multiply_mode, first_row)?;
                 alpha_multiply_mode = AlphaMultiplyMode::NoOp;
             }
         }
@@ -422,6 +783,31 @@ impl Image {
     }
 }
 
+// Returns an error if the YUV to RGB conversion of |image| is not implemented.
+pub(crate) fn check_yuv_conversion_supported(image: &image::Image) -> AvifResult<()> {
+    if matches!(
+        image.matrix_coefficients,
+        MatrixCoefficients::Reserved
+            | MatrixCoefficients::Bt2020Cl
+            | MatrixCoefficients::Smpte2085
+            | MatrixCoefficients::ChromaDerivedCl
+            | MatrixCoefficients::Ictcp
+    ) {
+        return Err(AvifError::NotImplemented);
+    }
+    if image.matrix_coefficients == MatrixCoefficients::Ycgco
+        && image.yuv_range == YuvRange::Limited
+    {
+        return Err(AvifError::NotImplemented);
+    }
+    if image.matrix_coefficients == MatrixCoefficients::Identity
+        && !matches!(image.yuv_format, PixelFormat::Yuv444 | PixelFormat::Yuv400)
+    {
+        return Err(AvifError::NotImplemented);
+    }
+    Ok(())
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -575,6 +961,246 @@ mod tests {
         Ok(())
     }
 
+    #[test_matrix(
+        [PixelFormat::Yuv420, PixelFormat::Yuv422, PixelFormat::Yuv444],
+        [8, 10],
+        [8, 16],
+        [ChromaUpsampling::Nearest, ChromaUpsampling::Bilinear, ChromaUpsampling::Automatic],
+        [false, true]
+    )]
+    fn multithreaded_rgb_conversion(
+        yuv_format: PixelFormat,
+        yuv_depth: u8,
+        rgb_depth: u8,
+        chroma_upsampling: ChromaUpsampling,
+        premultiply_alpha: bool,
+    ) -> AvifResult<()> {
+        let mut image = image::Image {
+            width: 37,
+            height: 301,
+            depth: yuv_depth,
+            yuv_format,
+            matrix_coefficients: MatrixCoefficients::Bt601,
+            yuv_range: YuvRange::Limited,
+            ..image::Image::default()
+        };
+        image.allocate_planes(Category::Color)?;
+        image.allocate_planes(Category::Alpha)?;
+        let mut value: u32 = 1;
+        for plane in ALL_PLANES {
+            for y in 0..image.height(plane) as u32 {
+                for x in 0..image.width(plane) {
+                    value = value.wrapping_mul(1103515245).wrapping_add(12345);
+                    let pixel = ((value >> 16) % (image.max_channel() as u32 + 1)) as u16;
+                    if yuv_depth == 8 {
+                        image.row_mut(plane, y)?[x] = pixel as u8;
+                    } else {
+                        image.row16_mut(plane, y)?[x] = pixel;
+                    }
+                }
+            }
+        }
+        let mut rgbs = Vec::new();
+        for max_threads in [1, 4] {
+            let mut rgb = Image::create_from_yuv(&image);
+            rgb.depth = rgb_depth;
+            rgb.chroma_upsampling = chroma_upsampling;
+            rgb.premultiply_alpha = premultiply_alpha;
+            rgb.max_threads = max_threads;
+            rgb.allocate()?;
+            // Each band has at least MIN_ROWS_PER_THREAD rows, including with libyuv.
+            assert_eq!(
+                rgb.conversion_bands(&image).len(),
+                if max_threads == 1 { 1 } else { 4 }
+            );
+            rgb.convert_from_yuv(&image)?;
+            rgbs.push(rgb);
+        }
+        for y in 0..image.height {
+            if rgb_depth == 8 {
+                assert_eq!(rgbs[0].row(y)?, rgbs[1].row(y)?);
+            } else {
+                assert_eq!(rgbs[0].row16(y)?, rgbs[1].row16(y)?);
+            }
+        }
+        Ok(())
+    }
+
+    #[test_matrix(
+        [PixelFormat::Yuv420, PixelFormat::Yuv422, PixelFormat::Yuv444],
+        [8, 10],
+        [8, 16],
+        [ChromaUpsampling::Nearest, ChromaUpsampling::Bilinear],
+        [false, true]
+    )]
+    fn incremental_rgb_conversion(
+        yuv_format: PixelFormat,
+        yuv_depth: u8,
+        rgb_depth: u8,
+        chroma_upsampling: ChromaUpsampling,
+        premultiply_alpha: bool,
+    ) -> AvifResult<()> {
+        // Returns the image of which only the first |decoded_row_count| rows are decoded, the
+        // other rows are zero.
+        let create_image = |decoded_row_count: u32| -> AvifResult<image::Image> {
+            let mut image = image::Image {
+                width: 37,
+                height: 301,
+                depth: yuv_depth,
+                yuv_format,
+                matrix_coefficients: MatrixCoefficients::Bt601,
+                yuv_range: YuvRange::Limited,
+                alpha_premultiplied: !premultiply_alpha,
+                ..image::Image::default()
+            };
+            image.allocate_planes(Category::Color)?;
+            image.allocate_planes(Category::Alpha)?;
+            let chroma_shift_y = yuv_format.chroma_shift_y();
+            let mut value: u32 = 1;
+            for plane in ALL_PLANES {
+                let decoded_plane_row_count = match plane {
+                    Plane::U | Plane::V => decoded_row_count >> chroma_shift_y,
+                    _ => decoded_row_count,
+                };
+                for y in 0..image.height(plane) as u32 {
+                    for x in 0..image.width(plane) {
+                        value = value.wrapping_mul(1103515245).wrapping_add(12345);
+                        let mut pixel = ((value >> 16) % (image.max_channel() as u32 + 1)) as u16;
+                        if y >= decoded_plane_row_count {
+                            pixel = 0;
+                        }
+                        if yuv_depth == 8 {
+                            image.row_mut(plane, y)?[x] = pixel as u8;
+                        } else {
+                            image.row16_mut(plane, y)?[x] = pixel;
+                        }
+                    }
+                }
+            }
+            Ok(image)
+        };
+        let create_rgb = |image: &image::Image| -> AvifResult<Image> {
+            let mut rgb = Image::create_from_yuv(image);
+            rgb.depth = rgb_depth;
+            rgb.chroma_upsampling = chroma_upsampling;
+            rgb.premultiply_alpha = premultiply_alpha;
+            rgb.allocate()?;
+            Ok(rgb)
+        };
+        let image = create_image(301)?;
+        let mut expected = create_rgb(&image)?;
+        expected.convert_from_yuv(&image)?;
+
+        let mut rgb = create_rgb(&image)?;
+        assert_eq!(
+            rgb.convert_row_range_from_yuv(&image, 2, 1),
+            Err(AvifError::InvalidArgument)
+        );
+        assert_eq!(
+            rgb.convert_row_range_from_yuv(&image, 0, 302),
+            Err(AvifError::InvalidArgument)
+        );
+        let mut converted_row_count = 0;
+        for decoded_row_count in [0, 7, 8, 9, 65, 130, 131, 300, 301] {
+            let partial_image = create_image(decoded_row_count)?;
+            let convertible_row_count = rgb.convertible_row_count(&image, decoded_row_count);
+            assert!(convertible_row_count <= decoded_row_count);
+            rgb.convert_row_range_from_yuv(
+                &partial_image,
+                converted_row_count,
+                convertible_row_count,
+            )?;
+            converted_row_count = convertible_row_count;
+        }
+        assert_eq!(converted_row_count, image.height);
+        for y in 0..image.height {
+            if rgb_depth == 8 {
+                assert_eq!(rgb.row(y)?, expected.row(y)?, "row {y}");
+            } else {
+                assert_eq!(rgb.row16(y)?, expected.row16(y)?, "row {y}");
+            }
+        }
+        Ok(())
+    }
+
+    #[test_matrix(
+        [PixelFormat::Yuv420, PixelFormat::Yuv444],
+        [8, 12],
+        [(Format::Rgba, 8, false), (Format::Argb, 8, false), (Format::Bgra, 10, false), (Format::Abgr, 16, true)],
+        [AlphaMultiplyMode::NoOp, AlphaMultiplyMode::Multiply, AlphaMultiplyMode::UnMultiply],
+        [false, true]
+    )]
+    fn fused_rgb_conversion(
+        yuv_format: PixelFormat,
+        yuv_depth: u8,
+        rgb_params: (Format, u8, bool),
+        alpha_multiply_mode: AlphaMultiplyMode,
+        has_alpha: bool,
+    ) -> AvifResult<()> {
+        let mut image = image::Image {
+            width: 13,
+            height: 7,
+            depth: yuv_depth,
+            yuv_format,
+            matrix_coefficients: MatrixCoefficients::Bt709,
+            yuv_range: YuvRange::Full,
+            ..image::Image::default()
+        };
+        image.allocate_planes(Category::Color)?;
+        if has_alpha {
+            image.allocate_planes(Category::Alpha)?;
+        }
+        let mut value: u32 = 7;
+        for plane in ALL_PLANES {
+            if !image.has_plane(plane) {
+                continue;
+            }
+            for y in 0..image.height(plane) as u32 {
+                for x in 0..image.width(plane) {
+                    value = value.wrapping_mul(1103515245).wrapping_add(12345);
+                    let pixel = ((value >> 16) % (image.max_channel() as u32 + 1)) as u16;
+                    if yuv_depth == 8 {
+                        image.row_mut(plane, y)?[x] = pixel as u8;
+                    } else {
+                        image.row16_mut(plane, y)?[x] = pixel;
+                    }
+                }
+            }
+        }
+        let create_rgb = || -> AvifResult<Image> {
+            let mut rgb = Image::create_from_yuv(&image);
+            (rgb.format, rgb.depth, rgb.is_float) = rgb_params;
+            rgb.chroma_upsampling = ChromaUpsampling::Nearest;
+            rgb.allocate()?;
+            Ok(rgb)
+        };
+        let mut expected = create_rgb()?;
+        if has_alpha {
+            expected.import_alpha_from(&image)?;
+        } else {
+            expected.set_opaque()?;
+        }
+        rgb_impl::yuv_to_rgb_fast(&image, &mut expected)?;
+        match alpha_multiply_mode {
+            AlphaMultiplyMode::Multiply => expected.premultiply_alpha()?,
+            AlphaMultiplyMode::UnMultiply => expected.unpremultiply_alpha()?,
+            AlphaMultiplyMode::NoOp => {}
+        }
+        if expected.is_float {
+            expected.convert_to_half_float()?;
+        }
+        let mut actual = create_rgb()?;
+        rgb_impl::yuv_to_rgba_fused(&image, &mut actual, alpha_multiply_mode)?;
+        for y in 0..image.height {
+            if expected.depth == 8 {
+                assert_eq!(actual.row(y)?, expected.row(y)?);
+            } else {
+                assert_eq!(actual.row16(y)?, expected.row16(y)?);
+            }
+        }
+        Ok(())
+    }
+
     #[test_case(Format::Rgba, &[0, 1, 2, 3])]
     #[test_case(Format::Abgr, &[3, 2, 1, 0])]
     #[test_case(Format::Rgb, &[0, 1, 2])]
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+use super::alpha::*;
 use super::coeffs::*;
 use super::rgb;
 use super::rgb::*;
@@ -436,35 +437,211 @@ pub fn yuv_to_rgb_fast(image: &image::Image, rgb: &mut rgb::Image) -> AvifResult
     }
 }
 
+// The type of the samples of an image. This allows writing the conversion functions once for all
+// the combinations of input and output depths.
+trait Sample: Copy {
+    fn yuv_row(image: &image::Image, plane: Plane, row: u32) -> AvifResult<&[Self]>;
+    fn rgb_row_mut(rgb: &mut rgb::Image, row: u32) -> AvifResult<&mut [Self]>;
+    fn to_u16(self) -> u16;
+    fn from_u16(value: u16) -> Self;
+}
+
+impl Sample for u8 {
+    fn yuv_row(image: &image::Image, plane: Plane, row: u32) -> AvifResult<&[Self]> {
+        image.row(plane, row)
+    }
+
+    fn rgb_row_mut(rgb: &mut rgb::Image, row: u32) -> AvifResult<&mut [Self]> {
+        rgb.row_mut(row)
+    }
+
+    fn to_u16(self) -> u16 {
+        self as u16
+    }
+
+    fn from_u16(value: u16) -> Self {
+        value as u8
+    }
+}
+
+impl Sample for u16 {
+    fn yuv_row(image: &image::Image, plane: Plane, row: u32) -> AvifResult<&[Self]> {
+        image.row16(plane, row)
+    }
+
+    fn rgb_row_mut(rgb: &mut rgb::Image, row: u32) -> AvifResult<&mut [Self]> {
+        rgb.row16_mut(row)
+    }
+
+    fn to_u16(self) -> u16 {
+        self
+    }
+
+    fn from_u16(value: u16) -> Self {
+        value
+    }
+}
+
+fn yuv_to_rgba_fused_impl<T: Sample, U: Sample>(
+    image: &image::Image,
+    rgb: &mut rgb::Image,
+    kr: f32,
+    kg: f32,
+    kb: f32,
+    alpha_multiply_mode: AlphaMultiplyMode,
+) -> AvifResult<()> {
+    let (table_y, table_uv) = unorm_lookup_tables(image, Mode::YuvCoefficients(kr, kg, kb))?;
+    let table_uv = match &table_uv {
+        Some(table_uv) => table_uv,
+        None => &table_y,
+    };
+    let has_alpha = image.has_alpha();
+    let rescale_alpha = image.depth != rgb.depth;
+    let yuv_max_channel = image.max_channel();
+    let yuv_max_channel_f = image.max_channel_f();
+    let rgb_max_channel = rgb.max_channel();
+    let rgb_max_channel_f = rgb.max_channel_f();
+    let is_float = rgb.is_float;
+    let half_float_multiplier = rgb::Image::half_float_multiplier(1.0 / rgb_max_channel_f);
+    let offsets = [
+        rgb.format.r_offset(),
+        rgb.format.g_offset(),
+        rgb.format.b_offset(),
+    ];
+    let alpha_offset = rgb.format.alpha_offset();
+    let width = image.width as usize;
+    for j in 0..image.height {
+        let uv_j = j >> image.yuv_format.chroma_shift_y();
+        let y_row = T::yuv_row(image, Plane::Y, j)?;
+        let u_row = T::yuv_row(image, Plane::U, uv_j)?;
+        let v_row = T::yuv_row(image, Plane::V, uv_j)?;
+        let a_row = if has_alpha { T::yuv_row(image, Plane::A, j)? } else { &[][..] };
+        let dst = &mut U::rgb_row_mut(rgb, j)?[..width * 4];
+        for (i, pixel) in dst.chunks_exact_mut(4).enumerate() {
+            let y = table_y[min(y_row[i].to_u16(), yuv_max_channel) as usize];
+            let uv_i = i >> image.yuv_format.chroma_shift_x();
+            let cb = table_uv[min(u_row[uv_i].to_u16(), yuv_max_channel) as usize];
+            let cr = table_uv[min(v_row[uv_i].to_u16(), yuv_max_channel) as usize];
+            let r = y + (2.0 * (1.0 - kr)) * cr;
+            let b = y + (2.0 * (1.0 - kb)) * cb;
+            let g = y - ((2.0 * ((kr * (1.0 - kr) * cr) + (kb * (1.0 - kb) * cb))) / kg);
+            let mut values = [r, g, b]
+                .map(|value| (0.5 + (clamp_f32(value, 0.0, 1.0) * rgb_max_channel_f)) as u16);
+            let alpha = if !has_alpha {
+                rgb_max_channel
+            } else if rescale_alpha {
+                rgb::Image::rescale_alpha_value(
+                    a_row[i].to_u16(),
+                    yuv_max_channel_f,
+                    rgb_max_channel,
+                )
+            } else {
+                a_row[i].to_u16()
+            };
+            if alpha_multiply_mode != AlphaMultiplyMode::NoOp && alpha < rgb_max_channel {
+                for value in &mut values {
+                    *value = match (alpha, alpha_multiply_mode) {
+                        (0, _) => 0,
+                        (_, AlphaMultiplyMode::Multiply) => {
+                            premultiply_u16(*value, alpha, rgb_max_channel_f)
+                        }
+                        _ => unpremultiply_u16(*value, alpha, rgb_max_channel_f),
+                    };
+                }
+            }
+            for (value, offset) in values.into_iter().zip(offsets) {
+                pixel[offset] = U::from_u16(if is_float {
+                    rgb::Image::to_half_float(value, half_float_multiplier)
+                } else {
+                    value
+                });
+            }
+            pixel[alpha_offset] = U::from_u16(if is_float {
+                rgb::Image::to_half_float(alpha, half_float_multiplier)
+            } else {
+                alpha
+            });
+        }
+    }
+    Ok(())
+}
+
+// Converts color YUV (with nearest neighbor chroma upsampling) into a 4 channel RGB format in a
+// single pass over each row: the color conversion, the import of the alpha channel (or the
+// filling of it with opaque values), the alpha (un)premultiplication and the conversion to half
+// float are done on each pixel before moving on to the next one, directly in the channel order
+// of the output format. The results are the same as the ones of yuv_to_rgb_fast() followed by
+// import_alpha_from() (or set_opaque()), by premultiply_alpha() (or unpremultiply_alpha()) when
+// |alpha_multiply_mode| is not NoOp, and by convert_to_half_float() if rgb.is_float is true.
+pub fn yuv_to_rgba_fused(
+    image: &image::Image,
+    rgb: &mut rgb::Image,
+    alpha_multiply_mode: AlphaMultiplyMode,
+) -> AvifResult<()> {
+    let (kr, kg, kb) = match Mode::from(image) {
+        Mode::YuvCoefficients(kr, kg, kb) => (kr, kg, kb),
+        _ => return Err(AvifError::NotImplemented),
+    };
+    if image.yuv_format == PixelFormat::Yuv400
+        || !image.has_plane(Plane::U)
+        || !image.has_plane(Plane::V)
+        || !rgb.has_alpha()
+        || (rgb.is_float && rgb.depth != 16)
+    {
+        return Err(AvifError::NotImplemented);
+    }
+    match (image.depth == 8, rgb.depth == 8) {
+        (true, true) => {
+            yuv_to_rgba_fused_impl::<u8, u8>(image, rgb, kr, kg, kb, alpha_multiply_mode)
+        }
+        (false, false) => {
+            yuv_to_rgba_fused_impl::<u16, u16>(image, rgb, kr, kg, kb, alpha_multiply_mode)
+        }
+        (false, true) => {
+            yuv_to_rgba_fused_impl::<u16, u8>(image, rgb, kr, kg, kb, alpha_multiply_mode)
+        }
+        (true, false) => {
+            yuv_to_rgba_fused_impl::<u8, u16>(image, rgb, kr, kg, kb, alpha_multiply_mode)
+        }
+    }
+}
+
+// Returns the (bias, range) pairs used to convert the luma and the chroma samples of |image|
+// into unorm values.
+fn unorm_parameters(image: &image::Image) -> ((f32, f32), (f32, f32)) {
+    // Formula specified in ISO/IEC 23091-2.
+    if image.yuv_range == YuvRange::Limited {
+        (
+            (
+                (16 << (image.depth - 8)) as f32,
+                (219 << (image.depth - 8)) as f32,
+            ),
+            (
+                (1 << (image.depth - 1)) as f32,
+                (224 << (image.depth - 8)) as f32,
+            ),
+        )
+    } else {
+        (
+            (0.0, image.max_channel_f()),
+            ((1 << (image.depth - 1)) as f32, image.max_channel_f()),
+        )
+    }
+}
+
 fn unorm_lookup_tables(
     image: &image::Image,
     mode: Mode,
 ) -> AvifResult<(Vec<f32>, Option<Vec<f32>>)> {
     let count = 1usize << image.depth;
+    let ((bias_y, range_y), (bias_uv, range_uv)) = unorm_parameters(image);
     let mut table_y: Vec<f32> = create_vec_exact(count)?;
-    let bias_y;
-    let range_y;
-    // Formula specified in ISO/IEC 23091-2.
-    if image.yuv_range == YuvRange::Limited {
-        bias_y = (16 << (image.depth - 8)) as f32;
-        range_y = (219 << (image.depth - 8)) as f32;
-    } else {
-        bias_y = 0.0;
-        range_y = image.max_channel_f();
-    }
     for cp in 0..count {
         table_y.push(((cp as f32) - bias_y) / range_y);
     }
     if mode == Mode::Identity {
         Ok((table_y, None))
     } else {
-        // Formula specified in ISO/IEC 23091-2.
-        let bias_uv = (1 << (image.depth - 1)) as f32;
-        let range_uv = if image.yuv_range == YuvRange::Limited {
-            (224 << (image.depth - 8)) as f32
-        } else {
-            image.max_channel_f()
-        };
         let mut table_uv: Vec<f32> = create_vec_exact(count)?;
         for cp in 0..count {
             table_uv.push(((cp as f32) - bias_uv) / range_uv);
@@ -519,137 +696,573 @@ fn unorm_value(row: PlaneRow, index: usize, max_channel: u16, table: &[f32]) ->
     table[clamped_pixel(row, index, max_channel) as usize]
 }
 
-pub fn yuv_to_rgb_any(
-    image: &image::Image,
+// Converts a row of samples into unorm values. This is the same arithmetic as the one used to
+// build the tables of unorm_lookup_tables() (so the results are identical) but it does not
+// involve a lookup per sample, which lets the compiler vectorize the loop.
+fn unorm_row16(row: &[u16], max_channel: u16, bias: f32, range: f32, dst: &mut [f32]) {
+    for (dst, &pixel) in dst.iter_mut().zip(row) {
+        *dst = ((min(pixel, max_channel) as f32) - bias) / range;
+    }
+}
+
+// Bilinearly upsamples a row of horizontally subsampled unorm chroma values. |row| is the
+// nearest chroma row and |adj_row| is the adjacent one. The weights and the order of the
+// operations are the same as in yuv_to_rgb_any().
+fn upsample_chroma_row_bilinear(row: &[f32], adj_row: &[f32], dst: &mut [f32]) {
+    let width = dst.len();
+    for (i, dst) in dst.iter_mut().enumerate() {
+        let uv_i = i >> 1;
+        let uv_adj_i = if i == 0 || (i == width - 1 && (i % 2) != 0) {
+            uv_i
+        } else if (i % 2) != 0 {
+            uv_i + 1
+        } else {
+            uv_i - 1
+        };
+        *dst = (row[uv_i] * (9.0 / 16.0))
+            + (row[uv_adj_i] * (3.0 / 16.0))
+            + (adj_row[uv_i] * (3.0 / 16.0))
+            + (adj_row[uv_adj_i] * (1.0 / 16.0));
+    }
+}
+
+// Converts rows of YUV samples into unorm RGB values, for conversions that process the RGB values
+// further before writing them (such as the gain map application). The chroma samples are
+// upsampled bilinearly if |chroma_upsampling| allows it and they are centered, and with the
+// nearest neighbor otherwise.
+pub(crate) struct UnormRowConverter {
+    mode: Mode,
+    table_y: Vec<f32>,
+    table_uv: Vec<f32>,
+    has_color: bool,
+    bilinear: bool,
+}
+
+impl UnormRowConverter {
+    pub(crate) fn create(
+        image: &image::Image,
+        chroma_upsampling: ChromaUpsampling,
+    ) -> AvifResult<Self> {
+        let mode: Mode = image.into();
+        let (table_y, table_uv) = unorm_lookup_tables(image, mode)?;
+        let table_uv = match table_uv {
+            Some(table_uv) => table_uv,
+            None => table_y.clone(),
+        };
+        let has_color = image.has_plane(Plane::U)
+            && image.has_plane(Plane::V)
+            && image.yuv_format != PixelFormat::Yuv400;
+        let bilinear = has_color
+            && matches!(image.yuv_format, PixelFormat::Yuv420 | PixelFormat::Yuv422)
+            && chroma_upsampling.bilinear_or_better_filter_allowed()
+            && image.chroma_sample_position == ChromaSamplePosition::CENTER;
+        Ok(Self {
+            mode,
+            table_y,
+            table_uv,
+            has_color,
+            bilinear,
+        })
+    }
+
+    // Writes the unorm RGB values of the first dst.len() pixels of the row |j| of |image| into
+    // |dst|. The weights of the bilinear upsampling are the same as in yuv_to_rgb_any().
+    pub(crate) fn convert_row(
+        &self,
+        image: &image::Image,
+        j: u32,
+        dst: &mut [[f32; 3]],
+    ) -> AvifResult<()> {
+        let max_channel = image.max_channel();
+        let y_row = image.row_generic(Plane::Y, j)?;
+        if !self.has_color {
+            for (i, dst) in dst.iter_mut().enumerate() {
+                let y = unorm_value(y_row, i, max_channel, &self.table_y);
+                let (r, g, b) = compute_rgb(y, 0.5, 0.5, false, self.mode);
+                *dst = [r, g, b];
+            }
+            return Ok(());
+        }
+        let uv_j = j >> image.yuv_format.chroma_shift_y();
+        let uv_adj_j = if !self.bilinear
+            || j == 0
+            || (j == image.height - 1 && (j % 2) != 0)
+            || image.yuv_format == PixelFormat::Yuv422
+        {
+            uv_j
+        } else if (j % 2) != 0 {
+            uv_j + 1
+        } else {
+            uv_j - 1
+        };
+        let u_row = image.row_generic(Plane::U, uv_j)?;
+        let v_row = image.row_generic(Plane::V, uv_j)?;
+        let u_adj_row = image.row_generic(Plane::U, uv_adj_j)?;
+        let v_adj_row = image.row_generic(Plane::V, uv_adj_j)?;
+        let table_uv = &self.table_uv;
+        let width_minus_1 = (image.width - 1) as usize;
+        let chroma_shift_x = image.yuv_format.chroma_shift_x();
+        for (i, dst) in dst.iter_mut().enumerate() {
+            let y = unorm_value(y_row, i, max_channel, &self.table_y);
+            let uv_i = i >> chroma_shift_x;
+            let (cb, cr) = if self.bilinear {
+                let uv_adj_i = if i == 0 || (i == width_minus_1 && (i % 2) != 0) {
+                    uv_i
+                } else if (i % 2) != 0 {
+                    uv_i + 1
+                } else {
+                    uv_i - 1
+                };
+                let upsample = |row: PlaneRow, adj_row: PlaneRow| {
+                    (unorm_value(row, uv_i, max_channel, table_uv) * (9.0 / 16.0))
+                        + (unorm_value(row, uv_adj_i, max_channel, table_uv) * (3.0 / 16.0))
+                        + (unorm_value(adj_row, uv_i, max_channel, table_uv) * (3.0 / 16.0))
+                        + (unorm_value(adj_row, uv_adj_i, max_channel, table_uv) * (1.0 / 16.0))
+                };
+                (upsample(u_row, u_adj_row), upsample(v_row, v_adj_row))
+            } else {
+                (
+                    unorm_value(u_row, uv_i, max_channel, table_uv),
+                    unorm_value(v_row, uv_i, max_channel, table_uv),
+                )
+            };
+            let (r, g, b) = compute_rgb(y, cb, cr, true, self.mode);
+            *dst = [r, g, b];
+        }
+        Ok(())
+    }
+}
+
+// Returns (0.5 + (clamp_f32(value, 0.0, 1.0) * max_channel_f)) as u16 for |max_channel_f| up to
+// 65535. NaN becomes 0 in both cases.
+#[inline(always)]
+fn quantize_unorm(value: f32, max_channel_f: f32) -> u16 {
+    let value = 0.5 + (value.max(0.0).min(1.0) * max_channel_f);
+    // SAFETY: |value| is in [0.5, max_channel_f + 0.5], which fits in an i32. Unlike the
+    // saturating `as` conversion, this one has a vector instruction, so the loops that use it are
+    // vectorized.
+    unsafe { value.to_int_unchecked::<i32>() as u16 }
+}
+
+struct Yuv16ToRgb16Params {
+    coefficients: (f32, f32, f32),
+    bias_y: f32,
+    range_y: f32,
+    yuv_max_channel: u16,
+    rgb_max_channel_f: f32,
+}
+
+// Converts a row of Y samples and the matching upsampled unorm chroma values into |dst|. The
+// channel count and offsets are constants so that the stores of each pixel are at fixed positions
+// and the loop is vectorized. The alpha channel, if any, is left untouched.
+#[inline(always)]
+fn yuv16_to_rgb16_row<const CHANNELS: usize, const R: usize, const G: usize, const B: usize>(
+    params: &Yuv16ToRgb16Params,
+    y_row: &[u16],
+    cb_row: &[f32],
+    cr_row: &[f32],
+    dst: &mut [u16],
+) {
+    let (kr, kg, kb) = params.coefficients;
+    for (((pixel, &y), &cb), &cr) in dst
+        .chunks_exact_mut(CHANNELS)
+        .zip(y_row)
+        .zip(cb_row)
+        .zip(cr_row)
+    {
+        let y = ((min(y, params.yuv_max_channel) as f32) - params.bias_y) / params.range_y;
+        let r = y + (2.0 * (1.0 - kr)) * cr;
+        let b = y + (2.0 * (1.0 - kb)) * cb;
+        let g = y - ((2.0 * ((kr * (1.0 - kr) * cr) + (kb * (1.0 - kb) * cb))) / kg);
+        pixel[R] = quantize_unorm(r, params.rgb_max_channel_f);
+        pixel[G] = quantize_unorm(g, params.rgb_max_channel_f);
+        pixel[B] = quantize_unorm(b, params.rgb_max_channel_f);
+    }
+}
+
+// Converts high bit depth 4:2:0 or 4:2:2 YUV into RGB with more than 8 bits per channel using
+// bilinear chroma upsampling. This produces the same values as yuv_to_rgb_any() but works on
+// whole rows: the chroma rows are converted and upsampled once per row into scratch buffers and
+// the per pixel loop is free of lookups and branches, with one specialization per RGB format. The
+// rows of |rgb| are the rows of |image| starting at |first_row|. The loops are vectorized for the
+// instruction sets selected by cpu_dispatched!.
+cpu_dispatched! {
+    pub fn yuv16_to_rgb16_bilinear(
+        image: &image::Image,
+        rgb: &mut rgb::Image,
+        first_row: u32,
+    ) -> AvifResult<()> {
+        let coefficients = match Mode::from(image) {
+            Mode::YuvCoefficients(kr, kg, kb) => (kr, kg, kb),
+            _ => return Err(AvifError::NotImplemented),
+        };
+        if image.depth == 8
+            || rgb.depth == 8
+            || rgb.format == Format::Rgb565
+            || !matches!(image.yuv_format, PixelFormat::Yuv420 | PixelFormat::Yuv422)
+            || !image.has_plane(Plane::U)
+            || !image.has_plane(Plane::V)
+            || image.chroma_sample_position != ChromaSamplePosition::CENTER
+        {
+            return Err(AvifError::NotImplemented);
+        }
+        let ((bias_y, range_y), (bias_uv, range_uv)) = unorm_parameters(image);
+        let yuv_max_channel = image.max_channel();
+        let params = Yuv16ToRgb16Params {
+            coefficients,
+            bias_y,
+            range_y,
+            yuv_max_channel,
+            rgb_max_channel_f: rgb.max_channel_f(),
+        };
+        let rgb_format = rgb.format;
+        let rgb_channel_count = rgb.channel_count() as usize;
+        let width = image.width as usize;
+        let uv_width = image.width(Plane::U);
+        let mut unorm_u: Vec<f32> = vec![0.0; uv_width];
+        let mut unorm_u_adj: Vec<f32> = vec![0.0; uv_width];
+        let mut unorm_v: Vec<f32> = vec![0.0; uv_width];
+        let mut unorm_v_adj: Vec<f32> = vec![0.0; uv_width];
+        let mut cb_row: Vec<f32> = vec![0.0; width];
+        let mut cr_row: Vec<f32> = vec![0.0; width];
+        for j in first_row..first_row + rgb.height {
+            let uv_j = j >> image.yuv_format.chroma_shift_y();
+            let uv_adj_j = if j == 0
+                || (j == image.height - 1 && (j % 2) != 0)
+                || image.yuv_format == PixelFormat::Yuv422
+            {
+                uv_j
+            } else if (j % 2) != 0 {
+                uv_j + 1
+            } else {
+                uv_j - 1
+            };
+            unorm_row16(
+                image.row16(Plane::U, uv_j)?,
+                yuv_max_channel,
+                bias_uv,
+                range_uv,
+                &mut unorm_u,
+            );
+            unorm_row16(
+                image.row16(Plane::U, uv_adj_j)?,
+                yuv_max_channel,
+                bias_uv,
+                range_uv,
+                &mut unorm_u_adj,
+            );
+            unorm_row16(
+                image.row16(Plane::V, uv_j)?,
+                yuv_max_channel,
+                bias_uv,
+                range_uv,
+                &mut unorm_v,
+            );
+            unorm_row16(
+                image.row16(Plane::V, uv_adj_j)?,
+                yuv_max_channel,
+                bias_uv,
+                range_uv,
+                &mut unorm_v_adj,
+            );
+            upsample_chroma_row_bilinear(&unorm_u, &unorm_u_adj, &mut cb_row);
+            upsample_chroma_row_bilinear(&unorm_v, &unorm_v_adj, &mut cr_row);
+            let y_row = &image.row16(Plane::Y, j)?[..width];
+            let dst = &mut rgb.row16_mut(j - first_row)?[..width * rgb_channel_count];
+            // The format is matched for each row so that the specialized row functions are
+            // inlined (and compiled for the same instruction set as this function).
+            match rgb_format {
+                Format::Rgb => {
+                    yuv16_to_rgb16_row::<3, 0, 1, 2>(&params, y_row, &cb_row, &cr_row, dst)
+                }
+                Format::Rgba => {
+                    yuv16_to_rgb16_row::<4, 0, 1, 2>(&params, y_row, &cb_row, &cr_row, dst)
+                }
+                Format::Argb => {
+                    yuv16_to_rgb16_row::<4, 1, 2, 3>(&params, y_row, &cb_row, &cr_row, dst)
+                }
+                Format::Bgr => {
+                    yuv16_to_rgb16_row::<3, 2, 1, 0>(&params, y_row, &cb_row, &cr_row, dst)
+                }
+                Format::Bgra => {
+                    yuv16_to_rgb16_row::<4, 2, 1, 0>(&params, y_row, &cb_row, &cr_row, dst)
+                }
+                Format::Abgr => {
+                    yuv16_to_rgb16_row::<4, 3, 2, 1>(&params, y_row, &cb_row, &cr_row, dst)
+                }
+                Format::Rgb565 => return Err(AvifError::NotImplemented),
+            }
+        }
+        Ok(())
+    }
+}
+
+// Converts a row of samples into unorm values with |table| (see unorm_lookup_tables()).
+fn lookup_unorm_row<T: Sample>(row: &[T], max_channel: u16, table: &[f32], dst: &mut [f32]) {
+    for (dst, &pixel) in dst.iter_mut().zip(row) {
+        *dst = table[min(pixel.to_u16(), max_channel) as usize];
+    }
+}
+
+// The const generic parameters of the kernels of yuv_to_rgb_any(). Each combination is a separate
+// kernel, chosen once per image, so that the per pixel loop does not branch on the configuration.
+const ANY_CHROMA_NONE: u8 = 0;
+const ANY_CHROMA_NEAREST: u8 = 1;
+const ANY_CHROMA_BILINEAR: u8 = 2;
+
+const ANY_MODE_YUV_COEFFICIENTS: u8 = 0;
+const ANY_MODE_IDENTITY: u8 = 1;
+const ANY_MODE_YCGCO: u8 = 2;
+
+const ANY_ALPHA_NOOP: u8 = 0;
+const ANY_ALPHA_MULTIPLY: u8 = 1;
+const ANY_ALPHA_UNMULTIPLY: u8 = 2;
+
+struct AnyParams<'a> {
+    image: &'a image::Image,
+    table_y: &'a [f32],
+    table_uv: &'a [f32],
+    coefficients: (f32, f32, f32),
+    first_row: u32,
+}
+
+fn yuv_to_rgb_any_kernel<
+    T: Sample,
+    U: Sample,
+    const CHROMA: u8,
+    const MODE: u8,
+    const ALPHA: u8,
+>(
+    params: &AnyParams,
     rgb: &mut rgb::Image,
-    alpha_multiply_mode: AlphaMultiplyMode,
 ) -> AvifResult<()> {
-    let mode: Mode = image.into();
-    let (table_y, table_uv) = unorm_lookup_tables(image, mode)?;
-    let table_uv = match &table_uv {
-        Some(table_uv) => table_uv,
-        None => &table_y,
+    let image = params.image;
+    let (kr, kg, kb) = params.coefficients;
+    let mode = match MODE {
+        ANY_MODE_IDENTITY => Mode::Identity,
+        ANY_MODE_YCGCO => Mode::Ycgco,
+        _ => Mode::YuvCoefficients(kr, kg, kb),
     };
+    let has_color = CHROMA != ANY_CHROMA_NONE;
+    let bilinear = CHROMA == ANY_CHROMA_BILINEAR;
     let r_offset = rgb.format.r_offset();
     let g_offset = rgb.format.g_offset();
     let b_offset = rgb.format.b_offset();
     let rgb_channel_count = rgb.channel_count() as usize;
-    let rgb_depth = rgb.depth;
-    let chroma_upsampling = rgb.chroma_upsampling;
-    let has_color = image.has_plane(Plane::U)
-        && image.has_plane(Plane::V)
-        && image.yuv_format != PixelFormat::Yuv400;
     let yuv_max_channel = image.max_channel();
     let rgb_max_channel_f = rgb.max_channel_f();
-    for j in 0..image.height {
-        let uv_j = j >> image.yuv_format.chroma_shift_y();
-        let y_row = image.row_generic(Plane::Y, j)?;
-        let u_row = image.row_generic(Plane::U, uv_j).ok();
-        let v_row = image.row_generic(Plane::V, uv_j).ok();
-        let a_row = image.row_generic(Plane::A, j).ok();
-        for i in 0..image.width as usize {
-            let y = unorm_value(y_row, i, yuv_max_channel, &table_y);
-            let mut cb = 0.5;
-            let mut cr = 0.5;
-            if has_color {
-                let u_row = u_row.unwrap();
-                let v_row = v_row.unwrap();
-                let uv_i = i >> image.yuv_format.chroma_shift_x();
-                if image.yuv_format == PixelFormat::Yuv444
-                    || matches!(
-                        chroma_upsampling,
-                        ChromaUpsampling::Fastest | ChromaUpsampling::Nearest
-                    )
+    let width = image.width as usize;
+    let chroma_shift_x = image.yuv_format.chroma_shift_x();
+    let uv_width = if has_color { image.width(Plane::U) } else { 0 };
+    let adj_width = if bilinear { uv_width } else { 0 };
+    let upsampled_width = if bilinear { width } else { 0 };
+    let mut unorm_u: Vec<f32> = vec![0.0; uv_width];
+    let mut unorm_v: Vec<f32> = vec![0.0; uv_width];
+    let mut unorm_u_adj: Vec<f32> = vec![0.0; adj_width];
+    let mut unorm_v_adj: Vec<f32> = vec![0.0; adj_width];
+    let mut cb_row: Vec<f32> = vec![0.0; upsampled_width];
+    let mut cr_row: Vec<f32> = vec![0.0; upsampled_width];
+    for j in params.first_row..params.first_row + rgb.height {
+        // The rows are fetched and the chroma is converted to unorm values once per row.
+        if has_color {
+            let uv_j = j >> image.yuv_format.chroma_shift_y();
+            let table_uv = params.table_uv;
+            lookup_unorm_row(
+                T::yuv_row(image, Plane::U, uv_j)?,
+                yuv_max_channel,
+                table_uv,
+                &mut unorm_u,
+            );
+            lookup_unorm_row(
+                T::yuv_row(image, Plane::V, uv_j)?,
+                yuv_max_channel,
+                table_uv,
+                &mut unorm_v,
+            );
+            if bilinear {
+                // Bilinear filtering with weights. See
+                // https://github.com/AOMediaCodec/libavif/blob/0580334466d57fedb889d5ed7ae9574d6f66e00c/src/reformat.c#L657-L685.
+                let uv_adj_j = if j == 0
+                    || (j == image.height - 1 && (j % 2) != 0)
+                    || image.yuv_format == PixelFormat::Yuv422
                 {
-                    cb = unorm_value(u_row, uv_i, yuv_max_channel, table_uv);
-                    cr = unorm_value(v_row, uv_i, yuv_max_channel, table_uv);
+                    uv_j
+                } else if (j % 2) != 0 {
+                    uv_j + 1
                 } else {
-                    if image.chroma_sample_position != ChromaSamplePosition::CENTER {
-                        return Err(AvifError::NotImplemented);
-                    }
-
-                    // Bilinear filtering with weights. See
-                    // https://github.com/AOMediaCodec/libavif/blob/0580334466d57fedb889d5ed7ae9574d6f66e00c/src/reformat.c#L657-L685.
-                    let image_width_minus_1 = (image.width - 1) as usize;
-                    let uv_adj_i = if i == 0 || (i == image_width_minus_1 && (i % 2) != 0) {
-                        uv_i
-                    } else if (i % 2) != 0 {
-                        uv_i + 1
-                    } else {
-                        uv_i - 1
-                    };
-                    let uv_adj_j = if j == 0
-                        || (j == image.height - 1 && (j % 2) != 0)
-                        || image.yuv_format == PixelFormat::Yuv422
-                    {
-                        uv_j
-                    } else if (j % 2) != 0 {
-                        uv_j + 1
-                    } else {
-                        uv_j - 1
-                    };
-                    let u_adj_row = image.row_generic(Plane::U, uv_adj_j)?;
-                    let v_adj_row = image.row_generic(Plane::V, uv_adj_j)?;
-                    let mut unorm_u: [[f32; 2]; 2] = [[0.0; 2]; 2];
-                    let mut unorm_v: [[f32; 2]; 2] = [[0.0; 2]; 2];
-                    unorm_u[0][0] = unorm_value(u_row, uv_i, yuv_max_channel, table_uv);
-                    unorm_v[0][0] = unorm_value(v_row, uv_i, yuv_max_channel, table_uv);
-                    unorm_u[1][0] = unorm_value(u_row, uv_adj_i, yuv_max_channel, table_uv);
-                    unorm_v[1][0] = unorm_value(v_row, uv_adj_i, yuv_max_channel, table_uv);
-                    unorm_u[0][1] = unorm_value(u_adj_row, uv_i, yuv_max_channel, table_uv);
-                    unorm_v[0][1] = unorm_value(v_adj_row, uv_i, yuv_max_channel, table_uv);
-                    unorm_u[1][1] = unorm_value(u_adj_row, uv_adj_i, yuv_max_channel, table_uv);
-                    unorm_v[1][1] = unorm_value(v_adj_row, uv_adj_i, yuv_max_channel, table_uv);
-                    cb = (unorm_u[0][0] * (9.0 / 16.0))
-                        + (unorm_u[1][0] * (3.0 / 16.0))
-                        + (unorm_u[0][1] * (3.0 / 16.0))
-                        + (unorm_u[1][1] * (1.0 / 16.0));
-                    cr = (unorm_v[0][0] * (9.0 / 16.0))
-                        + (unorm_v[1][0] * (3.0 / 16.0))
-                        + (unorm_v[0][1] * (3.0 / 16.0))
-                        + (unorm_v[1][1] * (1.0 / 16.0));
-                }
+                    uv_j - 1
+                };
+                lookup_unorm_row(
+                    T::yuv_row(image, Plane::U, uv_adj_j)?,
+                    yuv_max_channel,
+                    table_uv,
+                    &mut unorm_u_adj,
+                );
+                lookup_unorm_row(
+                    T::yuv_row(image, Plane::V, uv_adj_j)?,
+                    yuv_max_channel,
+                    table_uv,
+                    &mut unorm_v_adj,
+                );
+                upsample_chroma_row_bilinear(&unorm_u, &unorm_u_adj, &mut cb_row);
+                upsample_chroma_row_bilinear(&unorm_v, &unorm_v_adj, &mut cr_row);
             }
+        }
+        let y_row = &T::yuv_row(image, Plane::Y, j)?[..width];
+        let a_row: &[T] = if ALPHA != ANY_ALPHA_NOOP {
+            &T::yuv_row(image, Plane::A, j)?[..width]
+        } else {
+            &[]
+        };
+        let dst = &mut U::rgb_row_mut(rgb, j - params.first_row)?[..width * rgb_channel_count];
+        for (i, pixel) in dst.chunks_exact_mut(rgb_channel_count).enumerate() {
+            let y = params.table_y[min(y_row[i].to_u16(), yuv_max_channel) as usize];
+            let (cb, cr) = match CHROMA {
+                ANY_CHROMA_NEAREST => (unorm_u[i >> chroma_shift_x], unorm_v[i >> chroma_shift_x]),
+                ANY_CHROMA_BILINEAR => (cb_row[i], cr_row[i]),
+                _ => (0.5, 0.5),
+            };
             let (mut rc, mut gc, mut bc) = compute_rgb(y, cb, cr, has_color, mode);
-            if alpha_multiply_mode != AlphaMultiplyMode::NoOp {
-                let unorm_a = clamped_pixel(a_row.unwrap(), i, yuv_max_channel);
+            if ALPHA != ANY_ALPHA_NOOP {
+                let unorm_a = min(a_row[i].to_u16(), yuv_max_channel);
                 let ac = clamp_f32((unorm_a as f32) / (yuv_max_channel as f32), 0.0, 1.0);
                 if ac == 0.0 {
                     rc = 0.0;
                     gc = 0.0;
                     bc = 0.0;
                 } else if ac < 1.0 {
-                    match alpha_multiply_mode {
-                        AlphaMultiplyMode::Multiply => {
-                            rc *= ac;
-                            gc *= ac;
-                            bc *= ac;
-                        }
-                        AlphaMultiplyMode::UnMultiply => {
-                            rc = f32::min(rc / ac, 1.0);
-                            gc = f32::min(gc / ac, 1.0);
-                            bc = f32::min(bc / ac, 1.0);
-                        }
-                        _ => {} // Not reached.
+                    if ALPHA == ANY_ALPHA_MULTIPLY {
+                        rc *= ac;
+                        gc *= ac;
+                        bc *= ac;
+                    } else {
+                        rc = f32::min(rc / ac, 1.0);
+                        gc = f32::min(gc / ac, 1.0);
+                        bc = f32::min(bc / ac, 1.0);
                     }
                 }
             }
-            if rgb_depth == 8 {
-                let dst = rgb.row_mut(j)?;
-                dst[(i * rgb_channel_count) + r_offset] = (0.5 + (rc * rgb_max_channel_f)) as u8;
-                dst[(i * rgb_channel_count) + g_offset] = (0.5 + (gc * rgb_max_channel_f)) as u8;
-                dst[(i * rgb_channel_count) + b_offset] = (0.5 + (bc * rgb_max_channel_f)) as u8;
-            } else {
-                let dst16 = rgb.row16_mut(j)?;
-                dst16[(i * rgb_channel_count) + r_offset] = (0.5 + (rc * rgb_max_channel_f)) as u16;
-                dst16[(i * rgb_channel_count) + g_offset] = (0.5 + (gc * rgb_max_channel_f)) as u16;
-                dst16[(i * rgb_channel_count) + b_offset] = (0.5 + (bc * rgb_max_channel_f)) as u16;
-            }
+            pixel[r_offset] = U::from_u16((0.5 + (rc * rgb_max_channel_f)) as u16);
+            pixel[g_offset] = U::from_u16((0.5 + (gc * rgb_max_channel_f)) as u16);
+            pixel[b_offset] = U::from_u16((0.5 + (bc * rgb_max_channel_f)) as u16);
         }
     }
     Ok(())
 }
 
+fn yuv_to_rgb_any_with_alpha<T: Sample, U: Sample, const CHROMA: u8, const MODE: u8>(
+    params: &AnyParams,
+    rgb: &mut rgb::Image,
+    alpha_multiply_mode: AlphaMultiplyMode,
+) -> AvifResult<()> {
+    match alpha_multiply_mode {
+        AlphaMultiplyMode::NoOp => {
+            yuv_to_rgb_any_kernel::<T, U, CHROMA, MODE, ANY_ALPHA_NOOP>(params, rgb)
+        }
+        AlphaMultiplyMode::Multiply => {
+            yuv_to_rgb_any_kernel::<T, U, CHROMA, MODE, ANY_ALPHA_MULTIPLY>(params, rgb)
+        }
+        AlphaMultiplyMode::UnMultiply => {
+            yuv_to_rgb_any_kernel::<T, U, CHROMA, MODE, ANY_ALPHA_UNMULTIPLY>(params, rgb)
+        }
+    }
+}
+
+fn yuv_to_rgb_any_with_mode<T: Sample, U: Sample, const CHROMA: u8>(
+    params: &AnyParams,
+    rgb: &mut rgb::Image,
+    mode: Mode,
+    alpha_multiply_mode: AlphaMultiplyMode,
+) -> AvifResult<()> {
+    match mode {
+        Mode::YuvCoefficients(..) => yuv_to_rgb_any_with_alpha::<
+            T,
+            U,
+            CHROMA,
+            ANY_MODE_YUV_COEFFICIENTS,
+        >(params, rgb, alpha_multiply_mode),
+        Mode::Identity => yuv_to_rgb_any_with_alpha::<T, U, CHROMA, ANY_MODE_IDENTITY>(
+            params,
+            rgb,
+            alpha_multiply_mode,
+        ),
+        Mode::Ycgco => yuv_to_rgb_any_with_alpha::<T, U, CHROMA, ANY_MODE_YCGCO>(
+            params,
+            rgb,
+            alpha_multiply_mode,
+        ),
+    }
+}
+
+fn yuv_to_rgb_any_impl<T: Sample, U: Sample>(
+    params: &AnyParams,
+    rgb: &mut rgb::Image,
+    mode: Mode,
+    alpha_multiply_mode: AlphaMultiplyMode,
+) -> AvifResult<()> {
+    let image = params.image;
+    let has_color = image.has_plane(Plane::U)
+        && image.has_plane(Plane::V)
+        && image.yuv_format != PixelFormat::Yuv400;
+    if !has_color {
+        // The color mode does not matter without chroma.
+        return yuv_to_rgb_any_with_alpha::<T, U, ANY_CHROMA_NONE, ANY_MODE_YUV_COEFFICIENTS>(
+            params,
+            rgb,
+            alpha_multiply_mode,
+        );
+    }
+    if image.yuv_format == PixelFormat::Yuv444
+        || matches!(
+            rgb.chroma_upsampling,
+            ChromaUpsampling::Fastest | ChromaUpsampling::Nearest
+        )
+    {
+        return yuv_to_rgb_any_with_mode::<T, U, ANY_CHROMA_NEAREST>(
+            params,
+            rgb,
+            mode,
+            alpha_multiply_mode,
+        );
+    }
+    if image.chroma_sample_position != ChromaSamplePosition::CENTER {
+        return Err(AvifError::NotImplemented);
+    }
+    yuv_to_rgb_any_with_mode::<T, U, ANY_CHROMA_BILINEAR>(params, rgb, mode, alpha_multiply_mode)
+}
+
+// The rows of |rgb| are the rows of |image| starting at |first_row|. The whole |image| is
+// available so that the chroma rows adjacent to the converted rows can be used for upsampling.
+pub fn yuv_to_rgb_any(
+    image: &image::Image,
+    rgb: &mut rgb::Image,
+    alpha_multiply_mode: AlphaMultiplyMode,
+    first_row: u32,
+) -> AvifResult<()> {
+    let mode: Mode = image.into();
+    let (table_y, table_uv) = unorm_lookup_tables(image, mode)?;
+    let table_uv = match &table_uv {
+        Some(table_uv) => table_uv,
+        None => &table_y,
+    };
+    let params = AnyParams {
+        image,
+        table_y: &table_y,
+        table_uv,
+        coefficients: match mode {
+            Mode::YuvCoefficients(kr, kg, kb) => (kr, kg, kb),
+            _ => (0.0, 0.0, 0.0),
+        },
+        first_row,
+    };
+    match (image.depth == 8, rgb.depth == 8) {
+        (true, true) => yuv_to_rgb_any_impl::<u8, u8>(&params, rgb, mode, alpha_multiply_mode),
+        (false, false) => yuv_to_rgb_any_impl::<u16, u16>(&params, rgb, mode, alpha_multiply_mode),
+        (false, true) => yuv_to_rgb_any_impl::<u16, u8>(&params, rgb, mode, alpha_multiply_mode),
+        (true, false) => yuv_to_rgb_any_impl::<u8, u16>(&params, rgb, mode, alpha_multiply_mode),
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -695,7 +1308,7 @@ mod tests {
             dst.format = rgb::Format::Rgb;
             dst.chroma_upsampling = ChromaUpsampling::Bilinear;
             assert!(dst.allocate().is_ok());
-            assert!(yuv_to_rgb_any(yuv, &mut dst, AlphaMultiplyMode::NoOp).is_ok());
+            assert!(yuv_to_rgb_any(yuv, &mut dst, AlphaMultiplyMode::NoOp, 0).is_ok());
             assert_eq!(dst.height, r.len() as u32);
             assert_eq!(dst.height, g.len() as u32);
             assert_eq!(dst.height, b.len() as u32);
@@ -869,4 +1482,253 @@ mod tests {
             ],
         );
     }
+
+    #[test]
+    fn yuv16_to_rgb16_bilinear_matches_any() -> AvifResult<()> {
+        for (width, height) in [(1, 1), (2, 3), (7, 5), (16, 9)] {
+            for yuv_format in [PixelFormat::Yuv420, PixelFormat::Yuv422] {
+                for depth in [10, 12] {
+                    for yuv_range in [YuvRange::Limited, YuvRange::Full] {
+                        let mut yuv = image::Image {
+                            width,
+                            height,
+                            depth,
+                            yuv_format,
+                            yuv_range,
+                            matrix_coefficients: MatrixCoefficients::Bt709,
+                            ..Default::default()
+                        };
+                        yuv.allocate_planes(decoder::Category::Color)?;
+                        let mut value: u32 = 12345;
+                        for plane in image::YUV_PLANES {
+                            for y in 0..yuv.height(plane) {
+                                for pixel in yuv.row16_mut(plane, y as u32)? {
+                                    // Includes values above the maximum for the depth.
+                                    value = value.wrapping_mul(1103515245).wrapping_add(12345);
+                                    *pixel = ((value >> 16) % (1 << (depth + 1))) as u16;
+                                }
+                            }
+                        }
+                        for (format, rgb_depth) in [
+                            (Format::Rgb, 16),
+                            (Format::Rgba, 10),
+                            (Format::Argb, 12),
+                            (Format::Bgr, 10),
+                            (Format::Bgra, 16),
+                            (Format::Abgr, 16),
+                        ] {
+                            let mut expected = rgb::Image::create_from_yuv(&yuv);
+                            expected.format = format;
+                            expected.depth = rgb_depth;
+                            expected.allocate()?;
+                            yuv_to_rgb_any(&yuv, &mut expected, AlphaMultiplyMode::NoOp, 0)?;
+                            let mut actual = rgb::Image::create_from_yuv(&yuv);
+                            actual.format = format;
+                            actual.depth = rgb_depth;
+                            actual.allocate()?;
+                            yuv16_to_rgb16_bilinear(&yuv, &mut actual, 0)?;
+                            for y in 0..height {
+                                assert_eq!(actual.row16(y)?, expected.row16(y)?);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        Ok(())
+    }
+
+    // The conversion of yuv_to_rgb_any() written pixel by pixel, without specialization.
+    fn yuv_to_rgb_per_pixel(
+        image: &image::Image,
+        rgb: &mut rgb::Image,
+        alpha_multiply_mode: AlphaMultiplyMode,
+        first_row: u32,
+    ) -> AvifResult<()> {
+        let mode: Mode = image.into();
+        let (table_y, table_uv) = unorm_lookup_tables(image, mode)?;
+        let table_uv = table_uv.unwrap_or(table_y.clone());
+        let has_color = image.yuv_format != PixelFormat::Yuv400;
+        let bilinear = has_color
+            && image.yuv_format != PixelFormat::Yuv444
+            && rgb.chroma_upsampling.bilinear_or_better_filter_allowed();
+        let max_channel = image.max_channel();
+        let channel_count = rgb.channel_count() as usize;
+        let offsets = [
+            rgb.format.r_offset(),
+            rgb.format.g_offset(),
+            rgb.format.b_offset(),
+        ];
+        for j in first_row..first_row + rgb.height {
+            let uv_j = j >> image.yuv_format.chroma_shift_y();
+            let uv_adj_j = if !bilinear
+                || j == 0
+                || (j == image.height - 1 && (j % 2) != 0)
+                || image.yuv_format == PixelFormat::Yuv422
+            {
+                uv_j
+            } else if (j % 2) != 0 {
+                uv_j + 1
+            } else {
+                uv_j - 1
+            };
+            for i in 0..image.width as usize {
+                let y = unorm_value(image.row_generic(Plane::Y, j)?, i, max_channel, &table_y);
+                let (mut cb, mut cr) = (0.5, 0.5);
+                if has_color {
+                    let uv_i = i >> image.yuv_format.chroma_shift_x();
+                    let uv_adj_i =
+                        if !bilinear || i == 0 || (i == image.width as usize - 1 && (i % 2) != 0) {
+                            uv_i
+                        } else if (i % 2) != 0 {
+                            uv_i + 1
+                        } else {
+                            uv_i - 1
+                        };
+                    let value = |plane, row, index| -> AvifResult<f32> {
+                        Ok(unorm_value(
+                            image.row_generic(plane, row)?,
+                            index,
+                            max_channel,
+                            &table_uv,
+                        ))
+                    };
+                    let upsample = |plane| -> AvifResult<f32> {
+                        if !bilinear {
+                            return value(plane, uv_j, uv_i);
+                        }
+                        Ok((value(plane, uv_j, uv_i)? * (9.0 / 16.0))
+                            + (value(plane, uv_j, uv_adj_i)? * (3.0 / 16.0))
+                            + (value(plane, uv_adj_j, uv_i)? * (3.0 / 16.0))
+                            + (value(plane, uv_adj_j, uv_adj_i)? * (1.0 / 16.0)))
+                    };
+                    cb = upsample(Plane::U)?;
+                    cr = upsample(Plane::V)?;
+                }
+                let (r, g, b) = compute_rgb(y, cb, cr, has_color, mode);
+                let mut rgb_values = [r, g, b];
+                if alpha_multiply_mode != AlphaMultiplyMode::NoOp {
+                    let a = clamped_pixel(image.row_generic(Plane::A, j)?, i, max_channel);
+                    let a = clamp_f32((a as f32) / (max_channel as f32), 0.0, 1.0);
+                    for c in &mut rgb_values {
+                        if a == 0.0 {
+                            *c = 0.0;
+                        } else if a < 1.0 {
+                            *c = match alpha_multiply_mode {
+                                AlphaMultiplyMode::Multiply => *c * a,
+                                _ => f32::min(*c / a, 1.0),
+                            };
+                        }
+                    }
+                }
+                for (c, offset) in rgb_values.iter().zip(offsets) {
+                    let value = 0.5 + (c * rgb.max_channel_f());
+                    let index = (i * channel_count) + offset;
+                    if rgb.depth == 8 {
+                        rgb.row_mut(j - first_row)?[index] = value as u8;
+                    } else {
+                        rgb.row16_mut(j - first_row)?[index] = value as u16;
+                    }
+                }
+            }
+        }
+        Ok(())
+    }
+
+    #[test]
+    fn yuv_to_rgb_any_matches_per_pixel() -> AvifResult<()> {
+        let (width, height) = (7, 5);
+        for yuv_format in [
+            PixelFormat::Yuv444,
+            PixelFormat::Yuv422,
+            PixelFormat::Yuv420,
+            PixelFormat::Yuv400,
+        ] {
+            for depth in [8, 10] {
+                for matrix_coefficients in [
+                    MatrixCoefficients::Bt601,
+                    MatrixCoefficients::Identity,
+                    MatrixCoefficients::Ycgco,
+                ] {
+                    let mut yuv = image::Image {
+                        width,
+                        height,
+                        depth,
+                        yuv_format,
+                        yuv_range: YuvRange::Full,
+                        matrix_coefficients,
+                        ..Default::default()
+                    };
+                    yuv.allocate_planes(decoder::Category::Color)?;
+                    yuv.allocate_planes(decoder::Category::Alpha)?;
+                    let mut value: u32 = 54321;
+                    for plane in image::ALL_PLANES {
+                        if !yuv.has_plane(plane) {
+                            continue;
+                        }
+                        for y in 0..yuv.height(plane) as u32 {
+                            for x in 0..yuv.width(plane) {
+                                value = value.wrapping_mul(1103515245).wrapping_add(12345);
+                                // Includes values above the maximum for the depth, and fully
+                                // transparent and opaque alpha values.
+                                let sample = match (value >> 16) % 8 {
+                                    0 => 0,
+                                    1 => (1 << depth) - 1,
+                                    _ => (value >> 8) % (1 << (depth + 1)),
+                                };
+                                if depth == 8 {
+                                    yuv.row_mut(plane, y)?[x] = sample as u8;
+                                } else {
+                                    yuv.row16_mut(plane, y)?[x] = sample as u16;
+                                }
+                            }
+                        }
+                    }
+                    for (chroma_upsampling, alpha_multiply_mode, rgb_depth, first_row) in [
+                        (ChromaUpsampling::Nearest, AlphaMultiplyMode::NoOp, 8, 0),
+                        (ChromaUpsampling::Bilinear, AlphaMultiplyMode::NoOp, 16, 1),
+                        (
+                            ChromaUpsampling::Automatic,
+                            AlphaMultiplyMode::Multiply,
+                            8,
+                            2,
+                        ),
+                        (
+                            ChromaUpsampling::Fastest,
+                            AlphaMultiplyMode::UnMultiply,
+                            10,
+                            0,
+                        ),
+                        (
+                            ChromaUpsampling::BestQuality,
+                            AlphaMultiplyMode::UnMultiply,
+                            8,
+                            3,
+                        ),
+                    ] {
+                        let mut expected = rgb::Image::create_from_yuv(&yuv);
+                        expected.height = height - first_row;
+                        expected.depth = rgb_depth;
+                        expected.chroma_upsampling = chroma_upsampling;
+                        expected.allocate()?;
+                        yuv_to_rgb_per_pixel(&yuv, &mut expected, alpha_multiply_mode, first_row)?;
+                        let mut actual = rgb::Image::create_from_yuv(&yuv);
+                        actual.height = height - first_row;
+                        actual.depth = rgb_depth;
+                        actual.chroma_upsampling = chroma_upsampling;
+                        actual.allocate()?;
+                        yuv_to_rgb_any(&yuv, &mut actual, alpha_multiply_mode, first_row)?;
+                        for y in 0..actual.height {
+                            if rgb_depth == 8 {
+                                assert_eq!(actual.row(y)?, expected.row(y)?);
+                            } else {
+                                assert_eq!(actual.row16(y)?, expected.row16(y)?);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        Ok(())
+    }
 }
@@ -0,0 +1,219 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+use crate::internal_utils::pixels::*;
+use crate::internal_utils::*;
+use crate::*;
+
+// A pool of previously allocated buffers that can be reused instead of allocating new ones. The
+// total capacity (in bytes) of the buffers kept in the pool never exceeds max_size. Buffers that
+// do not fit are simply freed.
+#[derive(Debug, Default)]
+pub struct BufferPool {
+    max_size: usize,
+    size: usize,
+    buffers: Vec<Vec<u8>>,
+    buffers16: Vec<Vec<u16>>,
+}
+
+impl BufferPool {
+    pub fn create(max_size: usize) -> Self {
+        Self {
+            max_size,
+            ..Default::default()
+        }
+    }
+
+    pub fn max_size(&self) -> usize {
+        self.max_size
+    }
+
+    // Total capacity in bytes of the buffers currently held by the pool.
+    pub fn size(&self) -> usize {
+        self.size
+    }
+
+    // Frees the pooled buffers (largest first) until the pool fits in |max_size|.
+    pub fn set_max_size(&mut self, max_size: usize) {
+        self.max_size = max_size;
+        while self.size > self.max_size {
+            let largest = self.buffers.iter().map(|x| x.capacity()).max().unwrap_or(0);
+            let largest16 = self
+                .buffers16
+                .iter()
+                .map(|x| x.capacity() * 2)
+                .max()
+                .unwrap_or(0);
+            if largest >= largest16 {
+                let index = self
+                    .buffers
+                    .iter()
+                    .position(|x| x.capacity() == largest)
+                    .unwrap();
+                self.size -= self.buffers.swap_remove(index).capacity();
+            } else {
+                let index = self
+                    .buffers16
+                    .iter()
+                    .position(|x| x.capacity() * 2 == largest16)
+                    .unwrap();
+                self.size -= self.buffers16.swap_remove(index).capacity() * 2;
+            }
+        }
+    }
+
+    pub fn clear(&mut self) {
+        self.buffers.clear();
+        self.buffers16.clear();
+        self.size = 0;
+    }
+
+    // Returns an empty buffer with a capacity of at least |capacity| elements. The smallest
+    // pooled buffer that is large enough is used, if any.
+    pub fn take(&mut self, capacity: usize) -> AvifResult<Vec<u8>> {
+        match Self::best_fit(self.buffers.iter().map(|x| x.capacity()), capacity) {
+            Some(index) => {
+                let buffer = self.buffers.swap_remove(index);
+                self.size -= buffer.capacity();
+                Ok(buffer)
+            }
+            None => create_vec_exact(capacity),
+        }
+    }
+
+    pub fn take16(&mut self, capacity: usize) -> AvifResult<Vec<u16>> {
+        match Self::best_fit(self.buffers16.iter().map(|x| x.capacity()), capacity) {
+            Some(index) => {
+                let buffer = self.buffers16.swap_remove(index);
+                self.size -= buffer.capacity() * 2;
+                Ok(buffer)
+            }
+            None => create_vec_exact(capacity),
+        }
+    }
+
+    pub fn give(&mut self, mut buffer: Vec<u8>) {
+        let buffer_size = buffer.capacity();
+        if buffer_size == 0 || buffer_size > self.max_size - self.size {
+            return;
+        }
+        buffer.clear();
+        self.buffers.push(buffer);
+        self.size += buffer_size;
+    }
+
+    pub fn give16(&mut self, mut buffer: Vec<u16>) {
+        let buffer_size = buffer.capacity().saturating_mul(2);
+        if buffer_size == 0 || buffer_size > self.max_size - self.size {
+            return;
+        }
+        buffer.clear();
+        self.buffers16.push(buffer);
+        self.size += buffer_size;
+    }
+
+    // Takes back the buffer of |pixels|, if it owns one.
+    pub(crate) fn give_pixels(&mut self, pixels: Pixels) {
+        match pixels {
+            Pixels::Buffer(buffer) => self.give(buffer),
+            Pixels::Buffer16(buffer) => self.give16(buffer),
+            Pixels::Pointer(_) | Pixels::Pointer16(_) => {}
+        }
+    }
+
+    // Number of bytes that taking buffers of |capacities| elements with take() (or take16() if
+    // |is_16bit|) would allocate. The pooled buffers that would be reused are not counted since
+    // they are already part of size().
+    pub(crate) fn allocation_size(
+        &self,
+        capacities: &[usize],
+        is_16bit: bool,
+    ) -> AvifResult<usize> {
+        let (mut pooled, element_size): (Vec<usize>, usize) = if is_16bit {
+            (self.buffers16.iter().map(|x| x.capacity()).collect(), 2)
+        } else {
+            (self.buffers.iter().map(|x| x.capacity()).collect(), 1)
+        };
+        let mut size: usize = 0;
+        for capacity in capacities {
+            match Self::best_fit(pooled.iter().copied(), *capacity) {
+                Some(index) => {
+                    pooled.swap_remove(index);
+                }
+                None => checked_incr!(size, checked_mul!(*capacity, element_size)?),
+            }
+        }
+        Ok(size)
+    }
+
+    fn best_fit(capacities: impl Iterator<Item = usize>, capacity: usize) -> Option<usize> {
+        capacities
+            .enumerate()
+            .filter(|(_, buffer_capacity)| *buffer_capacity >= capacity)
+            .min_by_key(|(_, buffer_capacity)| *buffer_capacity)
+            .map(|(index, _)| index)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn take_and_give() -> AvifResult<()> {
+        let mut pool = BufferPool::create(1000);
+        let buffer = pool.take(100)?;
+        assert!(buffer.capacity() >= 100);
+        let buffer_ptr = buffer.as_ptr();
+        pool.give(buffer);
+        assert_eq!(pool.size(), 100);
+        // Too big for the pooled buffer.
+        let big_buffer = pool.take(200)?;
+        assert_ne!(big_buffer.as_ptr(), buffer_ptr);
+        assert_eq!(pool.size(), 100);
+        // The pooled buffer is reused.
+        let buffer = pool.take(50)?;
+        assert_eq!(buffer.as_ptr(), buffer_ptr);
+        assert!(buffer.is_empty());
+        assert_eq!(pool.size(), 0);
+        pool.give(buffer);
+        pool.give(big_buffer);
+        assert_eq!(pool.size(), 300);
+        // Does not fit.
+        pool.give16(create_vec_exact(400)?);
+        assert_eq!(pool.size(), 300);
+        pool.give16(create_vec_exact(300)?);
+        assert_eq!(pool.size(), 900);
+        pool.set_max_size(400);
+        assert_eq!(pool.size(), 300);
+        pool.clear();
+        assert_eq!(pool.size(), 0);
+        Ok(())
+    }
+
+    #[test]
+    fn allocation_size() -> AvifResult<()> {
+        let mut pool = BufferPool::create(1000);
+        pool.give(create_vec_exact(100)?);
+        pool.give16(create_vec_exact(50)?);
+        assert_eq!(pool.allocation_size(&[80], false)?, 0);
+        // Each pooled buffer is only reused once.
+        assert_eq!(pool.allocation_size(&[80, 80], false)?, 80);
+        assert_eq!(pool.allocation_size(&[200], false)?, 200);
+        assert_eq!(pool.allocation_size(&[50, 60], true)?, 120);
+        // Nothing was taken.
+        assert_eq!(pool.size(), 200);
+        Ok(())
+    }
+}
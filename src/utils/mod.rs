@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+pub mod buffer_pool;
 pub mod clap;
 pub mod raw;
 pub mod y4m;
@@ -90,8 +90,10 @@ fn main() {
         "dav1d_data_wrap",
         "dav1d_default_settings",
         "dav1d_error",
+        "dav1d_flush",
         "dav1d_get_picture",
         "dav1d_open",
+        "dav1d_picture_ref",
         "dav1d_picture_unref",
         "dav1d_send_data",
     ];
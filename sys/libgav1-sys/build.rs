@@ -75,6 +75,7 @@ fn main() {
         "Libgav1DecoderDestroy",
         "Libgav1DecoderEnqueueFrame",
         "Libgav1DecoderSettingsInitDefault",
+        "Libgav1DecoderSignalEOS",
     ];
     for allowlist_item in allowlist_items {
         bindings = bindings.allowlist_item(allowlist_item);
@@ -48,15 +48,26 @@ fn main() {
         .derive_default(true)
         .layout_tests(false)
         .generate_comments(false);
+    // The functions that are not available on all the supported API levels (such as
+    // AMediaCodec_setAsyncNotifyCallback and the AImageReader functions) are not listed. They are
+    // looked up at runtime.
     let allowlist_items = &[
+        "AHardwareBuffer",
+        "AHardwareBuffer_UsageFlags",
+        "AIMAGE_FORMATS",
+        "AImage",
+        "AImageReader",
+        "AImageReader_ImageListener",
         "AMediaCodec",
         "AMediaCodecBufferInfo",
+        "AMediaCodecOnAsyncNotifyCallback",
         "AMediaCodec_configure",
         "AMediaCodec_createCodecByName",
         "AMediaCodec_createDecoderByType",
         "AMediaCodec_delete",
         "AMediaCodec_dequeueInputBuffer",
         "AMediaCodec_dequeueOutputBuffer",
+        "AMediaCodec_flush",
         "AMediaCodec_getInputBuffer",
         "AMediaCodec_getOutputBuffer",
         "AMediaCodec_getOutputFormat",
@@ -71,6 +82,7 @@ fn main() {
         "AMediaFormat_new",
         "AMediaFormat_setInt32",
         "AMediaFormat_setString",
+        "ANativeWindow",
     ];
     for allowlist_item in allowlist_items {
         bindings = bindings.allowlist_item(allowlist_item);
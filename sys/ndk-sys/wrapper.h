@@ -14,4 +14,6 @@
  * limitations under the License.
  */
 
+#include <android/hardware_buffer.h>
+#include <media/NdkImageReader.h>
 #include <media/NdkMediaCodec.h>
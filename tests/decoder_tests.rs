@@ -207,6 +207,19 @@ fn progressive(filename: &str, layer_count: u32, width: u32, height: u32) {
     assert_eq!(image.width, width);
     assert_eq!(image.height, height);
     assert_eq!(decoder.image_count(), layer_count);
+
+    let mut metadata_decoder = get_decoder(&filename_with_prefix);
+    metadata_decoder.settings.allow_progressive = true;
+    metadata_decoder.settings.metadata_only = true;
+    assert!(metadata_decoder.parse().is_ok());
+    assert_eq!(metadata_decoder.image_count(), layer_count);
+    let metadata_image = metadata_decoder.image().expect("image was none");
+    assert!(matches!(
+        metadata_image.progressive_state,
+        decoder::ProgressiveState::Active
+    ));
+    assert_eq!(metadata_decoder.io_stats().color_obu_size, 0);
+
     if !HAS_DECODER {
         return;
     }
@@ -340,6 +353,634 @@ fn color_nogrid_alpha_nogrid_gainmap_grid() {
     assert!(res.is_ok());
 }
 
+#[test]
+fn categories_on_demand() {
+    let mut decoder = get_decoder("color_nogrid_alpha_nogrid_gainmap_grid.avif");
+    let res = decoder.parse();
+    assert!(res.is_ok());
+    assert!(decoder.gainmap_present());
+    // The gain map is only set up once it is requested.
+    assert_eq!(decoder.gainmap().image.width, 0);
+    if !HAS_DECODER {
+        return;
+    }
+    let res = decoder.next_image_with_categories(&[decoder::Category::Color]);
+    assert!(res.is_ok());
+    let image = decoder.image().expect("image was none");
+    assert!(image.has_plane(Plane::Y));
+    assert!(!image.has_plane(Plane::A));
+    assert!(!decoder.gainmap().image.has_plane(Plane::Y));
+
+    // Requesting more categories of the same image only decodes these.
+    let res = decoder.nth_image_with_categories(0, &decoder::Category::ALL);
+    assert!(res.is_ok());
+    let image = decoder.image().expect("image was none");
+    assert!(image.has_plane(Plane::Y));
+    assert!(image.has_plane(Plane::A));
+    assert_eq!(decoder.gainmap().image.width, 64 * 2);
+    assert_eq!(decoder.gainmap().image.height, 80 * 2);
+    assert!(decoder.gainmap().image.has_plane(Plane::Y));
+}
+
+#[test]
+fn decode_stats() {
+    let mut decoder = get_decoder("sofa_grid1x5_420.avif");
+    decoder.settings.enable_decode_stats = true;
+    let spans = Rc::new(RefCell::new(Vec::new()));
+    let spans_clone = spans.clone();
+    decoder.set_trace_callback(Some(Box::new(
+        move |span: &decoder::instrumentation::TraceSpan| spans_clone.borrow_mut().push(span.stage),
+    )));
+    let res = decoder.parse();
+    assert!(res.is_ok());
+    let stats = decoder.decode_stats();
+    assert!(stats.read_count > 0);
+    assert!(stats.read_size > 0);
+    assert_eq!(stats.tile_count, 0);
+    assert_eq!(
+        *spans.borrow(),
+        [decoder::instrumentation::DecodeStage::Parse]
+    );
+    if !HAS_DECODER {
+        return;
+    }
+    let res = decoder.next_image();
+    assert!(res.is_ok());
+    let stats = decoder.decode_stats();
+    assert_eq!(stats.tile_count, 5);
+    assert!(stats.codec.is_some());
+    let image = decoder.image().expect("image was none");
+    // All the tiles are copied into the planes of the grid image.
+    assert!(stats.copied_size >= (image.width * image.height) as u64);
+    for stage in [
+        decoder::instrumentation::DecodeStage::Codec,
+        decoder::instrumentation::DecodeStage::TileCopy,
+    ] {
+        assert!(spans.borrow().contains(&stage));
+    }
+
+    // The measurements start over with each call to parse().
+    let res = decoder.parse();
+    assert!(res.is_ok());
+    assert_eq!(decoder.decode_stats().tile_count, 0);
+}
+
+#[test]
+fn memory_limit() {
+    let filename = "sofa_grid1x5_420.avif";
+    let mut decoder = get_decoder(filename);
+    assert!(decoder.parse().is_ok());
+    assert_eq!(decoder.memory_stats().current_size, 0);
+    if !HAS_DECODER {
+        return;
+    }
+    assert!(decoder.next_image().is_ok());
+    let stats = decoder.memory_stats();
+    let image = decoder.image().expect("image was none");
+    // The tiles are copied into the planes of the grid image.
+    assert!(stats.current_size >= (image.width * image.height) as usize);
+    assert!(stats.peak_size >= stats.current_size);
+
+    // The decoding stays within a limit that fits the peak size.
+    let mut decoder = get_decoder(filename);
+    decoder.settings.memory_limit = stats.peak_size;
+    assert!(decoder.parse().is_ok());
+    assert!(decoder.next_image().is_ok());
+    assert!(decoder.memory_stats().peak_size <= stats.peak_size);
+
+    // The decoding fails early if the grid image does not fit.
+    let mut decoder = get_decoder(filename);
+    decoder.settings.memory_limit = stats.current_size / 2;
+    assert!(decoder.parse().is_ok());
+    assert!(matches!(decoder.next_image(), Err(AvifError::OutOfMemory)));
+    assert!(decoder.memory_stats().peak_size <= stats.current_size / 2);
+}
+
+#[test]
+fn memory_limit_rgb_image() {
+    let mut decoder = get_decoder("sofa_grid1x5_420.avif");
+    assert!(decoder.parse().is_ok());
+    let image = decoder.image().expect("image was none");
+    let mut rgb = rgb::Image::create_from_yuv(image);
+    let size = (rgb.width * rgb.height * rgb.pixel_size()) as usize;
+
+    decoder.settings.memory_limit = size - 1;
+    assert!(matches!(
+        decoder.allocate_rgb_image(&mut rgb),
+        Err(AvifError::OutOfMemory)
+    ));
+    assert!(rgb.pixels.is_none());
+
+    decoder.settings.memory_limit = size;
+    assert!(decoder.allocate_rgb_image(&mut rgb).is_ok());
+    assert_eq!(rgb.row_bytes * rgb.height, size as u32);
+    // The buffer is owned by the caller.
+    let stats = decoder.memory_stats();
+    assert_eq!(stats.current_size, 0);
+    assert_eq!(stats.peak_size, size);
+}
+
+#[test]
+fn memory_limit_with_buffer_pool() {
+    let filename = "sofa_grid1x5_420.avif";
+    let mut decoder = get_decoder(filename);
+    decoder.settings.buffer_pool_size_limit = 64 << 20;
+    assert!(decoder.parse().is_ok());
+    let image = decoder.image().expect("image was none");
+    let mut rgb = rgb::Image::create_from_yuv(image);
+    let size = (rgb.width * rgb.height * rgb.pixel_size()) as usize;
+    decoder.settings.memory_limit = size;
+    assert!(decoder.allocate_rgb_image(&mut rgb).is_ok());
+    // The buffer is given to the pool and taken back, so it is not counted twice.
+    assert!(decoder.allocate_rgb_image(&mut rgb).is_ok());
+    assert_eq!(decoder.memory_stats().peak_size, size);
+    if !HAS_DECODER {
+        return;
+    }
+
+    let mut decoder = get_decoder(filename);
+    decoder.settings.buffer_pool_size_limit = 64 << 20;
+    decoder.settings.enable_decode_stats = true;
+    assert!(decoder.parse().is_ok());
+    assert!(decoder.next_image().is_ok());
+    let peak_size = decoder.memory_stats().peak_size;
+    // The planes of the first decoding are in the pool and are reused by the second one, which
+    // fits in the same limit.
+    decoder.settings.memory_limit = peak_size;
+    assert!(decoder.parse().is_ok());
+    assert!(decoder.buffer_pool().size() > 0);
+    assert!(decoder.next_image().is_ok());
+    assert!(decoder.memory_stats().peak_size <= peak_size);
+}
+
+// Allocates the frame buffers from the heap and keeps track of the buffers in use.
+#[derive(Default)]
+struct TestFrameAllocator {
+    // Address and layout of each allocated buffer.
+    buffers: std::sync::Mutex<Vec<(usize, std::alloc::Layout)>>,
+    allocation_count: std::sync::atomic::AtomicUsize,
+}
+
+impl decoder::frame_allocator::FrameAllocator for TestFrameAllocator {
+    fn allocate(
+        &self,
+        request: &decoder::frame_allocator::FrameBufferRequest,
+    ) -> AvifResult<decoder::frame_allocator::FrameBuffer> {
+        let mut buffer = decoder::frame_allocator::FrameBuffer {
+            planes: [std::ptr::null_mut(); 3],
+            row_bytes: [0; 3],
+            user_data: std::ptr::null_mut(),
+        };
+        let mut plane_offsets = [0usize; 3];
+        let mut size = 0;
+        for plane in 0..request.plane_count() {
+            buffer.row_bytes[plane] = request.min_row_bytes(plane) as u32;
+            plane_offsets[plane] = size;
+            size += request
+                .min_plane_size(plane, request.min_row_bytes(plane))
+                .next_multiple_of(request.alignment);
+        }
+        let layout = std::alloc::Layout::from_size_align(size, request.alignment)
+            .or(Err(AvifError::OutOfMemory))?;
+        let data = unsafe { std::alloc::alloc(layout) };
+        if data.is_null() {
+            return Err(AvifError::OutOfMemory);
+        }
+        for plane in 0..request.plane_count() {
+            buffer.planes[plane] = unsafe { data.add(plane_offsets[plane]) };
+        }
+        buffer.user_data = data as *mut _;
+        self.buffers.lock().unwrap().push((data as usize, layout));
+        self.allocation_count
+            .fetch_add(1, std::sync::atomic::Ordering::SeqCst);
+        Ok(buffer)
+    }
+
+    fn release(&self, buffer: decoder::frame_allocator::FrameBuffer) {
+        let mut buffers = self.buffers.lock().unwrap();
+        let index = buffers
+            .iter()
+            .position(|(data, _)| *data == buffer.user_data as usize)
+            .expect("unknown buffer");
+        let (data, layout) = buffers.swap_remove(index);
+        unsafe { std::alloc::dealloc(data as *mut u8, layout) };
+    }
+}
+
+#[test]
+fn frame_allocator() {
+    let allocator = std::sync::Arc::new(TestFrameAllocator::default());
+    let mut decoder = get_decoder("paris_icc_exif_xmp.avif");
+    decoder.settings.frame_allocator = Some(allocator.clone());
+    let res = decoder.parse();
+    assert!(res.is_ok());
+    if !cfg!(any(feature = "dav1d", feature = "libgav1")) {
+        // The other codecs ignore the frame allocator.
+        return;
+    }
+    let res = decoder.next_image();
+    assert!(res.is_ok());
+    assert!(
+        allocator
+            .allocation_count
+            .load(std::sync::atomic::Ordering::SeqCst)
+            > 0
+    );
+    let image = decoder.image().expect("image was none");
+    // The planes of the image point into the buffers of the allocator.
+    let y = image.row(Plane::Y, 0).unwrap().as_ptr() as usize;
+    assert!(allocator
+        .buffers
+        .lock()
+        .unwrap()
+        .iter()
+        .any(|(data, layout)| y >= *data && y < *data + layout.size()));
+    // All the buffers are released with the codec.
+    drop(decoder);
+    assert!(allocator.buffers.lock().unwrap().is_empty());
+}
+
+#[test]
+fn decode_region() {
+    let mut decoder = get_decoder("sofa_grid1x5_420.avif");
+    decoder.settings.enable_decode_stats = true;
+    let res = decoder.parse();
+    assert!(res.is_ok());
+    let image = decoder.image().expect("image was none");
+    let (width, height) = (image.width, image.height);
+    let region = |x, y, width, height| utils::clap::CropRect {
+        x,
+        y,
+        width,
+        height,
+    };
+    // The region must be inside the image and aligned to the chroma subsampling.
+    for invalid_region in [
+        region(0, 0, 0, 2),
+        region(0, 0, width + 2, 2),
+        region(0, height - 1, 2, 2),
+        region(1, 0, 2, 2),
+    ] {
+        assert!(matches!(
+            decoder.decode_region(invalid_region),
+            Err(AvifError::InvalidArgument)
+        ));
+    }
+    if !HAS_DECODER {
+        return;
+    }
+    let res = decoder.next_image();
+    assert!(res.is_ok());
+    let full_tile_count = decoder.decode_stats().tile_count;
+    let image = decoder.image().expect("image was none");
+    let planes = [Plane::Y, Plane::U, Plane::V];
+    let full_planes: Vec<Vec<Vec<u8>>> = planes
+        .iter()
+        .map(|&plane| {
+            (0..image.height(plane) as u32)
+                .map(|y| image.row(plane, y).unwrap().to_vec())
+                .collect()
+        })
+        .collect();
+    for (roi, expected_tile_count) in [
+        (region(0, 0, 2, 2), Some(1)),
+        (region(width / 4 * 2, height / 4 * 2, 10, 6), None),
+        (region(0, 0, width, height), Some(full_tile_count)),
+    ] {
+        let tile_count = decoder.decode_stats().tile_count;
+        let res = decoder.decode_region(roi);
+        assert!(res.is_ok());
+        let decoded_tile_count = decoder.decode_stats().tile_count - tile_count;
+        match expected_tile_count {
+            Some(expected_tile_count) => assert_eq!(decoded_tile_count, expected_tile_count),
+            None => assert!(decoded_tile_count < full_tile_count),
+        }
+        let image = decoder.image().expect("image was none");
+        assert_eq!((image.width, image.height), (roi.width, roi.height));
+        for (plane_index, &plane) in planes.iter().enumerate() {
+            let shift = if plane == Plane::Y { 0 } else { 1 };
+            let x = (roi.x >> shift) as usize;
+            for y in 0..image.height(plane) as u32 {
+                let row = image.row(plane, y).unwrap();
+                let full_row = &full_planes[plane_index][((roi.y >> shift) + y) as usize];
+                assert_eq!(row, &full_row[x..x + row.len()]);
+            }
+        }
+    }
+    // The whole image is decoded again afterwards.
+    let res = decoder.nth_image(0);
+    assert!(res.is_ok());
+    let image = decoder.image().expect("image was none");
+    assert_eq!((image.width, image.height), (width, height));
+}
+
+#[test_case::test_case("color_grid_alpha_nogrid.avif", 4; "color_grid_alpha_nogrid")]
+#[test_case::test_case("color_grid_alpha_grid_gainmap_nogrid.avif", 2; "alpha_grid_two_threads")]
+#[test_case::test_case("color_grid_alpha_grid_gainmap_nogrid.avif", 64; "alpha_grid_many_threads")]
+#[test_case::test_case("color_nogrid_alpha_nogrid_gainmap_grid.avif", 3; "gainmap_grid")]
+#[test_case::test_case("sofa_grid1x5_420.avif", 8; "sofa_grid1x5_420")]
+fn parallel_grid_tile_decoding(filename: &str, grid_tile_threads: u32) {
+    if !HAS_DECODER {
+        return;
+    }
+    let mut serial_decoder = get_decoder(filename);
+    serial_decoder.settings.enable_decoding_gainmap = true;
+    assert!(serial_decoder.parse().is_ok());
+    assert!(serial_decoder.next_image().is_ok());
+    let mut parallel_decoder = get_decoder(filename);
+    parallel_decoder.settings.enable_decoding_gainmap = true;
+    parallel_decoder.settings.grid_tile_threads = grid_tile_threads;
+    assert!(parallel_decoder.parse().is_ok());
+    assert!(parallel_decoder.next_image().is_ok());
+    assert_eq!(
+        parallel_decoder.decoded_row_count(),
+        serial_decoder.decoded_row_count()
+    );
+
+    let serial_images = [
+        serial_decoder.image().unwrap(),
+        &serial_decoder.gainmap().image,
+    ];
+    let parallel_images = [
+        parallel_decoder.image().unwrap(),
+        &parallel_decoder.gainmap().image,
+    ];
+    for (serial_image, parallel_image) in serial_images.iter().zip(parallel_images.iter()) {
+        assert_same_pixels(serial_image, parallel_image);
+    }
+}
+
+fn assert_same_pixels(expected_image: &Image, image: &Image) {
+    assert_eq!(expected_image.width, image.width);
+    assert_eq!(expected_image.height, image.height);
+    assert_eq!(expected_image.depth, image.depth);
+    for plane in ALL_PLANES {
+        assert_eq!(expected_image.has_plane(plane), image.has_plane(plane));
+        if !expected_image.has_plane(plane) {
+            continue;
+        }
+        let width = expected_image.width(plane);
+        for y in 0..expected_image.height(plane) as u32 {
+            if expected_image.depth == 8 {
+                assert_eq!(
+                    expected_image.row(plane, y).unwrap()[..width],
+                    image.row(plane, y).unwrap()[..width]
+                );
+            } else {
+                assert_eq!(
+                    expected_image.row16(plane, y).unwrap()[..width],
+                    image.row16(plane, y).unwrap()[..width]
+                );
+            }
+        }
+    }
+}
+
+#[test_case::test_case("sofa_grid1x5_420.avif", 2; "sofa_grid1x5_420")]
+#[test_case::test_case("color_grid_alpha_nogrid.avif", 4; "color_grid_alpha_nogrid")]
+#[test_case::test_case("color_grid_alpha_grid_gainmap_nogrid.avif", 16; "alpha_grid")]
+fn pipelined_grid_tile_decoding(filename: &str, frame_pipeline_depth: u32) {
+    if !HAS_DECODER {
+        return;
+    }
+    let mut serial_decoder = get_decoder(filename);
+    serial_decoder.settings.enable_decoding_gainmap = true;
+    serial_decoder.settings.enable_decode_stats = true;
+    assert!(serial_decoder.parse().is_ok());
+    assert!(serial_decoder.next_image().is_ok());
+    let mut pipelined_decoder = get_decoder(filename);
+    pipelined_decoder.settings.enable_decoding_gainmap = true;
+    pipelined_decoder.settings.enable_decode_stats = true;
+    pipelined_decoder.settings.frame_pipeline_depth = frame_pipeline_depth;
+    assert!(pipelined_decoder.parse().is_ok());
+    assert!(pipelined_decoder.next_image().is_ok());
+    assert_eq!(
+        pipelined_decoder.decode_stats().tile_count,
+        serial_decoder.decode_stats().tile_count
+    );
+    assert_same_pixels(
+        serial_decoder.image().unwrap(),
+        pipelined_decoder.image().unwrap(),
+    );
+    assert_same_pixels(
+        &serial_decoder.gainmap().image,
+        &pipelined_decoder.gainmap().image,
+    );
+}
+
+#[test_case::test_case("sofa_grid1x5_420.avif", 1; "serial")]
+#[test_case::test_case("sofa_grid1x5_420.avif", 3; "parallel")]
+#[test_case::test_case("color_grid_alpha_grid_gainmap_nogrid.avif", 2; "color_and_alpha_grid")]
+fn thread_budget(filename: &str, grid_tile_threads: u32) {
+    if !HAS_DECODER {
+        return;
+    }
+    let budget = decoder::thread_budget::ThreadBudget::create(4);
+    let mut decoder = get_decoder(filename);
+    decoder.settings.max_threads = 4;
+    decoder.settings.grid_tile_threads = grid_tile_threads;
+    decoder.settings.thread_budget = Some(budget.clone());
+    assert!(decoder.parse().is_ok());
+    assert!(decoder.next_image().is_ok());
+    // The threads are given back once the last image is decoded.
+    assert_eq!(budget.available_threads(), 4);
+    assert!(decoder.image().unwrap().has_plane(Plane::Y));
+    assert!(matches!(
+        decoder.next_image(),
+        Err(AvifError::NoImagesRemaining)
+    ));
+    assert!(decoder.nth_image(0).is_ok());
+    assert_eq!(budget.available_threads(), 4);
+}
+
+#[test_case::test_case("sofa_grid1x5_420.avif"; "color_grid")]
+#[test_case::test_case("color_grid_alpha_grid_gainmap_nogrid.avif"; "color_and_alpha_grid")]
+fn tiled_output(filename: &str) {
+    let mut decoder = get_decoder(filename);
+    decoder.settings.tiled_output = true;
+    assert!(decoder.parse().is_ok());
+    if !HAS_DECODER {
+        return;
+    }
+    assert!(decoder.next_image().is_ok());
+    let mut stitched_decoder = get_decoder(filename);
+    assert!(stitched_decoder.parse().is_ok());
+    assert!(stitched_decoder.next_image().is_ok());
+    let stitched_image = stitched_decoder.image().unwrap();
+    let image = decoder.image().unwrap();
+    assert_eq!(image.width, stitched_image.width);
+    assert_eq!(image.height, stitched_image.height);
+    assert!(!image.has_plane(Plane::Y));
+
+    for category in [decoder::Category::Color, decoder::Category::Alpha] {
+        let tile_views = match decoder.tile_views(category) {
+            Ok(tile_views) => tile_views,
+            Err(_) => continue,
+        };
+        assert!(!tile_views.is_empty());
+        let mut covered_pixels = 0;
+        for tile_view in &tile_views {
+            covered_pixels += tile_view.width * tile_view.height;
+            // Compare the luma (or alpha) samples of the tile with the stitched image.
+            let plane = if category == decoder::Category::Alpha { Plane::A } else { Plane::Y };
+            let width = tile_view.width as usize;
+            let x = tile_view.x as usize;
+            for y in 0..tile_view.height {
+                if image.depth == 8 {
+                    assert_eq!(
+                        tile_view.image.row(plane, y).unwrap()[..width],
+                        stitched_image.row(plane, tile_view.y + y).unwrap()[x..x + width]
+                    );
+                } else {
+                    assert_eq!(
+                        tile_view.image.row16(plane, y).unwrap()[..width],
+                        stitched_image.row16(plane, tile_view.y + y).unwrap()[x..x + width]
+                    );
+                }
+            }
+        }
+        assert_eq!(covered_pixels, image.width * image.height);
+    }
+}
+
+#[test]
+fn buffer_pool_reuse() {
+    let mut decoder = get_decoder("sofa_grid1x5_420.avif");
+    decoder.settings.buffer_pool_size_limit = 64 << 20;
+    assert!(decoder.parse().is_ok());
+    if !HAS_DECODER {
+        return;
+    }
+    assert!(decoder.next_image().is_ok());
+    let first_row = decoder.image().unwrap().row(Plane::Y, 0).unwrap().to_vec();
+    assert_eq!(decoder.buffer_pool().size(), 0);
+    // Parsing again gives the planes of the stitched image to the pool.
+    assert!(decoder.parse().is_ok());
+    let pool_size = decoder.buffer_pool().size();
+    assert!(pool_size > 0);
+    assert!(decoder.next_image().is_ok());
+    assert!(decoder.buffer_pool().size() < pool_size);
+    assert_eq!(
+        decoder.image().unwrap().row(Plane::Y, 0).unwrap()[..],
+        first_row[..]
+    );
+}
+
+#[test]
+fn codec_reuse() {
+    let mut decoder = get_decoder("sofa_grid1x5_420.avif");
+    decoder.settings.max_idle_codecs = 4;
+    assert!(decoder.parse().is_ok());
+    if !HAS_DECODER {
+        return;
+    }
+    assert!(decoder.next_image().is_ok());
+    assert_eq!(decoder.idle_codec_count(), 0);
+    // Parsing another file flushes the codec instance of the previous one.
+    assert!(decoder
+        .set_io_file(&get_test_file("paris_icc_exif_xmp.avif"))
+        .is_ok());
+    assert!(decoder.parse().is_ok());
+    let idle_codec_count = decoder.idle_codec_count();
+    assert!(idle_codec_count > 0);
+    // The flushed instance is used to decode the new file.
+    assert!(decoder.next_image().is_ok());
+    assert!(decoder.idle_codec_count() < idle_codec_count);
+    let mut expected_decoder = get_decoder("paris_icc_exif_xmp.avif");
+    assert!(expected_decoder.parse().is_ok());
+    assert!(expected_decoder.next_image().is_ok());
+    let image = decoder.image().unwrap();
+    let expected_image = expected_decoder.image().unwrap();
+    for y in [0, image.height / 2, image.height - 1] {
+        assert_eq!(
+            image.row(Plane::Y, y).unwrap()[..],
+            expected_image.row(Plane::Y, y).unwrap()[..]
+        );
+    }
+    // No instance is kept when the reuse is disabled.
+    decoder.settings.max_idle_codecs = 0;
+    assert!(decoder.parse().is_ok());
+    assert_eq!(decoder.idle_codec_count(), 0);
+}
+
+#[test]
+fn idle_codecs_keep_their_threads() {
+    if !HAS_DECODER {
+        return;
+    }
+    let budget = decoder::thread_budget::ThreadBudget::create(4);
+    let mut decoder = get_decoder("sofa_grid1x5_420.avif");
+    decoder.settings.max_threads = 4;
+    decoder.settings.thread_budget = Some(budget.clone());
+    decoder.settings.max_idle_codecs = 4;
+    assert!(decoder.parse().is_ok());
+    assert!(decoder.next_image().is_ok());
+    // The instance that is kept for reuse still holds its threads.
+    assert_eq!(decoder.idle_codec_count(), 1);
+    assert_eq!(budget.available_threads(), 0);
+    // It is reused although the budget is exhausted, since the same number of threads is
+    // requested.
+    assert!(decoder.parse().is_ok());
+    assert!(decoder.next_image().is_ok());
+    assert_eq!(decoder.idle_codec_count(), 1);
+    assert_eq!(budget.available_threads(), 0);
+    decoder.settings.max_idle_codecs = 0;
+    assert!(decoder.parse().is_ok());
+    assert_eq!(decoder.idle_codec_count(), 0);
+    assert_eq!(budget.available_threads(), 4);
+}
+
+#[test_case::test_case("sofa_grid1x5_420.avif")]
+#[test_case::test_case("color_grid_alpha_nogrid.avif")]
+#[test_case::test_case("alpha.avif")]
+#[test_case::test_case("paris_icc_exif_xmp.avif")]
+#[test_case::test_case("colors-animated-8bpc.avif")]
+#[test_case::test_case("colors-animated-8bpc-alpha-exif-xmp.avif")]
+fn probe(filename: &str) {
+    let data = std::fs::read(get_test_file(filename)).expect("Failed to read file");
+    // Feed the prefix by as many bytes as requested until the info is known.
+    let mut prefix_size = 0;
+    let info = loop {
+        match decoder::Decoder::probe(&data[..prefix_size]) {
+            Ok(decoder::probe::ProbeResult::Info(info)) => break info,
+            Ok(decoder::probe::ProbeResult::NeedMoreBytes(size)) => {
+                assert!(size > 0);
+                prefix_size += size as usize;
+                assert!(prefix_size <= data.len());
+            }
+            Err(err) => panic!("{err:?}"),
+        }
+    };
+    assert!(prefix_size < data.len());
+    let mut decoder = get_decoder(filename);
+    assert!(decoder.parse().is_ok());
+    let image = decoder.image().expect("image was none");
+    assert_eq!((info.width, info.height), (image.width, image.height));
+    assert_eq!(info.depth, image.depth);
+    assert_eq!(info.yuv_format, image.yuv_format);
+    assert_eq!(info.alpha_present, image.alpha_present);
+    assert_eq!(
+        info.image_sequence_track_present,
+        image.image_sequence_track_present
+    );
+    if info.source == decoder::Source::Tracks {
+        assert_eq!(info.timescale, decoder.timescale());
+        assert_eq!(
+            info.duration_in_timescales,
+            decoder.duration_in_timescales()
+        );
+    }
+    // Any prefix has to be at least as large as prefix_size.
+    assert!(matches!(
+        decoder::Decoder::probe(&data[..prefix_size - 1]),
+        Ok(decoder::probe::ProbeResult::NeedMoreBytes(_))
+    ));
+    assert_eq!(
+        decoder::Decoder::probe(&data),
+        Ok(decoder::probe::ProbeResult::Info(info))
+    );
+}
+
 // From avifcllitest.cc
 #[test_case::test_case("clli_0_0.avif", 0, 0; "clli_0_0")]
 #[test_case::test_case("clli_0_1.avif", 0, 1; "clli_0_1")]
@@ -418,6 +1059,73 @@ impl decoder::IO for CustomIO {
     }
 }
 
+#[test]
+fn shared_parse_segments() {
+    let filename = "colors-animated-12bpc-keyframes-0-2-3.avif";
+    let mut decoder = get_decoder(filename);
+    assert!(decoder.parse().is_ok());
+    let segments = decoder.keyframe_segments();
+    assert_eq!(segments, [0..2, 2..3, 3..5]);
+    let shared_parse = decoder.shared_parse().expect("shared_parse failed");
+    assert_eq!(shared_parse.image_count(), 5);
+    let data = std::fs::read(get_test_file(filename)).expect("Unable to read file");
+    let create_decoder = || {
+        decoder::Decoder::create_from_shared_parse(
+            &shared_parse,
+            decoder::Settings::default(),
+            Box::new(CustomIO {
+                available_size_rc: Rc::new(RefCell::new(data.len())),
+                data: data.clone(),
+            }),
+        )
+    };
+    let mut sibling = create_decoder();
+    assert_eq!(sibling.image_count(), 5);
+    assert_eq!(sibling.keyframe_segments(), segments);
+    let image = sibling.image().expect("image was none");
+    let reference_image = decoder.image().expect("image was none");
+    assert_eq!(image.width, reference_image.width);
+    assert_eq!(image.height, reference_image.height);
+    assert_eq!(image.depth, reference_image.depth);
+    assert!(image.image_sequence_track_present);
+    // Segments must start at a keyframe.
+    assert!(matches!(
+        sibling.decode_segment(1..2, |_| Ok(())),
+        Err(AvifError::InvalidArgument)
+    ));
+    if !HAS_DECODER {
+        return;
+    }
+
+    // Each segment is decoded by its own decoder on its own thread.
+    let segment_rows: Vec<Vec<(i32, Vec<u16>)>> = std::thread::scope(|scope| {
+        let threads: Vec<_> = segments
+            .iter()
+            .map(|segment| {
+                let segment = segment.clone();
+                scope.spawn(|| {
+                    let mut rows = Vec::new();
+                    let mut sibling = create_decoder();
+                    let res = sibling.decode_segment(segment, |decoder| {
+                        let image = decoder.image().unwrap();
+                        rows.push((decoder.image_index(), image.row16(Plane::Y, 0)?.to_vec()));
+                        Ok(())
+                    });
+                    assert!(res.is_ok());
+                    rows
+                })
+            })
+            .collect();
+        threads.into_iter().map(|x| x.join().unwrap()).collect()
+    });
+    for (index, (image_index, row)) in segment_rows.iter().flatten().enumerate() {
+        assert_eq!(*image_index, index as i32);
+        assert!(decoder.nth_image(index as u32).is_ok());
+        let image = decoder.image().expect("image was none");
+        assert_eq!(row, image.row16(Plane::Y, 0).unwrap());
+    }
+}
+
 #[test]
 fn custom_io() {
     let data =
@@ -439,6 +1147,178 @@ fn custom_io() {
     }
 }
 
+#[test_case::test_case("colors-animated-8bpc-alpha-exif-xmp.avif")]
+#[test_case::test_case("paris_icc_exif_xmp.avif")]
+#[test_case::test_case("sofa_grid1x5_420.avif")]
+fn read_ahead_io(filename: &str) {
+    let data = std::fs::read(get_test_file(filename)).expect("Unable to read file");
+    let mut reference_decoder = get_decoder(filename);
+    assert!(reference_decoder.parse().is_ok());
+    assert_eq!(reference_decoder.io_stats().read_ahead_misses, 0);
+
+    let mut decoder = decoder::Decoder::default();
+    decoder.settings.io_min_read_size = 64 * 1024;
+    let available_size_rc = Rc::new(RefCell::new(data.len()));
+    decoder.set_io(Box::new(CustomIO {
+        available_size_rc: available_size_rc.clone(),
+        data: data.clone(),
+    }));
+    assert!(decoder.parse().is_ok());
+    // The whole file was read at once.
+    assert_eq!(decoder.io_stats().read_ahead_misses, 1);
+    assert!(decoder.io_stats().read_ahead_hits > 0);
+    assert_eq!(decoder.image_count(), reference_decoder.image_count());
+    let image = decoder.image().expect("image was none");
+    let reference_image = reference_decoder.image().expect("image was none");
+    assert_eq!(image.width, reference_image.width);
+    assert_eq!(image.exif, reference_image.exif);
+    assert_eq!(image.xmp, reference_image.xmp);
+    assert_eq!(image.icc, reference_image.icc);
+    assert_eq!(
+        decoder.io_stats().color_obu_size,
+        reference_decoder.io_stats().color_obu_size
+    );
+
+    // Data past what is requested may not be available yet.
+    for available_size in [data.len() / 4, data.len() / 2] {
+        let mut reference_decoder = decoder::Decoder::default();
+        reference_decoder.set_io(Box::new(CustomIO {
+            available_size_rc: Rc::new(RefCell::new(available_size)),
+            data: data.clone(),
+        }));
+        let mut decoder = decoder::Decoder::default();
+        decoder.settings.io_min_read_size = 64 * 1024;
+        decoder.set_io(Box::new(CustomIO {
+            available_size_rc: Rc::new(RefCell::new(available_size)),
+            data: data.clone(),
+        }));
+        assert_eq!(decoder.parse(), reference_decoder.parse());
+    }
+
+    // Persistent IOs are not wrapped.
+    let mut persistent_decoder = decoder::Decoder::default();
+    persistent_decoder.settings.io_min_read_size = 64 * 1024;
+    persistent_decoder.set_io_vec(data.clone());
+    assert!(persistent_decoder.parse().is_ok());
+    assert_eq!(persistent_decoder.io_stats().read_ahead_misses, 0);
+    assert_eq!(persistent_decoder.io_stats().read_ahead_hits, 0);
+    if !HAS_DECODER {
+        return;
+    }
+    assert!(decoder.next_image().is_ok());
+}
+
+#[test_case::test_case("colors-animated-8bpc.avif")]
+#[test_case::test_case("colors-animated-8bpc-alpha-exif-xmp.avif")]
+fn frame_pipeline(filename: &str) {
+    let mut reference_decoder = get_decoder(filename);
+    assert!(reference_decoder.parse().is_ok());
+    let mut decoder = get_decoder(filename);
+    decoder.settings.frame_pipeline_depth = 3;
+    decoder.settings.max_threads = 4;
+    assert!(decoder.parse().is_ok());
+    assert_eq!(decoder.image_count(), reference_decoder.image_count());
+    if !HAS_DECODER {
+        return;
+    }
+    let image_count = decoder.image_count();
+    // Play the whole sequence, then seek back (which restarts the pipeline).
+    let indices = (0..image_count).chain([1, 2]);
+    for index in indices {
+        assert!(decoder.nth_image(index).is_ok());
+        assert!(reference_decoder.nth_image(index).is_ok());
+        assert_eq!(decoder.image_index(), reference_decoder.image_index());
+        let image = decoder.image().expect("image was none");
+        let reference_image = reference_decoder.image().expect("image was none");
+        assert_same_pixels(reference_image, image);
+    }
+    assert!(decoder.next_image().is_err());
+}
+
+#[test]
+fn frame_cache() {
+    let filename = "colors-animated-8bpc-alpha-exif-xmp.avif";
+    let mut reference_decoder = get_decoder(filename);
+    assert!(reference_decoder.parse().is_ok());
+    let mut decoder = get_decoder(filename);
+    decoder.settings.frame_cache_frame_limit = 3;
+    assert!(decoder.parse().is_ok());
+    assert_eq!(decoder.frame_cache_stats().frame_count, 0);
+    if !HAS_DECODER {
+        return;
+    }
+    let image_count = decoder.image_count();
+    assert!(image_count > 3);
+    // Play forward, then scrub backwards.
+    for index in (0..image_count).chain((0..image_count).rev()) {
+        assert!(decoder.nth_image(index).is_ok());
+        assert!(reference_decoder.nth_image(index).is_ok());
+        assert_eq!(decoder.image_index(), reference_decoder.image_index());
+        let image = decoder.image().expect("image was none");
+        let reference_image = reference_decoder.image().expect("image was none");
+        assert_same_pixels(reference_image, image);
+    }
+    let stats = decoder.frame_cache_stats();
+    assert_eq!(stats.frame_count, 3);
+    assert!(stats.hits > 0);
+    assert!(stats.misses >= image_count as u64);
+    // The frames that follow a cached frame are still decoded correctly.
+    assert!(decoder.nth_image(0).is_ok());
+    assert!(decoder.next_image().is_ok());
+    assert_eq!(decoder.image_index(), 1);
+
+    // The last frame decoded by the codecs is not decoded again when it is requested after a
+    // cached frame, even if it was evicted from the cache.
+    let mut decoder = get_decoder(filename);
+    decoder.settings.frame_cache_frame_limit = 2;
+    decoder.settings.enable_decode_stats = true;
+    assert!(decoder.parse().is_ok());
+    assert!(decoder.nth_image(1).is_ok());
+    decoder.settings.frame_cache_frame_limit = 1;
+    assert!(decoder.nth_image(0).is_ok());
+    assert_eq!(decoder.frame_cache_stats().hits, 1);
+    let tile_count = decoder.decode_stats().tile_count;
+    assert!(decoder.nth_image(1).is_ok());
+    assert_eq!(decoder.image_index(), 1);
+    assert_eq!(decoder.decode_stats().tile_count, tile_count);
+    assert!(reference_decoder.nth_image(1).is_ok());
+    let image = decoder.image().expect("image was none");
+    let reference_image = reference_decoder.image().expect("image was none");
+    assert_same_pixels(reference_image, image);
+}
+
+#[test]
+fn frame_handle() {
+    let filename = "colors-animated-8bpc-alpha-exif-xmp.avif";
+    let mut decoder = get_decoder(filename);
+    assert!(decoder.parse().is_ok());
+    // There is no decoded image yet.
+    assert!(matches!(decoder.frame_handle(), Err(AvifError::NoContent)));
+    if !HAS_DECODER {
+        return;
+    }
+    // Keep all the frames, then compare them with the frames of another decoder.
+    let mut handles = Vec::new();
+    for _ in 0..decoder.image_count() {
+        assert!(decoder.next_image().is_ok());
+        let handle = decoder
+            .frame_handle()
+            .expect("failed to create the frame handle");
+        assert!(handle.image().has_alpha());
+        handles.push(handle);
+    }
+    drop(decoder);
+    let mut reference_decoder = get_decoder(filename);
+    assert!(reference_decoder.parse().is_ok());
+    for handle in &handles {
+        assert!(reference_decoder.next_image().is_ok());
+        let image = handle.image();
+        let reference_image = reference_decoder.image().expect("image was none");
+        assert_eq!(image.exif, reference_image.exif);
+        assert_same_pixels(reference_image, image);
+    }
+}
+
 fn expected_min_decoded_row_count(
     height: u32,
     cell_height: u32,
@@ -620,6 +1500,44 @@ fn color_and_alpha_dimensions_do_not_match() {
     assert!(res.is_err());
 }
 
+#[test]
+fn thumbnail_source() {
+    // Same as invalid_color10x10_alpha5x5.avif with the auxl reference replaced by a thmb
+    // reference: item 2 is a 4x4 thumbnail of the 10x10 primary item.
+    let mut decoder = get_decoder("color10x10_thumbnail4x4.avif");
+    let res = decoder.parse();
+    assert!(res.is_ok());
+    let image = decoder.image().expect("image was none");
+    assert_eq!(image.width, 10);
+    assert_eq!(image.height, 10);
+    assert!(!image.alpha_present);
+
+    let mut decoder = get_decoder("color10x10_thumbnail4x4.avif");
+    decoder.settings.source = decoder::Source::Thumbnail;
+    let res = decoder.parse();
+    assert!(res.is_ok());
+    assert_eq!(decoder.image_count(), 1);
+    let image = decoder.image().expect("image was none");
+    assert_eq!(image.width, 4);
+    assert_eq!(image.height, 4);
+    assert!(!image.alpha_present);
+    if !HAS_DECODER {
+        return;
+    }
+    let res = decoder.next_image();
+    assert!(res.is_ok());
+    let image = decoder.image().expect("image was none");
+    assert_eq!(image.width, 4);
+    assert_eq!(image.height, 4);
+}
+
+#[test]
+fn thumbnail_source_without_thumbnail() {
+    let mut decoder = get_decoder("white_1x1.avif");
+    decoder.settings.source = decoder::Source::Thumbnail;
+    assert_eq!(decoder.parse(), Err(AvifError::NoContent));
+}
+
 #[test]
 fn rgb_conversion_alpha_premultiply() -> AvifResult<()> {
     let mut decoder = get_decoder("alpha.avif");
@@ -713,3 +1631,148 @@ fn white_1x1_ftyp_size0() -> AvifResult<()> {
     ));
     Ok(())
 }
+
+#[test_case::test_case("colors-animated-8bpc.avif")]
+#[test_case::test_case("colors-animated-8bpc-alpha-exif-xmp.avif")]
+#[test_case::test_case("alpha.avif")]
+#[test_case::test_case("sofa_grid1x5_420.avif")]
+#[test_case::test_case("paris_icc_exif_xmp.avif")]
+fn metadata_only(filename: &str) {
+    let mut decoder = get_decoder(filename);
+    assert!(decoder.parse().is_ok());
+
+    let mut metadata_decoder = get_decoder(filename);
+    metadata_decoder.settings.metadata_only = true;
+    assert!(metadata_decoder.parse().is_ok());
+    assert_eq!(metadata_decoder.image_count(), decoder.image_count());
+    assert_eq!(metadata_decoder.timescale(), decoder.timescale());
+    assert_eq!(metadata_decoder.duration(), decoder.duration());
+    assert_eq!(
+        metadata_decoder.repetition_count(),
+        decoder.repetition_count()
+    );
+    let image = decoder.image().expect("image was none");
+    let metadata_image = metadata_decoder.image().expect("image was none");
+    assert_eq!(metadata_image.width, image.width);
+    assert_eq!(metadata_image.height, image.height);
+    assert_eq!(metadata_image.depth, image.depth);
+    assert_eq!(metadata_image.yuv_format, image.yuv_format);
+    assert_eq!(metadata_image.alpha_present, image.alpha_present);
+    assert_eq!(metadata_image.icc, image.icc);
+    assert!(metadata_image.exif.is_empty());
+    assert!(metadata_image.xmp.is_empty());
+    // No sample was read.
+    assert_eq!(metadata_decoder.io_stats().color_obu_size, 0);
+    // Decoding is not possible.
+    assert_eq!(metadata_decoder.next_image(), Err(AvifError::NoContent));
+    assert_eq!(metadata_decoder.nth_image(0), Err(AvifError::NoContent));
+}
+
+fn check_byte_ranges(ranges: &[decoder::Extent], max_extent: &decoder::Extent) {
+    for (index, range) in ranges.iter().enumerate() {
+        assert!(range.size > 0);
+        assert!(range.offset >= max_extent.offset);
+        assert!(range.offset + range.size as u64 <= max_extent.offset + max_extent.size as u64);
+        if index > 0 {
+            // Sorted, and not overlapping nor adjacent.
+            let previous = &ranges[index - 1];
+            assert!(previous.offset + (previous.size as u64) < range.offset);
+        }
+    }
+}
+
+#[test]
+fn byte_ranges_of_track() {
+    let mut decoder = get_decoder("colors-animated-8bpc-alpha-exif-xmp.avif");
+    assert!(decoder.parse().is_ok());
+    let categories = [decoder::Category::Color, decoder::Category::Alpha];
+    let ranges = decoder
+        .byte_ranges(0, 4, &categories, false)
+        .expect("byte_ranges failed");
+    check_byte_ranges(&ranges, &decoder.nth_image_max_extent(4).unwrap());
+    let io_stats = decoder.io_stats();
+    assert_eq!(
+        ranges.iter().map(|x| x.size).sum::<usize>(),
+        io_stats.color_obu_size + io_stats.alpha_obu_size
+    );
+    let color_ranges = decoder
+        .byte_ranges(0, 4, &categories[..1], false)
+        .expect("byte_ranges failed");
+    assert_eq!(
+        color_ranges.iter().map(|x| x.size).sum::<usize>(),
+        io_stats.color_obu_size
+    );
+
+    let ranges_with_metadata = decoder
+        .byte_ranges(0, 4, &categories, true)
+        .expect("byte_ranges failed");
+    let image = decoder.image().expect("image was none");
+    assert!(
+        ranges_with_metadata.iter().map(|x| x.size).sum::<usize>()
+            >= ranges.iter().map(|x| x.size).sum::<usize>() + image.exif.len() + image.xmp.len()
+    );
+
+    assert!(decoder.byte_ranges(1, 0, &categories, false).is_err());
+    assert!(decoder.byte_ranges(0, 5, &categories, false).is_err());
+}
+
+#[test]
+fn byte_ranges_of_item() {
+    let mut decoder = get_decoder("sacre_coeur_2extents.avif");
+    assert!(decoder.parse().is_ok());
+    let ranges = decoder
+        .byte_ranges(0, 0, &[decoder::Category::Color], false)
+        .expect("byte_ranges failed");
+    assert!(!ranges.is_empty());
+    check_byte_ranges(&ranges, &decoder.nth_image_max_extent(0).unwrap());
+    assert_eq!(
+        ranges.iter().map(|x| x.size).sum::<usize>(),
+        decoder.io_stats().color_obu_size
+    );
+
+    let mut decoder = get_decoder("paris_icc_exif_xmp.avif");
+    assert!(decoder.parse().is_ok());
+    let ranges = decoder
+        .byte_ranges(0, 0, &[decoder::Category::Color], false)
+        .expect("byte_ranges failed");
+    let ranges_with_metadata = decoder
+        .byte_ranges(0, 0, &[decoder::Category::Color], true)
+        .expect("byte_ranges failed");
+    let image = decoder.image().expect("image was none");
+    assert!(
+        ranges_with_metadata.iter().map(|x| x.size).sum::<usize>()
+            >= ranges.iter().map(|x| x.size).sum::<usize>() + image.exif.len() + image.xmp.len()
+    );
+}
+
+#[test_case::test_case("seine_sdr_gainmap_srgb.avif" ; "item")]
+#[test_case::test_case("color_grid_gainmap_different_grid.avif" ; "grid")]
+fn byte_ranges_of_gainmap(filename: &str) {
+    let to_tuples = |ranges: &[decoder::Extent]| -> Vec<(u64, usize)> {
+        ranges.iter().map(|x| (x.offset, x.size)).collect()
+    };
+    // With the default settings, the gain map is not decoded but its ranges are still known.
+    let mut decoder = get_decoder(filename);
+    assert!(decoder.parse().is_ok());
+    assert!(decoder.gainmap_present());
+    let ranges = decoder
+        .byte_ranges(0, 0, &[decoder::Category::Gainmap], false)
+        .expect("byte_ranges failed");
+    assert!(!ranges.is_empty());
+    let file_size = std::fs::metadata(get_test_file(filename)).unwrap().len();
+    check_byte_ranges(
+        &ranges,
+        &decoder::Extent {
+            offset: 0,
+            size: file_size as usize,
+        },
+    );
+
+    let mut gainmap_decoder = get_decoder(filename);
+    gainmap_decoder.settings.enable_decoding_gainmap = true;
+    assert!(gainmap_decoder.parse().is_ok());
+    let gainmap_ranges = gainmap_decoder
+        .byte_ranges(0, 0, &[decoder::Category::Gainmap], false)
+        .expect("byte_ranges failed");
+    assert_eq!(to_tuples(&ranges), to_tuples(&gainmap_ranges));
+}